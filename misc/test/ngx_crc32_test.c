@@ -0,0 +1,303 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * ngx_crc32_long() and ngx_crc32_update() pass 64 bytes or more to the
+ * slicing-by-8 loop, or to the PCLMULQDQ folding if the CPU has it.  The
+ * test checks them against zlib crc32() for random lengths, alignments and
+ * split updates, then measures the bytewise loop, ngx_crc32_long() with
+ * and without PCLMULQDQ, and zlib crc32() for several lengths.
+ *
+ * The gzip filter deflates a response that is already buffered as a whole
+ * into one buffer sized by deflateBound(), and other responses into the
+ * gzip_buffers.  The second part measures both ways for a JSON-like body
+ * at gzip_comp_level 1 with the default 32 buffers of a page.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include <zlib.h>
+
+
+#define NGX_TEST_BUF        (1024 * 1024 + 64)
+#define NGX_TEST_BYTES      (256 * 1024 * 1024)
+
+
+static double ngx_test_bench_crc32(ngx_uint_t how, u_char *p, size_t len);
+static double ngx_test_bench_deflate(z_stream *zs, ngx_uint_t whole,
+    u_char *p, size_t len, u_char *out, size_t size, ngx_uint_t n);
+static uint32_t ngx_test_crc32_bytewise(u_char *p, size_t len);
+
+
+static size_t  ngx_test_lengths[] = {
+    16, 63, 64, 256, 4096, 65536, 1048576
+};
+
+
+static size_t  ngx_test_bodies[] = {
+    8192, 123904
+};
+
+
+static volatile uint32_t  ngx_test_sink;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    int                      rc;
+    u_char                  *buf, *out, *p;
+    size_t                   len, part, size;
+    double                   one, many;
+    uint32_t                 crc;
+    ngx_uint_t               i, k, n, iterations, features, failed;
+    z_stream                 zs;
+    static ngx_log_t         log;
+    static ngx_cycle_t       cycle;
+    static ngx_open_file_t   file;
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 200000;
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    file.fd = ngx_stderr;
+    log.file = &file;
+    log.log_level = NGX_LOG_WARN;
+
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    ngx_cpuinfo();
+
+    if (ngx_crc32_table_init() != NGX_OK) {
+        return 2;
+    }
+
+    features = ngx_cpu_features;
+
+    printf("cpu features:%s\n",
+           (features & NGX_CPU_PCLMUL) ? " pclmul" : "");
+
+    buf = ngx_alloc(NGX_TEST_BUF, &log);
+    if (buf == NULL) {
+        return 2;
+    }
+
+    srandom(1);
+
+    for (i = 0; i < NGX_TEST_BUF; i++) {
+        buf[i] = (u_char) random();
+    }
+
+    failed = 0;
+
+    for (n = 0; n < iterations; n++) {
+        p = buf + random() % 8;
+        len = (n & 1) ? random() % 300 : random() % 65536;
+
+        ngx_cpu_features = (n & 2) ? features : features & ~NGX_CPU_PCLMUL;
+
+        crc = ngx_crc32_long(p, len);
+
+        if (crc != (uint32_t) crc32(0, p, len)) {
+            printf("ngx_crc32_long() mismatch, length %lu, alignment %lu\n",
+                   (unsigned long) len, (unsigned long) (p - buf));
+            failed++;
+        }
+
+        ngx_crc32_init(crc);
+
+        for (k = 0; k < len; k += part) {
+            part = random() % 200;
+            part = ngx_min(len - k, part);
+            ngx_crc32_update(&crc, p + k, part);
+        }
+
+        ngx_crc32_final(crc);
+
+        if (crc != (uint32_t) crc32(0, p, len)) {
+            printf("ngx_crc32_update() mismatch, length %lu, alignment %lu\n",
+                   (unsigned long) len, (unsigned long) (p - buf));
+            failed++;
+        }
+    }
+
+    printf("%lu lengths, %lu mismatches\n",
+           (unsigned long) iterations, (unsigned long) failed);
+
+    printf("GB/s      bytewise  slice-by-8  pclmul  zlib\n");
+
+    for (i = 0; i < sizeof(ngx_test_lengths) / sizeof(size_t); i++) {
+        len = ngx_test_lengths[i];
+
+        printf("%-8lu  %8.2f  %10.2f  ", (unsigned long) len,
+               ngx_test_bench_crc32(0, buf, len),
+               ngx_test_bench_crc32(1, buf, len));
+
+        if (features & NGX_CPU_PCLMUL) {
+            printf("%6.2f", ngx_test_bench_crc32(2, buf, len));
+
+        } else {
+            printf("%6s", "-");
+        }
+
+        printf("  %4.2f\n", ngx_test_bench_crc32(3, buf, len));
+    }
+
+    ngx_cpu_features = features;
+
+    /* a JSON-like body compresses about as well as the real responses do */
+
+    p = buf;
+
+    for (i = 0; p < buf + NGX_TEST_BUF - 128; i++) {
+        p = ngx_sprintf(p, "{\"id\":%ui,\"name\":\"item-%ui\","
+                        "\"price\":%ui.%02ui,\"tags\":[\"t%ui\",\"t%ui\"],"
+                        "\"stock\":%s},\n",
+                        i, (ngx_uint_t) random() % 100000,
+                        (ngx_uint_t) random() % 1000,
+                        (ngx_uint_t) random() % 100,
+                        (ngx_uint_t) random() % 50,
+                        (ngx_uint_t) random() % 50,
+                        (random() & 1) ? "true" : "false");
+    }
+
+    size = deflateBound(NULL, NGX_TEST_BUF);
+
+    out = ngx_alloc(size, &log);
+    if (out == NULL) {
+        return 2;
+    }
+
+    ngx_memzero(&zs, sizeof(z_stream));
+
+    rc = deflateInit2(&zs, 1, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL - 1,
+                      Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+        return 2;
+    }
+
+    printf("us/body   whole  gzip_buffers\n");
+
+    for (i = 0; i < sizeof(ngx_test_bodies) / sizeof(size_t); i++) {
+        len = ngx_test_bodies[i];
+        n = 2000 * 8192 / len;
+
+        one = ngx_test_bench_deflate(&zs, 1, buf, len, out, size, n);
+        many = ngx_test_bench_deflate(&zs, 0, buf, len, out, size, n);
+
+        printf("%-8lu  %5.1f  %12.1f\n", (unsigned long) len, one, many);
+    }
+
+    deflateEnd(&zs);
+
+    return failed ? 1 : 0;
+}
+
+
+static double
+ngx_test_bench_crc32(ngx_uint_t how, u_char *p, size_t len)
+{
+    ngx_uint_t      i, n;
+    struct timeval  start, end;
+
+    ngx_cpu_features &= ~NGX_CPU_PCLMUL;
+
+    if (how == 2) {
+        ngx_cpu_features |= NGX_CPU_PCLMUL;
+    }
+
+    n = NGX_TEST_BYTES / len;
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < n; i++) {
+        switch (how) {
+        case 0:
+            ngx_test_sink = ngx_test_crc32_bytewise(p, len);
+            break;
+        case 3:
+            ngx_test_sink = (uint32_t) crc32(0, p, len);
+            break;
+        default:
+            ngx_test_sink = ngx_crc32_long(p, len);
+            break;
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    return (double) n * len
+           / ((end.tv_sec - start.tv_sec) * 1e9
+              + (end.tv_usec - start.tv_usec) * 1e3);
+}
+
+
+static double
+ngx_test_bench_deflate(z_stream *zs, ngx_uint_t whole, u_char *p, size_t len,
+    u_char *out, size_t size, ngx_uint_t n)
+{
+    int             rc;
+    ngx_uint_t      i;
+    struct timeval  start, end;
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < n; i++) {
+        deflateReset(zs);
+
+        zs->next_in = p;
+        zs->avail_in = len;
+
+        if (whole) {
+            zs->next_out = out;
+            zs->avail_out = size;
+
+            rc = deflate(zs, Z_FINISH);
+
+        } else {
+
+            /* the buffers are reused, as they are sent at once */
+
+            do {
+                zs->next_out = out;
+                zs->avail_out = ngx_pagesize;
+
+                rc = deflate(zs, Z_FINISH);
+
+            } while (rc == Z_OK);
+        }
+
+        if (rc != Z_STREAM_END) {
+            printf("deflate() failed: %d\n", rc);
+            return 0;
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e6
+            + (end.tv_usec - start.tv_usec)) / n;
+}
+
+
+static uint32_t
+ngx_test_crc32_bytewise(u_char *p, size_t len)
+{
+    uint32_t  crc;
+
+    crc = 0xffffffff;
+
+    while (len--) {
+        crc = ngx_crc32_table256[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
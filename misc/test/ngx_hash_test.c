@@ -0,0 +1,248 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * The known request headers are looked up in a dispatch table indexed by
+ * the name length and the first character instead of the headers_in hash.
+ * The test builds both tables from ngx_http_headers_in[] the same way as
+ * ngx_http_init_headers_in_hash() does, checks that they agree for the
+ * known names, for the names that differ from a known one in one byte and
+ * for random names, then measures the lookups of a typical header set.
+ * The hash key is computed in advance as the parser does it.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_TEST_NAME_LEN  32
+
+
+static double ngx_test_bench_hash(ngx_hash_t *hash, ngx_str_t *names,
+    ngx_uint_t *keys, ngx_uint_t nnames, ngx_uint_t n);
+static double ngx_test_bench_dispatch(ngx_hash_dispatch_t *hd,
+    ngx_str_t *names, ngx_uint_t nnames, ngx_uint_t n);
+static ngx_uint_t ngx_test_compare(ngx_hash_t *hash, ngx_hash_dispatch_t *hd,
+    u_char *name, size_t len);
+
+
+static ngx_str_t  ngx_test_bench_names[] = {
+    ngx_string("host"),
+    ngx_string("user-agent"),
+    ngx_string("accept"),
+    ngx_string("accept-language"),
+    ngx_string("accept-encoding"),
+    ngx_string("cookie"),
+    ngx_string("referer"),
+    ngx_string("connection"),
+    ngx_string("if-modified-since"),
+    ngx_string("cache-control"),
+    ngx_string("x-requested-with"),
+    ngx_string("dnt")
+};
+
+
+static void  *volatile  ngx_test_sink;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                   len;
+    double                   hashed, dispatched;
+    u_char                   name[NGX_TEST_NAME_LEN];
+    ngx_uint_t               i, k, n, iterations, failed, nnames,
+                             keys[sizeof(ngx_test_bench_names)
+                                  / sizeof(ngx_str_t)];
+    ngx_pool_t              *pool;
+    ngx_hash_t               hash;
+    ngx_array_t              headers_in;
+    ngx_hash_key_t          *hk;
+    ngx_hash_init_t          hinit;
+    ngx_http_header_t       *header;
+    ngx_hash_dispatch_t      hd;
+    static ngx_log_t         log;
+    static ngx_cycle_t       cycle;
+    static ngx_open_file_t   file;
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 1000000;
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    file.fd = ngx_stderr;
+    log.file = &file;
+    log.log_level = NGX_LOG_WARN;
+
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    pool = ngx_create_pool(16384, &log);
+    if (pool == NULL) {
+        return 2;
+    }
+
+    if (ngx_array_init(&headers_in, pool, 32, sizeof(ngx_hash_key_t))
+        != NGX_OK)
+    {
+        return 2;
+    }
+
+    for (header = ngx_http_headers_in; header->name.len; header++) {
+        hk = ngx_array_push(&headers_in);
+        if (hk == NULL) {
+            return 2;
+        }
+
+        hk->key = header->name;
+        hk->key_hash = ngx_hash_key_lc(header->name.data, header->name.len);
+        hk->value = header;
+    }
+
+    hinit.hash = &hash;
+    hinit.key = ngx_hash_key_lc;
+    hinit.max_size = 512;
+    hinit.bucket_size = ngx_align(64, ngx_cacheline_size);
+    hinit.name = "headers_in_hash";
+    hinit.pool = pool;
+    hinit.temp_pool = NULL;
+
+    if (ngx_hash_init(&hinit, headers_in.elts, headers_in.nelts) != NGX_OK) {
+        return 2;
+    }
+
+    if (ngx_hash_dispatch_init(&hd, pool, headers_in.elts, headers_in.nelts)
+        != NGX_OK)
+    {
+        return 2;
+    }
+
+    srandom(time(NULL));
+
+    failed = 0;
+    n = 0;
+
+    hk = headers_in.elts;
+
+    for (i = 0; i < headers_in.nelts; i++) {
+        len = hk[i].key.len;
+
+        ngx_strlow(name, hk[i].key.data, len);
+
+        failed += ngx_test_compare(&hash, &hd, name, len);
+        n++;
+
+        for (k = 0; k < len; k++) {
+            ngx_strlow(name, hk[i].key.data, len);
+            name[k] ^= 1 << (random() % 7);
+
+            failed += ngx_test_compare(&hash, &hd, name, len);
+            n++;
+        }
+    }
+
+    for (i = 0; i < 100000; i++) {
+        len = 1 + random() % (NGX_TEST_NAME_LEN - 1);
+
+        for (k = 0; k < len; k++) {
+            name[k] = "abcdefghijklmnopqrstuvwxyz-_"[random() % 28];
+        }
+
+        failed += ngx_test_compare(&hash, &hd, name, len);
+        n++;
+    }
+
+    printf("%lu known headers, %lu names, %lu mismatches\n",
+           (unsigned long) headers_in.nelts, (unsigned long) n,
+           (unsigned long) failed);
+
+    nnames = sizeof(ngx_test_bench_names) / sizeof(ngx_str_t);
+
+    for (i = 0; i < nnames; i++) {
+        keys[i] = ngx_hash_key(ngx_test_bench_names[i].data,
+                               ngx_test_bench_names[i].len);
+    }
+
+    hashed = ngx_test_bench_hash(&hash, ngx_test_bench_names, keys, nnames,
+                                 iterations);
+    dispatched = ngx_test_bench_dispatch(&hd, ngx_test_bench_names, nnames,
+                                         iterations);
+
+    printf("%lu headers: ngx_hash_find %.1f ns, "
+           "ngx_hash_dispatch_find %.1f ns\n",
+           (unsigned long) nnames, hashed, dispatched);
+
+    return failed ? 1 : 0;
+}
+
+
+static ngx_uint_t
+ngx_test_compare(ngx_hash_t *hash, ngx_hash_dispatch_t *hd, u_char *name,
+    size_t len)
+{
+    void  *one, *two;
+
+    one = ngx_hash_find(hash, ngx_hash_key(name, len), name, len);
+    two = ngx_hash_dispatch_find(hd, name, len);
+
+    if (one == two) {
+        return 0;
+    }
+
+    printf("mismatch for \"%.*s\": %p instead of %p\n",
+           (int) len, name, two, one);
+
+    return 1;
+}
+
+
+static double
+ngx_test_bench_hash(ngx_hash_t *hash, ngx_str_t *names, ngx_uint_t *keys,
+    ngx_uint_t nnames, ngx_uint_t n)
+{
+    ngx_uint_t      i, k;
+    struct timeval  start, end;
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < nnames; k++) {
+            ngx_test_sink = ngx_hash_find(hash, keys[k], names[k].data,
+                                          names[k].len);
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9
+            + (end.tv_usec - start.tv_usec) * 1e3) / n;
+}
+
+
+static double
+ngx_test_bench_dispatch(ngx_hash_dispatch_t *hd, ngx_str_t *names,
+    ngx_uint_t nnames, ngx_uint_t n)
+{
+    ngx_uint_t      i, k;
+    struct timeval  start, end;
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < nnames; k++) {
+            ngx_test_sink = ngx_hash_dispatch_find(hd, names[k].data,
+                                                   names[k].len);
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9
+            + (end.tv_usec - start.tv_usec) * 1e3) / n;
+}
@@ -0,0 +1,450 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * The request line and header parser scans the long runs with SSE2, AVX2
+ * and SSE4.2 when the CPU has them.  The test feeds random requests split
+ * in random fragments to the parser with each set of the CPU features and
+ * compares every result and every pointer the parser sets with the ones
+ * of the scalar state machine, then measures the time of a typical request.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_TEST_BUF      8192
+#define NGX_TEST_TRACE    4096
+#define NGX_TEST_CUTS     4
+
+
+typedef struct {
+    ngx_uint_t     n;
+    intptr_t       v[NGX_TEST_TRACE];
+} ngx_test_trace_t;
+
+
+static void ngx_test_generate(u_char *buf, size_t *len);
+static void ngx_test_parse(u_char *buf, size_t len, size_t *cuts,
+    ngx_uint_t ncuts, ngx_uint_t allow_underscores, ngx_test_trace_t *tr);
+static void ngx_test_trace_request(ngx_test_trace_t *tr,
+    ngx_http_request_t *r, u_char *buf);
+static double ngx_test_bench(u_char *buf, size_t len, ngx_uint_t n);
+
+
+static ngx_uint_t  ngx_test_features[] = {
+    NGX_CPU_SSE2,
+    NGX_CPU_SSE2|NGX_CPU_SSE42,
+    NGX_CPU_SSE2|NGX_CPU_AVX2,
+    NGX_CPU_SSE2|NGX_CPU_SSE42|NGX_CPU_AVX2
+};
+
+
+static char  *ngx_test_methods[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PROPFIND", "G3T"
+};
+
+
+static char  *ngx_test_names[] = {
+    "Host", "User-Agent", "Accept", "Accept-Encoding", "Cookie",
+    "X-Forwarded-For", "If-Modified-Since", "Content-Length", "Referer"
+};
+
+
+static char  *ngx_test_newlines[] = { CRLF, CRLF, "\n" };
+
+
+static u_char  ngx_test_bench_request[] =
+    "GET /static/js/application.min.js?v=20120315&locale=en_US"
+    "&session=4f2c8d1a9b7e6035 HTTP/1.1" CRLF
+    "Host: www.example.com" CRLF
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.2) "
+    "Gecko/20100101 Firefox/10.0.2" CRLF
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+    "*/*;q=0.8" CRLF
+    "Accept-Language: en-us,en;q=0.5" CRLF
+    "Accept-Encoding: gzip, deflate" CRLF
+    "Cookie: __utma=111872281.1045513234.1331811298.1331811298."
+    "1331811298.1; __utmz=111872281.1331811298.1.1.utmcsr=(direct)" CRLF
+    "Connection: keep-alive" CRLF
+    CRLF;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    size_t                   len, cut, cuts[NGX_TEST_CUTS];
+    double                   scalar, simd;
+    ngx_uint_t               i, k, n, ncuts, iterations, features, failed,
+                             us, seed;
+    ngx_test_trace_t         expected, trace;
+    static u_char            buf[NGX_TEST_BUF];
+    static ngx_log_t         log;
+    static ngx_cycle_t       cycle;
+    static ngx_open_file_t   file;
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 100000;
+    seed = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : (ngx_uint_t) time(NULL);
+
+    ngx_pagesize = getpagesize();
+    ngx_cacheline_size = NGX_CPU_CACHE_LINE;
+
+    file.fd = ngx_stderr;
+    log.file = &file;
+    log.log_level = NGX_LOG_WARN;
+
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    ngx_cpuinfo();
+
+    features = ngx_cpu_features;
+
+    printf("cpu features: %s%s%s\n",
+           (features & NGX_CPU_SSE2) ? " sse2" : "",
+           (features & NGX_CPU_SSE42) ? " sse4.2" : "",
+           (features & NGX_CPU_AVX2) ? " avx2" : "");
+
+    printf("seed: %lu\n", (unsigned long) seed);
+
+    srandom(seed);
+
+    failed = 0;
+
+    for (n = 0; n < iterations; n++) {
+
+        ngx_test_generate(buf, &len);
+
+        ncuts = random() % (NGX_TEST_CUTS + 1);
+
+        for (i = 0; i < ncuts; i++) {
+            cuts[i] = random() % (len + 1);
+        }
+
+        for (i = 1; i < ncuts; i++) {
+            for (k = i; k > 0 && cuts[k - 1] > cuts[k]; k--) {
+                cut = cuts[k];
+                cuts[k] = cuts[k - 1];
+                cuts[k - 1] = cut;
+            }
+        }
+
+        us = random() & 1;
+
+        ngx_cpu_features = 0;
+        ngx_test_parse(buf, len, cuts, ncuts, us, &expected);
+
+        for (i = 0; i < sizeof(ngx_test_features) / sizeof(ngx_uint_t); i++) {
+
+            if ((ngx_test_features[i] & features) != ngx_test_features[i]) {
+                continue;
+            }
+
+            ngx_cpu_features = ngx_test_features[i];
+            ngx_test_parse(buf, len, cuts, ncuts, us, &trace);
+
+            if (trace.n == expected.n
+                && ngx_memcmp(trace.v, expected.v,
+                              trace.n * sizeof(intptr_t)) == 0)
+            {
+                continue;
+            }
+
+            if (failed++ < 10) {
+                for (k = 0; k < trace.n && k < expected.n; k++) {
+                    if (trace.v[k] != expected.v[k]) {
+                        break;
+                    }
+                }
+
+                printf("mismatch with features 0x%lx, underscores %lu, "
+                       "trace entry %lu: %ld instead of %ld, cuts:",
+                       (unsigned long) ngx_test_features[i],
+                       (unsigned long) us, (unsigned long) k,
+                       (long) (k < trace.n ? trace.v[k] : -2),
+                       (long) (k < expected.n ? expected.v[k] : -2));
+
+                for (k = 0; k < ncuts; k++) {
+                    printf(" %lu", (unsigned long) cuts[k]);
+                }
+
+                printf("\n\"%.*s\"\n", (int) len, buf);
+            }
+        }
+    }
+
+    printf("%lu random requests, %lu mismatches\n",
+           (unsigned long) iterations, (unsigned long) failed);
+
+    len = sizeof(ngx_test_bench_request) - 1;
+
+    ngx_cpu_features = 0;
+    scalar = ngx_test_bench(ngx_test_bench_request, len, 1000000);
+
+    ngx_cpu_features = features;
+    simd = ngx_test_bench(ngx_test_bench_request, len, 1000000);
+
+    printf("%lu byte request: scalar %.1f ns, simd %.1f ns\n",
+           (unsigned long) len, scalar, simd);
+
+    return failed ? 1 : 0;
+}
+
+
+static u_char *
+ngx_test_random_string(u_char *p, char **strings, ngx_uint_t n)
+{
+    char  *s;
+
+    s = strings[random() % n];
+
+    return ngx_cpymem(p, s, ngx_strlen(s));
+}
+
+
+static u_char *
+ngx_test_random_run(u_char *p, size_t n, char *alphabet)
+{
+    size_t  len;
+
+    len = ngx_strlen(alphabet);
+
+    while (n--) {
+        *p++ = alphabet[random() % len];
+    }
+
+    return p;
+}
+
+
+static void
+ngx_test_generate(u_char *buf, size_t *len)
+{
+    u_char      *p;
+    ngx_uint_t   i, n;
+
+    p = buf;
+
+    p = ngx_test_random_string(p, ngx_test_methods,
+                               sizeof(ngx_test_methods) / sizeof(char *));
+    *p++ = ' ';
+
+    *p++ = '/';
+    p = ngx_test_random_run(p, random() % 40,
+                            "abcdefghijklmnopqrstuvwxyz0123456789/._-");
+
+    if (random() % 4) {
+        *p++ = '?';
+        p = ngx_test_random_run(p, random() % 400,
+                                "abcdefghijklmnopqrstuvwxyz0123456789"
+                                "ABCDEFGHIJ=&%+/._-");
+    }
+
+    if (random() % 8 == 0) {
+        p = ngx_test_random_run(p, 1 + random() % 4, "%#?./+ ");
+    }
+
+    if (random() % 8) {
+        p = ngx_cpymem(p, " HTTP/1.1", 9);
+    }
+
+    p = ngx_test_random_string(p, ngx_test_newlines, 3);
+
+    n = random() % 10;
+
+    for (i = 0; i < n; i++) {
+
+        if (random() % 2) {
+            p = ngx_test_random_string(p, ngx_test_names,
+                                       sizeof(ngx_test_names) / sizeof(char *));
+
+        } else {
+            p = ngx_test_random_run(p, 1 + random() % 60,
+                                    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJ"
+                                    "0123456789-_");
+        }
+
+        *p++ = ':';
+
+        p = ngx_test_random_run(p, random() % 3, " \t");
+
+        p = ngx_test_random_run(p, random() % 300,
+                                "abcdefghijklmnopqrstuvwxyz0123456789"
+                                " ,;=/()._-\t");
+
+        p = ngx_test_random_string(p, ngx_test_newlines, 3);
+    }
+
+    p = ngx_cpymem(p, CRLF, 2);
+
+    /* damage a few bytes */
+
+    n = (random() % 4 == 0) ? 1 + random() % 3 : 0;
+
+    for (i = 0; i < n; i++) {
+        buf[random() % (p - buf)] = (u_char) random();
+    }
+
+    *len = p - buf;
+}
+
+
+static void
+ngx_test_push(ngx_test_trace_t *tr, intptr_t v)
+{
+    if (tr->n < NGX_TEST_TRACE) {
+        tr->v[tr->n++] = v;
+    }
+}
+
+
+static void
+ngx_test_push_ptr(ngx_test_trace_t *tr, u_char *p, u_char *buf)
+{
+    ngx_test_push(tr, p ? p - buf : -1);
+}
+
+
+static void
+ngx_test_parse(u_char *buf, size_t len, size_t *cuts, ngx_uint_t ncuts,
+    ngx_uint_t allow_underscores, ngx_test_trace_t *tr)
+{
+    ngx_int_t           rc;
+    ngx_buf_t           b;
+    ngx_uint_t          i, header;
+    ngx_http_request_t  r;
+
+    tr->n = 0;
+
+    ngx_memzero(&r, sizeof(ngx_http_request_t));
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    b.start = buf;
+    b.pos = buf;
+    b.end = buf + len;
+
+    i = 0;
+    b.last = (i < ncuts) ? buf + cuts[i++] : buf + len;
+
+    header = 0;
+
+    for ( ;; ) {
+
+        if (header) {
+            rc = ngx_http_parse_header_line(&r, &b, allow_underscores);
+
+        } else {
+            rc = ngx_http_parse_request_line(&r, &b);
+        }
+
+        ngx_test_push(tr, rc);
+        ngx_test_push_ptr(tr, b.pos, buf);
+
+        if (rc == NGX_AGAIN) {
+
+            if (b.last == buf + len) {
+                ngx_test_push(tr, r.state);
+                return;
+            }
+
+            b.last = (i < ncuts) ? buf + cuts[i++] : buf + len;
+            continue;
+        }
+
+        ngx_test_trace_request(tr, &r, buf);
+
+        if (rc == NGX_OK) {
+            header = 1;
+            continue;
+        }
+
+        return;
+    }
+}
+
+
+static void
+ngx_test_trace_request(ngx_test_trace_t *tr, ngx_http_request_t *r,
+    u_char *buf)
+{
+    ngx_uint_t  i;
+
+    ngx_test_push(tr, r->state);
+    ngx_test_push(tr, r->method);
+    ngx_test_push(tr, r->http_major);
+    ngx_test_push(tr, r->http_minor);
+    ngx_test_push(tr, r->complex_uri);
+    ngx_test_push(tr, r->quoted_uri);
+    ngx_test_push(tr, r->plus_in_uri);
+    ngx_test_push(tr, r->space_in_uri);
+    ngx_test_push(tr, r->invalid_header);
+    ngx_test_push(tr, r->header_hash);
+    ngx_test_push(tr, r->lowcase_index);
+
+    ngx_test_push_ptr(tr, r->request_start, buf);
+    ngx_test_push_ptr(tr, r->request_end, buf);
+    ngx_test_push_ptr(tr, r->method_end, buf);
+    ngx_test_push_ptr(tr, r->schema_start, buf);
+    ngx_test_push_ptr(tr, r->schema_end, buf);
+    ngx_test_push_ptr(tr, r->host_start, buf);
+    ngx_test_push_ptr(tr, r->host_end, buf);
+    ngx_test_push_ptr(tr, r->port_start, buf);
+    ngx_test_push_ptr(tr, r->port_end, buf);
+    ngx_test_push_ptr(tr, r->uri_start, buf);
+    ngx_test_push_ptr(tr, r->uri_end, buf);
+    ngx_test_push_ptr(tr, r->uri_ext, buf);
+    ngx_test_push_ptr(tr, r->args_start, buf);
+    ngx_test_push_ptr(tr, r->header_name_start, buf);
+    ngx_test_push_ptr(tr, r->header_name_end, buf);
+    ngx_test_push_ptr(tr, r->header_start, buf);
+    ngx_test_push_ptr(tr, r->header_end, buf);
+
+    for (i = 0; i < r->lowcase_index && i < NGX_HTTP_LC_HEADER_LEN; i++) {
+        ngx_test_push(tr, r->lowcase_header[i]);
+    }
+}
+
+
+static double
+ngx_test_bench(u_char *buf, size_t len, ngx_uint_t n)
+{
+    ngx_int_t           rc;
+    ngx_buf_t           b;
+    ngx_uint_t          i;
+    struct timeval      start, end;
+    ngx_http_request_t  r;
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+    ngx_memzero(&r, sizeof(ngx_http_request_t));
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < n; i++) {
+        r.state = 0;
+
+        b.pos = buf;
+        b.last = buf + len;
+
+        rc = ngx_http_parse_request_line(&r, &b);
+
+        while (rc == NGX_OK) {
+            rc = ngx_http_parse_header_line(&r, &b, 0);
+        }
+
+        if (rc != NGX_HTTP_PARSE_HEADER_DONE) {
+            printf("benchmark request is invalid: %ld\n", (long) rc);
+            return 0;
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9
+            + (end.tv_usec - start.tv_usec) * 1e3) / n;
+}
@@ -0,0 +1,630 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * The range filter merges the overlapping ranges and cuts the parts from
+ * the body buffers as they pass, or keeps the buffers when the parts go
+ * out of the body order.  The test runs the header and body filters on
+ * random "Range" headers and random bodies split in memory and file
+ * buffers that are passed in several calls, and compares the status, the
+ * headers and the body with the ones built by a plain model of RFC 7233.
+ * The known edge cases go first.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_TEST_BODY     4096
+#define NGX_TEST_RANGES   8
+#define NGX_TEST_BUFS     6
+#define NGX_TEST_OUT      (4 * NGX_TEST_BODY + 65536)
+
+
+typedef struct {
+    off_t          start;
+    off_t          end;
+} ngx_test_range_t;
+
+
+typedef struct {
+    ngx_uint_t     header;
+    ngx_uint_t     last_buf;
+    size_t         len;
+    u_char         data[NGX_TEST_OUT];
+} ngx_test_out_t;
+
+
+extern ngx_module_t  ngx_http_range_header_filter_module;
+extern ngx_module_t  ngx_http_range_body_filter_module;
+
+
+static ngx_int_t ngx_test_run(u_char *body, off_t len, char *value);
+static ngx_int_t ngx_test_model(char *value, off_t len,
+    ngx_test_range_t *ranges, ngx_uint_t *n);
+static void ngx_test_generate(char *value, off_t len);
+static ngx_int_t ngx_test_header_filter(ngx_http_request_t *r);
+static ngx_int_t ngx_test_body_filter(ngx_http_request_t *r, ngx_chain_t *in);
+
+
+static char  *ngx_test_cases[] = {
+    "bytes=-1000",
+    "bytes=-1000,0-5",
+    "bytes=0-5,-1000",
+    "bytes=-100",
+    "bytes=-99",
+    "bytes=-0",
+    "bytes=0-",
+    "bytes=0-0",
+    "bytes=99-",
+    "bytes=100-",
+    "bytes=0-1000",
+    "bytes=5-2",
+    "bytes=0-5,6-9",
+    "bytes=0-5,3-9",
+    "bytes=50-60,0-5",
+    "bytes=50-60,0-5,55-70",
+    "bytes=-1,0-0",
+    "bytes= 1-2, 4-5",
+    "bytes=1-2,",
+    "bytes=x",
+    "bytes=1-2-3",
+    "bytes=,",
+    NULL
+};
+
+
+static ngx_fd_t         ngx_test_fd;
+static ngx_file_t       ngx_test_file;
+static ngx_test_out_t   ngx_test_out;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    off_t                    len;
+    u_char                  *body;
+    char                     value[256], name[] = "/tmp/ngx_range_XXXXXX";
+    ngx_uint_t               i, n, iterations, seed, failed;
+    ngx_http_module_t       *module;
+    static ngx_log_t         log;
+    static ngx_cycle_t       cycle;
+    static ngx_open_file_t   file;
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 100000;
+    seed = (argc > 2) ? (ngx_uint_t) atoi(argv[2]) : (ngx_uint_t) time(NULL);
+
+    ngx_pagesize = getpagesize();
+
+    file.fd = ngx_stderr;
+    log.file = &file;
+    log.log_level = NGX_LOG_WARN;
+
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    ngx_http_top_header_filter = ngx_test_header_filter;
+    ngx_http_top_body_filter = ngx_test_body_filter;
+
+    module = ngx_http_range_header_filter_module.ctx;
+    module->postconfiguration(NULL);
+
+    module = ngx_http_range_body_filter_module.ctx;
+    module->postconfiguration(NULL);
+
+    body = malloc(NGX_TEST_BODY);
+    if (body == NULL) {
+        return 2;
+    }
+
+    srandom(seed);
+
+    for (i = 0; i < NGX_TEST_BODY; i++) {
+        body[i] = (u_char) random();
+    }
+
+    ngx_test_fd = mkstemp(name);
+    if (ngx_test_fd == NGX_INVALID_FILE) {
+        return 2;
+    }
+
+    unlink(name);
+
+    if (write(ngx_test_fd, body, NGX_TEST_BODY) != NGX_TEST_BODY) {
+        return 2;
+    }
+
+    ngx_test_file.fd = ngx_test_fd;
+    ngx_test_file.log = &log;
+
+    printf("seed: %lu\n", (unsigned long) seed);
+
+    failed = 0;
+    n = 0;
+
+    for (i = 0; ngx_test_cases[i]; i++) {
+        failed += ngx_test_run(body, 100, ngx_test_cases[i]);
+        failed += ngx_test_run(body, 1, ngx_test_cases[i]);
+        n += 2;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        len = 1 + random() % ((random() % 4) ? 200 : NGX_TEST_BODY);
+
+        ngx_test_generate(value, len);
+
+        failed += ngx_test_run(body, len, value);
+        n++;
+
+        if (failed > 10) {
+            break;
+        }
+    }
+
+    printf("%lu range requests, %lu mismatches\n",
+           (unsigned long) n, (unsigned long) failed);
+
+    return failed ? 1 : 0;
+}
+
+
+static ngx_int_t
+ngx_test_run(u_char *body, off_t len, char *value)
+{
+    u_char                    *p, *last, expect[NGX_TEST_OUT];
+    off_t                      pos, size;
+    ngx_int_t                  rc, status;
+    ngx_str_t                  boundary;
+    ngx_buf_t                 *b;
+    ngx_uint_t                 i, n, nbufs, nranges;
+    ngx_pool_t                *pool;
+    ngx_chain_t               *in, *cl, **ll;
+    ngx_table_elt_t            range;
+    ngx_test_range_t           ranges[NGX_TEST_RANGES + 1];
+    ngx_connection_t           c;
+    ngx_http_request_t        *r;
+    ngx_http_core_loc_conf_t   clcf;
+    static void               *ctx[256], *loc_conf[256];
+
+    pool = ngx_create_pool(4096, ngx_cycle->log);
+    if (pool == NULL) {
+        return 1;
+    }
+
+    r = ngx_pcalloc(pool, sizeof(ngx_http_request_t));
+    if (r == NULL) {
+        return 1;
+    }
+
+    ngx_memzero(&c, sizeof(ngx_connection_t));
+    ngx_memzero(&clcf, sizeof(ngx_http_core_loc_conf_t));
+    ngx_memzero(ctx, sizeof(ctx));
+
+    c.log = ngx_cycle->log;
+    clcf.max_ranges = NGX_MAX_INT32_VALUE;
+    loc_conf[ngx_http_core_module.ctx_index] = &clcf;
+
+    r->pool = pool;
+    r->connection = &c;
+    r->main = r;
+    r->ctx = ctx;
+    r->loc_conf = loc_conf;
+    r->http_version = NGX_HTTP_VERSION_11;
+    r->allow_ranges = 1;
+
+    if (ngx_list_init(&r->headers_out.headers, pool, 4,
+                      sizeof(ngx_table_elt_t))
+        != NGX_OK)
+    {
+        return 1;
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = len;
+    r->headers_out.last_modified_time = -1;
+    ngx_str_set(&r->headers_out.content_type, "text/plain");
+
+    ngx_memzero(&range, sizeof(ngx_table_elt_t));
+    range.value.data = (u_char *) value;
+    range.value.len = ngx_strlen(value);
+    r->headers_in.range = &range;
+
+    ngx_test_out.header = 0;
+    ngx_test_out.last_buf = 0;
+    ngx_test_out.len = 0;
+
+    rc = ngx_http_top_header_filter(r);
+
+    /* the expected response */
+
+    status = ngx_test_model(value, len, ranges, &nranges);
+
+    p = expect;
+
+    if (status == NGX_HTTP_RANGE_NOT_SATISFIABLE) {
+
+        if (rc != NGX_HTTP_RANGE_NOT_SATISFIABLE
+            || r->headers_out.status != NGX_HTTP_RANGE_NOT_SATISFIABLE
+            || r->headers_out.content_range == NULL)
+        {
+            goto failed;
+        }
+
+        last = ngx_sprintf(expect, "bytes */%O", len);
+
+        if (r->headers_out.content_range->value.len
+                != (size_t) (last - expect)
+            || ngx_memcmp(r->headers_out.content_range->value.data, expect,
+                          last - expect)
+               != 0)
+        {
+            goto failed;
+        }
+
+        ngx_destroy_pool(pool);
+
+        return 0;
+    }
+
+    if (rc != NGX_OK
+        || !ngx_test_out.header
+        || r->headers_out.status != NGX_HTTP_PARTIAL_CONTENT)
+    {
+        goto failed;
+    }
+
+    if (nranges == 1) {
+        last = ngx_sprintf(expect, "bytes %O-%O/%O",
+                           ranges[0].start, ranges[0].end - 1, len);
+
+        if (r->headers_out.content_range == NULL
+            || r->headers_out.content_range->value.len
+               != (size_t) (last - expect)
+            || ngx_memcmp(r->headers_out.content_range->value.data, expect,
+                          last - expect)
+               != 0)
+        {
+            goto failed;
+        }
+
+        p = ngx_cpymem(expect, body + ranges[0].start,
+                       ranges[0].end - ranges[0].start);
+
+    } else {
+        n = sizeof("multipart/byteranges; boundary=") - 1;
+
+        if (r->headers_out.content_type.len <= n
+            || ngx_strncmp(r->headers_out.content_type.data,
+                           "multipart/byteranges; boundary=", n)
+               != 0)
+        {
+            goto failed;
+        }
+
+        boundary.data = r->headers_out.content_type.data + n;
+        boundary.len = r->headers_out.content_type.len - n;
+
+        for (i = 0; i < nranges; i++) {
+            p = ngx_sprintf(p, CRLF "--%V" CRLF
+                            "Content-Type: text/plain" CRLF
+                            "Content-Range: bytes %O-%O/%O" CRLF CRLF,
+                            &boundary, ranges[i].start, ranges[i].end - 1,
+                            len);
+            p = ngx_cpymem(p, body + ranges[i].start,
+                           ranges[i].end - ranges[i].start);
+        }
+
+        p = ngx_sprintf(p, CRLF "--%V--" CRLF, &boundary);
+    }
+
+    if (r->headers_out.content_length_n != p - expect) {
+        goto failed;
+    }
+
+    /* the body in random memory and file buffers passed in several calls */
+
+    nbufs = 1 + random() % NGX_TEST_BUFS;
+    pos = 0;
+    in = NULL;
+    ll = &in;
+
+    for (i = 0; i < nbufs; i++) {
+        size = (i == nbufs - 1) ? len - pos : random() % (len - pos + 1);
+
+        if (random() % 2) {
+            b = ngx_create_temp_buf(pool, (size_t) size);
+            if (b == NULL) {
+                return 1;
+            }
+
+            b->last = ngx_cpymem(b->pos, body + pos, (size_t) size);
+
+        } else {
+            b = ngx_calloc_buf(pool);
+            if (b == NULL) {
+                return 1;
+            }
+
+            b->in_file = 1;
+            b->file = &ngx_test_file;
+            b->file_pos = pos;
+            b->file_last = pos + size;
+        }
+
+        b->last_buf = (i == nbufs - 1);
+
+        cl = ngx_alloc_chain_link(pool);
+        if (cl == NULL) {
+            return 1;
+        }
+
+        cl->buf = b;
+        *ll = cl;
+        ll = &cl->next;
+
+        pos += size;
+
+        if (b->last_buf || random() % 2) {
+            *ll = NULL;
+
+            if (ngx_http_top_body_filter(r, in) == NGX_ERROR) {
+                goto failed;
+            }
+
+            in = NULL;
+            ll = &in;
+        }
+    }
+
+    if (ngx_test_out.last_buf != 1
+        || ngx_test_out.len != (size_t) (p - expect)
+        || ngx_memcmp(ngx_test_out.data, expect, p - expect) != 0)
+    {
+        goto failed;
+    }
+
+    ngx_destroy_pool(pool);
+
+    return 0;
+
+failed:
+
+    printf("mismatch for \"%s\" of %ld bytes: rc %ld, status %lu, "
+           "length %ld, sent %lu, expected status %ld, length %ld\n",
+           value, (long) len, (long) rc,
+           (unsigned long) r->headers_out.status,
+           (long) r->headers_out.content_length_n,
+           (unsigned long) ngx_test_out.len, (long) status,
+           (long) (p - expect));
+
+    ngx_destroy_pool(pool);
+
+    return 1;
+}
+
+
+/*
+ * RFC 7233: the syntax errors and the ranges that select nothing make
+ * the response 416, the suffix range that is longer than the body selects
+ * the whole body, the overlapping and adjacent ranges form one part,
+ * the parts go in the order their first range appeared
+ */
+
+static ngx_int_t
+ngx_test_model(char *value, off_t len, ngx_test_range_t *ranges,
+    ngx_uint_t *n)
+{
+    char              *p;
+    off_t              a, b;
+    ngx_uint_t         i, j, k, m, group[NGX_TEST_RANGES + 1];
+    ngx_test_range_t   r[NGX_TEST_RANGES + 1], t;
+
+    p = value + sizeof("bytes=") - 1;
+    m = 0;
+
+    for ( ;; ) {
+        while (*p == ' ') { p++; }
+
+        a = -1;
+        b = -1;
+
+        if (*p >= '0' && *p <= '9') {
+            for (a = 0; *p >= '0' && *p <= '9'; p++) {
+                a = a * 10 + *p - '0';
+            }
+
+            while (*p == ' ') { p++; }
+        }
+
+        if (*p++ != '-') {
+            return NGX_HTTP_RANGE_NOT_SATISFIABLE;
+        }
+
+        if (a != -1) {
+            while (*p == ' ') { p++; }
+        }
+
+        if (*p >= '0' && *p <= '9') {
+            for (b = 0; *p >= '0' && *p <= '9'; p++) {
+                b = b * 10 + *p - '0';
+            }
+
+            while (*p == ' ') { p++; }
+
+        } else if (a == -1 || (*p != ',' && *p != '\0')) {
+            return NGX_HTTP_RANGE_NOT_SATISFIABLE;
+        }
+
+        if (*p != ',' && *p != '\0') {
+            return NGX_HTTP_RANGE_NOT_SATISFIABLE;
+        }
+
+        if (a == -1) {
+            r[m].start = (b < len) ? len - b : 0;
+            r[m].end = len;
+
+        } else {
+            r[m].start = a;
+            r[m].end = (b == -1 || b >= len) ? len : b + 1;
+        }
+
+        if (r[m].start < r[m].end && m < NGX_TEST_RANGES) {
+            m++;
+        }
+
+        if (*p++ != ',') {
+            break;
+        }
+    }
+
+    if (m == 0) {
+        return NGX_HTTP_RANGE_NOT_SATISFIABLE;
+    }
+
+    /* the groups of the overlapping ranges, the lowest index names it */
+
+    for (i = 0; i < m; i++) {
+        group[i] = i;
+    }
+
+    for (k = 0; k < m; k++) {
+        for (i = 0; i < m; i++) {
+            for (j = 0; j < m; j++) {
+                if (r[i].start <= r[j].end && r[j].start <= r[i].end
+                    && group[j] < group[i])
+                {
+                    group[i] = group[j];
+                }
+            }
+        }
+    }
+
+    *n = 0;
+
+    for (i = 0; i < m; i++) {
+        if (group[i] != i) {
+            continue;
+        }
+
+        t = r[i];
+
+        for (j = i + 1; j < m; j++) {
+            if (group[j] == i) {
+                t.start = ngx_min(t.start, r[j].start);
+                t.end = ngx_max(t.end, r[j].end);
+            }
+        }
+
+        ranges[(*n)++] = t;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_test_generate(char *value, off_t len)
+{
+    char        *p;
+    off_t        a, b;
+    ngx_uint_t   i, n;
+
+    p = (char *) ngx_cpymem(value, "bytes=", sizeof("bytes=") - 1);
+
+    n = 1 + random() % NGX_TEST_RANGES;
+
+    for (i = 0; i < n; i++) {
+
+        if (i) {
+            *p++ = ',';
+        }
+
+        if (random() % 4 == 0) {
+            *p++ = ' ';
+        }
+
+        a = random() % (len + len / 4 + 2);
+        b = random() % 3 ? a + random() % (len / 2 + 2) : random() % (len + 2);
+
+        switch (random() % 5) {
+
+        case 0:
+
+            /* a suffix, possibly longer than the body */
+
+            p = (char *) ngx_sprintf((u_char *) p, "-%O",
+                                     random() % 3 ? b : b * 8);
+            break;
+
+        case 1:
+            p = (char *) ngx_sprintf((u_char *) p, "%O-", a);
+            break;
+
+        default:
+            p = (char *) ngx_sprintf((u_char *) p, "%O-%O", a, b);
+            break;
+        }
+    }
+
+    *p = '\0';
+}
+
+
+static ngx_int_t
+ngx_test_header_filter(ngx_http_request_t *r)
+{
+    ngx_test_out.header = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_test_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    size_t        size;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    for (cl = in; cl; cl = cl->next) {
+        b = cl->buf;
+
+        if (b->last_buf) {
+            ngx_test_out.last_buf++;
+        }
+
+        if (ngx_buf_in_memory(b)) {
+            size = b->last - b->pos;
+
+        } else if (b->in_file) {
+            size = (size_t) (b->file_last - b->file_pos);
+
+        } else {
+            continue;
+        }
+
+        if (ngx_test_out.len + size > NGX_TEST_OUT) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_buf_in_memory(b)) {
+            ngx_memcpy(ngx_test_out.data + ngx_test_out.len, b->pos, size);
+
+        } else if (pread(b->file->fd, ngx_test_out.data + ngx_test_out.len,
+                         size, b->file_pos)
+                   != (ssize_t) size)
+        {
+            return NGX_ERROR;
+        }
+
+        ngx_test_out.len += size;
+    }
+
+    return NGX_OK;
+}
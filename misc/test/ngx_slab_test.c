@@ -0,0 +1,165 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * The slab allocator joins the adjacent free page runs.  The test
+ * allocates and frees random sizes in a pool, checks that the allocations
+ * do not overlap, and that the pool is one free run again when everything
+ * is freed.  It also counts the multipage allocations that failed while
+ * the pool had twice as many free pages.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_TEST_POOL     (1024 * 1024)
+#define NGX_TEST_ALLOCS   512
+
+
+typedef struct {
+    u_char        *p;
+    size_t         size;
+    u_char         fill;
+} ngx_test_alloc_t;
+
+
+static ngx_uint_t ngx_test_free_pages(ngx_slab_pool_t *pool);
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char            *p;
+    size_t             size;
+    ngx_uint_t         i, n, k, iterations, failed, unfit, pages;
+    ngx_slab_pool_t   *pool;
+    ngx_test_alloc_t  *a;
+    static ngx_log_t         log;
+    static ngx_cycle_t       cycle;
+    static ngx_open_file_t   file;
+    static ngx_test_alloc_t  allocs[NGX_TEST_ALLOCS];
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 1000000;
+
+    ngx_pagesize = getpagesize();
+    for (n = ngx_pagesize; n >>= 1; ngx_pagesize_shift++) { /* void */ }
+
+    file.fd = ngx_stderr;
+    log.file = &file;
+    log.log_level = NGX_LOG_WARN;
+
+    cycle.log = &log;
+    ngx_cycle = &cycle;
+
+    pool = ngx_memalign(ngx_pagesize, NGX_TEST_POOL, &log);
+    if (pool == NULL) {
+        return 2;
+    }
+
+    pool->end = (u_char *) pool + NGX_TEST_POOL;
+    pool->min_shift = 3;
+    pool->addr = pool;
+
+    ngx_slab_init(pool);
+
+    pool->log_nomem = 0;
+
+    pages = ngx_test_free_pages(pool);
+
+    srandom(1);
+
+    failed = 0;
+    unfit = 0;
+
+    for (i = 0; i < iterations; i++) {
+        a = &allocs[random() % NGX_TEST_ALLOCS];
+
+        if (a->p) {
+            for (k = 0; k < a->size; k++) {
+                if (a->p[k] != a->fill) {
+                    failed++;
+                    break;
+                }
+            }
+
+            ngx_slab_free_locked(pool, a->p);
+            a->p = NULL;
+
+            continue;
+        }
+
+        switch (random() % 3) {
+        case 0:
+            size = 1 + random() % 128;
+            break;
+        case 1:
+            size = 1 + random() % ngx_pagesize;
+            break;
+        default:
+            size = 1 + random() % (16 * ngx_pagesize);
+            break;
+        }
+
+        p = ngx_slab_alloc_locked(pool, size);
+
+        if (p == NULL) {
+            n = (size + ngx_pagesize - 1) >> ngx_pagesize_shift;
+
+            if (size >= ngx_pagesize / 2
+                && ngx_test_free_pages(pool) >= 2 * n)
+            {
+                unfit++;
+            }
+
+            continue;
+        }
+
+        a->p = p;
+        a->size = size;
+        a->fill = (u_char) random();
+        ngx_memset(p, a->fill, size);
+    }
+
+    for (i = 0; i < NGX_TEST_ALLOCS; i++) {
+        if (allocs[i].p) {
+            ngx_slab_free_locked(pool, allocs[i].p);
+        }
+    }
+
+    if (pool->free.next->next != &pool->free
+        || pool->free.next->slab != pages)
+    {
+        printf("the pool is not one free run of %lu pages\n",
+               (unsigned long) pages);
+        failed++;
+    }
+
+    printf("%lu operations, %lu multipage allocations failed "
+           "with twice as many pages free, %lu errors\n",
+           (unsigned long) iterations, (unsigned long) unfit,
+           (unsigned long) failed);
+
+    return failed ? 1 : 0;
+}
+
+
+static ngx_uint_t
+ngx_test_free_pages(ngx_slab_pool_t *pool)
+{
+    ngx_uint_t        n;
+    ngx_slab_page_t  *page;
+
+    n = 0;
+
+    for (page = pool->free.next; page != &pool->free; page = page->next) {
+        n += page->slab;
+    }
+
+    return n;
+}
@@ -387,6 +387,7 @@ char *ngx_conf_set_bitmask_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 extern ngx_uint_t     ngx_max_module;
 extern ngx_module_t  *ngx_modules[];
+extern char          *ngx_module_names[];
 
 
 #endif /* _NGX_HTTP_CONF_FILE_H_INCLUDED_ */
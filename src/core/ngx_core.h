@@ -89,7 +89,14 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #define ngx_max(val1, val2)  ((val1 < val2) ? (val2) : (val1))
 #define ngx_min(val1, val2)  ((val1 > val2) ? (val2) : (val1))
 
+#define NGX_CPU_SSE2         0x01
+#define NGX_CPU_SSE42        0x02
+#define NGX_CPU_AVX2         0x04
+#define NGX_CPU_PCLMUL       0x08
+
 void ngx_cpuinfo(void);
 
+extern ngx_uint_t  ngx_cpu_features;
+
 
 #endif /* _NGX_CORE_H_INCLUDED_ */
@@ -9,10 +9,14 @@
 #include <ngx_core.h>
 
 
+ngx_uint_t  ngx_cpu_features;
+
+
 #if (( __i386__ || __amd64__ ) && ( __GNUC__ || __INTEL_COMPILER ))
 
 
 static ngx_inline void ngx_cpuid(uint32_t i, uint32_t *buf);
+static ngx_inline uint32_t ngx_xgetbv(void);
 
 
 #if ( __i386__ )
@@ -31,6 +35,7 @@ ngx_cpuid(uint32_t i, uint32_t *buf)
 
     "    mov    %%ebx, %%esi;  "
 
+    "    xor    %%ecx, %%ecx;  "
     "    cpuid;                "
     "    mov    %%eax, (%1);   "
     "    mov    %%ebx, 4(%1);  "
@@ -51,11 +56,13 @@ ngx_cpuid(uint32_t i, uint32_t *buf)
 {
     uint32_t  eax, ebx, ecx, edx;
 
+    /* the subleaf in %ecx is 0 */
+
     __asm__ (
 
         "cpuid"
 
-    : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (i) );
+    : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (i), "c" (0) );
 
     buf[0] = eax;
     buf[1] = ebx;
@@ -67,13 +74,30 @@ ngx_cpuid(uint32_t i, uint32_t *buf)
 #endif
 
 
+/* the XCR0 register, the xgetbv instruction is encoded for old assemblers */
+
+static ngx_inline uint32_t
+ngx_xgetbv(void)
+{
+    uint32_t  eax, edx;
+
+    __asm__ (
+
+        ".byte 0x0f, 0x01, 0xd0"
+
+    : "=a" (eax), "=d" (edx) : "c" (0) );
+
+    return eax;
+}
+
+
 /* auto detect the L2 cache line size of modern and widespread CPUs */
 
 void
 ngx_cpuinfo(void)
 {
     u_char    *vendor;
-    uint32_t   vbuf[5], cpu[4], model;
+    uint32_t   vbuf[5], cpu[4], ext[4], model;
 
     vbuf[0] = 0;
     vbuf[1] = 0;
@@ -91,6 +115,33 @@ ngx_cpuinfo(void)
 
     ngx_cpuid(1, cpu);
 
+    /* cpu[2] is %edx and cpu[3] is %ecx */
+
+    if (cpu[2] & (1 << 26)) {
+        ngx_cpu_features |= NGX_CPU_SSE2;
+    }
+
+    if (cpu[3] & (1 << 20)) {
+        ngx_cpu_features |= NGX_CPU_SSE42;
+    }
+
+    if (cpu[3] & (1 << 1)) {
+        ngx_cpu_features |= NGX_CPU_PCLMUL;
+    }
+
+    /* AVX2 requires the OS to save the YMM registers, OSXSAVE and AVX */
+
+    if ((cpu[3] & (3 << 27)) == (3 << 27)
+        && (ngx_xgetbv() & 6) == 6
+        && vbuf[0] >= 7)
+    {
+        ngx_cpuid(7, ext);
+
+        if (ext[1] & (1 << 5)) {
+            ngx_cpu_features |= NGX_CPU_AVX2;
+        }
+    }
+
     if (ngx_strcmp(vendor, "GenuineIntel") == 0) {
 
         switch ((cpu[0] & 0xf00) >> 8) {
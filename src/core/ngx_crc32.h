@@ -17,6 +17,16 @@ extern uint32_t  *ngx_crc32_table_short;
 extern uint32_t   ngx_crc32_table256[];
 
 
+#if (NGX_HAVE_LITTLE_ENDIAN && NGX_HAVE_NONALIGNED)
+
+#define NGX_CRC32_SLICE      1
+#define NGX_CRC32_SLICE_MIN  64
+
+uint32_t ngx_crc32_update_slice(uint32_t crc, u_char *p, size_t len);
+
+#endif
+
+
 static ngx_inline uint32_t
 ngx_crc32_short(u_char *p, size_t len)
 {
@@ -42,6 +52,12 @@ ngx_crc32_long(u_char *p, size_t len)
 
     crc = 0xffffffff;
 
+#if (NGX_CRC32_SLICE)
+    if (len >= NGX_CRC32_SLICE_MIN) {
+        return ngx_crc32_update_slice(crc, p, len) ^ 0xffffffff;
+    }
+#endif
+
     while (len--) {
         crc = ngx_crc32_table256[(crc ^ *p++) & 0xff] ^ (crc >> 8);
     }
@@ -59,6 +75,13 @@ ngx_crc32_update(uint32_t *crc, u_char *p, size_t len)
 {
     uint32_t  c;
 
+#if (NGX_CRC32_SLICE)
+    if (len >= NGX_CRC32_SLICE_MIN) {
+        *crc = ngx_crc32_update_slice(*crc, p, len);
+        return;
+    }
+#endif
+
     c = *crc;
 
     while (len--) {
@@ -16,6 +16,7 @@ static ngx_int_t ngx_init_zone_pool(ngx_cycle_t *cycle,
     ngx_shm_zone_t *shm_zone);
 static ngx_int_t ngx_test_lockfile(u_char *file, ngx_log_t *log);
 static void ngx_clean_old_cycles(ngx_event_t *ev);
+static void ngx_conf_profile_log(ngx_cycle_t *cycle);
 
 
 volatile ngx_cycle_t  *ngx_cycle;
@@ -44,7 +45,7 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 {
     void                *rv;
     char               **senv, **env;
-    ngx_uint_t           i, n;
+    ngx_uint_t           i, n, start, begin;
     ngx_log_t           *log;
     ngx_time_t          *tp;
     ngx_conf_t           conf;//nginx.confļصһļĽΧ
@@ -66,6 +67,7 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
     tp->sec = 0;
 
     ngx_time_update(); //ֽһtime
+    begin = ngx_conf_profile_start();
 
 
     log = old_cycle->log;
@@ -176,6 +178,14 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
         return NULL;
     }
 
+    if (ngx_array_init(&cycle->config_profile, pool, 64,
+                       sizeof(ngx_conf_profile_t))
+        != NGX_OK)
+    {
+        ngx_destroy_pool(pool);
+        return NULL;
+    }
+
     //ߣʼ 
     n = old_cycle->listening.nelts ? old_cycle->listening.nelts : 10;
 
@@ -242,6 +252,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 
         //create_confڣֱӴconfig  --- ֻngx_core_module ngx_core_module_create_conf ngx_core_conf_t
         if (module->create_conf) {
+            start = ngx_conf_profile_start();
+
             rv = module->create_conf(cycle); //ÿģģڲĹngx_xxx_module_create_confֻеһģcore ngx_core_module_create_confngx_core_conf_t
             if (rv == NULL) {
                 ngx_destroy_pool(pool);
@@ -249,6 +261,9 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
             }
             //config(ngx_core_conf_t, for ngx_core_module)￴conf_ctxǷŶӦģmain conf.
             cycle->conf_ctx[ngx_modules[i]->index] = rv;
+
+            ngx_conf_profile_add(cycle, ngx_module_names[i], "create_conf",
+                                 start);
         }
     }
 
@@ -288,6 +303,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
      *
      * һɡ{͡}
      */
+    start = ngx_conf_profile_start();
+
     if (ngx_conf_param(&conf) != NGX_CONF_OK) { //!< confҪĲûоǿգ浽conf
         environ = senv;
         ngx_destroy_cycle_pools(&conf);
@@ -303,6 +320,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
         return NULL;
     }
 
+    ngx_conf_profile_add(cycle, "core", "parse", start);
+
     if (ngx_test_config && !ngx_quiet_mode) {
         ngx_log_stderr(0, "the configuration file %s syntax is ok",
                        cycle->conf_file.data);
@@ -318,6 +337,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 
         //ngx_xxx_module_init_conf :   ngx_event_init_conf
         if (module->init_conf) {
+            start = ngx_conf_profile_start();
+
             if (module->init_conf(cycle, cycle->conf_ctx[ngx_modules[i]->index])
                 == NGX_CONF_ERROR)
             {
@@ -325,6 +346,9 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
                 ngx_destroy_cycle_pools(&conf);
                 return NULL;
             }
+
+            ngx_conf_profile_add(cycle, ngx_module_names[i], "init_conf",
+                                 start);
         }
     }
 
@@ -432,6 +456,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 
     /* create shared memory */
 
+    start = ngx_conf_profile_start();
+
     part = &cycle->shared_memory.part;
     shm_zone = part->elts;
 
@@ -516,9 +542,13 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
         continue;
     }
 
+    ngx_conf_profile_add(cycle, "core", "shared memory", start);
+
 
     /* handle the listening sockets */
 
+    start = ngx_conf_profile_start();
+
     if (old_cycle->listening.nelts) {
         ls = old_cycle->listening.elts;
         for (i = 0; i < old_cycle->listening.nelts; i++) {
@@ -613,6 +643,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
         ngx_configure_listening_sockets(cycle);
     }
 
+    ngx_conf_profile_add(cycle, "core", "listening", start);
+
 
     /* commit the new cycle configuration */
 
@@ -629,13 +661,24 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
     //init_moduleеģгʼģngx_XXX_module_initӣngx_event_module_init
     for (i = 0; ngx_modules[i]; i++) {
         if (ngx_modules[i]->init_module) {
+            start = ngx_conf_profile_start();
+
             if (ngx_modules[i]->init_module(cycle) != NGX_OK) {
                 /* fatal */
                 exit(1);
             }
+
+            ngx_conf_profile_add(cycle, ngx_module_names[i], "init_module",
+                                 start);
         }
     }
 
+    ngx_conf_profile_add(cycle, "core", "total", begin);
+
+    if (ccf->config_profile == 1) {
+        ngx_conf_profile_log(cycle);
+    }
+
 
     /* close and delete stuff that lefts from an old cycle */
     // رջɾold_cycleеԴ
@@ -1322,6 +1365,10 @@ ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
             continue;
         }
 
+        if (shm_zone[i].shm.size == 0) {
+            shm_zone[i].shm.size = size;
+        }
+
         if (size && size != shm_zone[i].shm.size) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                             "the size %uz of shared memory zone \"%V\" "
@@ -1414,3 +1461,55 @@ ngx_clean_old_cycles(ngx_event_t *ev)
         ngx_old_cycles.nelts = 0;
     }
 }
+
+
+ngx_uint_t
+ngx_conf_profile_start(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (ngx_uint_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+void
+ngx_conf_profile_add(ngx_cycle_t *cycle, char *module, char *stage,
+    ngx_uint_t start)
+{
+    ngx_conf_profile_t  *cp;
+
+    cp = ngx_array_push(&cycle->config_profile);
+    if (cp == NULL) {
+        return;
+    }
+
+    cp->module = module;
+    cp->stage = stage;
+    cp->usec = ngx_conf_profile_start() - start;
+}
+
+
+static void
+ngx_conf_profile_log(ngx_cycle_t *cycle)
+{
+    ngx_uint_t           i;
+    ngx_conf_profile_t  *cp;
+
+    cp = cycle->config_profile.elts;
+
+    for (i = 0; i < cycle->config_profile.nelts; i++) {
+
+        if (cp[i].usec < NGX_CONF_PROFILE_MIN
+            && ngx_strcmp(cp[i].stage, "total") != 0)
+        {
+            continue;
+        }
+
+        ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
+                      "config profile: %s %s %ui.%03uims",
+                      cp[i].module, cp[i].stage,
+                      cp[i].usec / 1000, cp[i].usec % 1000);
+    }
+}
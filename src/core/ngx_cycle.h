@@ -23,6 +23,9 @@
 #define NGX_DEBUG_POINTS_ABORT  2
 
 
+#define NGX_CONF_PROFILE_MIN    100     /* usec */
+
+
 typedef struct ngx_shm_zone_s  ngx_shm_zone_t;
 
 typedef ngx_int_t (*ngx_shm_zone_init_pt) (ngx_shm_zone_t *zone, void *data);
@@ -86,6 +89,9 @@ struct ngx_cycle_s {
     // 单链表容器，元素类型是ngx_shm_zone_t结构体，每个元素表示一块共享内存
     ngx_list_t                shared_memory;   
 
+    // 元素类型是ngx_conf_profile_t，记录配置各阶段及各模块的耗时
+    ngx_array_t               config_profile;
+
     // 当前进程中所有链接对象的总数，与connections成员配合使用
     ngx_uint_t                connection_n;    
     ngx_uint_t                files_n;     
@@ -143,6 +149,8 @@ typedef struct {
      ngx_str_t                working_directory;
      ngx_str_t                lock_file;
 
+     ngx_flag_t               config_profile;
+
      ngx_str_t                pid;
      ngx_str_t                oldpid;				
 
@@ -162,6 +170,13 @@ typedef struct {
 } ngx_core_tls_t;
 
 
+typedef struct {
+    char                     *module;
+    char                     *stage;
+    ngx_uint_t                usec;
+} ngx_conf_profile_t;
+
+
 #define ngx_is_init_cycle(cycle)  (cycle->conf_ctx == NULL)
 
 
@@ -175,6 +190,9 @@ ngx_pid_t ngx_exec_new_binary(ngx_cycle_t *cycle, char *const *argv);
 u_long ngx_get_cpu_affinity(ngx_uint_t n);
 ngx_shm_zone_t *ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name,
     size_t size, void *tag);
+ngx_uint_t ngx_conf_profile_start(void);
+void ngx_conf_profile_add(ngx_cycle_t *cycle, char *module, char *stage,
+    ngx_uint_t start);
 
 
 extern volatile ngx_cycle_t  *ngx_cycle;
@@ -9,6 +9,23 @@
 #include <ngx_core.h>
 
 
+/*
+ * the bucket count found by ngx_hash_init() depends only on the keys'
+ * hashes and lengths, so it is remembered across reconfigurations
+ * to skip the search when the same key set is hashed again
+ */
+
+#define NGX_HASH_SIZE_CACHE       1024
+
+typedef struct {
+    uint32_t          crc;
+    ngx_uint_t        nelts;
+    ngx_uint_t        size;
+} ngx_hash_size_cache_t;
+
+static ngx_hash_size_cache_t  ngx_hash_sizes[NGX_HASH_SIZE_CACHE];
+
+
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
 {
@@ -289,6 +306,122 @@ ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key, u_char *name,
     return NULL;
 }
 
+
+void *
+ngx_hash_dispatch_find(ngx_hash_dispatch_t *hd, u_char *name, size_t len)
+{
+    ngx_hash_dispatch_elt_t  *elt;
+
+    if (len == 0 || len > hd->max_len) {
+        return NULL;
+    }
+
+    elt = hd->buckets[ngx_hash_dispatch_index(name, len)];
+
+    if (elt == NULL) {
+        return NULL;
+    }
+
+    for ( /* void */ ; elt->name; elt++) {
+        if (ngx_memcmp(elt->name, name, len) == 0) {
+            return elt->value;
+        }
+    }
+
+    return NULL;
+}
+
+
+ngx_int_t
+ngx_hash_dispatch_init(ngx_hash_dispatch_t *hd, ngx_pool_t *pool,
+    ngx_hash_key_t *names, ngx_uint_t nelts)
+{
+    size_t                    len;
+    u_char                   *name;
+    ngx_uint_t                i, k, n, size, *counts;
+    ngx_hash_dispatch_elt_t  *elts, **buckets;
+
+    hd->max_len = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.len > hd->max_len) {
+            hd->max_len = names[i].key.len;
+        }
+    }
+
+    size = (hd->max_len + 1) << 5;
+
+    buckets = ngx_pcalloc(pool, size * sizeof(ngx_hash_dispatch_elt_t *));
+    if (buckets == NULL) {
+        return NGX_ERROR;
+    }
+
+    counts = ngx_alloc(size * sizeof(ngx_uint_t), pool->log);
+    if (counts == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(counts, size * sizeof(ngx_uint_t));
+
+    for (i = 0; i < nelts; i++) {
+        len = names[i].key.len;
+
+        if (len) {
+            counts[ngx_hash_dispatch_index(names[i].key.data, len)]++;
+        }
+    }
+
+    n = 0;
+
+    for (k = 0; k < size; k++) {
+        if (counts[k]) {
+            n += counts[k] + 1;
+        }
+    }
+
+    elts = ngx_pcalloc(pool, (n + 1) * sizeof(ngx_hash_dispatch_elt_t));
+    if (elts == NULL) {
+        ngx_free(counts);
+        return NGX_ERROR;
+    }
+
+    for (k = 0; k < size; k++) {
+        if (counts[k]) {
+            buckets[k] = elts;
+            elts += counts[k] + 1;
+            counts[k] = 0;
+        }
+    }
+
+    for (i = 0; i < nelts; i++) {
+        len = names[i].key.len;
+
+        if (len == 0) {
+            continue;
+        }
+
+        name = ngx_pnalloc(pool, len);
+        if (name == NULL) {
+            ngx_free(counts);
+            return NGX_ERROR;
+        }
+
+        ngx_strlow(name, names[i].key.data, len);
+
+        k = ngx_hash_dispatch_index(name, len);
+
+        buckets[k][counts[k]].name = name;
+        buckets[k][counts[k]].value = names[i].value;
+        counts[k]++;
+    }
+
+    ngx_free(counts);
+
+    hd->buckets = buckets;
+
+    return NGX_OK;
+}
+
 //!< ϣԪ ngx_hash_elt_tСnameΪngx_hash_elt_tṹָ
 #define NGX_HASH_ELT_SIZE(name/*name.key Ϊngx_hash_key_t->key.len, ַ ngx_hash_elt_tռڴС*/) \
     (sizeof(void *) + ngx_align((name)->key.len + 2/*sizeof(u_short)*/, sizeof(void *)))    /* Ӧ ngx_hash_elt_t */
@@ -307,11 +440,13 @@ ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key, u_char *name,
  */
 ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts)
 {
-    u_char          *elts;
-    size_t           len;
-    u_short         *test;
-    ngx_uint_t       i, n, key, size, start, bucket_size;
-    ngx_hash_elt_t  *elt, **buckets;
+    u_char                 *elts;
+    size_t                  len;
+    u_short                *test;
+    uint32_t                crc;
+    ngx_uint_t              i, n, key, size, start, bucket_size;
+    ngx_hash_elt_t         *elt, **buckets;
+    ngx_hash_size_cache_t  *sc;
 
     for (n = 0; n < nelts; n++) {   //!< 1. volume check, ϣͰװһelement
         if (hinit->bucket_size/*ÿbucketĿռС, λ:ֽ*/ < NGX_HASH_ELT_SIZE(&names[n]) + sizeof(void *)/*void * Ϊʶ*/)
@@ -343,6 +478,48 @@ ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_
         start = hinit->max_size - 1000;
     }
 
+    ngx_crc32_init(crc);
+    ngx_crc32_update(&crc, (u_char *) &bucket_size, sizeof(ngx_uint_t));
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        ngx_crc32_update(&crc, (u_char *) &names[n].key_hash,
+                         sizeof(ngx_uint_t));
+        ngx_crc32_update(&crc, (u_char *) &names[n].key.len, sizeof(size_t));
+    }
+
+    ngx_crc32_final(crc);
+
+    sc = &ngx_hash_sizes[crc % NGX_HASH_SIZE_CACHE];
+
+    if (sc->crc == crc && sc->nelts == nelts
+        && sc->size >= start && sc->size < hinit->max_size)
+    {
+        size = sc->size;
+
+        ngx_memzero(test, size * sizeof(u_short));
+
+        for (n = 0; n < nelts; n++) {
+            if (names[n].key.data == NULL) {
+                continue;
+            }
+
+            key = names[n].key_hash % size;
+            test[key] = (u_short) (test[key] + NGX_HASH_ELT_SIZE(&names[n]));
+
+            if (test[key] > (u_short) bucket_size) {
+                break;
+            }
+        }
+
+        if (n == nelts) {
+            goto found;
+        }
+    }
+
     /** ÿͰ, O(n)Ч
      * СͰĸʼֱе<key,value>ֵԶܴڶӦͰв(Ͱbucket_size)ǵǰͰҪͰ
      */
@@ -387,6 +564,11 @@ ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_
     return NGX_ERROR;
 
 found:
+
+    sc->crc = crc;
+    sc->nelts = nelts;
+    sc->size = size;
+
     /**
      * ȷ bucketͰ, ´hashռõĿռ䣬ڴ亯Щռ
      */
@@ -67,6 +67,27 @@ typedef struct {
 } ngx_hash_key_t;
 
 
+/*
+ * a static dispatch table for a small fixed key set such as the known
+ * request headers: a key is found by its length and first character
+ * without hashing the name or dividing by the table size
+ */
+
+typedef struct {
+    u_char           *name;
+    void             *value;
+} ngx_hash_dispatch_elt_t;
+
+
+typedef struct {
+    ngx_hash_dispatch_elt_t  **buckets;
+    size_t                     max_len;
+} ngx_hash_dispatch_t;
+
+
+#define ngx_hash_dispatch_index(name, len)  ((len) << 5 | ((name)[0] & 0x1f))
+
+
 typedef ngx_uint_t (*ngx_hash_key_pt) (u_char *data, size_t len);
 
 
@@ -161,6 +182,10 @@ ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
 ngx_int_t ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
 
+void *ngx_hash_dispatch_find(ngx_hash_dispatch_t *hd, u_char *name, size_t len);
+ngx_int_t ngx_hash_dispatch_init(ngx_hash_dispatch_t *hd, ngx_pool_t *pool,
+    ngx_hash_key_t *names, ngx_uint_t nelts);
+
 #define ngx_hash(key, c)   ((ngx_uint_t) key * 31 + c)
 ngx_uint_t ngx_hash_key(u_char *data, size_t len);
 //lc表示lower case，即字符串转换为小写后再计算hash值
@@ -14,6 +14,11 @@
 #define NGX_SLAB_EXACT       2
 #define NGX_SLAB_SMALL       3
 
+#define ngx_slab_page_type(page)   ((page)->prev & NGX_SLAB_PAGE_MASK)
+
+#define ngx_slab_page_prev(page)                                              \
+    (ngx_slab_page_t *) ((page)->prev & ~NGX_SLAB_PAGE_MASK)
+
 #if (NGX_PTR_SIZE == 4)
 
 #define NGX_SLAB_PAGE_FREE   0
@@ -133,8 +138,12 @@ ngx_slab_init(ngx_slab_pool_t *pool)
         pool->pages->slab = pages;
     }
 
+    pool->last = pool->pages + pages;
+
     pool->log_ctx = &pool->zero;
     pool->zero = '\0';
+
+    pool->log_nomem = 1;
 }
 
 
@@ -628,6 +637,8 @@ ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
         if (page->slab >= pages) {
 
             if (page->slab > pages) {
+                page[page->slab - 1].prev = (uintptr_t) &page[pages];
+
                 page[pages].slab = page->slab - pages;
                 page[pages].next = page->next;
                 page[pages].prev = page->prev;
@@ -661,7 +672,10 @@ ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
         }
     }
 
-    ngx_slab_error(pool, NGX_LOG_CRIT, "ngx_slab_alloc() failed: no memory");
+    if (pool->log_nomem) {
+        ngx_slab_error(pool, NGX_LOG_CRIT,
+                       "ngx_slab_alloc() failed: no memory");
+    }
 
     return NULL;
 }
@@ -671,7 +685,7 @@ static void
 ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
     ngx_uint_t pages)
 {
-    ngx_slab_page_t  *prev;
+    ngx_slab_page_t  *prev, *join;
 
     page->slab = pages--;
 
@@ -680,11 +694,65 @@ ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
     }
 
     if (page->next) {
-        prev = (ngx_slab_page_t *) (page->prev & ~NGX_SLAB_PAGE_MASK);
+        prev = ngx_slab_page_prev(page);
         prev->next = page->next;
         page->next->prev = page->prev;
     }
 
+    /*
+     * the adjacent free runs are joined, otherwise the pool breaks up
+     * into runs too short for the multipage allocations; the first page
+     * of a free run is in the free list, the last one points to the first
+     */
+
+    join = page + page->slab;
+
+    if (join < pool->last
+        && ngx_slab_page_type(join) == NGX_SLAB_PAGE
+        && join->next != NULL)
+    {
+        pages += join->slab;
+        page->slab += join->slab;
+
+        prev = ngx_slab_page_prev(join);
+        prev->next = join->next;
+        join->next->prev = join->prev;
+
+        join->slab = NGX_SLAB_PAGE_FREE;
+        join->next = NULL;
+        join->prev = NGX_SLAB_PAGE;
+    }
+
+    if (page > pool->pages) {
+        join = page - 1;
+
+        if (ngx_slab_page_type(join) == NGX_SLAB_PAGE) {
+
+            if (join->slab == NGX_SLAB_PAGE_FREE) {
+                join = ngx_slab_page_prev(join);
+            }
+
+            if (join->next != NULL) {
+                pages += join->slab;
+                join->slab += page->slab;
+
+                prev = ngx_slab_page_prev(join);
+                prev->next = join->next;
+                join->next->prev = join->prev;
+
+                page->slab = NGX_SLAB_PAGE_FREE;
+                page->next = NULL;
+                page->prev = NGX_SLAB_PAGE;
+
+                page = join;
+            }
+        }
+    }
+
+    if (pages) {
+        page[pages].prev = (uintptr_t) page;
+    }
+
     page->prev = (uintptr_t) &pool->free;
     page->next = pool->free.next;
 
@@ -702,6 +702,36 @@ ngx_strcasestrn(u_char *s1, char *s2, size_t n)
 }
 
 
+/*
+ * ngx_strlstrn() is intended to search for static substring
+ * with known length in string until the argument last. The argument n
+ * must be length of the second substring - 1.
+ */
+
+u_char *
+ngx_strlstrn(u_char *s1, u_char *last, u_char *s2, size_t n)
+{
+    u_char  c1, c2;
+
+    c2 = *s2++;
+    last -= n;
+
+    do {
+        do {
+            if (s1 >= last) {
+                return NULL;
+            }
+
+            c1 = *s1++;
+
+        } while (c1 != c2);
+
+    } while (ngx_strncmp(s1, s2, n) != 0);
+
+    return --s1;
+}
+
+
 /*
  * ngx_strlcasestrn() is intended to search for static substring
  * with known length in string until the argument last. The argument n
@@ -684,7 +684,7 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
                 ngx_locked_post_event(rev, queue);
 
             } else {
-                rev->handler(rev);  //!< 将读事件结构的处理函数设置为ngx_event_accept
+                ngx_event_call(rev);  //!< 将读事件结构的处理函数设置为ngx_event_accept
             }
         }
 
@@ -715,7 +715,7 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
                 ngx_locked_post_event(wev, &ngx_posted_events);
 
             } else {
-                wev->handler(wev);
+                ngx_event_call(wev);
             }
         }
     }
@@ -518,7 +518,7 @@ ngx_eventport_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
                     ngx_locked_post_event(rev, queue);
 
                 } else {
-                    rev->handler(rev);
+                    ngx_event_call(rev);
 
                     if (ev->closed) {
                         continue;
@@ -555,7 +555,7 @@ ngx_eventport_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
                     ngx_locked_post_event(wev, &ngx_posted_events);
 
                 } else {
-                    wev->handler(wev);
+                    ngx_event_call(wev);
                 }
             }
 
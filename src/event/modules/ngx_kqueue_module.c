@@ -681,7 +681,7 @@ ngx_kqueue_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
             continue;
         }
 
-        ev->handler(ev);
+        ngx_event_call(ev);
     }
 
     ngx_mutex_unlock(ngx_posted_events_mutex);
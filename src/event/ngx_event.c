@@ -23,6 +23,10 @@ extern ngx_module_t ngx_select_module;
 
 static ngx_int_t ngx_event_module_init(ngx_cycle_t *cycle);
 static ngx_int_t ngx_event_process_init(ngx_cycle_t *cycle);
+static void ngx_event_process_exit(ngx_cycle_t *cycle);
+static uint64_t ngx_event_stat_now(void);
+static void ngx_event_stat_update(uint64_t loop);
+static ngx_int_t ngx_event_balance_accept(ngx_cycle_t *cycle);
 static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
@@ -55,6 +59,8 @@ ngx_uint_t            ngx_accept_events;
 ngx_uint_t            ngx_accept_mutex_held;
 ngx_msec_t            ngx_accept_mutex_delay;
 ngx_int_t             ngx_accept_disabled;
+ngx_uint_t            ngx_accept_event_flags;
+ngx_uint_t            ngx_use_accept_balance;
 ngx_file_t            ngx_accept_mutex_lock_file;
 
 
@@ -72,10 +78,34 @@ ngx_atomic_t   ngx_stat_reading0;
 ngx_atomic_t  *ngx_stat_reading = &ngx_stat_reading0;
 ngx_atomic_t   ngx_stat_writing0;
 ngx_atomic_t  *ngx_stat_writing = &ngx_stat_writing0;
+ngx_atomic_t   ngx_stat_waiting_mem0;
+ngx_atomic_t  *ngx_stat_waiting_mem = &ngx_stat_waiting_mem0;
+ngx_atomic_t   ngx_stat_released0;
+ngx_atomic_t  *ngx_stat_released = &ngx_stat_released0;
+ngx_atomic_t   ngx_stat_cached_mem0;
+ngx_atomic_t  *ngx_stat_cached_mem = &ngx_stat_cached_mem0;
 
 #endif
 
 
+ngx_uint_t            ngx_event_timing;
+ngx_uint_t            ngx_event_stat_stage;
+ngx_event_stat_t     *ngx_event_stat;
+ngx_event_stat_t     *ngx_event_stats;
+
+static ngx_event_stat_t  ngx_event_stat0;
+static ngx_msec_t        ngx_event_slow_handler;
+static ngx_uint_t        ngx_event_stat_events[3];
+static uint64_t          ngx_event_stat_usec[3];
+
+static ngx_event_load_t *ngx_event_loads;
+static ngx_event_load_t *ngx_event_load;
+static ngx_uint_t        ngx_event_latency;
+static ngx_uint_t        ngx_accept_overloaded;
+static ngx_msec_t        ngx_accept_balance_time;
+static ngx_uint_t        ngx_bulk_event_budget;
+
+
 
 static ngx_command_t  ngx_events_commands[] = {
 
@@ -160,6 +190,41 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("loop_stats"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, loop_stats),
+      NULL },
+
+    { ngx_string("slow_handler"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      0,
+      offsetof(ngx_event_conf_t, slow_handler),
+      NULL },
+
+    { ngx_string("accept_batch"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_event_conf_t, accept_batch),
+      NULL },
+
+    { ngx_string("accept_balance"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, accept_balance),
+      NULL },
+
+    { ngx_string("bulk_event_budget"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_event_conf_t, bulk_event_budget),
+      NULL },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -190,7 +255,7 @@ ngx_module_t  ngx_event_core_module = {
     ngx_event_process_init,                /* init process */
     NULL,                                  /* init thread */
     NULL,                                  /* exit thread */
-    NULL,                                  /* exit process */
+    ngx_event_process_exit,                /* exit process */
     NULL,                                  /* exit master */
     NGX_MODULE_V1_PADDING
 };
@@ -199,9 +264,17 @@ ngx_module_t  ngx_event_core_module = {
 void
 ngx_process_events_and_timers(ngx_cycle_t *cycle)
 {
+    uint64_t    start, wait, io;
     ngx_uint_t  flags;
     ngx_msec_t  timer, delta;
 
+    if (ngx_event_timing) {
+        start = ngx_event_stat_now();
+
+    } else {
+        start = 0;
+    }
+
     /** ngx_timer_resolution
      * ָûٵgettimeofday()Ĵ
      * Ĭ£gettimeofdayÿI/O˿ڼepoll_waitغ󶼽ãͨtimer_resolutionѡֱָgettimeofday()ļʱ䡣
@@ -225,6 +298,21 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
 #endif
     }
 
+    if (ngx_posted_bulk_events) {
+        timer = 0;
+    }
+
+    /*
+     * the balance check runs before the accept mutex is tried,
+     * so an overloaded worker never holds the mutex
+     */
+
+    if (ngx_use_accept_balance) {
+        if (ngx_event_balance_accept(cycle) == NGX_ERROR) {
+            return;
+        }
+    }
+
     /** ؾ   ---- ngx_use_accept_mutexʾǷҪͨaccept    Ⱥ͸ؾ
      * nginx worker>1ʱļдaccept_mutexʱ־Ϊ1
      *
@@ -244,6 +332,16 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         if (ngx_accept_disabled > 0) {  //0˵ý̽յӹ࣬һaccept mutexĻ
             ngx_accept_disabled--;  //!< ÿһ,ͨ-- һμ
 
+        } else if (ngx_accept_overloaded) {
+
+            /* recheck the load in time to take the mutex again */
+
+            if (timer == NGX_TIMER_INFINITE
+                || timer > ngx_accept_mutex_delay)
+            {
+                timer = ngx_accept_mutex_delay;
+            }
+
         } else {                        //!< accpet mutex
             /** acceptworkerһԵõ
              * 1. ̷̣أȡɹĻngx_accept_mutex_heldΪ1
@@ -276,10 +374,29 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         }
     }
 
+    ngx_event_stat_stage = NGX_EVENT_STAT_IO;
+
+    if (ngx_event_timing) {
+        wait = ngx_event_stat_now();
+        io = ngx_event_stat_usec[NGX_EVENT_STAT_IO];
+
+    } else {
+        wait = 0;
+        io = 0;
+    }
+
     delta = ngx_current_msec;
     //epollʼwait¼
     (void) ngx_process_events(cycle, timer, flags); //!< ngx_epoll_process_events
 
+    if (ngx_event_timing) {
+
+        /* the time spent in the I/O handlers is not a wait */
+
+        wait = ngx_event_stat_now() - wait
+               - (ngx_event_stat_usec[NGX_EVENT_STAT_IO] - io);
+    }
+
     delta = ngx_current_msec - delta;   //!< ngx_epoll_process_eventsִ˶ʱ
 
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
@@ -288,6 +405,8 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
     /** accept¼ --- ngx_posted_accept_eventsݴepollӼ׽ֽӿwaitaccept¼
      * ngx_posted_accept_eventsݣͿʼaccept 
      */
+    ngx_event_stat_stage = NGX_EVENT_STAT_POSTED;
+
     if (ngx_posted_accept_events) {
         ngx_event_process_posted(cycle, &ngx_posted_accept_events); //!< handlerִ ngx_event_accept
     }
@@ -303,7 +422,9 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
      * deltaĶepoll wait¼ĺʱͳƣں뼶ĺʱͶ¼timerм飬
      */
     if (delta) {
+        ngx_event_stat_stage = NGX_EVENT_STAT_TIMERS;
         ngx_event_expire_timers();
+        ngx_event_stat_stage = NGX_EVENT_STAT_POSTED;
     }
 
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
@@ -321,6 +442,256 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
             ngx_event_process_posted(cycle, &ngx_posted_events);
         }
     }
+
+    if (ngx_posted_bulk_events) {
+        ngx_event_process_bulk_posted(cycle, ngx_bulk_event_budget);
+    }
+
+    if (ngx_event_timing) {
+        ngx_event_stat_update(ngx_event_stat_now() - start - wait);
+    }
+}
+
+
+void
+ngx_event_timed_call(ngx_event_t *ev)
+{
+    void              *handler;
+    uint64_t           usec;
+    ngx_uint_t         write, timedout;
+    ngx_atomic_uint_t  number;
+    ngx_connection_t  *c;
+
+    handler = (void *) ev->handler;
+    write = ev->write;
+    timedout = ev->timedout;
+
+    /*
+     * the event and its log may be freed by the handler, so the log
+     * of the connection is used only if the connection is still alive
+     */
+
+    c = NULL;
+    number = 0;
+
+    if ((ev >= ngx_cycle->read_events
+         && ev < ngx_cycle->read_events + ngx_cycle->connection_n)
+        || (ev >= ngx_cycle->write_events
+            && ev < ngx_cycle->write_events + ngx_cycle->connection_n))
+    {
+        c = ev->data;
+        number = c->number;
+    }
+
+    usec = ngx_event_stat_now();
+
+    ev->handler(ev);
+
+    usec = ngx_event_stat_now() - usec;
+
+    if ((int64_t) usec < 0) {
+        usec = 0;
+    }
+
+    ngx_event_stat_events[ngx_event_stat_stage]++;
+    ngx_event_stat_usec[ngx_event_stat_stage] += usec;
+
+    if (ngx_event_stat && usec > ngx_event_stat->max_handler) {
+        ngx_event_stat->max_handler = (ngx_atomic_uint_t) usec;
+    }
+
+    if (ngx_event_slow_handler == 0 || usec < ngx_event_slow_handler * 1000) {
+        return;
+    }
+
+    if (ngx_event_stat) {
+        ngx_event_stat->slow++;
+    }
+
+    if (c && c->fd != (ngx_socket_t) -1 && c->number == number) {
+        ngx_log_error(NGX_LOG_WARN, c->log, 0,
+                      "slow %s event handler %p%s took %uL.%03uLms",
+                      write ? "write" : "read", handler,
+                      timedout ? " (timed out)" : "",
+                      usec / 1000, usec % 1000);
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                  "slow %s event handler %p%s took %uL.%03uLms, "
+                  "connection *%uA",
+                  write ? "write" : "read", handler,
+                  timedout ? " (timed out)" : "",
+                  usec / 1000, usec % 1000, number);
+}
+
+
+static uint64_t
+ngx_event_stat_now(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ * the loop time is the wall time of the iteration without the wait
+ * for events, the handler time is used for the accept balancing
+ */
+
+static void
+ngx_event_stat_update(uint64_t loop)
+{
+    uint64_t           usec;
+    ngx_uint_t         i, n, events;
+    ngx_event_stat_t  *st;
+
+    st = ngx_event_stat;
+
+    usec = 0;
+    events = 0;
+
+    for (i = 0; i < 3; i++) {
+        if (st) {
+            st->events[i] += ngx_event_stat_events[i];
+            st->usec[i] += (ngx_atomic_uint_t) ngx_event_stat_usec[i];
+        }
+
+        events += ngx_event_stat_events[i];
+        usec += ngx_event_stat_usec[i];
+
+        ngx_event_stat_events[i] = 0;
+        ngx_event_stat_usec[i] = 0;
+    }
+
+    ngx_event_latency = (ngx_event_latency * 7 + (ngx_uint_t) usec) / 8;
+
+    if (st == NULL) {
+        return;
+    }
+
+    st->loops++;
+
+    if (events > st->max_events) {
+        st->max_events = events;
+    }
+
+    /* the clock may step back */
+
+    if ((int64_t) loop < 0) {
+        loop = 0;
+    }
+
+    if (loop > st->max_loop) {
+        st->max_loop = (ngx_atomic_uint_t) loop;
+    }
+
+    for (n = 0, loop >>= 4; loop && n < NGX_EVENT_STAT_BUCKETS - 1; n++) {
+        loop >>= 1;
+    }
+
+    st->latency[n]++;
+}
+
+
+/*
+ * a worker whose number of active connections exceeds the average of
+ * all workers by a quarter, or whose loop latency is more than twice
+ * the average, stops accepting new connections until it falls back
+ */
+
+static ngx_int_t
+ngx_event_balance_accept(ngx_cycle_t *cycle)
+{
+    ngx_uint_t         i, n, overloaded;
+    ngx_atomic_uint_t  active, latency;
+    ngx_event_load_t  *load;
+
+    if (ngx_exiting) {
+
+        /* the listening sockets are closed already */
+
+        ngx_use_accept_balance = 0;
+        ngx_event_load->pid = 0;
+
+        return NGX_OK;
+    }
+
+    if (ngx_current_msec - ngx_accept_balance_time >= 10) {
+        ngx_accept_balance_time = ngx_current_msec;
+
+        ngx_event_load->active = cycle->connection_n
+                                 - cycle->free_connection_n;
+        ngx_event_load->latency = ngx_event_latency;
+
+        n = 0;
+        active = 0;
+        latency = 0;
+
+        for (i = 0; i < NGX_MAX_PROCESSES; i++) {
+            load = &ngx_event_loads[i];
+
+            if (load->pid == 0) {
+                continue;
+            }
+
+            n++;
+            active += load->active;
+            latency += load->latency;
+        }
+
+        load = ngx_event_load;
+
+        overloaded = (n > 1
+                      && (load->active * n > active + active / 4 + 8 * n
+                          || load->latency * n > 2 * latency + 1000 * n));
+
+        if (overloaded != ngx_accept_overloaded) {
+            ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "accept balance: %s, active:%uA latency:%uA",
+                           overloaded ? "overloaded" : "normal",
+                           load->active, load->latency);
+
+            ngx_accept_overloaded = overloaded;
+
+            if (!ngx_use_accept_mutex
+                && !(ngx_event_flags & NGX_USE_RTSIG_EVENT))
+            {
+                if (overloaded) {
+                    if (ngx_disable_accept_events(cycle) == NGX_ERROR) {
+                        return NGX_ERROR;
+                    }
+
+                } else {
+                    if (ngx_enable_accept_events(cycle) == NGX_ERROR) {
+                        return NGX_ERROR;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!ngx_accept_overloaded || !ngx_use_accept_mutex) {
+        return NGX_OK;
+    }
+
+    /*
+     * the mutex was unlocked at the end of the previous iteration,
+     * only the listening events of its last holder are left to remove
+     */
+
+    if (ngx_accept_mutex_held) {
+        if (ngx_disable_accept_events(cycle) == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        ngx_accept_mutex_held = 0;
+    }
+
+    return NGX_OK;
 }
 
 
@@ -543,7 +914,9 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     // ڴ棬accept mutexconnection counterngx_temp_number
     size = cl            /* ngx_accept_mutex */
            + cl          /* ngx_connection_counter */
-           + cl;         /* ngx_temp_number */
+           + cl          /* ngx_temp_number */
+           + NGX_MAX_PROCESSES * sizeof(ngx_event_stat_t)
+           + NGX_MAX_PROCESSES * sizeof(ngx_event_load_t);
 
 #if (NGX_STAT_STUB)
 
@@ -552,7 +925,10 @@ ngx_event_module_init(ngx_cycle_t *cycle)
            + cl          /* ngx_stat_requests */
            + cl          /* ngx_stat_active */
            + cl          /* ngx_stat_reading */
-           + cl;         /* ngx_stat_writing */
+           + cl          /* ngx_stat_writing */
+           + cl          /* ngx_stat_waiting_mem */
+           + cl          /* ngx_stat_released */
+           + cl;         /* ngx_stat_cached_mem */
 
 #endif
 
@@ -598,9 +974,21 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     ngx_stat_active = (ngx_atomic_t *) (shared + 6 * cl);
     ngx_stat_reading = (ngx_atomic_t *) (shared + 7 * cl);
     ngx_stat_writing = (ngx_atomic_t *) (shared + 8 * cl);
+    ngx_stat_waiting_mem = (ngx_atomic_t *) (shared + 9 * cl);
+    ngx_stat_released = (ngx_atomic_t *) (shared + 10 * cl);
+    ngx_stat_cached_mem = (ngx_atomic_t *) (shared + 11 * cl);
+
+    ngx_event_stats = (ngx_event_stat_t *) (shared + 12 * cl);
+
+#else
+
+    ngx_event_stats = (ngx_event_stat_t *) (shared + 3 * cl);
 
 #endif
 
+    ngx_event_loads = (ngx_event_load_t *)
+                          (ngx_event_stats + NGX_MAX_PROCESSES);
+
     return NGX_OK;
 }
 
@@ -645,6 +1033,62 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         ngx_use_accept_mutex = 0;
     }
 
+    ngx_event_stat = NULL;
+
+    if (ecf->loop_stats) {
+
+        if (ngx_event_stats && ngx_process_slot >= 0
+            && ngx_process_slot < NGX_MAX_PROCESSES)
+        {
+            ngx_event_stat = &ngx_event_stats[ngx_process_slot];
+
+        } else {
+            ngx_event_stat = &ngx_event_stat0;
+        }
+
+        ngx_memzero(ngx_event_stat, sizeof(ngx_event_stat_t));
+        ngx_event_stat->pid = ngx_pid;
+    }
+
+    ngx_accept_event_flags = 0;
+
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+
+    /*
+     * without the accept mutex each worker waits on the listening
+     * sockets, EPOLLEXCLUSIVE wakes up only one of them
+     */
+
+    if (!ngx_use_accept_mutex
+        && ccf->master && ccf->worker_processes > 1
+        && (ngx_event_flags & NGX_USE_EPOLL_EVENT))
+    {
+        ngx_accept_event_flags = NGX_EXCLUSIVE_EVENT;
+    }
+
+#endif
+
+    ngx_use_accept_balance = 0;
+    ngx_event_load = NULL;
+    ngx_accept_overloaded = 0;
+
+    if (ecf->accept_balance
+        && ngx_event_loads && ccf->worker_processes > 1
+        && ngx_process_slot >= 0 && ngx_process_slot < NGX_MAX_PROCESSES)
+    {
+        ngx_use_accept_balance = 1;
+
+        ngx_event_load = &ngx_event_loads[ngx_process_slot];
+        ngx_event_load->active = 0;
+        ngx_event_load->latency = 0;
+        ngx_event_load->pid = ngx_pid;
+    }
+
+    ngx_bulk_event_budget = ecf->bulk_event_budget;
+    ngx_event_slow_handler = ecf->slow_handler;
+    ngx_event_timing = (ngx_event_stat || ngx_event_slow_handler
+                        || ngx_use_accept_balance);
+
 #if (NGX_THREADS)
     ngx_posted_events_mutex = ngx_mutex_init(cycle->log, 0);
     if (ngx_posted_events_mutex == NULL) {
@@ -903,7 +1347,9 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
         } else {
             //ӿɶ¼¼ûʹaccept壬ôڴ˴׽ַ
-            if (ngx_add_event(rev, NGX_READ_EVENT, 0) == NGX_ERROR) {
+            if (ngx_add_event(rev, NGX_READ_EVENT, ngx_accept_event_flags)
+                == NGX_ERROR)
+            {
                 return NGX_ERROR;
             }
         }
@@ -916,6 +1362,21 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 }
 
 
+static void
+ngx_event_process_exit(ngx_cycle_t *cycle)
+{
+    if (ngx_event_stat) {
+        ngx_event_stat->pid = 0;
+        ngx_event_stat = NULL;
+    }
+
+    if (ngx_event_load) {
+        ngx_event_load->pid = 0;
+        ngx_event_load = NULL;
+    }
+}
+
+
 ngx_int_t
 ngx_send_lowat(ngx_connection_t *c, size_t lowat)
 {
@@ -1205,6 +1666,11 @@ ngx_event_create_conf(ngx_cycle_t *cycle)
     ecf->multi_accept = NGX_CONF_UNSET;
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->loop_stats = NGX_CONF_UNSET;
+    ecf->slow_handler = NGX_CONF_UNSET_MSEC;
+    ecf->accept_batch = NGX_CONF_UNSET_UINT;
+    ecf->accept_balance = NGX_CONF_UNSET;
+    ecf->bulk_event_budget = NGX_CONF_UNSET_UINT;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1320,6 +1786,11 @@ ngx_event_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 1);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_value(ecf->loop_stats, 0);
+    ngx_conf_init_msec_value(ecf->slow_handler, 0);
+    ngx_conf_init_uint_value(ecf->accept_batch, 0);
+    ngx_conf_init_value(ecf->accept_balance, 0);
+    ngx_conf_init_uint_value(ecf->bulk_event_budget, 16);
 
 
 #if (NGX_HAVE_RTSIG)
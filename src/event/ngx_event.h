@@ -480,6 +480,9 @@ extern ngx_event_actions_t   ngx_event_actions;
 #define NGX_LEVEL_EVENT    0
 #define NGX_CLEAR_EVENT    EPOLLET
 #define NGX_ONESHOT_EVENT  0x70000000
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+#define NGX_EXCLUSIVE_EVENT  EPOLLEXCLUSIVE
+#endif
 #if 0
 #define NGX_ONESHOT_EVENT  EPOLLONESHOT
 #endif
@@ -559,6 +562,19 @@ typedef struct {
     */
     ngx_msec_t    accept_mutex_delay;
 
+    // 标志位，为1时在共享内存中记录每个worker进程事件循环的统计数据
+    ngx_flag_t    loop_stats;
+    // 单次事件处理方法执行超过这个时间时记录日志，0表示关闭
+    ngx_msec_t    slow_handler;
+
+    // 每次监听事件最多建立的连接数，0表示不限制
+    ngx_uint_t    accept_batch;
+    // 标志位，为1时根据各worker进程的负载决定是否接受新连接
+    ngx_flag_t    accept_balance;
+
+    // 每次事件循环最多处理的低优先级(大文件发送)事件数，0表示不限制
+    ngx_uint_t    bulk_event_budget;
+
     // 所选用事件模块的名字，它与use成员是匹配的
     u_char       *name;
 
@@ -594,6 +610,8 @@ extern ngx_uint_t             ngx_accept_events;
 extern ngx_uint_t             ngx_accept_mutex_held;
 extern ngx_msec_t             ngx_accept_mutex_delay;
 extern ngx_int_t              ngx_accept_disabled;
+extern ngx_uint_t             ngx_accept_event_flags;
+extern ngx_uint_t             ngx_use_accept_balance;
 
 
 #if (NGX_STAT_STUB)
@@ -604,10 +622,55 @@ extern ngx_atomic_t  *ngx_stat_requests;
 extern ngx_atomic_t  *ngx_stat_active;
 extern ngx_atomic_t  *ngx_stat_reading;
 extern ngx_atomic_t  *ngx_stat_writing;
+extern ngx_atomic_t  *ngx_stat_waiting_mem;
+extern ngx_atomic_t  *ngx_stat_released;
+extern ngx_atomic_t  *ngx_stat_cached_mem;
 
 #endif
 
 
+#define NGX_EVENT_STAT_BUCKETS  20
+
+#define NGX_EVENT_STAT_IO       0
+#define NGX_EVENT_STAT_POSTED   1
+#define NGX_EVENT_STAT_TIMERS   2
+
+
+/*
+ * the event loop statistics of a worker process, the slot is written
+ * by the worker only; latency[n] counts the loop iterations that took
+ * less than 2^(n + 4) microseconds of wall time, the wait for events
+ * excluded, the last bucket counts the rest
+ */
+
+typedef struct {
+    ngx_atomic_t  pid;
+    ngx_atomic_t  loops;
+    ngx_atomic_t  max_loop;
+    ngx_atomic_t  max_events;
+    ngx_atomic_t  events[3];
+    ngx_atomic_t  usec[3];
+    ngx_atomic_t  slow;
+    ngx_atomic_t  max_handler;
+    ngx_atomic_t  latency[NGX_EVENT_STAT_BUCKETS];
+} ngx_event_stat_t;
+
+
+/* the load of a worker process published for the accept balancing */
+
+typedef struct {
+    ngx_atomic_t  pid;
+    ngx_atomic_t  active;
+    ngx_atomic_t  latency;
+} ngx_event_load_t;
+
+
+extern ngx_uint_t             ngx_event_timing;
+extern ngx_uint_t             ngx_event_stat_stage;
+extern ngx_event_stat_t      *ngx_event_stat;
+extern ngx_event_stat_t      *ngx_event_stats;
+
+
 #define NGX_UPDATE_TIME         1
 #define NGX_POST_EVENTS         2
 #define NGX_POST_THREAD_EVENTS  4
@@ -626,10 +689,13 @@ extern ngx_module_t           ngx_event_core_module;
 
 void ngx_event_accept(ngx_event_t *ev);
 ngx_int_t ngx_trylock_accept_mutex(ngx_cycle_t *cycle);
+ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
+ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle);
 u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 
 
 void ngx_process_events_and_timers(ngx_cycle_t *cycle);
+void ngx_event_timed_call(ngx_event_t *ev);
 ngx_int_t ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags);
 ngx_int_t ngx_handle_write_event(ngx_event_t *wev, size_t lowat);
 
@@ -644,6 +710,18 @@ u_char *ngx_acceptex_log_error(ngx_log_t *log, u_char *buf, size_t len);
 ngx_int_t ngx_send_lowat(ngx_connection_t *c, size_t lowat);
 
 
+static ngx_inline void
+ngx_event_call(ngx_event_t *ev)
+{
+    if (ngx_event_timing) {
+        ngx_event_timed_call(ev);
+        return;
+    }
+
+    ev->handler(ev);
+}
+
+
 /* used in ngx_log_debugX() */
 #define ngx_event_ident(p)  ((ngx_connection_t *) (p))->fd
 
@@ -10,8 +10,6 @@
 #include <ngx_event.h>
 
 
-static ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
-static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
 
 //ǵlisten пɶ¼֮ű
@@ -20,6 +18,7 @@ ngx_event_accept(ngx_event_t *ev)
 {
     socklen_t          socklen;
     ngx_err_t          err;
+    ngx_uint_t         n;
     ngx_log_t         *log;
     ngx_socket_t       s;
     ngx_event_t       *rev, *wev;
@@ -52,6 +51,8 @@ ngx_event_accept(ngx_event_t *ev)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "accept on %V, ready: %d", &ls->addr_text, ev->available);
 
+    n = 0;
+
     do {
         socklen = NGX_SOCKADDRLEN;
         //ʼaccept
@@ -315,6 +316,15 @@ ngx_event_accept(ngx_event_t *ev)
             ev->available--;
         }
 
+        /*
+         * the listening socket is level-triggered, so the connections
+         * left in the backlog are reported again on the next iteration
+         */
+
+        if (ecf->accept_batch && ++n == ecf->accept_batch) {
+            break;
+        }
+
     } while (ev->available);
 }
 
@@ -367,7 +377,7 @@ ngx_trylock_accept_mutex(ngx_cycle_t *cycle)
 }
 
 
-static ngx_int_t
+ngx_int_t
 ngx_enable_accept_events(ngx_cycle_t *cycle)
 {
     ngx_uint_t         i;
@@ -386,7 +396,10 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
             }
 
         } else {
-            if (ngx_add_event(c->read, NGX_READ_EVENT, 0) == NGX_ERROR) {   //!< ngx_epoll_module_ctx -> ngx_epoll_add_event
+            //!< ngx_epoll_module_ctx -> ngx_epoll_add_event
+            if (ngx_add_event(c->read, NGX_READ_EVENT, ngx_accept_event_flags)
+                == NGX_ERROR)
+            {
                 return NGX_ERROR;
             }
         }
@@ -396,7 +409,7 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
 }
 
 
-static ngx_int_t
+ngx_int_t
 ngx_disable_accept_events(ngx_cycle_t *cycle)
 {
     ngx_uint_t         i;
@@ -12,6 +12,7 @@
 
 ngx_thread_volatile ngx_event_t  *ngx_posted_accept_events;
 ngx_thread_volatile ngx_event_t  *ngx_posted_events;
+ngx_thread_volatile ngx_event_t  *ngx_posted_bulk_events;
 
 #if (NGX_THREADS)
 ngx_mutex_t                      *ngx_posted_events_mutex;
@@ -37,11 +38,66 @@ ngx_event_process_posted(ngx_cycle_t *cycle,
 
         ngx_delete_posted_event(ev);
 
-        ev->handler(ev);
+        ngx_event_call(ev);
     }
 }
 
 
+/*
+ * the bulk events are the delayed write events of the large transfers
+ * that have sent a chunk and yield to the others; they are processed
+ * after all other events and at most "budget" of them in an iteration,
+ * the events posted again by the handlers wait for the next iteration
+ */
+
+void
+ngx_event_process_bulk_posted(ngx_cycle_t *cycle, ngx_uint_t budget)
+{
+    ngx_uint_t                        n;
+    ngx_event_t                      *ev, *last;
+    ngx_thread_volatile ngx_event_t  *queue;
+
+    queue = ngx_posted_bulk_events;
+    ngx_posted_bulk_events = NULL;
+    queue->prev = (ngx_event_t **) &queue;
+
+    for (n = 0; queue && (budget == 0 || n < budget); n++) {
+
+        ev = (ngx_event_t *) queue;
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                      "posted bulk event %p", ev);
+
+        ngx_delete_posted_event(ev);
+
+        /* the delay ends when the event is processed */
+
+        ev->delayed = 0;
+
+        ngx_event_call(ev);
+    }
+
+    if (queue == NULL) {
+        return;
+    }
+
+    /* the events left are moved to the head of the queue */
+
+    for (last = (ngx_event_t *) queue; last->next; last = last->next) {
+        /* void */
+    }
+
+    last->next = (ngx_event_t *) ngx_posted_bulk_events;
+
+    if (last->next) {
+        last->next->prev = &last->next;
+    }
+
+    ngx_posted_bulk_events = queue;
+    queue->prev = (ngx_event_t **) &ngx_posted_bulk_events;
+}
+
+
 #if (NGX_THREADS) && !(NGX_WIN32)
 
 void
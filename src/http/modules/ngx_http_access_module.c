@@ -361,6 +361,15 @@ ngx_http_access_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     }
 #endif
 
+    if (conf->rules == NULL
+#if (NGX_HAVE_INET6)
+        && conf->rules6 == NULL
+#endif
+       )
+    {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_ACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
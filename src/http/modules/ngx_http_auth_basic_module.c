@@ -394,6 +394,10 @@ ngx_http_auth_basic_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         conf->user_file = prev->user_file;
     }
 
+    if (conf->realm.len == 0 || conf->user_file.value.len == 0) {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_ACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
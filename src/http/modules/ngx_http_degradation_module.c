@@ -189,6 +189,10 @@ ngx_http_degradation_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_uint_value(conf->degrade, prev->degrade, 0);
 
+    if (conf->degrade == 0) {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_PREACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -73,6 +73,9 @@ typedef struct {
 
     ngx_str_t                      script_name;
     ngx_str_t                      path_info;
+
+    ngx_chain_t                   *free;
+    ngx_chain_t                   *busy;
 } ngx_http_fastcgi_ctx_t;
 
 
@@ -130,6 +133,10 @@ static ngx_int_t ngx_http_fastcgi_create_key(ngx_http_request_t *r);
 #endif
 static ngx_int_t ngx_http_fastcgi_create_request(ngx_http_request_t *r);
 static ngx_int_t ngx_http_fastcgi_reinit_request(ngx_http_request_t *r);
+static ngx_int_t ngx_http_fastcgi_body_output_filter(void *data,
+    ngx_chain_t *in);
+static ngx_buf_t *ngx_http_fastcgi_body_buf(ngx_http_request_t *r,
+    ngx_http_fastcgi_ctx_t *f, ngx_chain_t ***last);
 static ngx_int_t ngx_http_fastcgi_process_header(ngx_http_request_t *r);
 static ngx_int_t ngx_http_fastcgi_input_filter(ngx_event_pipe_t *p,
     ngx_buf_t *buf);
@@ -234,6 +241,13 @@ static ngx_command_t  ngx_http_fastcgi_commands[] = {
       offsetof(ngx_http_fastcgi_loc_conf_t, upstream.ignore_client_abort),
       NULL },
 
+    { ngx_string("fastcgi_force_ranges"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_fastcgi_loc_conf_t, upstream.force_ranges),
+      NULL },
+
     { ngx_string("fastcgi_bind"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_http_upstream_bind_set_slot,
@@ -283,6 +297,13 @@ static ngx_command_t  ngx_http_fastcgi_commands[] = {
       offsetof(ngx_http_fastcgi_loc_conf_t, upstream.pass_request_body),
       NULL },
 
+    { ngx_string("fastcgi_request_buffering"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_fastcgi_loc_conf_t, upstream.request_buffering),
+      NULL },
+
     { ngx_string("fastcgi_intercept_errors"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
       ngx_conf_set_flag_slot,
@@ -604,6 +625,16 @@ ngx_http_fastcgi_handler(ngx_http_request_t *r)
     u->pipe->input_filter = ngx_http_fastcgi_input_filter;
     u->pipe->input_ctx = r;
 
+    if (!flcf->upstream.request_buffering
+        && flcf->upstream.pass_request_body
+        && r == r->main)
+    {
+        r->request_body_no_buffering = 1;
+
+        u->output.output_filter = ngx_http_fastcgi_body_output_filter;
+        u->output.filter_ctx = r;
+    }
+
     rc = ngx_http_read_client_request_body(r, ngx_http_upstream_init);
 
     if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
@@ -1118,6 +1149,27 @@ ngx_http_fastcgi_create_request(ngx_http_request_t *r)
     h->padding_length = 0;
     h->reserved = 0;
 
+    if (r->upstream->request_body_streaming) {
+
+        /*
+         * the rest of the body and the empty FCGI_STDIN record
+         * are sent by ngx_http_fastcgi_body_output_filter()
+         */
+
+        b->last -= sizeof(ngx_http_fastcgi_header_t);
+
+        if (b->last == b->pos) {
+            for (body = r->upstream->request_bufs;
+                 body->next != cl;
+                 body = body->next)
+            {
+                /* void */
+            }
+
+            cl = body;
+        }
+    }
+
     cl->next = NULL;
 
     return NGX_OK;
@@ -1143,6 +1195,158 @@ ngx_http_fastcgi_reinit_request(ngx_http_request_t *r)
 }
 
 
+/*
+ * frames the parts of an unbuffered request body into FCGI_STDIN records,
+ * the framing bufs are reused because the upstream passes the next part
+ * only after the previous one was sent
+ */
+
+static ngx_int_t
+ngx_http_fastcgi_body_output_filter(void *data, ngx_chain_t *in)
+{
+    ngx_http_request_t  *r = data;
+
+    size_t                      len, padding;
+    u_char                     *pos, *last;
+    ngx_int_t                   rc;
+    ngx_buf_t                  *b;
+    ngx_chain_t                *cl, *out, **ll;
+    ngx_http_upstream_t        *u;
+    ngx_http_fastcgi_ctx_t     *f;
+    ngx_http_fastcgi_header_t  *h;
+
+    u = r->upstream;
+
+    if (in == NULL || !u->request_body_streamed) {
+
+        /* the request header and the pre-read part of the body */
+
+        return ngx_chain_writer(&u->writer, in);
+    }
+
+    f = ngx_http_get_module_ctx(r, ngx_http_fastcgi_module);
+
+    out = NULL;
+    ll = &out;
+
+    for (cl = in; cl; cl = cl->next) {
+
+        pos = cl->buf->pos;
+        last = cl->buf->last;
+
+        while (pos < last) {
+            len = ngx_min((size_t) (last - pos), 32 * 1024);
+
+            padding = 8 - len % 8;
+            padding = (padding == 8) ? 0 : padding;
+
+            b = ngx_http_fastcgi_body_buf(r, f, &ll);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
+
+            h = (ngx_http_fastcgi_header_t *) b->last;
+            b->last += sizeof(ngx_http_fastcgi_header_t);
+
+            h->version = 1;
+            h->type = NGX_HTTP_FASTCGI_STDIN;
+            h->request_id_hi = 0;
+            h->request_id_lo = 1;
+            h->content_length_hi = (u_char) ((len >> 8) & 0xff);
+            h->content_length_lo = (u_char) (len & 0xff);
+            h->padding_length = (u_char) padding;
+            h->reserved = 0;
+
+            b = ngx_http_fastcgi_body_buf(r, f, &ll);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
+
+            b->pos = pos;
+            b->last = pos + len;
+
+            pos += len;
+
+            if (padding) {
+                b = ngx_http_fastcgi_body_buf(r, f, &ll);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+
+                ngx_memzero(b->last, padding);
+                b->last += padding;
+            }
+        }
+
+        cl->buf->pos = last;
+
+        if (cl->buf->last_buf) {
+            b = ngx_http_fastcgi_body_buf(r, f, &ll);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
+
+            h = (ngx_http_fastcgi_header_t *) b->last;
+            b->last += sizeof(ngx_http_fastcgi_header_t);
+
+            h->version = 1;
+            h->type = NGX_HTTP_FASTCGI_STDIN;
+            h->request_id_hi = 0;
+            h->request_id_lo = 1;
+            h->content_length_hi = 0;
+            h->content_length_lo = 0;
+            h->padding_length = 0;
+            h->reserved = 0;
+        }
+    }
+
+    rc = ngx_chain_writer(&u->writer, out);
+
+    ngx_chain_update_chains(&f->free, &f->busy, &out,
+                            (ngx_buf_tag_t) &ngx_http_fastcgi_module);
+
+    return rc;
+}
+
+
+static ngx_buf_t *
+ngx_http_fastcgi_body_buf(ngx_http_request_t *r, ngx_http_fastcgi_ctx_t *f,
+    ngx_chain_t ***last)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    cl = ngx_chain_get_free_buf(r->pool, &f->free);
+    if (cl == NULL) {
+        return NULL;
+    }
+
+    b = cl->buf;
+
+    if (b->start == NULL) {
+
+        /* the own memory is used for a record header or padding */
+
+        b->start = ngx_palloc(r->pool, sizeof(ngx_http_fastcgi_header_t));
+        if (b->start == NULL) {
+            return NULL;
+        }
+
+        b->end = b->start + sizeof(ngx_http_fastcgi_header_t);
+        b->temporary = 1;
+        b->tag = (ngx_buf_tag_t) &ngx_http_fastcgi_module;
+    }
+
+    b->pos = b->start;
+    b->last = b->start;
+
+    **last = cl;
+    *last = &cl->next;
+
+    return b;
+}
+
+
 static ngx_int_t
 ngx_http_fastcgi_process_header(ngx_http_request_t *r)
 {
@@ -1461,8 +1665,8 @@ ngx_http_fastcgi_process_header(ngx_http_request_t *r)
                     ngx_strlow(h->lowcase_key, h->key.data, h->key.len);
                 }
 
-                hh = ngx_hash_find(&umcf->headers_in_hash, h->hash,
-                                   h->lowcase_key, h->key.len);
+                hh = ngx_hash_dispatch_find(&umcf->headers_in_dispatch,
+                                            h->lowcase_key, h->key.len);
 
                 if (hh && hh->handler(r, h, hh->offset) != NGX_OK) {
                     return NGX_ERROR;
@@ -1984,6 +2188,7 @@ ngx_http_fastcgi_create_loc_conf(ngx_conf_t *cf)
     conf->upstream.store_access = NGX_CONF_UNSET_UINT;
     conf->upstream.buffering = NGX_CONF_UNSET;
     conf->upstream.ignore_client_abort = NGX_CONF_UNSET;
+    conf->upstream.force_ranges = NGX_CONF_UNSET;
 
     conf->upstream.connect_timeout = NGX_CONF_UNSET_MSEC;
     conf->upstream.send_timeout = NGX_CONF_UNSET_MSEC;
@@ -1998,6 +2203,7 @@ ngx_http_fastcgi_create_loc_conf(ngx_conf_t *cf)
 
     conf->upstream.pass_request_headers = NGX_CONF_UNSET;
     conf->upstream.pass_request_body = NGX_CONF_UNSET;
+    conf->upstream.request_buffering = NGX_CONF_UNSET;
 
 #if (NGX_HTTP_CACHE)
     conf->upstream.cache = NGX_CONF_UNSET_PTR;
@@ -2052,6 +2258,9 @@ ngx_http_fastcgi_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->upstream.ignore_client_abort,
                               prev->upstream.ignore_client_abort, 0);
 
+    ngx_conf_merge_value(conf->upstream.force_ranges,
+                              prev->upstream.force_ranges, 0);
+
     ngx_conf_merge_msec_value(conf->upstream.connect_timeout,
                               prev->upstream.connect_timeout, 60000);
 
@@ -2251,6 +2460,9 @@ ngx_http_fastcgi_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->upstream.pass_request_body,
                               prev->upstream.pass_request_body, 1);
 
+    ngx_conf_merge_value(conf->upstream.request_buffering,
+                              prev->upstream.request_buffering, 1);
+
     ngx_conf_merge_value(conf->upstream.intercept_errors,
                               prev->upstream.intercept_errors, 0);
 
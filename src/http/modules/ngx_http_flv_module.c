@@ -7,9 +7,117 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
-
+#include <ngx_md5.h>
+
+
+#define NGX_HTTP_FLV_BUFFER_SIZE   65536
+#define NGX_HTTP_FLV_AMF_DEPTH     16
+
+#define NGX_FLV_TAG_AUDIO          8
+#define NGX_FLV_TAG_VIDEO          9
+#define NGX_FLV_TAG_SCRIPT         18
+
+#define NGX_FLV_AMF_NUMBER         0x00
+#define NGX_FLV_AMF_STRING         0x02
+#define NGX_FLV_AMF_OBJECT         0x03
+#define NGX_FLV_AMF_ECMA_ARRAY     0x08
+#define NGX_FLV_AMF_OBJECT_END     0x09
+#define NGX_FLV_AMF_STRICT_ARRAY   0x0a
+
+
+typedef struct {
+    ngx_shm_zone_t       *index;
+} ngx_http_flv_conf_t;
+
+
+typedef struct {
+    off_t                 offset;
+    uint32_t              time;
+} ngx_http_flv_keyframe_t;
+
+
+typedef struct {
+    off_t                     header_start;
+    off_t                     header_end;
+    ngx_uint_t                nkeyframes;
+    ngx_http_flv_keyframe_t  *keyframes;
+} ngx_http_flv_index_t;
+
+
+typedef struct {
+    off_t                    header_start;
+    off_t                    header_end;
+    ngx_uint_t               nkeyframes;
+    ngx_http_flv_keyframe_t  keyframes[1];
+} ngx_http_flv_index_entry_t;
+
+
+typedef struct {
+    ngx_msec_t            time;
+    ngx_int_t             rc;
+    off_t                 start;
+    off_t                 header_start;
+    off_t                 header_end;
+} ngx_http_flv_lookup_t;
+
+
+typedef struct {
+    ngx_file_t           *file;
+    off_t                 size;
+    off_t                 start;
+    size_t                len;
+    u_char               *buffer;
+} ngx_http_flv_reader_t;
+
+
+#define ngx_flv_get_24value(p)                                                \
+    ( ((uint32_t) ((u_char *) (p))[0] << 16)                                  \
+    + (            ((u_char *) (p))[1] << 8)                                  \
+    + (            ((u_char *) (p))[2]) )
+
+#define ngx_flv_get_32value(p)                                                \
+    ( ((uint32_t) ((u_char *) (p))[0] << 24)                                  \
+    + (           ((u_char *) (p))[1] << 16)                                  \
+    + (           ((u_char *) (p))[2] << 8)                                   \
+    + (           ((u_char *) (p))[3]) )
+
+#define ngx_flv_get_64value(p)                                                \
+    ( ((uint64_t) ngx_flv_get_32value(p) << 32)                               \
+    + (           ngx_flv_get_32value(&((u_char *) (p))[4])) )
+
+
+static ngx_int_t ngx_http_flv_seek(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_open_file_info_t *of, ngx_msec_t time, off_t *start,
+    off_t *header_start, off_t *header_end);
+static ngx_int_t ngx_http_flv_index(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_open_file_info_t *of, ngx_uint_t scan, ngx_http_flv_index_t *index);
+static ngx_int_t ngx_http_flv_read(ngx_http_flv_reader_t *rd, off_t offset,
+    size_t len, u_char **p);
+static ngx_int_t ngx_http_flv_metadata(ngx_http_request_t *r,
+    ngx_http_flv_reader_t *rd, u_char *p, u_char *last,
+    ngx_http_flv_index_t *index);
+static ngx_int_t ngx_http_flv_scan(ngx_http_request_t *r,
+    ngx_http_flv_reader_t *rd, off_t offset, ngx_http_flv_index_t *index);
+static u_char *ngx_http_flv_amf_find(u_char *p, u_char *last, char *name,
+    size_t len);
+static u_char *ngx_http_flv_amf_skip(u_char *p, u_char *last,
+    ngx_uint_t depth);
+static u_char *ngx_http_flv_amf_skip_object(u_char *p, u_char *last,
+    ngx_uint_t depth);
+static ngx_int_t ngx_http_flv_search(ngx_http_flv_keyframe_t *keyframes,
+    ngx_uint_t n, ngx_msec_t time, off_t *start);
+static ngx_int_t ngx_http_flv_index_load(void *data, u_char *p, size_t len);
+static void ngx_http_flv_index_put(ngx_http_flv_conf_t *conf, u_char *md5,
+    ngx_http_flv_index_t *index, ngx_log_t *log);
+static void ngx_http_flv_index_fill(void *data, u_char *p);
 
 static char *ngx_http_flv(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static void *ngx_http_flv_create_conf(ngx_conf_t *cf);
+static char *ngx_http_flv_merge_conf(ngx_conf_t *cf, void *parent,
+    void *child);
+
+ngx_module_t  ngx_http_flv_module;
+
 
 static ngx_command_t  ngx_http_flv_commands[] = {
 
@@ -20,6 +128,20 @@ static ngx_command_t  ngx_http_flv_commands[] = {
       0,
       NULL },
 
+    { ngx_string("flv_index_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_zone,
+      0,
+      0,
+      &ngx_http_flv_module },
+
+    { ngx_string("flv_index"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_set_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_flv_conf_t, index),
+      &ngx_http_flv_module },
+
       ngx_null_command
 };
 
@@ -37,8 +159,8 @@ static ngx_http_module_t  ngx_http_flv_module_ctx = {
     NULL,                          /* create server configuration */
     NULL,                          /* merge server configuration */
 
-    NULL,                          /* create location configuration */
-    NULL                           /* merge location configuration */
+    ngx_http_flv_create_conf,      /* create location configuration */
+    ngx_http_flv_merge_conf        /* merge location configuration */
 };
 
 
@@ -62,14 +184,14 @@ static ngx_int_t
 ngx_http_flv_handler(ngx_http_request_t *r)
 {
     u_char                    *last;
-    off_t                      start, len;
+    off_t                      start, len, header_start, header_end;
     size_t                     root;
-    ngx_int_t                  rc;
+    ngx_int_t                  rc, time;
     ngx_uint_t                 level, i;
     ngx_str_t                  path, value;
     ngx_log_t                 *log;
-    ngx_buf_t                 *b;
-    ngx_chain_t                out[2];
+    ngx_buf_t                 *b, *header;
+    ngx_chain_t                out[3];
     ngx_open_file_info_t       of;
     ngx_http_core_loc_conf_t  *clcf;
 
@@ -99,12 +221,28 @@ ngx_http_flv_handler(ngx_http_request_t *r)
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
                    "http flv filename: \"%V\"", &path);
 
+    time = -1;
+
+    if (r->args.len
+        && ngx_http_arg(r, (u_char *) "start", 5, &value) != NGX_OK
+        && ngx_http_arg(r, (u_char *) "time", 4, &value) == NGX_OK)
+    {
+        /* the same conversion as the mp4 "start" argument */
+
+        ngx_set_errno(0);
+        time = (int) (strtod((char *) value.data, NULL) * 1000);
+
+        if (ngx_errno != 0) {
+            time = -1;
+        }
+    }
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
     of.read_ahead = clcf->read_ahead;
-    of.directio = clcf->directio;
+    of.directio = (time >= 0) ? NGX_MAX_OFF_T_VALUE : clcf->directio;
     of.valid = clcf->open_file_cache_valid;
     of.min_uses = clcf->open_file_cache_min_uses;
     of.errors = clcf->open_file_cache_errors;
@@ -161,9 +299,26 @@ ngx_http_flv_handler(ngx_http_request_t *r)
 
     start = 0;
     len = of.size;
-    i = 1;
+    header_start = 0;
+    header_end = 0;
+    i = 2;
+
+    if (time > 0) {
 
-    if (r->args.len) {
+        rc = ngx_http_flv_seek(r, &path, &of, time, &start, &header_start,
+                               &header_end);
+
+        if (rc == NGX_ERROR) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        if (rc == NGX_OK) {
+            len = sizeof(ngx_flv_header) - 1 + header_end - header_start
+                  + len - start;
+            i = 0;
+        }
+
+    } else if (time < 0 && r->args.len) {
 
         if (ngx_http_arg(r, (u_char *) "start", 5, &value) == NGX_OK) {
 
@@ -180,6 +335,21 @@ ngx_http_flv_handler(ngx_http_request_t *r)
         }
     }
 
+    if (time >= 0 && clcf->directio <= of.size) {
+
+        /*
+         * DIRECTIO is set on transfer only
+         * to allow kernel to cache the keyframe index reads
+         */
+
+        if (ngx_directio_on(of.fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          ngx_directio_on_n " \"%s\" failed", path.data);
+        }
+
+        of.is_directio = 1;
+    }
+
     log->action = "sending flv to client";
 
     r->headers_out.status = NGX_HTTP_OK;
@@ -201,9 +371,24 @@ ngx_http_flv_handler(ngx_http_request_t *r)
         b->memory = 1;
 
         out[0].buf = b;
-        out[0].next = &out[1];
+        out[0].next = &out[2];
     }
 
+    header = NULL;
+
+    if (header_start != header_end) {
+
+        /* codec configuration tags the decoder needs before a keyframe */
+
+        header = ngx_pcalloc(r->pool, sizeof(ngx_buf_t));
+        if (header == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        out[0].next = &out[1];
+        out[1].buf = header;
+        out[1].next = &out[2];
+    }
 
     b = ngx_pcalloc(r->pool, sizeof(ngx_buf_t));
     if (b == NULL) {
@@ -235,13 +420,727 @@ ngx_http_flv_handler(ngx_http_request_t *r)
     b->file->log = log;
     b->file->directio = of.is_directio;
 
-    out[1].buf = b;
-    out[1].next = NULL;
+    out[2].buf = b;
+    out[2].next = NULL;
+
+    if (header) {
+        header->file_pos = header_start;
+        header->file_last = header_end;
+        header->in_file = 1;
+        header->file = b->file;
+    }
 
     return ngx_http_output_filter(r, &out[i]);
 }
 
 
+static ngx_int_t
+ngx_http_flv_seek(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_open_file_info_t *of, ngx_msec_t time, off_t *start,
+    off_t *header_start, off_t *header_end)
+{
+    u_char                  md5[16];
+    ngx_md5_t               ctx;
+    ngx_http_flv_conf_t    *conf;
+    ngx_http_flv_index_t    index;
+    ngx_http_flv_lookup_t   lk;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_flv_module);
+
+    lk.time = time;
+
+    if (conf->index) {
+
+        /* the file identity */
+
+        ngx_md5_init(&ctx);
+        ngx_md5_update(&ctx, path->data, path->len);
+        ngx_md5_update(&ctx, &of->uniq, sizeof(ngx_file_uniq_t));
+        ngx_md5_update(&ctx, &of->mtime, sizeof(time_t));
+        ngx_md5_update(&ctx, &of->size, sizeof(off_t));
+        ngx_md5_final(md5, &ctx);
+
+        /* the keyframes are searched in the shared memory */
+
+        if (ngx_http_shm_cache_get(conf->index, md5, ngx_http_flv_index_load,
+                                   &lk)
+            == NGX_OK)
+        {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "flv index hit");
+
+            goto found;
+        }
+    }
+
+    if (ngx_http_flv_index(r, path, of, conf->index != NULL, &index)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (conf->index) {
+        ngx_http_flv_index_put(conf, md5, &index, r->connection->log);
+    }
+
+    lk.rc = ngx_http_flv_search(index.keyframes, index.nkeyframes, time,
+                                &lk.start);
+    lk.header_start = index.header_start;
+    lk.header_end = index.header_end;
+
+found:
+
+    /* the first keyframe follows the header, so the whole file is sent */
+
+    if (lk.rc != NGX_OK || lk.start <= lk.header_end) {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "flv seek: %M -> %O", time, lk.start);
+
+    *start = lk.start;
+    *header_start = lk.header_start;
+    *header_end = lk.header_end;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_flv_index(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_open_file_info_t *of, ngx_uint_t scan, ngx_http_flv_index_t *index)
+{
+    u_char                 *p, *data;
+    off_t                   offset;
+    size_t                  size;
+    ssize_t                 n;
+    ngx_int_t               rc;
+    ngx_uint_t              type;
+    ngx_file_t              file;
+    ngx_http_flv_reader_t   rd;
+
+    ngx_memzero(index, sizeof(ngx_http_flv_index_t));
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.fd = of->fd;
+    file.name = *path;
+    file.log = r->connection->log;
+
+    rd.file = &file;
+    rd.size = of->size;
+    rd.start = 0;
+    rd.len = 0;
+
+    rd.buffer = ngx_palloc(r->pool, NGX_HTTP_FLV_BUFFER_SIZE);
+    if (rd.buffer == NULL) {
+        return NGX_ERROR;
+    }
+
+    rc = ngx_http_flv_read(&rd, 0, 9, &p);
+
+    if (rc != NGX_OK || ngx_strncmp(p, "FLV", 3) != 0) {
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "\"%s\" is not an flv file", path->data);
+
+        return NGX_OK;
+    }
+
+    /* the data offset and PreviousTagSize0 */
+
+    offset = ngx_flv_get_32value(p + 5) + 4;
+
+    rc = ngx_http_flv_read(&rd, offset, 11, &p);
+
+    if (rc == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (rc == NGX_OK && (p[0] & 0x1f) == NGX_FLV_TAG_SCRIPT) {
+
+        size = ngx_flv_get_24value(p + 1);
+        offset += 11;
+
+        if (size <= NGX_HTTP_FLV_BUFFER_SIZE) {
+            rc = ngx_http_flv_read(&rd, offset, size, &data);
+
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+        } else if (offset + (off_t) size <= rd.size) {
+            data = ngx_palloc(r->pool, size);
+            if (data == NULL) {
+                return NGX_ERROR;
+            }
+
+            n = ngx_read_file(&file, data, size, offset);
+
+            if (n == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            rc = ((size_t) n == size) ? NGX_OK : NGX_DECLINED;
+
+        } else {
+            rc = NGX_DECLINED;
+        }
+
+        if (rc == NGX_OK) {
+            rc = ngx_http_flv_metadata(r, &rd, data, data + size, index);
+
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if (rc == NGX_DECLINED) {
+                ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                               "flv metadata has no keyframes");
+            }
+        }
+
+        offset += size + 4;
+    }
+
+    /* the codec configuration tags */
+
+    index->header_start = offset;
+
+    for ( ;; ) {
+        rc = ngx_http_flv_read(&rd, offset, 13, &p);
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (rc == NGX_DECLINED) {
+            break;
+        }
+
+        size = ngx_flv_get_24value(p + 1);
+        type = p[0] & 0x1f;
+
+        if (size < 2 || offset + 15 + (off_t) size > rd.size || p[12] != 0) {
+            break;
+        }
+
+        /* AVC sequence header or AAC audio specific config */
+
+        if (!(type == NGX_FLV_TAG_VIDEO && (p[11] & 0x0f) == 7)
+            && !(type == NGX_FLV_TAG_AUDIO && (p[11] >> 4) == 10))
+        {
+            break;
+        }
+
+        offset += 15 + size;
+    }
+
+    index->header_end = offset;
+
+    if (index->nkeyframes || !scan) {
+        return NGX_OK;
+    }
+
+    return ngx_http_flv_scan(r, &rd, offset, index);
+}
+
+
+static ngx_int_t
+ngx_http_flv_read(ngx_http_flv_reader_t *rd, off_t offset, size_t len,
+    u_char **p)
+{
+    size_t   size;
+    ssize_t  n;
+
+    if (offset >= rd->start
+        && offset + (off_t) len <= rd->start + (off_t) rd->len)
+    {
+        *p = rd->buffer + (size_t) (offset - rd->start);
+        return NGX_OK;
+    }
+
+    if (offset < 0 || offset + (off_t) len > rd->size) {
+        return NGX_DECLINED;
+    }
+
+    size = (size_t) ngx_min(rd->size - offset, NGX_HTTP_FLV_BUFFER_SIZE);
+
+    n = ngx_read_file(rd->file, rd->buffer, size, offset);
+
+    if (n == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if ((size_t) n < len) {
+        ngx_log_error(NGX_LOG_CRIT, rd->file->log, 0,
+                      ngx_read_file_n " read only %z of %z from \"%s\"",
+                      n, size, rd->file->name.data);
+        rd->len = 0;
+        return NGX_DECLINED;
+    }
+
+    rd->start = offset;
+    rd->len = n;
+
+    *p = rd->buffer;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_flv_metadata(ngx_http_request_t *r, ngx_http_flv_reader_t *rd,
+    u_char *p, u_char *last, ngx_http_flv_index_t *index)
+{
+    u_char                   *times, *positions, *tag;
+    double                    t, pos;
+    uint64_t                  v;
+    uint32_t                  n;
+    ngx_int_t                 rc;
+    ngx_uint_t                i, check[3];
+    ngx_http_flv_keyframe_t  *kf;
+
+    if (last - p < 14 || ngx_memcmp(p, "\x02\x00\x0a" "onMetaData", 13) != 0) {
+        return NGX_DECLINED;
+    }
+
+    p += 13;
+
+    if (*p == NGX_FLV_AMF_ECMA_ARRAY && last - p >= 5) {
+        p += 5;
+
+    } else if (*p == NGX_FLV_AMF_OBJECT) {
+        p++;
+
+    } else {
+        return NGX_DECLINED;
+    }
+
+    p = ngx_http_flv_amf_find(p, last, "keyframes", 9);
+
+    if (p == NULL || *p++ != NGX_FLV_AMF_OBJECT) {
+        return NGX_DECLINED;
+    }
+
+    times = ngx_http_flv_amf_find(p, last, "times", 5);
+    positions = ngx_http_flv_amf_find(p, last, "filepositions", 13);
+
+    if (times == NULL || positions == NULL
+        || *times != NGX_FLV_AMF_STRICT_ARRAY
+        || *positions != NGX_FLV_AMF_STRICT_ARRAY
+        || last - times < 5 || last - positions < 5)
+    {
+        return NGX_DECLINED;
+    }
+
+    n = ngx_flv_get_32value(times + 1);
+
+    times += 5;
+    positions += 5;
+
+    if (n == 0
+        || n != ngx_flv_get_32value(positions - 4)
+        || (size_t) (last - times) / 9 < n
+        || (size_t) (last - positions) / 9 < n)
+    {
+        return NGX_DECLINED;
+    }
+
+    kf = ngx_palloc(r->pool, n * sizeof(ngx_http_flv_keyframe_t));
+    if (kf == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+
+        if (times[0] != NGX_FLV_AMF_NUMBER
+            || positions[0] != NGX_FLV_AMF_NUMBER)
+        {
+            return NGX_DECLINED;
+        }
+
+        v = ngx_flv_get_64value(times + 1);
+        ngx_memcpy(&t, &v, sizeof(double));
+
+        v = ngx_flv_get_64value(positions + 1);
+        ngx_memcpy(&pos, &v, sizeof(double));
+
+        /* the negated comparisons reject NaNs as well */
+
+        if (!(t >= 0 && t < 4294967) || !(pos >= 0 && pos < rd->size)) {
+            return NGX_DECLINED;
+        }
+
+        kf[i].time = (uint32_t) (t * 1000);
+        kf[i].offset = (off_t) pos;
+
+        if (i && (kf[i].time < kf[i - 1].time
+                  || kf[i].offset <= kf[i - 1].offset))
+        {
+            return NGX_DECLINED;
+        }
+
+        times += 9;
+        positions += 9;
+    }
+
+    /* encoders are known to write stale indexes, so spot check the tags */
+
+    check[0] = 0;
+    check[1] = n / 2;
+    check[2] = n - 1;
+
+    for (i = 0; i < 3; i++) {
+        rc = ngx_http_flv_read(rd, kf[check[i]].offset, 12, &tag);
+
+        if (rc != NGX_OK) {
+            return rc;
+        }
+
+        if ((tag[0] & 0x1f) != NGX_FLV_TAG_VIDEO || (tag[11] >> 4) != 1) {
+            return NGX_DECLINED;
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "flv metadata keyframes: %uD", n);
+
+    index->keyframes = kf;
+    index->nkeyframes = n;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_flv_scan(ngx_http_request_t *r, ngx_http_flv_reader_t *rd,
+    off_t offset, ngx_http_flv_index_t *index)
+{
+    u_char                   *p;
+    uint32_t                  time;
+    ngx_int_t                 rc;
+    ngx_array_t               keyframes;
+    ngx_http_flv_keyframe_t  *kf;
+
+    if (ngx_array_init(&keyframes, r->pool, 64,
+                       sizeof(ngx_http_flv_keyframe_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    kf = NULL;
+
+    for ( ;; ) {
+        rc = ngx_http_flv_read(rd, offset, 13, &p);
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (rc == NGX_DECLINED) {
+            break;
+        }
+
+        /* video keyframes except AVC sequence headers */
+
+        if ((p[0] & 0x1f) == NGX_FLV_TAG_VIDEO
+            && (p[11] >> 4) == 1
+            && ((p[11] & 0x0f) != 7 || p[12] == 1))
+        {
+            time = ngx_flv_get_24value(p + 4) + ((uint32_t) p[7] << 24);
+
+            if (kf == NULL || time >= kf->time) {
+                kf = ngx_array_push(&keyframes);
+                if (kf == NULL) {
+                    return NGX_ERROR;
+                }
+
+                kf->offset = offset;
+                kf->time = time;
+            }
+        }
+
+        offset += 15 + ngx_flv_get_24value(p + 1);
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "flv scan keyframes: %ui", keyframes.nelts);
+
+    index->keyframes = keyframes.elts;
+    index->nkeyframes = keyframes.nelts;
+
+    return NGX_OK;
+}
+
+
+static u_char *
+ngx_http_flv_amf_find(u_char *p, u_char *last, char *name, size_t len)
+{
+    size_t  n;
+
+    for ( ;; ) {
+
+        if (last - p < 3) {
+            return NULL;
+        }
+
+        n = (p[0] << 8) + p[1];
+
+        if (n == 0 && p[2] == NGX_FLV_AMF_OBJECT_END) {
+            return NULL;
+        }
+
+        p += 2;
+
+        if ((size_t) (last - p) <= n) {
+            return NULL;
+        }
+
+        if (n == len && ngx_memcmp(p, name, len) == 0) {
+            return p + n;
+        }
+
+        p = ngx_http_flv_amf_skip(p + n, last, 0);
+
+        if (p == NULL) {
+            return NULL;
+        }
+    }
+}
+
+
+static u_char *
+ngx_http_flv_amf_skip(u_char *p, u_char *last, ngx_uint_t depth)
+{
+    size_t    len;
+    uint32_t  n;
+
+    if (p >= last || depth > NGX_HTTP_FLV_AMF_DEPTH) {
+        return NULL;
+    }
+
+    switch (*p++) {
+
+    case NGX_FLV_AMF_NUMBER:
+        len = 8;
+        break;
+
+    case 0x01: /* boolean */
+        len = 1;
+        break;
+
+    case NGX_FLV_AMF_STRING:
+        if (last - p < 2) {
+            return NULL;
+        }
+
+        len = 2 + ((p[0] << 8) + p[1]);
+        break;
+
+    case 0x0c: /* long string */
+    case 0x0f: /* XML document */
+        if (last - p < 4) {
+            return NULL;
+        }
+
+        len = 4 + (size_t) ngx_flv_get_32value(p);
+        break;
+
+    case 0x05: /* null */
+    case 0x06: /* undefined */
+    case 0x0d: /* unsupported */
+        len = 0;
+        break;
+
+    case 0x07: /* reference */
+        len = 2;
+        break;
+
+    case 0x0b: /* date */
+        len = 10;
+        break;
+
+    case NGX_FLV_AMF_ECMA_ARRAY:
+        if (last - p < 4) {
+            return NULL;
+        }
+
+        return ngx_http_flv_amf_skip_object(p + 4, last, depth + 1);
+
+    case NGX_FLV_AMF_OBJECT:
+        return ngx_http_flv_amf_skip_object(p, last, depth + 1);
+
+    case 0x10: /* typed object */
+        if (last - p < 2) {
+            return NULL;
+        }
+
+        len = 2 + ((p[0] << 8) + p[1]);
+
+        if ((size_t) (last - p) < len) {
+            return NULL;
+        }
+
+        return ngx_http_flv_amf_skip_object(p + len, last, depth + 1);
+
+    case NGX_FLV_AMF_STRICT_ARRAY:
+        if (last - p < 4) {
+            return NULL;
+        }
+
+        n = ngx_flv_get_32value(p);
+        p += 4;
+
+        while (n--) {
+            p = ngx_http_flv_amf_skip(p, last, depth + 1);
+
+            if (p == NULL) {
+                return NULL;
+            }
+        }
+
+        return p;
+
+    default:
+        return NULL;
+    }
+
+    if ((size_t) (last - p) < len) {
+        return NULL;
+    }
+
+    return p + len;
+}
+
+
+static u_char *
+ngx_http_flv_amf_skip_object(u_char *p, u_char *last, ngx_uint_t depth)
+{
+    size_t  n;
+
+    for ( ;; ) {
+
+        if (last - p < 3) {
+            return NULL;
+        }
+
+        n = (p[0] << 8) + p[1];
+
+        if (n == 0 && p[2] == NGX_FLV_AMF_OBJECT_END) {
+            return p + 3;
+        }
+
+        p += 2;
+
+        if ((size_t) (last - p) < n) {
+            return NULL;
+        }
+
+        p = ngx_http_flv_amf_skip(p + n, last, depth);
+
+        if (p == NULL) {
+            return NULL;
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_http_flv_search(ngx_http_flv_keyframe_t *keyframes, ngx_uint_t n,
+    ngx_msec_t time, off_t *start)
+{
+    ngx_uint_t  left, right, middle;
+
+    if (n == 0 || keyframes[0].time > time) {
+        return NGX_DECLINED;
+    }
+
+    /* the last keyframe not later than the time */
+
+    left = 0;
+    right = n;
+
+    while (right - left > 1) {
+        middle = left + (right - left) / 2;
+
+        if (keyframes[middle].time <= time) {
+            left = middle;
+
+        } else {
+            right = middle;
+        }
+    }
+
+    *start = keyframes[left].offset;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_flv_index_load(void *data, u_char *p, size_t len)
+{
+    ngx_http_flv_lookup_t *lk = data;
+
+    ngx_http_flv_index_entry_t  *fe;
+
+    fe = (ngx_http_flv_index_entry_t *) p;
+
+    lk->rc = ngx_http_flv_search(fe->keyframes, fe->nkeyframes, lk->time,
+                                 &lk->start);
+    lk->header_start = fe->header_start;
+    lk->header_end = fe->header_end;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_flv_index_put(ngx_http_flv_conf_t *conf, u_char *md5,
+    ngx_http_flv_index_t *index, ngx_log_t *log)
+{
+    size_t  len;
+
+    /* files without keyframes are stored too to avoid rescanning them */
+
+    len = offsetof(ngx_http_flv_index_entry_t, keyframes)
+          + index->nkeyframes * sizeof(ngx_http_flv_keyframe_t);
+
+    if (ngx_http_shm_cache_put(conf->index, md5, len,
+                               ngx_http_flv_index_fill, index)
+        == NGX_OK)
+    {
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                       "flv index store: %ui", index->nkeyframes);
+    }
+}
+
+
+static void
+ngx_http_flv_index_fill(void *data, u_char *p)
+{
+    ngx_http_flv_index_t *index = data;
+
+    ngx_http_flv_index_entry_t  *fe;
+
+    fe = (ngx_http_flv_index_entry_t *) p;
+
+    fe->header_start = index->header_start;
+    fe->header_end = index->header_end;
+    fe->nkeyframes = index->nkeyframes;
+
+    ngx_memcpy(fe->keyframes, index->keyframes,
+               index->nkeyframes * sizeof(ngx_http_flv_keyframe_t));
+}
+
+
 static char *
 ngx_http_flv(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -252,3 +1151,31 @@ ngx_http_flv(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     return NGX_CONF_OK;
 }
+
+
+static void *
+ngx_http_flv_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_flv_conf_t  *conf;
+
+    conf = ngx_palloc(cf->pool, sizeof(ngx_http_flv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    conf->index = NGX_CONF_UNSET_PTR;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_flv_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_flv_conf_t *prev = parent;
+    ngx_http_flv_conf_t *conf = child;
+
+    ngx_conf_merge_ptr_value(conf->index, prev->index, NULL);
+
+    return NGX_CONF_OK;
+}
@@ -8,25 +8,28 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include <ngx_md5.h>
 
 #include <zlib.h>
 
 
 typedef struct {
-    ngx_flag_t           enable;
-    ngx_flag_t           no_buffer;
+    size_t               zin;
+    u_char               data[1];
+} ngx_http_gzip_cache_entry_t;
 
-    ngx_hash_t           types;
 
-    ngx_bufs_t           bufs;
+typedef struct {
+    ngx_flag_t           enable;
+    ngx_flag_t           no_buffer;
 
     size_t               postpone_gzipping;
     ngx_int_t            level;
     size_t               wbits;
     size_t               memlevel;
-    ssize_t              min_length;
 
-    ngx_array_t         *types_keys;
+    ngx_shm_zone_t      *cache;
+    size_t               cache_max_length;
 } ngx_http_gzip_conf_t;
 
 
@@ -44,6 +47,10 @@ typedef struct {
     ngx_buf_t           *out_buf;
     ngx_int_t            bufs;
 
+    ngx_buf_t           *cache_buf;
+
+    size_t               bound;
+
     void                *preallocated;
     char                *free_mem;
     ngx_uint_t           allocated;
@@ -57,10 +64,13 @@ typedef struct {
     unsigned             nomem:1;
     unsigned             gzheader:1;
     unsigned             buffering:1;
+    unsigned             caching:1;
 
     size_t               zin;
     size_t               zout;
 
+    u_char               md5[16];
+
     uint32_t             crc32;
     z_stream             zstream;
     ngx_http_request_t  *request;
@@ -107,6 +117,15 @@ static void ngx_http_gzip_filter_free(void *opaque, void *address);
 static void ngx_http_gzip_filter_free_copy_buf(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
 
+static ngx_int_t ngx_http_gzip_cache_get(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx);
+static ngx_int_t ngx_http_gzip_cache_load(void *data, u_char *p, size_t len);
+static void ngx_http_gzip_cache_copy(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx);
+static void ngx_http_gzip_cache_put(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx);
+static void ngx_http_gzip_cache_fill(void *data, u_char *p);
+
 static ngx_int_t ngx_http_gzip_add_variables(ngx_conf_t *cf);
 static ngx_int_t ngx_http_gzip_ratio_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
@@ -127,6 +146,9 @@ static ngx_conf_post_handler_pt  ngx_http_gzip_window_p = ngx_http_gzip_window;
 static ngx_conf_post_handler_pt  ngx_http_gzip_hash_p = ngx_http_gzip_hash;
 
 
+ngx_module_t  ngx_http_gzip_filter_module;
+
+
 static ngx_command_t  ngx_http_gzip_filter_commands[] = {
 
     { ngx_string("gzip"),
@@ -137,20 +159,6 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       offsetof(ngx_http_gzip_conf_t, enable),
       NULL },
 
-    { ngx_string("gzip_buffers"),
-      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
-      ngx_conf_set_bufs_slot,
-      NGX_HTTP_LOC_CONF_OFFSET,
-      offsetof(ngx_http_gzip_conf_t, bufs),
-      NULL },
-
-    { ngx_string("gzip_types"),
-      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
-      ngx_http_types_slot,
-      NGX_HTTP_LOC_CONF_OFFSET,
-      offsetof(ngx_http_gzip_conf_t, types_keys),
-      &ngx_http_html_default_types[0] },
-
     { ngx_string("gzip_comp_level"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_num_slot,
@@ -186,11 +194,25 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       offsetof(ngx_http_gzip_conf_t, no_buffer),
       NULL },
 
-    { ngx_string("gzip_min_length"),
+    { ngx_string("gzip_cache_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_zone,
+      0,
+      0,
+      &ngx_http_gzip_filter_module },
+
+    { ngx_string("gzip_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_set_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_gzip_conf_t, cache),
+      &ngx_http_gzip_filter_module },
+
+    { ngx_string("gzip_cache_max_length"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_size_slot,
       NGX_HTTP_LOC_CONF_OFFSET,
-      offsetof(ngx_http_gzip_conf_t, min_length),
+      offsetof(ngx_http_gzip_conf_t, cache_max_length),
       NULL },
 
       ngx_null_command
@@ -237,11 +259,13 @@ static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
 static ngx_int_t
 ngx_http_gzip_header_filter(ngx_http_request_t *r)
 {
-    ngx_table_elt_t       *h;
-    ngx_http_gzip_ctx_t   *ctx;
-    ngx_http_gzip_conf_t  *conf;
+    ngx_table_elt_t           *h;
+    ngx_http_gzip_ctx_t       *ctx;
+    ngx_http_gzip_conf_t      *conf;
+    ngx_http_core_loc_conf_t  *clcf;
 
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (!conf->enable
         || (r->headers_out.status != NGX_HTTP_OK
@@ -250,8 +274,8 @@ ngx_http_gzip_header_filter(ngx_http_request_t *r)
         || (r->headers_out.content_encoding
             && r->headers_out.content_encoding->value.len)
         || (r->headers_out.content_length_n != -1
-            && r->headers_out.content_length_n < conf->min_length)
-        || ngx_http_test_content_type(r, &conf->types) == NULL
+            && r->headers_out.content_length_n < clcf->gzip_min_length)
+        || ngx_http_test_content_type(r, &clcf->gzip_types) == NULL
         || r->header_only)
     {
         return ngx_http_next_header_filter(r);
@@ -260,15 +284,11 @@ ngx_http_gzip_header_filter(ngx_http_request_t *r)
     r->gzip_vary = 1;
 
 #if (NGX_HTTP_DEGRADATION)
-    {
-    ngx_http_core_loc_conf_t  *clcf;
-
-    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (clcf->gzip_disable_degradation && ngx_http_degraded(r)) {
         return ngx_http_next_header_filter(r);
     }
-    }
+
 #endif
 
     if (!r->gzip_tested) {
@@ -290,6 +310,17 @@ ngx_http_gzip_header_filter(ngx_http_request_t *r)
     ctx->request = r;
     ctx->buffering = (conf->postpone_gzipping != 0);
 
+    if (conf->cache
+        && (r->headers_out.content_length_n == -1
+            || r->headers_out.content_length_n
+               <= (off_t) conf->cache_max_length))
+    {
+        /* the whole response is needed to look it up in the cache */
+
+        ctx->caching = 1;
+        ctx->buffering = 1;
+    }
+
     ngx_http_gzip_filter_memory(r, ctx);
 
     h = ngx_list_push(&r->headers_out.headers);
@@ -354,11 +385,22 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
         } else {
             ctx->buffering = 0;
+            ctx->caching = 0;
         }
     }
 
-    if (ctx->preallocated == NULL) {
-        if (ngx_http_gzip_filter_deflate_start(r, ctx) != NGX_OK) {
+    if (ctx->caching) {
+        ctx->caching = 0;
+
+        switch (ngx_http_gzip_cache_get(r, ctx)) {
+
+        case NGX_OK:
+            return ngx_http_next_body_filter(r, ctx->out);
+
+        case NGX_DECLINED:
+            break;
+
+        default:  /* NGX_ERROR */
             goto failed;
         }
     }
@@ -369,6 +411,12 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         }
     }
 
+    if (ctx->preallocated == NULL) {
+        if (ngx_http_gzip_filter_deflate_start(r, ctx) != NGX_OK) {
+            goto failed;
+        }
+    }
+
     if (ctx->nomem) {
 
         /* flush busy buffers */
@@ -441,6 +489,10 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             }
         }
 
+        if (ctx->cache_buf) {
+            ngx_http_gzip_cache_copy(r, ctx);
+        }
+
         rc = ngx_http_next_body_filter(r, ctx->out);
 
         if (rc == NGX_ERROR) {
@@ -456,6 +508,10 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         ctx->nomem = 0;
 
         if (ctx->done) {
+            if (ctx->cache_buf) {
+                ngx_http_gzip_cache_put(r, ctx);
+            }
+
             return rc;
         }
     }
@@ -521,7 +577,7 @@ ngx_http_gzip_filter_memory(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
 static ngx_int_t
 ngx_http_gzip_filter_buffer(ngx_http_gzip_ctx_t *ctx, ngx_chain_t *in)
 {
-    size_t                 size, buffered;
+    size_t                 size, buffered, limit;
     ngx_buf_t             *b, *buf;
     ngx_chain_t           *cl, **ll;
     ngx_http_request_t    *r;
@@ -541,6 +597,10 @@ ngx_http_gzip_filter_buffer(ngx_http_gzip_ctx_t *ctx, ngx_chain_t *in)
 
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
 
+    limit = ctx->caching ? ngx_max(conf->cache_max_length,
+                                   conf->postpone_gzipping)
+                         : conf->postpone_gzipping;
+
     while (in) {
         cl = ngx_alloc_chain_link(r->pool);
         if (cl == NULL) {
@@ -552,8 +612,12 @@ ngx_http_gzip_filter_buffer(ngx_http_gzip_ctx_t *ctx, ngx_chain_t *in)
         size = b->last - b->pos;
         buffered += size;
 
-        if (b->flush || b->last_buf || buffered > conf->postpone_gzipping) {
+        if (b->flush || b->last_buf || buffered > limit) {
             ctx->buffering = 0;
+
+            if (!b->last_buf || buffered > conf->cache_max_length) {
+                ctx->caching = 0;
+            }
         }
 
         if (ctx->buffering && size) {
@@ -591,6 +655,8 @@ ngx_http_gzip_filter_deflate_start(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx)
 {
     int                    rc;
+    size_t                 size;
+    ngx_chain_t           *cl;
     ngx_http_gzip_conf_t  *conf;
 
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
@@ -619,6 +685,31 @@ ngx_http_gzip_filter_deflate_start(ngx_http_request_t *r,
     ctx->crc32 = crc32(0L, Z_NULL, 0);
     ctx->flush = Z_NO_FLUSH;
 
+    /*
+     * if the whole response is already here, it is compressed in one pass
+     * to a single buffer large enough for the deflate output and the trailer
+     */
+
+    size = 0;
+
+    for (cl = ctx->in; cl; cl = cl->next) {
+
+        if (cl->buf->flush || cl->buf->in_file) {
+            return NGX_OK;
+        }
+
+        size += cl->buf->last - cl->buf->pos;
+
+        if (cl->buf->last_buf) {
+            ctx->bound = deflateBound(&ctx->zstream, size) + 8;
+
+            ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "gzip whole response: %uz, bound: %uz",
+                           size, ctx->bound);
+            break;
+        }
+    }
+
     return NGX_OK;
 }
 
@@ -720,21 +811,38 @@ ngx_http_gzip_filter_add_data(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
 static ngx_int_t
 ngx_http_gzip_filter_get_buf(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
 {
-    ngx_http_gzip_conf_t  *conf;
+    ngx_http_core_loc_conf_t  *clcf;
 
     if (ctx->zstream.avail_out) {
         return NGX_OK;
     }
 
-    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+    if (ctx->bound) {
+
+        /* the buffer is not recycled as its size differs from gzip_buffers */
+
+        ctx->out_buf = ngx_create_temp_buf(r->pool, ctx->bound);
+        if (ctx->out_buf == NULL) {
+            return NGX_ERROR;
+        }
+
+        ctx->zstream.next_out = ctx->out_buf->pos;
+        ctx->zstream.avail_out = ctx->bound;
+
+        ctx->bound = 0;
+
+        return NGX_OK;
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (ctx->free) {
         ctx->out_buf = ctx->free->buf;
         ctx->free = ctx->free->next;
 
-    } else if (ctx->bufs < conf->bufs.num) {
+    } else if (ctx->bufs < clcf->gzip_bufs.num) {
 
-        ctx->out_buf = ngx_create_temp_buf(r->pool, conf->bufs.size);
+        ctx->out_buf = ngx_create_temp_buf(r->pool, clcf->gzip_bufs.size);
         if (ctx->out_buf == NULL) {
             return NGX_ERROR;
         }
@@ -749,7 +857,7 @@ ngx_http_gzip_filter_get_buf(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
     }
 
     ctx->zstream.next_out = ctx->out_buf->pos;
-    ctx->zstream.avail_out = conf->bufs.size;
+    ctx->zstream.avail_out = clcf->gzip_bufs.size;
 
     return NGX_OK;
 }
@@ -1022,6 +1130,176 @@ ngx_http_gzip_filter_free_copy_buf(ngx_http_request_t *r,
 }
 
 
+static ngx_int_t
+ngx_http_gzip_cache_get(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
+{
+    int                    n;
+    size_t                 len;
+    ngx_int_t              rc;
+    ngx_md5_t              md5;
+    ngx_chain_t           *cl;
+    ngx_http_gzip_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+    ngx_md5_init(&md5);
+
+    n = (int) conf->level;
+    ngx_md5_update(&md5, &n, sizeof(int));
+    ngx_md5_update(&md5, &ctx->wbits, sizeof(int));
+    ngx_md5_update(&md5, &ctx->memlevel, sizeof(int));
+
+    len = 0;
+
+    for (cl = ctx->in; cl; cl = cl->next) {
+        ngx_md5_update(&md5, cl->buf->pos, cl->buf->last - cl->buf->pos);
+        len += cl->buf->last - cl->buf->pos;
+    }
+
+    ngx_md5_final(ctx->md5, &md5);
+
+    rc = ngx_http_shm_cache_get(conf->cache, ctx->md5,
+                                ngx_http_gzip_cache_load, ctx);
+
+    if (rc == NGX_DECLINED) {
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "gzip cache miss: %uz", len);
+
+        /* the gzip header and trailer take 18 bytes */
+
+        ctx->cache_buf = ngx_create_temp_buf(r->pool,
+                                             compressBound(len) + 18);
+
+        return NGX_DECLINED;
+    }
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "gzip cache hit: %uz %uz", ctx->zin, ctx->zout);
+
+    for (cl = ctx->in; cl; cl = cl->next) {
+        if (cl->buf->tag == (ngx_buf_tag_t) &ngx_http_gzip_filter_module) {
+            ngx_pfree(r->pool, cl->buf->start);
+
+        } else {
+            cl->buf->pos = cl->buf->last;
+        }
+    }
+
+    ctx->in = NULL;
+
+    ctx->done = 1;
+
+    r->connection->buffered &= ~NGX_HTTP_GZIP_BUFFERED;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_cache_load(void *data, u_char *p, size_t len)
+{
+    ngx_http_gzip_ctx_t  *ctx = data;
+
+    ngx_buf_t                    *b;
+    ngx_chain_t                  *cl;
+    ngx_http_gzip_cache_entry_t  *ge;
+
+    ge = (ngx_http_gzip_cache_entry_t *) p;
+    len -= offsetof(ngx_http_gzip_cache_entry_t, data);
+
+    b = ngx_create_temp_buf(ctx->request->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->last = ngx_cpymem(b->pos, ge->data, len);
+    b->last_buf = 1;
+
+    cl = ngx_alloc_chain_link(ctx->request->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+    ctx->out = cl;
+
+    ctx->zin = ge->zin;
+    ctx->zout = len;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_gzip_cache_copy(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
+{
+    size_t        size;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    b = ctx->cache_buf;
+
+    for (cl = ctx->out; cl; cl = cl->next) {
+        size = cl->buf->last - cl->buf->pos;
+
+        if (size > (size_t) (b->end - b->last)) {
+            ngx_pfree(r->pool, b->start);
+            ctx->cache_buf = NULL;
+            return;
+        }
+
+        b->last = ngx_cpymem(b->last, cl->buf->pos, size);
+    }
+}
+
+
+static void
+ngx_http_gzip_cache_put(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
+{
+    size_t                 len;
+    ngx_int_t              rc;
+    ngx_http_gzip_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+    len = ctx->cache_buf->last - ctx->cache_buf->pos;
+
+    rc = ngx_http_shm_cache_put(conf->cache, ctx->md5,
+                                offsetof(ngx_http_gzip_cache_entry_t, data)
+                                + len,
+                                ngx_http_gzip_cache_fill, ctx);
+
+    if (rc == NGX_OK) {
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "gzip cache store: %uz %uz", ctx->zin, len);
+    }
+
+    ngx_pfree(r->pool, ctx->cache_buf->start);
+    ctx->cache_buf = NULL;
+}
+
+
+static void
+ngx_http_gzip_cache_fill(void *data, u_char *p)
+{
+    ngx_http_gzip_ctx_t  *ctx = data;
+
+    ngx_http_gzip_cache_entry_t  *ge;
+
+    ge = (ngx_http_gzip_cache_entry_t *) p;
+
+    ge->zin = ctx->zin;
+
+    ngx_memcpy(ge->data, ctx->cache_buf->pos,
+               ctx->cache_buf->last - ctx->cache_buf->pos);
+}
+
+
 static ngx_int_t
 ngx_http_gzip_add_variables(ngx_conf_t *cf)
 {
@@ -1092,13 +1370,8 @@ ngx_http_gzip_create_conf(ngx_conf_t *cf)
         return NULL;
     }
 
-    /*
-     * set by ngx_pcalloc():
-     *
-     *     conf->bufs.num = 0;
-     *     conf->types = { NULL };
-     *     conf->types_keys = NULL;
-     */
+    conf->cache = NGX_CONF_UNSET_PTR;
+    conf->cache_max_length = NGX_CONF_UNSET_SIZE;
 
     conf->enable = NGX_CONF_UNSET;
     conf->no_buffer = NGX_CONF_UNSET;
@@ -1107,7 +1380,6 @@ ngx_http_gzip_create_conf(ngx_conf_t *cf)
     conf->level = NGX_CONF_UNSET;
     conf->wbits = NGX_CONF_UNSET_SIZE;
     conf->memlevel = NGX_CONF_UNSET_SIZE;
-    conf->min_length = NGX_CONF_UNSET;
 
     return conf;
 }
@@ -1122,24 +1394,15 @@ ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->enable, prev->enable, 0);
     ngx_conf_merge_value(conf->no_buffer, prev->no_buffer, 0);
 
-    ngx_conf_merge_bufs_value(conf->bufs, prev->bufs,
-                              (128 * 1024) / ngx_pagesize, ngx_pagesize);
-
     ngx_conf_merge_size_value(conf->postpone_gzipping, prev->postpone_gzipping,
                               0);
     ngx_conf_merge_value(conf->level, prev->level, 1);
     ngx_conf_merge_size_value(conf->wbits, prev->wbits, MAX_WBITS);
     ngx_conf_merge_size_value(conf->memlevel, prev->memlevel,
                               MAX_MEM_LEVEL - 1);
-    ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
-
-    if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
-                             &prev->types_keys, &prev->types,
-                             ngx_http_html_default_types)
-        != NGX_OK)
-    {
-        return NGX_CONF_ERROR;
-    }
+    ngx_conf_merge_ptr_value(conf->cache, prev->cache, NULL);
+    ngx_conf_merge_size_value(conf->cache_max_length, prev->cache_max_length,
+                              256 * 1024);
 
     return NGX_CONF_OK;
 }
@@ -29,6 +29,7 @@ struct ngx_http_header_val_s {
     ngx_str_t                  key;
     ngx_http_set_header_pt     handler;
     ngx_uint_t                 offset;
+    ngx_uint_t                 in_block;   /* unsigned  in_block:1; */
 };
 
 
@@ -40,10 +41,16 @@ struct ngx_http_header_val_s {
 #define NGX_HTTP_EXPIRES_DAILY     5
 
 
+#define ngx_http_headers_static(hv)                                           \
+    ((hv)->handler == ngx_http_add_header && (hv)->value.lengths == NULL      \
+     && (hv)->value.value.len)
+
+
 typedef struct {
     ngx_uint_t               expires;
     time_t                   expires_time;
     ngx_array_t             *headers;
+    ngx_http_header_block_t *block;
 } ngx_http_headers_conf_t;
 
 
@@ -57,6 +64,8 @@ static ngx_int_t ngx_http_set_last_modified(ngx_http_request_t *r,
 static void *ngx_http_headers_create_conf(ngx_conf_t *cf);
 static char *ngx_http_headers_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
+static ngx_int_t ngx_http_headers_block(ngx_conf_t *cf,
+    ngx_http_headers_conf_t *conf);
 static ngx_int_t ngx_http_headers_filter_init(ngx_conf_t *cf);
 static char *ngx_http_headers_expires(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -163,9 +172,15 @@ ngx_http_headers_filter(ngx_http_request_t *r)
     }
 
     if (conf->headers) {
+        r->headers_out.header_block = conf->block;
+
         h = conf->headers->elts;
         for (i = 0; i < conf->headers->nelts; i++) {
 
+            if (h[i].in_block) {
+                continue;
+            }
+
             if (ngx_http_complex_value(r, &h[i].value, &value) != NGX_OK) {
                 return NGX_ERROR;
             }
@@ -417,6 +432,7 @@ ngx_http_headers_create_conf(ngx_conf_t *cf)
      * set by ngx_pcalloc():
      *
      *     conf->headers = NULL;
+     *     conf->block = NULL;
      *     conf->expires_time = 0;
      */
 
@@ -443,12 +459,123 @@ ngx_http_headers_merge_conf(ngx_conf_t *cf, void *parent, void *child)
 
     if (conf->headers == NULL) {
         conf->headers = prev->headers;
+
+        if (conf->headers && prev->block == NULL) {
+            if (ngx_http_headers_block(cf, prev) != NGX_OK) {
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        conf->block = prev->block;
+
+    } else {
+        if (ngx_http_headers_block(cf, conf) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
     }
 
     return NGX_CONF_OK;
 }
 
 
+/*
+ * the headers without variables are serialized once, they are sent
+ * after all other headers, so a header name that also has a value with
+ * variables or a special handler leaves the location without the block
+ */
+
+static ngx_int_t
+ngx_http_headers_block(ngx_conf_t *cf, ngx_http_headers_conf_t *conf)
+{
+    u_char                   *p;
+    size_t                    len;
+    ngx_uint_t                i, j, n;
+    ngx_table_elt_t          *elt;
+    ngx_http_header_val_t    *h;
+    ngx_http_header_block_t  *block;
+
+    h = conf->headers->elts;
+
+    n = 0;
+    len = 0;
+
+    for (i = 0; i < conf->headers->nelts; i++) {
+
+        if (!ngx_http_headers_static(&h[i])) {
+            continue;
+        }
+
+        for (j = 0; j < conf->headers->nelts; j++) {
+
+            if (!ngx_http_headers_static(&h[j])
+                && h[j].key.len == h[i].key.len
+                && ngx_strncasecmp(h[j].key.data, h[i].key.data,
+                                   h[i].key.len)
+                   == 0)
+            {
+                return NGX_OK;
+            }
+        }
+
+        n++;
+        len += h[i].key.len + sizeof(": ") - 1 + h[i].value.value.len
+               + sizeof(CRLF) - 1;
+    }
+
+    if (n == 0) {
+        return NGX_OK;
+    }
+
+    block = ngx_palloc(cf->pool, sizeof(ngx_http_header_block_t));
+    if (block == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = ngx_pnalloc(cf->pool, len);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    elt = ngx_pcalloc(cf->pool, n * sizeof(ngx_table_elt_t));
+    if (elt == NULL) {
+        return NGX_ERROR;
+    }
+
+    block->text.len = len;
+    block->text.data = p;
+
+    block->part.elts = elt;
+    block->part.nelts = n;
+    block->part.next = NULL;
+
+    for (i = 0; i < conf->headers->nelts; i++) {
+
+        if (!ngx_http_headers_static(&h[i])) {
+            continue;
+        }
+
+        elt->hash = h[i].hash;
+
+        elt->key.len = h[i].key.len;
+        elt->key.data = p;
+        p = ngx_cpymem(p, h[i].key.data, h[i].key.len);
+        *p++ = ':'; *p++ = ' ';
+
+        elt->value.len = h[i].value.value.len;
+        elt->value.data = p;
+        p = ngx_cpymem(p, h[i].value.value.data, h[i].value.value.len);
+        *p++ = CR; *p++ = LF;
+
+        h[i].in_block = 1;
+        elt++;
+    }
+
+    conf->block = block;
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_headers_filter_init(ngx_conf_t *cf)
 {
@@ -584,6 +711,7 @@ ngx_http_headers_add(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     hv->key = value[1];
     hv->handler = ngx_http_add_header;
     hv->offset = 0;
+    hv->in_block = 0;
 
     set = ngx_http_set_headers;
     for (i = 0; set[i].name.len; i++) {
@@ -8,9 +8,15 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include <ngx_md5.h>
 
 #include <gd.h>
 
+#if (NGX_HAVE_LIBJPEG)
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
 
 #define NGX_HTTP_IMAGE_OFF       0
 #define NGX_HTTP_IMAGE_TEST      1
@@ -25,6 +31,7 @@
 #define NGX_HTTP_IMAGE_PROCESS   2
 #define NGX_HTTP_IMAGE_PASS      3
 #define NGX_HTTP_IMAGE_DONE      4
+#define NGX_HTTP_IMAGE_CACHED    5
 
 
 #define NGX_HTTP_IMAGE_NONE      0
@@ -36,6 +43,12 @@
 #define NGX_HTTP_IMAGE_BUFFERED  0x08
 
 
+typedef struct {
+    ngx_uint_t                   type;
+    u_char                       data[1];
+} ngx_http_image_cache_entry_t;
+
+
 typedef struct {
     ngx_uint_t                   filter;
     ngx_uint_t                   width;
@@ -53,6 +66,8 @@ typedef struct {
     ngx_http_complex_value_t    *shcv;
 
     size_t                       buffer_size;
+
+    ngx_shm_zone_t              *cache;
 } ngx_http_image_filter_conf_t;
 
 
@@ -71,9 +86,25 @@ typedef struct {
     ngx_uint_t                   phase;
     ngx_uint_t                   type;
     ngx_uint_t                   force;
+    ngx_uint_t                   shrink;
+
+    ngx_uint_t                   caching;
+    u_char                       md5[16];
+    ngx_buf_t                   *cached;
 } ngx_http_image_filter_ctx_t;
 
 
+#if (NGX_HAVE_LIBJPEG)
+
+typedef struct {
+    struct jpeg_error_mgr        pub;
+    jmp_buf                      jmp;
+    ngx_log_t                   *log;
+} ngx_http_image_jpeg_error_t;
+
+#endif
+
+
 static ngx_int_t ngx_http_image_send(ngx_http_request_t *r,
     ngx_http_image_filter_ctx_t *ctx, ngx_chain_t *in);
 static ngx_uint_t ngx_http_image_test(ngx_http_request_t *r, ngx_chain_t *in);
@@ -91,6 +122,14 @@ static ngx_buf_t *ngx_http_image_resize(ngx_http_request_t *r,
     ngx_http_image_filter_ctx_t *ctx);
 static gdImagePtr ngx_http_image_source(ngx_http_request_t *r,
     ngx_http_image_filter_ctx_t *ctx);
+#if (NGX_HAVE_LIBJPEG)
+static ngx_uint_t ngx_http_image_shrink(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx);
+static gdImagePtr ngx_http_image_jpeg_source(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx);
+static void ngx_http_image_jpeg_error_exit(j_common_ptr cinfo);
+static void ngx_http_image_jpeg_output_message(j_common_ptr cinfo);
+#endif
 static gdImagePtr ngx_http_image_new(ngx_http_request_t *r, int w, int h,
     int colors);
 static u_char *ngx_http_image_out(ngx_http_request_t *r, ngx_uint_t type,
@@ -100,6 +139,13 @@ static ngx_uint_t ngx_http_image_filter_get_value(ngx_http_request_t *r,
     ngx_http_complex_value_t *cv, ngx_uint_t v);
 static ngx_uint_t ngx_http_image_filter_value(ngx_str_t *value);
 
+static ngx_int_t ngx_http_image_cache_get(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx, ngx_http_image_filter_conf_t *conf);
+static ngx_int_t ngx_http_image_cache_load(void *data, u_char *p, size_t len);
+static void ngx_http_image_cache_put(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx, ngx_buf_t *b);
+static void ngx_http_image_cache_fill(void *data, u_char *p);
+
 
 static void *ngx_http_image_filter_create_conf(ngx_conf_t *cf);
 static char *ngx_http_image_filter_merge_conf(ngx_conf_t *cf, void *parent,
@@ -113,6 +159,9 @@ static char *ngx_http_image_filter_sharpen(ngx_conf_t *cf, ngx_command_t *cmd,
 static ngx_int_t ngx_http_image_filter_init(ngx_conf_t *cf);
 
 
+ngx_module_t  ngx_http_image_filter_module;
+
+
 static ngx_command_t  ngx_http_image_filter_commands[] = {
 
     { ngx_string("image_filter"),
@@ -150,6 +199,20 @@ static ngx_command_t  ngx_http_image_filter_commands[] = {
       offsetof(ngx_http_image_filter_conf_t, buffer_size),
       NULL },
 
+    { ngx_string("image_filter_cache_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_zone,
+      0,
+      0,
+      &ngx_http_image_filter_module },
+
+    { ngx_string("image_filter_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_set_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_image_filter_conf_t, cache),
+      &ngx_http_image_filter_module },
+
       ngx_null_command
 };
 
@@ -260,9 +323,25 @@ ngx_http_image_header_filter(ngx_http_request_t *r)
         r->headers_out.refresh->hash = 0;
     }
 
-    r->main_filter_need_in_memory = 1;
     r->allow_ranges = 0;
 
+    if (conf->cache) {
+        switch (ngx_http_image_cache_get(r, ctx, conf)) {
+
+        case NGX_OK:
+            /* the body is not read at all */
+            return NGX_OK;
+
+        case NGX_ERROR:
+            return NGX_ERROR;
+
+        default: /* NGX_DECLINED */
+            break;
+        }
+    }
+
+    r->main_filter_need_in_memory = 1;
+
     return NGX_OK;
 }
 
@@ -272,7 +351,7 @@ ngx_http_image_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
     ngx_int_t                      rc;
     ngx_str_t                     *ct;
-    ngx_chain_t                    out;
+    ngx_chain_t                    out, *cl;
     ngx_http_image_filter_ctx_t   *ctx;
     ngx_http_image_filter_conf_t  *conf;
 
@@ -366,6 +445,27 @@ ngx_http_image_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
         return ngx_http_next_body_filter(r, in);
 
+    case NGX_HTTP_IMAGE_CACHED:
+
+        for (cl = in; cl; cl = cl->next) {
+            if (cl->buf->in_file) {
+                cl->buf->file_pos = cl->buf->file_last;
+            }
+
+            cl->buf->pos = cl->buf->last;
+        }
+
+        if (ctx->cached == NULL) {
+            return ngx_http_next_body_filter(r, NULL);
+        }
+
+        out.buf = ctx->cached;
+        out.next = NULL;
+
+        ctx->cached = NULL;
+
+        return ngx_http_image_send(r, ctx, &out);
+
     default: /* NGX_HTTP_IMAGE_DONE */
 
         rc = ngx_http_next_body_filter(r, NULL);
@@ -745,6 +845,14 @@ ngx_http_image_resize(ngx_http_request_t *r, ngx_http_image_filter_ctx_t *ctx)
     ngx_pool_cleanup_t            *cln;
     ngx_http_image_filter_conf_t  *conf;
 
+#if (NGX_HAVE_LIBJPEG)
+
+    if (ctx->type == NGX_HTTP_IMAGE_JPEG) {
+        ctx->shrink = ngx_http_image_shrink(r, ctx);
+    }
+
+#endif
+
     src = ngx_http_image_source(r, ctx);
 
     if (src == NULL) {
@@ -758,6 +866,7 @@ ngx_http_image_resize(ngx_http_request_t *r, ngx_http_image_filter_ctx_t *ctx)
 
     if (!ctx->force
         && ctx->angle == 0
+        && ctx->shrink < 2
         && (ngx_uint_t) sx <= ctx->max_width
         && (ngx_uint_t) sy <= ctx->max_height)
     {
@@ -790,8 +899,17 @@ transparent:
 
     gdImageColorTransparent(src, -1);
 
-    dx = sx;
-    dy = sy;
+    if (ctx->shrink > 1) {
+
+        /* the sizes are calculated as if the image was decoded in full */
+
+        dx = ctx->width;
+        dy = ctx->height;
+
+    } else {
+        dx = sx;
+        dy = sy;
+    }
 
     if (conf->filter == NGX_HTTP_IMAGE_RESIZE) {
 
@@ -997,6 +1115,10 @@ transparent:
     b->memory = 1;
     b->last_buf = 1;
 
+    if (ctx->caching) {
+        ngx_http_image_cache_put(r, ctx, b);
+    }
+
     ngx_http_image_length(r, b);
 
     return b;
@@ -1014,6 +1136,23 @@ ngx_http_image_source(ngx_http_request_t *r, ngx_http_image_filter_ctx_t *ctx)
     switch (ctx->type) {
 
     case NGX_HTTP_IMAGE_JPEG:
+
+#if (NGX_HAVE_LIBJPEG)
+
+        if (ctx->shrink > 1) {
+            img = ngx_http_image_jpeg_source(r, ctx);
+
+            if (img) {
+                return img;
+            }
+
+            /* let GD try the image in full size */
+
+            ctx->shrink = 1;
+        }
+
+#endif
+
         img = gdImageCreateFromJpegPtr(ctx->length, ctx->image);
         failed = "gdImageCreateFromJpegPtr() failed";
         break;
@@ -1041,6 +1180,207 @@ ngx_http_image_source(ngx_http_request_t *r, ngx_http_image_filter_ctx_t *ctx)
 }
 
 
+#if (NGX_HAVE_LIBJPEG)
+
+static ngx_uint_t
+ngx_http_image_shrink(ngx_http_request_t *r, ngx_http_image_filter_ctx_t *ctx)
+{
+    ngx_uint_t                     sx, sy, dx, dy, shrink;
+    ngx_http_image_filter_conf_t  *conf;
+
+    /*
+     * JPEG may be decoded at 1/2, 1/4 or 1/8 of its size in the DCT domain,
+     * the largest reduction is chosen that still keeps the decoded image
+     * not smaller than the resized one
+     */
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_image_filter_module);
+
+    sx = ctx->width;
+    sy = ctx->height;
+
+    if (conf->filter == NGX_HTTP_IMAGE_ROTATE || sx == 0 || sy == 0) {
+        return 1;
+    }
+
+    dx = sx;
+    dy = sy;
+
+    if (conf->filter == NGX_HTTP_IMAGE_RESIZE) {
+
+        if (dx > ctx->max_width) {
+            dy = dy * ctx->max_width / dx;
+            dx = ctx->max_width;
+        }
+
+        if (dy > ctx->max_height) {
+            dx = dx * ctx->max_height / dy;
+            dy = ctx->max_height;
+        }
+
+    } else { /* NGX_HTTP_IMAGE_CROP */
+
+        if (dx * 100 / dy < ctx->max_width * 100 / ctx->max_height) {
+            if (dx > ctx->max_width) {
+                dy = dy * ctx->max_width / dx;
+                dx = ctx->max_width;
+            }
+
+        } else {
+            if (dy > ctx->max_height) {
+                dx = dx * ctx->max_height / dy;
+                dy = ctx->max_height;
+            }
+        }
+    }
+
+    for (shrink = 8; shrink > 1; shrink /= 2) {
+        if ((sx + shrink - 1) / shrink >= dx
+            && (sy + shrink - 1) / shrink >= dy)
+        {
+            break;
+        }
+    }
+
+    ngx_log_debug5(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "image shrink: %ui x %ui to %ui x %ui by %ui",
+                   sx, sy, dx, dy, shrink);
+
+    return shrink;
+}
+
+
+static gdImagePtr
+ngx_http_image_jpeg_source(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx)
+{
+    int                            *tp;
+    JSAMPROW                        p;
+    JDIMENSION                      x;
+    JSAMPARRAY                      row;
+    gdImagePtr volatile             img;
+    ngx_http_image_jpeg_error_t     jerr;
+    struct jpeg_decompress_struct   cinfo;
+
+    img = NULL;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+
+    jerr.pub.error_exit = ngx_http_image_jpeg_error_exit;
+    jerr.pub.output_message = ngx_http_image_jpeg_output_message;
+    jerr.log = r->connection->log;
+
+    if (setjmp(jerr.jmp)) {
+        if (img) {
+            gdImageDestroy(img);
+        }
+
+        jpeg_destroy_decompress(&cinfo);
+
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+
+    jpeg_mem_src(&cinfo, ctx->image, ctx->last - ctx->image);
+
+    (void) jpeg_read_header(&cinfo, TRUE);
+
+    /* CMYK and others are left to GD */
+
+    if (cinfo.jpeg_color_space != JCS_YCbCr
+        && cinfo.jpeg_color_space != JCS_GRAYSCALE)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+
+    cinfo.out_color_space = (cinfo.jpeg_color_space == JCS_GRAYSCALE)
+                            ? JCS_GRAYSCALE : JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = ctx->shrink;
+
+    (void) jpeg_start_decompress(&cinfo);
+
+    img = gdImageCreateTrueColor(cinfo.output_width, cinfo.output_height);
+    if (img == NULL) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "gdImageCreateTrueColor() failed");
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+
+    row = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE,
+                                     cinfo.output_width
+                                     * cinfo.output_components, 1);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+
+        tp = img->tpixels[cinfo.output_scanline];
+
+        (void) jpeg_read_scanlines(&cinfo, row, 1);
+
+        p = row[0];
+
+        if (cinfo.output_components == 1) {
+            for (x = 0; x < cinfo.output_width; x++) {
+                tp[x] = gdTrueColor(p[x], p[x], p[x]);
+            }
+
+        } else {
+            for (x = 0; x < cinfo.output_width; x++) {
+                tp[x] = gdTrueColor(p[0], p[1], p[2]);
+                p += 3;
+            }
+        }
+    }
+
+    (void) jpeg_finish_decompress(&cinfo);
+
+    jpeg_destroy_decompress(&cinfo);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "image jpeg decoded: %d x %d",
+                   gdImageSX(img), gdImageSY(img));
+
+    return img;
+}
+
+
+static void
+ngx_http_image_jpeg_error_exit(j_common_ptr cinfo)
+{
+    char                          buf[JMSG_LENGTH_MAX];
+    ngx_http_image_jpeg_error_t  *jerr;
+
+    jerr = (ngx_http_image_jpeg_error_t *) cinfo->err;
+
+    (*cinfo->err->format_message)(cinfo, buf);
+
+    ngx_log_error(NGX_LOG_ERR, jerr->log, 0, "libjpeg error: %s", buf);
+
+    longjmp(jerr->jmp, 1);
+}
+
+
+static void
+ngx_http_image_jpeg_output_message(j_common_ptr cinfo)
+{
+#if (NGX_DEBUG)
+    char                          buf[JMSG_LENGTH_MAX];
+    ngx_http_image_jpeg_error_t  *jerr;
+
+    jerr = (ngx_http_image_jpeg_error_t *) cinfo->err;
+
+    (*cinfo->err->format_message)(cinfo, buf);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, jerr->log, 0, "libjpeg: %s", buf);
+#endif
+}
+
+#endif
+
+
 static gdImagePtr
 ngx_http_image_new(ngx_http_request_t *r, int w, int h, int colors)
 {
@@ -1161,6 +1501,216 @@ ngx_http_image_filter_value(ngx_str_t *value)
 }
 
 
+static ngx_int_t
+ngx_http_image_cache_get(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx, ngx_http_image_filter_conf_t *conf)
+{
+    u_char                    *last;
+    size_t                     root;
+    ngx_int_t                  rc;
+    ngx_str_t                 *ct, path;
+    ngx_uint_t                 v[7];
+    ngx_md5_t                  md5;
+    ngx_open_file_info_t       of;
+    ngx_http_core_srv_conf_t  *cscf;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (conf->filter != NGX_HTTP_IMAGE_RESIZE
+        && conf->filter != NGX_HTTP_IMAGE_CROP
+        && conf->filter != NGX_HTTP_IMAGE_ROTATE)
+    {
+        return NGX_DECLINED;
+    }
+
+    /*
+     * the source is identified by its file or, if proxied, by its
+     * virtual host and full URI, and by the validators; the variant
+     * is identified by the transform parameters
+     */
+
+    if (r->headers_out.etag == NULL
+        && r->headers_out.last_modified_time == -1)
+    {
+        return NGX_DECLINED;
+    }
+
+    v[0] = conf->filter;
+    v[1] = ngx_http_image_filter_get_value(r, conf->wcv, conf->width);
+    v[2] = ngx_http_image_filter_get_value(r, conf->hcv, conf->height);
+    v[3] = ngx_http_image_filter_get_value(r, conf->acv, conf->angle);
+    v[4] = ngx_http_image_filter_get_value(r, conf->jqcv, conf->jpeg_quality);
+    v[5] = ngx_http_image_filter_get_value(r, conf->shcv, conf->sharpen);
+    v[6] = conf->transparency;
+
+    ngx_md5_init(&md5);
+
+    ngx_md5_update(&md5, v, sizeof(v));
+
+    if (r->upstream) {
+        cscf = ngx_http_get_module_srv_conf(r, ngx_http_core_module);
+
+        ngx_md5_update(&md5, cscf->server_name.data, cscf->server_name.len);
+        ngx_md5_update(&md5, "/", 1);
+        ngx_md5_update(&md5, r->headers_in.server.data,
+                       r->headers_in.server.len);
+        ngx_md5_update(&md5, r->uri.data, r->uri.len);
+        ngx_md5_update(&md5, "?", 1);
+        ngx_md5_update(&md5, r->args.data, r->args.len);
+
+    } else {
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+        last = ngx_http_map_uri_to_path(r, &path, &root, 0);
+        if (last == NULL) {
+            return NGX_ERROR;
+        }
+
+        path.len = last - path.data;
+
+        ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+
+        of.test_only = 1;
+        of.valid = clcf->open_file_cache_valid;
+        of.min_uses = clcf->open_file_cache_min_uses;
+        of.errors = clcf->open_file_cache_errors;
+        of.events = clcf->open_file_cache_events;
+
+        /* the response must come from the file that is mapped */
+
+        if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
+            != NGX_OK
+            || !of.is_file
+            || of.mtime != r->headers_out.last_modified_time
+            || of.size != r->headers_out.content_length_n)
+        {
+            return NGX_DECLINED;
+        }
+
+        ngx_md5_update(&md5, path.data, path.len);
+        ngx_md5_update(&md5, &of.uniq, sizeof(ngx_file_uniq_t));
+    }
+
+    ngx_md5_update(&md5, &r->headers_out.last_modified_time, sizeof(time_t));
+    ngx_md5_update(&md5, &r->headers_out.content_length_n, sizeof(off_t));
+
+    if (r->headers_out.etag) {
+        ngx_md5_update(&md5, r->headers_out.etag->value.data,
+                       r->headers_out.etag->value.len);
+    }
+
+    ngx_md5_final(ctx->md5, &md5);
+
+    rc = ngx_http_shm_cache_get(conf->cache, ctx->md5,
+                                ngx_http_image_cache_load, r);
+
+    if (rc == NGX_DECLINED) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "image cache miss");
+
+        ctx->caching = 1;
+
+        return NGX_DECLINED;
+    }
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "image cache hit: %uz",
+                   ctx->cached->last - ctx->cached->pos);
+
+    ct = &ngx_http_image_types[ctx->type - 1];
+    r->headers_out.content_type_len = ct->len;
+    r->headers_out.content_type = *ct;
+    r->headers_out.content_type_lowcase = NULL;
+
+    ngx_http_image_length(r, ctx->cached);
+
+    ctx->phase = NGX_HTTP_IMAGE_CACHED;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_image_cache_load(void *data, u_char *p, size_t len)
+{
+    ngx_http_request_t *r = data;
+
+    ngx_buf_t                     *b;
+    ngx_http_image_filter_ctx_t   *ctx;
+    ngx_http_image_cache_entry_t  *ie;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_image_filter_module);
+
+    ie = (ngx_http_image_cache_entry_t *) p;
+    len -= offsetof(ngx_http_image_cache_entry_t, data);
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->last = ngx_cpymem(b->pos, ie->data, len);
+    b->last_buf = 1;
+
+    ctx->type = ie->type;
+    ctx->cached = b;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_image_cache_put(ngx_http_request_t *r,
+    ngx_http_image_filter_ctx_t *ctx, ngx_buf_t *b)
+{
+    size_t                         len;
+    ngx_int_t                      rc;
+    ngx_http_image_filter_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_image_filter_module);
+
+    len = b->last - b->pos;
+
+    /* the fill handler copies the buffer from ctx->cached */
+
+    ctx->cached = b;
+
+    rc = ngx_http_shm_cache_put(conf->cache, ctx->md5,
+                                offsetof(ngx_http_image_cache_entry_t, data)
+                                + len,
+                                ngx_http_image_cache_fill, r);
+
+    ctx->cached = NULL;
+
+    if (rc == NGX_OK) {
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "image cache store: %uz", len);
+    }
+}
+
+
+static void
+ngx_http_image_cache_fill(void *data, u_char *p)
+{
+    ngx_http_request_t *r = data;
+
+    ngx_http_image_filter_ctx_t   *ctx;
+    ngx_http_image_cache_entry_t  *ie;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_image_filter_module);
+
+    ie = (ngx_http_image_cache_entry_t *) p;
+
+    ie->type = ctx->type;
+
+    ngx_memcpy(ie->data, ctx->cached->pos,
+               ctx->cached->last - ctx->cached->pos);
+}
+
+
 static void *
 ngx_http_image_filter_create_conf(ngx_conf_t *cf)
 {
@@ -1177,6 +1727,7 @@ ngx_http_image_filter_create_conf(ngx_conf_t *cf)
     conf->angle = NGX_CONF_UNSET_UINT;
     conf->transparency = NGX_CONF_UNSET;
     conf->buffer_size = NGX_CONF_UNSET_SIZE;
+    conf->cache = NGX_CONF_UNSET_PTR;
 
     return conf;
 }
@@ -1225,6 +1776,8 @@ ngx_http_image_filter_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_size_value(conf->buffer_size, prev->buffer_size,
                               1 * 1024 * 1024);
 
+    ngx_conf_merge_ptr_value(conf->cache, prev->cache, NULL);
+
     return NGX_CONF_OK;
 }
 
@@ -576,6 +576,10 @@ ngx_http_limit_req_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     conf->delay_log_level = (conf->limit_log_level == NGX_LOG_INFO) ?
                                 NGX_LOG_INFO : conf->limit_log_level + 1;
 
+    if (conf->shm_zone == NULL) {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_PREACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -423,6 +423,10 @@ ngx_http_limit_zone_merge_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_uint_value(conf->log_level, prev->log_level, NGX_LOG_ERR);
 
+    if (conf->shm_zone == NULL) {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_PREACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
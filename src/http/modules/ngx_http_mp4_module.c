@@ -7,6 +7,7 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include <ngx_md5.h>
 
 
 #define NGX_HTTP_MP4_TRAK_ATOM     0
@@ -39,12 +40,69 @@
 #define NGX_HTTP_MP4_LAST_ATOM    NGX_HTTP_MP4_CO64_DATA
 
 
+#define NGX_HTTP_MP4_HLS_PLAYLIST  1
+#define NGX_HTTP_MP4_HLS_INIT      2
+#define NGX_HTTP_MP4_HLS_SEGMENT   3
+
+#define NGX_HTTP_MP4_NO_SAMPLE     0xffffffff
+
+
 typedef struct {
     size_t                buffer_size;
     size_t                max_buffer_size;
+    ngx_shm_zone_t       *cache;
+    ngx_flag_t            hls;
+    ngx_msec_t            hls_fragment;
 } ngx_http_mp4_conf_t;
 
 
+/* a cached file is followed by its ftyp and moov atoms and trak indexes */
+
+typedef struct {
+    off_t                 moov_offset;
+    off_t                 mdat_offset;
+    off_t                 mdat_end;
+    size_t                ftyp_size;
+    size_t                moov_size;
+    ngx_uint_t            traks;
+    ngx_uint_t            moov_first;
+    u_char                data[1];
+} ngx_http_mp4_cache_entry_t;
+
+
+/*
+ * a cached trak index is followed by stts_entries + 1 stts index entries
+ * and by numbers of samples preceding each ctts and stsc entry
+ */
+
+typedef struct {
+    uint32_t              timescale;
+    uint32_t              stts_entries;
+    uint32_t              ctts_entries;
+    uint32_t              stsc_entries;
+} ngx_http_mp4_cache_trak_t;
+
+
+typedef struct {
+    uint64_t              time;
+    uint32_t              sample;
+    uint32_t              duration;
+} ngx_http_mp4_cache_stts_t;
+
+
+/* sample table entries to start searching from, found in the cache index */
+
+typedef struct {
+    ngx_uint_t            stts_entry;
+    uint64_t              stts_time;
+    uint32_t              stts_samples;
+    ngx_uint_t            ctts_entry;
+    uint32_t              ctts_samples;
+    ngx_uint_t            stsc_entry;
+    uint32_t              stsc_samples;
+} ngx_http_mp4_hint_t;
+
+
 typedef struct {
     u_char                chunk[4];
     u_char                samples[4];
@@ -67,6 +125,8 @@ typedef struct {
     uint64_t              chunk_samples_size;
     off_t                 start_offset;
 
+    ngx_http_mp4_hint_t  *hint;
+
     size_t                tkhd_size;
     size_t                mdhd_size;
     size_t                hdlr_size;
@@ -108,6 +168,59 @@ typedef struct {
 } ngx_http_mp4_trak_t;
 
 
+/* sample table cursors used to cut HLS fragments */
+
+typedef struct {
+    u_char               *entry;
+    u_char               *end;
+    uint32_t              sample;
+    uint64_t              time;
+} ngx_http_mp4_hls_stts_t;
+
+
+typedef struct {
+    ngx_http_mp4_trak_t  *trak;
+    uint32_t              samples;
+    uint32_t              sample_size;
+    uint32_t              start;
+    uint32_t              end;
+
+    uint32_t              sample;
+    uint64_t              time;
+    off_t                 offset;
+
+    u_char               *stts;
+    u_char               *stts_end;
+    uint32_t              stts_left;
+
+    u_char               *ctts;
+    u_char               *ctts_end;
+    uint32_t              ctts_left;
+
+    u_char               *stsc;
+    u_char               *stsc_end;
+    uint32_t              chunk;
+    uint32_t              next_chunk;
+    uint32_t              chunk_left;
+
+    u_char               *stss;
+    u_char               *stss_end;
+} ngx_http_mp4_hls_track_t;
+
+
+typedef struct {
+    u_char               *data_offset;
+    off_t                 pos;
+    off_t                 last;
+} ngx_http_mp4_hls_run_t;
+
+
+typedef struct {
+    uint64_t              number;
+    uint64_t              time;
+} ngx_http_mp4_hls_segment_t;
+
+
 typedef struct {
     ngx_file_t            file;
 
@@ -144,6 +257,18 @@ typedef struct {
 
     u_char                moov_atom_header[8];
     u_char                mdat_atom_header[16];
+
+    u_char                md5[16];
+    ngx_uint_t            caching;
+    u_char               *cache_moov;
+    off_t                 cache_moov_offset;
+    size_t                cache_moov_size;
+    ngx_uint_t            cache_moov_first;
+    ngx_http_mp4_hint_t  *hints;
+    ngx_uint_t            nhints;
+
+    ngx_uint_t            hls;
+    ngx_uint_t            segment;
 } ngx_http_mp4_file_t;
 
 
@@ -201,7 +326,10 @@ typedef struct {
     &((ngx_http_mp4_trak_t *) mp4->trak.elts)[mp4->trak.nelts - 1]
 
 
+static ngx_uint_t ngx_http_mp4_hls_uri(ngx_http_request_t *r,
+    ngx_str_t *path, ngx_uint_t *segment);
 static ngx_int_t ngx_http_mp4_process(ngx_http_mp4_file_t *mp4);
+static ngx_int_t ngx_http_mp4_parse(ngx_http_mp4_file_t *mp4);
 static ngx_int_t ngx_http_mp4_read_atom(ngx_http_mp4_file_t *mp4,
     ngx_http_mp4_atom_handler_t *atom, uint64_t atom_data_size);
 static ngx_int_t ngx_http_mp4_read(ngx_http_mp4_file_t *mp4);
@@ -279,10 +407,53 @@ static ngx_int_t ngx_http_mp4_update_co64_atom(ngx_http_mp4_file_t *mp4,
     ngx_http_mp4_trak_t *trak);
 static void ngx_http_mp4_adjust_co64_atom(ngx_http_mp4_file_t *mp4,
     ngx_http_mp4_trak_t *trak, off_t adjustment);
+static ngx_int_t ngx_http_mp4_hls_process(ngx_http_mp4_file_t *mp4);
+static ngx_int_t ngx_http_mp4_hls_playlist(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_trak_t *trak, uint64_t fragment);
+static ngx_int_t ngx_http_mp4_hls_init(ngx_http_mp4_file_t *mp4);
+static ngx_int_t ngx_http_mp4_hls_segment(ngx_http_mp4_file_t *mp4,
+    ngx_uint_t ref, uint64_t fragment);
+static int ngx_libc_cdecl ngx_http_mp4_hls_run_cmp(const void *one,
+    const void *two);
+static ngx_int_t ngx_http_mp4_hls_check_trak(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_trak_t *trak);
+static void ngx_http_mp4_hls_stts_init(ngx_http_mp4_trak_t *trak,
+    ngx_http_mp4_hls_stts_t *stts);
+static uint64_t ngx_http_mp4_hls_sample_time(ngx_http_mp4_hls_stts_t *stts,
+    uint32_t sample);
+static uint32_t ngx_http_mp4_hls_time_sample(ngx_http_mp4_hls_stts_t *stts,
+    uint64_t time);
+static ngx_int_t ngx_http_mp4_hls_seek(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_hls_track_t *t, uint32_t sample);
+static ngx_int_t ngx_http_mp4_hls_next(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_hls_track_t *t);
+static uint32_t ngx_http_mp4_hls_sample_size(ngx_http_mp4_hls_track_t *t,
+    uint32_t sample);
+static uint32_t ngx_http_mp4_hls_sync_sample(ngx_http_mp4_trak_t *trak,
+    uint32_t sample, uint32_t *prev);
+static ngx_uint_t ngx_http_mp4_hls_stss_search(ngx_http_mp4_trak_t *trak,
+    uint32_t sample);
+static uint32_t ngx_http_mp4_hls_track_id(ngx_http_mp4_trak_t *trak);
+static off_t ngx_http_mp4_hls_chunk_offset(ngx_http_mp4_trak_t *trak,
+    uint32_t chunk);
+static ngx_int_t ngx_http_mp4_cache_get(ngx_http_mp4_file_t *mp4);
+static ngx_int_t ngx_http_mp4_cache_copy(void *data, u_char *p, size_t len);
+static void ngx_http_mp4_cache_hint(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_cache_trak_t *ct, ngx_http_mp4_hint_t *hint);
+static ngx_uint_t ngx_http_mp4_cache_search(uint32_t *samples, ngx_uint_t n,
+    uint32_t sample);
+static size_t ngx_http_mp4_cache_trak_size(ngx_http_mp4_cache_trak_t *ct,
+    ngx_http_mp4_trak_t *trak);
+static void ngx_http_mp4_cache_put(ngx_http_mp4_file_t *mp4);
+static void ngx_http_mp4_cache_fill(void *data, u_char *p);
 static char *ngx_http_mp4(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static void *ngx_http_mp4_create_conf(ngx_conf_t *cf);
 static char *ngx_http_mp4_merge_conf(ngx_conf_t *cf, void *parent, void *child);
 
+
+ngx_module_t  ngx_http_mp4_module;
+
+
 static ngx_command_t  ngx_http_mp4_commands[] = {
 
     { ngx_string("mp4"),
@@ -306,6 +477,34 @@ static ngx_command_t  ngx_http_mp4_commands[] = {
       offsetof(ngx_http_mp4_conf_t, max_buffer_size),
       NULL },
 
+    { ngx_string("mp4_cache_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_zone,
+      0,
+      0,
+      &ngx_http_mp4_module },
+
+    { ngx_string("mp4_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_shm_cache_set_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mp4_conf_t, cache),
+      &ngx_http_mp4_module },
+
+    { ngx_string("mp4_hls"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mp4_conf_t, hls),
+      NULL },
+
+    { ngx_string("mp4_hls_fragment"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_mp4_conf_t, hls_fragment),
+      NULL },
+
       ngx_null_command
 };
 
@@ -395,11 +594,13 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
     u_char                    *last;
     size_t                     root;
     ngx_int_t                  rc, start;
-    ngx_uint_t                 level;
+    ngx_uint_t                 level, hls, segment;
     ngx_str_t                  path, value;
     ngx_log_t                 *log;
     ngx_buf_t                 *b;
     ngx_chain_t                out;
+    ngx_md5_t                  md5;
+    ngx_http_mp4_conf_t       *mcf;
     ngx_http_mp4_file_t       *mp4;
     ngx_open_file_info_t       of;
     ngx_http_core_loc_conf_t  *clcf;
@@ -427,6 +628,15 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
 
     path.len = last - path.data;
 
+    mcf = ngx_http_get_module_loc_conf(r, ngx_http_mp4_module);
+
+    hls = 0;
+    segment = 0;
+
+    if (mcf->hls) {
+        hls = ngx_http_mp4_hls_uri(r, &path, &segment);
+    }
+
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
                    "http mp4 filename: \"%V\"", &path);
 
@@ -496,7 +706,7 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
     mp4 = NULL;
     b = NULL;
 
-    if (r->args.len) {
+    if (r->args.len && !hls) {
 
         if (ngx_http_arg(r, (u_char *) "start", 5, &value) == NGX_OK) {
 
@@ -509,47 +719,71 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
             ngx_set_errno(0);
             start = (int) (strtod((char *) value.data, NULL) * 1000);
 
-            if (ngx_errno == 0 && start >= 0) {
-                r->allow_ranges = 0;
+            if (ngx_errno != 0) {
+                start = -1;
+            }
+        }
+    }
 
-                mp4 = ngx_pcalloc(r->pool, sizeof(ngx_http_mp4_file_t));
-                if (mp4 == NULL) {
-                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
-                }
+    if (start >= 0 || hls) {
+        r->allow_ranges = 0;
 
-                mp4->file.fd = of.fd;
-                mp4->file.name = path;
-                mp4->file.log = r->connection->log;;
-                mp4->end = of.size;
-                mp4->start = (ngx_uint_t) start;
-                mp4->request = r;
+        mp4 = ngx_pcalloc(r->pool, sizeof(ngx_http_mp4_file_t));
+        if (mp4 == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
 
-                switch (ngx_http_mp4_process(mp4)) {
+        mp4->file.fd = of.fd;
+        mp4->file.name = path;
+        mp4->file.log = r->connection->log;;
+        mp4->end = of.size;
+        mp4->start = hls ? 0 : (ngx_uint_t) start;
+        mp4->request = r;
+        mp4->hls = hls;
+        mp4->segment = segment;
+
+        if (mcf->cache) {
+
+            /* the file identity */
+
+            ngx_md5_init(&md5);
+            ngx_md5_update(&md5, path.data, path.len);
+            ngx_md5_update(&md5, &of.uniq, sizeof(ngx_file_uniq_t));
+            ngx_md5_update(&md5, &of.mtime, sizeof(time_t));
+            ngx_md5_update(&md5, &of.size, sizeof(off_t));
+            ngx_md5_final(mp4->md5, &md5);
+        }
 
-                case NGX_DECLINED:
-                    if (mp4->buffer) {
-                        ngx_pfree(r->pool, mp4->buffer);
-                    }
+        rc = hls ? ngx_http_mp4_hls_process(mp4) : ngx_http_mp4_process(mp4);
 
-                    ngx_pfree(r->pool, mp4);
-                    mp4 = NULL;
+        switch (rc) {
 
-                    break;
+        case NGX_DECLINED:
+            if (hls) {
+                return NGX_HTTP_NOT_FOUND;
+            }
 
-                case NGX_OK:
-                    r->headers_out.content_length_n = mp4->content_length;
-                    break;
+            if (mp4->buffer) {
+                ngx_pfree(r->pool, mp4->buffer);
+            }
 
-                default: /* NGX_ERROR */
-                    if (mp4->buffer) {
-                        ngx_pfree(r->pool, mp4->buffer);
-                    }
+            ngx_pfree(r->pool, mp4);
+            mp4 = NULL;
 
-                    ngx_pfree(r->pool, mp4);
+            break;
 
-                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
-                }
+        case NGX_OK:
+            r->headers_out.content_length_n = mp4->content_length;
+            break;
+
+        default: /* NGX_ERROR */
+            if (mp4->buffer) {
+                ngx_pfree(r->pool, mp4->buffer);
             }
+
+            ngx_pfree(r->pool, mp4);
+
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
         }
     }
 
@@ -577,7 +811,16 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.last_modified_time = of.mtime;
 
-    if (ngx_http_set_content_type(r) != NGX_OK) {
+    if (hls == NGX_HTTP_MP4_HLS_PLAYLIST) {
+        ngx_str_set(&r->headers_out.content_type,
+                    "application/vnd.apple.mpegurl");
+        r->headers_out.content_type_len = r->headers_out.content_type.len;
+
+    } else if (hls) {
+        ngx_str_set(&r->headers_out.content_type, "video/mp4");
+        r->headers_out.content_type_len = r->headers_out.content_type.len;
+
+    } else if (ngx_http_set_content_type(r) != NGX_OK) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
@@ -622,6 +865,69 @@ ngx_http_mp4_handler(ngx_http_request_t *r)
 }
 
 
+/*
+ * "file.mp4.m3u8", "file.mp4.init.mp4" and "file.mp4.<n>.m4s" are
+ * a playlist, an initialization and a media segment of "file.mp4"
+ */
+
+static ngx_uint_t
+ngx_http_mp4_hls_uri(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_uint_t *segment)
+{
+    u_char      *p, *last;
+    size_t       len;
+    ngx_int_t    n;
+    ngx_uint_t   type;
+
+    last = r->uri.data + r->uri.len;
+
+    if (r->uri.len > 5 && ngx_strncmp(last - 5, ".m3u8", 5) == 0) {
+        len = 5;
+        type = NGX_HTTP_MP4_HLS_PLAYLIST;
+
+    } else if (r->uri.len > 9 && ngx_strncmp(last - 9, ".init.mp4", 9) == 0) {
+        len = 9;
+        type = NGX_HTTP_MP4_HLS_INIT;
+
+    } else if (r->uri.len > 4 && ngx_strncmp(last - 4, ".m4s", 4) == 0) {
+
+        for (p = last - 4; p > r->uri.data; p--) {
+            if (*(p - 1) < '0' || *(p - 1) > '9') {
+                break;
+            }
+        }
+
+        if (p == last - 4 || p - 1 <= r->uri.data || *(p - 1) != '.') {
+            return 0;
+        }
+
+        n = ngx_atoi(p, last - 4 - p);
+        if (n == NGX_ERROR) {
+            return 0;
+        }
+
+        *segment = n;
+
+        len = last - p + 1;
+        type = NGX_HTTP_MP4_HLS_SEGMENT;
+
+    } else {
+        return 0;
+    }
+
+    if (path->len <= len
+        || ngx_strncmp(path->data + path->len - len, last - len, len) != 0)
+    {
+        return 0;
+    }
+
+    path->len -= len;
+    path->data[path->len] = '\0';
+
+    return type;
+}
+
+
 static ngx_int_t
 ngx_http_mp4_process(ngx_http_mp4_file_t *mp4)
 {
@@ -630,34 +936,15 @@ ngx_http_mp4_process(ngx_http_mp4_file_t *mp4)
     ngx_uint_t             i, j;
     ngx_chain_t          **prev;
     ngx_http_mp4_trak_t   *trak;
-    ngx_http_mp4_conf_t   *conf;
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
                    "mp4 start:%ui", mp4->start);
 
-    conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
-
-    mp4->buffer_size = conf->buffer_size;
-
-    rc = ngx_http_mp4_read_atom(mp4, ngx_http_mp4_atoms, mp4->end);
+    rc = ngx_http_mp4_parse(mp4);
     if (rc != NGX_OK) {
         return rc;
     }
 
-    if (mp4->trak.nelts == 0) {
-        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
-                      "no mp4 trak atoms were found in \"%s\"",
-                      mp4->file.name.data);
-        return NGX_ERROR;
-    }
-
-    if (mp4->mdat_atom.buf == NULL) {
-        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
-                      "no mp4 mdat atom was found in \"%s\"",
-                      mp4->file.name.data);
-        return NGX_ERROR;
-    }
-
     prev = &mp4->out;
 
     if (mp4->ftyp_atom.buf) {
@@ -679,6 +966,10 @@ ngx_http_mp4_process(ngx_http_mp4_file_t *mp4)
 
     for (i = 0; i < mp4->trak.nelts; i++) {
 
+        if (mp4->nhints == mp4->trak.nelts) {
+            trak[i].hint = &mp4->hints[i];
+        }
+
         if (ngx_http_mp4_update_stts_atom(mp4, &trak[i]) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -758,6 +1049,62 @@ ngx_http_mp4_process(ngx_http_mp4_file_t *mp4)
 }
 
 
+
+static ngx_int_t
+ngx_http_mp4_parse(ngx_http_mp4_file_t *mp4)
+{
+    ngx_int_t             rc;
+    ngx_http_mp4_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
+
+    mp4->buffer_size = conf->buffer_size;
+
+    rc = NGX_DECLINED;
+
+    if (conf->cache) {
+        rc = ngx_http_mp4_cache_get(mp4);
+
+        if (rc == NGX_DONE) {
+            return NGX_DECLINED;
+        }
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        mp4->caching = (rc == NGX_DECLINED);
+    }
+
+    if (rc == NGX_DECLINED) {
+        rc = ngx_http_mp4_read_atom(mp4, ngx_http_mp4_atoms, mp4->end);
+        if (rc != NGX_OK) {
+            return rc;
+        }
+    }
+
+    if (mp4->trak.nelts == 0) {
+        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                      "no mp4 trak atoms were found in \"%s\"",
+                      mp4->file.name.data);
+        return NGX_ERROR;
+    }
+
+    if (mp4->mdat_atom.buf == NULL) {
+        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                      "no mp4 mdat atom was found in \"%s\"",
+                      mp4->file.name.data);
+        return NGX_ERROR;
+    }
+
+    if (mp4->cache_moov) {
+        ngx_http_mp4_cache_put(mp4);
+    }
+
+    return NGX_OK;
+}
+
+
 typedef struct {
     u_char    size[4];
     u_char    name[4];
@@ -968,7 +1315,7 @@ ngx_http_mp4_read_moov_atom(ngx_http_mp4_file_t *mp4, uint64_t atom_data_size)
 
     no_mdat = (mp4->mdat_atom.buf == NULL);
 
-    if (no_mdat && mp4->start == 0) {
+    if (no_mdat && mp4->start == 0 && !mp4->hls) {
         /*
          * send original file if moov atom resides before
          * mdat atom and client requests integral file
@@ -978,7 +1325,11 @@ ngx_http_mp4_read_moov_atom(ngx_http_mp4_file_t *mp4, uint64_t atom_data_size)
 
     conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
 
-    if (atom_data_size > mp4->buffer_size) {
+    if (mp4->caching && mp4->offset + (off_t) atom_data_size > mp4->end) {
+        mp4->caching = 0;
+    }
+
+    if (atom_data_size > mp4->buffer_size || mp4->caching) {
 
         if (atom_data_size > conf->max_buffer_size) {
             ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
@@ -997,6 +1348,30 @@ ngx_http_mp4_read_moov_atom(ngx_http_mp4_file_t *mp4, uint64_t atom_data_size)
                          + NGX_HTTP_MP4_MOOV_BUFFER_EXCESS * no_mdat;
     }
 
+    if (mp4->caching) {
+
+        /*
+         * the whole moov atom is read at once and its copy is kept
+         * until the atom is cached, as the atoms are updated in place
+         */
+
+        if (ngx_http_mp4_read(mp4) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        mp4->cache_moov = ngx_pnalloc(mp4->request->pool,
+                                      (size_t) atom_data_size);
+        if (mp4->cache_moov == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(mp4->cache_moov, mp4->buffer_pos, (size_t) atom_data_size);
+
+        mp4->cache_moov_offset = mp4->offset;
+        mp4->cache_moov_size = (size_t) atom_data_size;
+        mp4->cache_moov_first = no_mdat;
+    }
+
     mp4->trak.elts = &mp4->traks;
     mp4->trak.size = sizeof(ngx_http_mp4_trak_t);
     mp4->trak.nalloc = 2;
@@ -1038,6 +1413,7 @@ ngx_http_mp4_read_mdat_atom(ngx_http_mp4_file_t *mp4, uint64_t atom_data_size)
     data->in_file = 1;
     data->last_buf = 1;
     data->last_in_chain = 1;
+    data->file_pos = mp4->offset;
     data->file_last = mp4->offset + atom_data_size;
 
     mp4->mdat_atom.buf = &mp4->mdat_atom_buf;
@@ -1859,7 +2235,7 @@ ngx_http_mp4_update_stts_atom(ngx_http_mp4_file_t *mp4,
     ngx_http_mp4_trak_t *trak)
 {
     size_t                 atom_size;
-    uint32_t               entries, count, duration;
+    uint32_t               entries, count, duration, rest;
     uint64_t               start_time;
     ngx_buf_t             *atom, *data;
     ngx_uint_t             start_sample;
@@ -1893,6 +2269,13 @@ ngx_http_mp4_update_stts_atom(ngx_http_mp4_file_t *mp4,
     entry = (ngx_mp4_stts_entry_t *) data->pos;
     end = (ngx_mp4_stts_entry_t *) data->last;
 
+    if (trak->hint && trak->hint->stts_entry < entries) {
+        start_sample = trak->hint->stts_samples;
+        start_time -= trak->hint->stts_time;
+        entries -= trak->hint->stts_entry;
+        entry += trak->hint->stts_entry;
+    }
+
     while (entry < end) {
         count = ngx_mp4_get_32value(entry->count);
         duration = ngx_mp4_get_32value(entry->duration);
@@ -1901,14 +2284,15 @@ ngx_http_mp4_update_stts_atom(ngx_http_mp4_file_t *mp4,
                        "count:%uD, duration:%uD", count, duration);
 
         if (start_time < (uint64_t) count * duration) {
-            start_sample += (ngx_uint_t) (start_time / duration);
-            count -= start_sample;
+            rest = (uint32_t) (start_time / duration);
+            start_sample += rest;
+            count -= rest;
             ngx_mp4_set_32value(entry->count, count);
             goto found;
         }
 
         start_sample += count;
-        start_time -= count * duration;
+        start_time -= (uint64_t) count * duration;
         entries--;
         entry++;
     }
@@ -2008,6 +2392,7 @@ ngx_http_mp4_update_stss_atom(ngx_http_mp4_file_t *mp4,
 {
     size_t                     atom_size;
     uint32_t                   entries, sample, start_sample, *entry, *end;
+    ngx_uint_t                 n;
     ngx_buf_t                 *atom, *data;
     ngx_http_mp4_stss_atom_t  *stss_atom;
 
@@ -2033,18 +2418,28 @@ ngx_http_mp4_update_stss_atom(ngx_http_mp4_file_t *mp4,
     entry = (uint32_t *) data->pos;
     end = (uint32_t *) data->last;
 
-    while (entry < end) {
-        sample = ngx_mp4_get_32value(entry);
+    /* sync samples are sorted, so the first suitable one is searched */
 
-        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
-                       "start:%uD, sync:%uD", start_sample, sample);
+    while (entry < end) {
+        n = (end - entry) / 2;
+        sample = ngx_mp4_get_32value(&entry[n]);
 
         if (sample >= start_sample) {
-            goto found;
+            end = &entry[n];
+
+        } else {
+            entries -= n + 1;
+            entry = &entry[n + 1];
         }
+    }
 
-        entries--;
-        entry++;
+    end = (uint32_t *) data->last;
+
+    if (entry < end) {
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                       "start:%uD, sync:%uD",
+                       start_sample, ngx_mp4_get_32value(entry));
+        goto found;
     }
 
     ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
@@ -2178,6 +2573,12 @@ ngx_http_mp4_update_ctts_atom(ngx_http_mp4_file_t *mp4,
     entry = (ngx_mp4_ctts_entry_t *) data->pos;
     end = (ngx_mp4_ctts_entry_t *) data->last;
 
+    if (trak->hint && trak->hint->ctts_entry < entries) {
+        start_sample -= trak->hint->ctts_samples;
+        entries -= trak->hint->ctts_entry;
+        entry += trak->hint->ctts_entry;
+    }
+
     while (entry < end) {
         count = ngx_mp4_get_32value(entry->count);
 
@@ -2315,6 +2716,12 @@ ngx_http_mp4_update_stsc_atom(ngx_http_mp4_file_t *mp4,
     entry = (ngx_mp4_stsc_entry_t *) data->pos;
     end = (ngx_mp4_stsc_entry_t *) data->last;
 
+    if (trak->hint && trak->hint->stsc_entry < trak->sample_to_chunk_entries) {
+        start_sample -= trak->hint->stsc_samples;
+        entries -= trak->hint->stsc_entry;
+        entry += trak->hint->stsc_entry;
+    }
+
     chunk = ngx_mp4_get_32value(entry->chunk);
     samples = ngx_mp4_get_32value(entry->samples);
     id = ngx_mp4_get_32value(entry->id);
@@ -2401,6 +2808,7 @@ found:
 
         ngx_mp4_set_32value(entry->chunk, 2);
 
+        entries++;
         atom_size += sizeof(ngx_mp4_stsc_entry_t);
     }
 
@@ -2815,44 +3223,1627 @@ ngx_http_mp4_adjust_co64_atom(ngx_http_mp4_file_t *mp4,
 }
 
 
-static char *
-ngx_http_mp4(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+static ngx_int_t
+ngx_http_mp4_hls_process(ngx_http_mp4_file_t *mp4)
 {
-    ngx_http_core_loc_conf_t  *clcf;
+    uint64_t              fragment;
+    ngx_int_t             rc;
+    ngx_uint_t            i, ref;
+    ngx_http_mp4_trak_t  *trak;
+    ngx_http_mp4_conf_t  *conf;
 
-    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
-    clcf->handler = ngx_http_mp4_handler;
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                   "mp4 hls:%ui segment:%ui", mp4->hls, mp4->segment);
 
-    return NGX_CONF_OK;
-}
+    rc = ngx_http_mp4_parse(mp4);
+    if (rc != NGX_OK) {
+        return rc;
+    }
 
+    trak = mp4->trak.elts;
+    ref = 0;
 
-static void *
-ngx_http_mp4_create_conf(ngx_conf_t *cf)
-{
-    ngx_http_mp4_conf_t  *conf;
+    for (i = 0; i < mp4->trak.nelts; i++) {
 
-    conf = ngx_palloc(cf->pool, sizeof(ngx_http_mp4_conf_t));
-    if (conf == NULL) {
-        return NULL;
+        if (ngx_http_mp4_hls_check_trak(mp4, &trak[i]) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        /* segments are cut on sync samples of the first video trak */
+
+        if (trak[i].vmhd_size && trak[ref].vmhd_size == 0) {
+            ref = i;
+        }
     }
 
-    conf->buffer_size = NGX_CONF_UNSET_SIZE;
-    conf->max_buffer_size = NGX_CONF_UNSET_SIZE;
+    if (mp4->hls == NGX_HTTP_MP4_HLS_INIT) {
+        return ngx_http_mp4_hls_init(mp4);
+    }
 
-    return conf;
-}
+    conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
 
+    fragment = (uint64_t) conf->hls_fragment * trak[ref].timescale / 1000;
 
-static char *
-ngx_http_mp4_merge_conf(ngx_conf_t *cf, void *parent, void *child)
-{
-    ngx_http_mp4_conf_t *prev = parent;
-    ngx_http_mp4_conf_t *conf = child;
+    if (fragment == 0) {
+        fragment = 1;
+    }
 
-    ngx_conf_merge_size_value(conf->buffer_size, prev->buffer_size, 512 * 1024);
+    if (mp4->hls == NGX_HTTP_MP4_HLS_PLAYLIST) {
+        return ngx_http_mp4_hls_playlist(mp4, &trak[ref], fragment);
+    }
+
+    return ngx_http_mp4_hls_segment(mp4, ref, fragment);
+}
+
+
+/*
+ * a segment starts at the first sync sample not earlier than
+ * its number multiplied by the fragment duration, segments
+ * starting at the same sample are listed once
+ */
+
+static ngx_int_t
+ngx_http_mp4_hls_playlist(ngx_http_mp4_file_t *mp4, ngx_http_mp4_trak_t *trak,
+    uint64_t fragment)
+{
+    u_char                      *p;
+    size_t                       len;
+    uint32_t                     sample, samples;
+    uint64_t                     n, time, duration, max;
+    ngx_str_t                    name;
+    ngx_buf_t                   *b;
+    ngx_uint_t                   i, escape;
+    ngx_chain_t                 *out;
+    ngx_array_t                  segments;
+    ngx_http_request_t          *r;
+    ngx_http_mp4_hls_stts_t      stts;
+    ngx_http_mp4_hls_segment_t  *seg;
+
+    r = mp4->request;
+
+    if (ngx_array_init(&segments, r->pool, 64,
+                       sizeof(ngx_http_mp4_hls_segment_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    samples = trak->sample_sizes_entries;
+
+    ngx_http_mp4_hls_stts_init(trak, &stts);
+
+    n = 0;
+
+    for ( ;; ) {
+        sample = ngx_http_mp4_hls_time_sample(&stts, n * fragment);
+        sample = ngx_http_mp4_hls_sync_sample(trak, sample, NULL);
+
+        if (sample >= samples) {
+            break;
+        }
+
+        time = ngx_http_mp4_hls_sample_time(&stts, sample);
+
+        seg = ngx_array_push(&segments);
+        if (seg == NULL) {
+            return NGX_ERROR;
+        }
+
+        seg->number = n;
+        seg->time = time;
+
+        n = time / fragment + 1;
+    }
+
+    if (segments.nelts == 0) {
+        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                      "no mp4 sync samples were found in \"%s\"",
+                      mp4->file.name.data);
+        return NGX_ERROR;
+    }
+
+    duration = ngx_http_mp4_hls_sample_time(&stts, samples);
+
+    seg = segments.elts;
+    max = 0;
+
+    for (i = 0; i < segments.nelts; i++) {
+        time = (i + 1 < segments.nelts) ? seg[i + 1].time : duration;
+        time = (time > seg[i].time) ? time - seg[i].time : 0;
+
+        /* the segment duration in milliseconds */
+
+        seg[i].time = (time * 1000 + trak->timescale / 2) / trak->timescale;
+
+        if (max < seg[i].time) {
+            max = seg[i].time;
+        }
+    }
+
+    /* the playlist refers to the segments relative to its own name */
+
+    p = r->uri.data + r->uri.len - (sizeof(".m3u8") - 1);
+    name.data = p;
+
+    while (name.data > r->uri.data && *(name.data - 1) != '/') {
+        name.data--;
+    }
+
+    name.len = p - name.data;
+
+    escape = 2 * ngx_escape_uri(NULL, name.data, name.len,
+                                NGX_ESCAPE_URI_COMPONENT);
+
+    if (escape) {
+        p = ngx_pnalloc(r->pool, name.len + escape);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_escape_uri(p, name.data, name.len, NGX_ESCAPE_URI_COMPONENT);
+
+        name.data = p;
+        name.len += escape;
+    }
+
+    len = sizeof("#EXTM3U\n"
+                 "#EXT-X-VERSION:7\n"
+                 "#EXT-X-TARGETDURATION:\n"
+                 "#EXT-X-PLAYLIST-TYPE:VOD\n"
+                 "#EXT-X-MAP:URI=\".init.mp4\"\n"
+                 "#EXT-X-ENDLIST\n") - 1
+          + NGX_INT64_LEN + name.len
+          + segments.nelts * (sizeof("#EXTINF:.000,\n..m4s\n") - 1
+                              + 2 * NGX_INT64_LEN + name.len);
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* the target duration is the longest segment rounded to seconds */
+
+    max = (max + 500) / 1000;
+
+    if (max == 0) {
+        max = 1;
+    }
+
+    b->last = ngx_sprintf(b->last, "#EXTM3U\n"
+                                   "#EXT-X-VERSION:7\n"
+                                   "#EXT-X-TARGETDURATION:%uL\n"
+                                   "#EXT-X-PLAYLIST-TYPE:VOD\n"
+                                   "#EXT-X-MAP:URI=\"%V.init.mp4\"\n",
+                          max, &name);
+
+    for (i = 0; i < segments.nelts; i++) {
+        b->last = ngx_sprintf(b->last, "#EXTINF:%uL.%03uL,\n%V.%uL.m4s\n",
+                              seg[i].time / 1000, seg[i].time % 1000,
+                              &name, seg[i].number);
+    }
+
+    b->last = ngx_cpymem(b->last, "#EXT-X-ENDLIST\n",
+                         sizeof("#EXT-X-ENDLIST\n") - 1);
+
+    b->last_buf = 1;
+    b->last_in_chain = 1;
+
+    out = ngx_alloc_chain_link(r->pool);
+    if (out == NULL) {
+        return NGX_ERROR;
+    }
+
+    out->buf = b;
+    out->next = NULL;
+
+    mp4->out = out;
+    mp4->content_length = b->last - b->pos;
+
+    return NGX_OK;
+}
+
+
+#define ngx_http_mp4_hls_atom_size(trak, n)                                   \
+    ((trak)->out[n].buf ?                                                     \
+        (size_t) ((trak)->out[n].buf->last - (trak)->out[n].buf->pos) : 0)
+
+#define ngx_http_mp4_hls_copy_atom(p, trak, n)                                \
+    if ((trak)->out[n].buf) {                                                 \
+        p = ngx_cpymem(p, (trak)->out[n].buf->pos,                            \
+                       (trak)->out[n].buf->last - (trak)->out[n].buf->pos);   \
+    }
+
+
+/* empty stts, stsc, stsz and stco atoms of a fragmented trak */
+
+static u_char  ngx_http_mp4_hls_stbl[] = {
+    0, 0, 0, 16, 's', 't', 't', 's', 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 16, 's', 't', 's', 'c', 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 20, 's', 't', 's', 'z', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 16, 's', 't', 'c', 'o', 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+
+static ngx_int_t
+ngx_http_mp4_hls_init(ngx_http_mp4_file_t *mp4)
+{
+    u_char               *p, *moov, *atom, *mdia, *minf, *stbl;
+    size_t                len;
+    ngx_buf_t            *b;
+    ngx_uint_t            i;
+    ngx_chain_t          *out;
+    ngx_http_mp4_trak_t  *trak;
+
+    if (mp4->mvhd_atom.buf == NULL) {
+        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                      "no mp4 mvhd atom was found in \"%s\"",
+                      mp4->file.name.data);
+        return NGX_ERROR;
+    }
+
+    /* ftyp, moov, mvhd and mvex atoms */
+
+    len = 24 + 8 + (mp4->mvhd_atom_buf.last - mp4->mvhd_atom_buf.pos) + 8;
+
+    trak = mp4->trak.elts;
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+
+        /* trak, mdia, minf and stbl headers, empty tables and trex atom */
+
+        len += 4 * 8 + sizeof(ngx_http_mp4_hls_stbl) + 32
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_TKHD_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_MDHD_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_HDLR_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_VMHD_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_SMHD_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_DINF_ATOM)
+               + ngx_http_mp4_hls_atom_size(&trak[i], NGX_HTTP_MP4_STSD_ATOM);
+    }
+
+    b = ngx_create_temp_buf(mp4->request->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = b->last;
+
+    ngx_mp4_set_32value(p, 24);
+    ngx_mp4_set_atom_name(p, 'f', 't', 'y', 'p');
+    p = ngx_cpymem(p + 8, "iso6\0\0\0\0iso6mp41", 16);
+
+    moov = p;
+    p += 8;
+
+    p = ngx_cpymem(p, mp4->mvhd_atom_buf.pos,
+                   mp4->mvhd_atom_buf.last - mp4->mvhd_atom_buf.pos);
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+        atom = p;
+        p += 8;
+
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_TKHD_ATOM);
+
+        mdia = p;
+        p += 8;
+
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_MDHD_ATOM);
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_HDLR_ATOM);
+
+        minf = p;
+        p += 8;
+
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_VMHD_ATOM);
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_SMHD_ATOM);
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_DINF_ATOM);
+
+        stbl = p;
+        p += 8;
+
+        ngx_http_mp4_hls_copy_atom(p, &trak[i], NGX_HTTP_MP4_STSD_ATOM);
+        p = ngx_cpymem(p, ngx_http_mp4_hls_stbl, sizeof(ngx_http_mp4_hls_stbl));
+
+        ngx_mp4_set_32value(stbl, p - stbl);
+        ngx_mp4_set_atom_name(stbl, 's', 't', 'b', 'l');
+        ngx_mp4_set_32value(minf, p - minf);
+        ngx_mp4_set_atom_name(minf, 'm', 'i', 'n', 'f');
+        ngx_mp4_set_32value(mdia, p - mdia);
+        ngx_mp4_set_atom_name(mdia, 'm', 'd', 'i', 'a');
+        ngx_mp4_set_32value(atom, p - atom);
+        ngx_mp4_set_atom_name(atom, 't', 'r', 'a', 'k');
+    }
+
+    atom = p;
+    p += 8;
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+        ngx_memzero(p, 32);
+        ngx_mp4_set_32value(p, 32);
+        ngx_mp4_set_atom_name(p, 't', 'r', 'e', 'x');
+        ngx_mp4_set_32value(p + 12, ngx_http_mp4_hls_track_id(&trak[i]));
+
+        /* default sample description index */
+        p[19] = 1;
+
+        p += 32;
+    }
+
+    ngx_mp4_set_32value(atom, p - atom);
+    ngx_mp4_set_atom_name(atom, 'm', 'v', 'e', 'x');
+    ngx_mp4_set_32value(moov, p - moov);
+    ngx_mp4_set_atom_name(moov, 'm', 'o', 'o', 'v');
+
+    b->last = p;
+    b->last_buf = 1;
+    b->last_in_chain = 1;
+
+    out = ngx_alloc_chain_link(mp4->request->pool);
+    if (out == NULL) {
+        return NGX_ERROR;
+    }
+
+    out->buf = b;
+    out->next = NULL;
+
+    mp4->out = out;
+    mp4->content_length = b->last - b->pos;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_mp4_hls_segment(ngx_http_mp4_file_t *mp4, ngx_uint_t ref,
+    uint64_t fragment)
+{
+    u_char                    *p, *moof, *traf, *trun;
+    off_t                      rel;
+    size_t                     len, moof_size;
+    uint32_t                   start, end, prev, size, count, flags, value;
+    uint32_t                   timescale;
+    uint64_t                   start_time, end_time, mdat_size;
+    ngx_buf_t                 *b, *fb;
+    ngx_uint_t                 i, first, last, video, ctts;
+    ngx_chain_t               *cl, **ll;
+    ngx_array_t                runs;
+    ngx_http_request_t        *r;
+    ngx_http_mp4_trak_t       *trak;
+    ngx_http_mp4_hls_run_t    *run;
+    ngx_http_mp4_hls_stts_t    stts;
+    ngx_http_mp4_hls_track_t  *tracks, *t;
+
+    r = mp4->request;
+    trak = mp4->trak.elts;
+
+    ngx_http_mp4_hls_stts_init(&trak[ref], &stts);
+
+    start = ngx_http_mp4_hls_time_sample(&stts,
+                                         (uint64_t) mp4->segment * fragment);
+    start = ngx_http_mp4_hls_sync_sample(&trak[ref], start, &prev);
+
+    if (start >= trak[ref].sample_sizes_entries) {
+        return NGX_DECLINED;
+    }
+
+    ngx_http_mp4_hls_stts_init(&trak[ref], &stts);
+
+    first = (prev == NGX_HTTP_MP4_NO_SAMPLE);
+
+    /* the segment number should be the one listed in the playlist */
+
+    if (first) {
+        if (mp4->segment != 0) {
+            return NGX_DECLINED;
+        }
+
+    } else if (ngx_http_mp4_hls_sample_time(&stts, prev) / fragment + 1
+               != mp4->segment)
+    {
+        return NGX_DECLINED;
+    }
+
+    start_time = ngx_http_mp4_hls_sample_time(&stts, start);
+
+    end = ngx_http_mp4_hls_time_sample(&stts,
+                                       (start_time / fragment + 1) * fragment);
+    end = ngx_http_mp4_hls_sync_sample(&trak[ref], end, NULL);
+
+    last = (end >= trak[ref].sample_sizes_entries);
+
+    if (last) {
+        end = trak[ref].sample_sizes_entries;
+    }
+
+    end_time = ngx_http_mp4_hls_sample_time(&stts, end);
+
+    ngx_log_debug4(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                   "mp4 hls segment samples:%uD-%uD time:%uL-%uL",
+                   start, end, start_time, end_time);
+
+    tracks = ngx_pcalloc(r->pool,
+                         mp4->trak.nelts * sizeof(ngx_http_mp4_hls_track_t));
+    if (tracks == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* moof, mfhd and mdat headers */
+
+    len = 8 + 16 + 16;
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+        t = &tracks[i];
+
+        t->trak = &trak[i];
+        t->samples = trak[i].sample_sizes_entries;
+
+        if (trak[i].out[NGX_HTTP_MP4_STSZ_DATA].buf == NULL) {
+            t->sample_size = ngx_mp4_get_32value(
+                ((ngx_mp4_stsz_atom_t *) trak[i].stsz_atom_buf.pos)
+                                                               ->uniform_size);
+        }
+
+        if (i == ref) {
+            t->start = start;
+            t->end = end;
+
+        } else {
+
+            /* other traks samples are cut at the same time */
+
+            timescale = trak[ref].timescale;
+
+            ngx_http_mp4_hls_stts_init(&trak[i], &stts);
+
+            t->start = first ? 0 : ngx_http_mp4_hls_time_sample(&stts,
+                           (start_time * trak[i].timescale + timescale - 1)
+                           / timescale);
+
+            t->end = last ? t->samples : ngx_http_mp4_hls_time_sample(&stts,
+                           (end_time * trak[i].timescale + timescale - 1)
+                           / timescale);
+
+            if (t->end > t->samples) {
+                t->end = t->samples;
+            }
+
+            if (t->start > t->end) {
+                t->start = t->end;
+            }
+        }
+
+        /* traf, tfhd and tfdt atoms, a trun atom and 16 bytes per sample */
+
+        len += 8 + 16 + 20 + (size_t) (t->end - t->start) * (20 + 16);
+    }
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_array_init(&runs, r->pool, 16, sizeof(ngx_http_mp4_hls_run_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    moof = b->last;
+    p = moof + 8;
+
+    ngx_mp4_set_32value(p, 16);
+    ngx_mp4_set_atom_name(p, 'm', 'f', 'h', 'd');
+    ngx_mp4_set_32value(p + 8, 0);
+    ngx_mp4_set_32value(p + 12, mp4->segment + 1);
+    p += 16;
+
+    mdat_size = 0;
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+        t = &tracks[i];
+
+        if (t->start == t->end) {
+            continue;
+        }
+
+        if (ngx_http_mp4_hls_seek(mp4, t, t->start) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        video = (trak[i].vmhd_size != 0);
+        ctts = (trak[i].out[NGX_HTTP_MP4_CTTS_DATA].buf != NULL);
+
+        /* data offset, sample duration, size, flags and composition offset */
+
+        flags = 0x000301;
+
+        if (video) {
+            flags |= 0x000400;
+        }
+
+        if (ctts) {
+            flags |= 0x000800;
+        }
+
+        traf = p;
+        p += 8;
+
+        /* default base is moof */
+
+        ngx_mp4_set_32value(p, 16);
+        ngx_mp4_set_atom_name(p, 't', 'f', 'h', 'd');
+        ngx_mp4_set_32value(p + 8, 0x020000);
+        ngx_mp4_set_32value(p + 12, ngx_http_mp4_hls_track_id(&trak[i]));
+        p += 16;
+
+        ngx_mp4_set_32value(p, 20);
+        ngx_mp4_set_atom_name(p, 't', 'f', 'd', 't');
+        ngx_mp4_set_32value(p + 8, 0x01000000);
+        ngx_mp4_set_64value(p + 12, t->time);
+        p += 20;
+
+        /* a trun atom per run of samples contiguous in the file */
+
+        trun = NULL;
+        run = NULL;
+        count = 0;
+
+        for ( ;; ) {
+            size = ngx_http_mp4_hls_sample_size(t, t->sample);
+
+            if (run == NULL || run->last != t->offset) {
+
+                if (trun) {
+                    ngx_mp4_set_32value(trun, p - trun);
+                    ngx_mp4_set_32value(trun + 12, count);
+                }
+
+                run = ngx_array_push(&runs);
+                if (run == NULL) {
+                    return NGX_ERROR;
+                }
+
+                run->data_offset = p + 16;
+                run->pos = t->offset;
+                run->last = t->offset;
+
+                trun = p;
+                ngx_mp4_set_atom_name(p, 't', 'r', 'u', 'n');
+                ngx_mp4_set_32value(p + 8, flags);
+                p += 20;
+
+                count = 0;
+            }
+
+            value = (t->stts < t->stts_end)
+                    ? ngx_mp4_get_32value(
+                          ((ngx_mp4_stts_entry_t *) t->stts)->duration)
+                    : 0;
+
+            ngx_mp4_set_32value(p, value);
+            ngx_mp4_set_32value(p + 4, size);
+            p += 8;
+
+            if (video) {
+                if (t->trak->out[NGX_HTTP_MP4_STSS_DATA].buf == NULL
+                    || (t->stss < t->stss_end
+                        && ngx_mp4_get_32value(t->stss) == t->sample + 1))
+                {
+                    value = 0x02000000;
+
+                } else {
+                    /* depends on others, non-sync */
+                    value = 0x01010000;
+                }
+
+                ngx_mp4_set_32value(p, value);
+                p += 4;
+            }
+
+            if (ctts) {
+                value = (t->ctts < t->ctts_end)
+                        ? ngx_mp4_get_32value(
+                              ((ngx_mp4_ctts_entry_t *) t->ctts)->offset)
+                        : 0;
+
+                ngx_mp4_set_32value(p, value);
+                p += 4;
+            }
+
+            count++;
+            run->last += size;
+            mdat_size += size;
+
+            if (t->sample + 1 == t->end) {
+                break;
+            }
+
+            if (ngx_http_mp4_hls_next(mp4, t) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+
+        ngx_mp4_set_32value(trun, p - trun);
+        ngx_mp4_set_32value(trun + 12, count);
+
+        ngx_mp4_set_32value(traf, p - traf);
+        ngx_mp4_set_atom_name(traf, 't', 'r', 'a', 'f');
+    }
+
+    moof_size = p - moof;
+
+    ngx_mp4_set_32value(moof, moof_size);
+    ngx_mp4_set_atom_name(moof, 'm', 'o', 'o', 'f');
+
+    if (mdat_size + 8 > 0xffffffff) {
+        ngx_mp4_set_32value(p, 1);
+        ngx_mp4_set_atom_name(p, 'm', 'd', 'a', 't');
+        ngx_mp4_set_64value(p + 8, mdat_size + 16);
+        p += 16;
+
+    } else {
+        ngx_mp4_set_32value(p, mdat_size + 8);
+        ngx_mp4_set_atom_name(p, 'm', 'd', 'a', 't');
+        p += 8;
+    }
+
+    b->last = p;
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = b;
+    mp4->out = cl;
+    ll = &cl->next;
+
+    /*
+     * the sample data are sent in the file order, so runs of
+     * different traks usually make up a single file range
+     */
+
+    run = runs.elts;
+
+    ngx_qsort(run, runs.nelts, sizeof(ngx_http_mp4_hls_run_t),
+              ngx_http_mp4_hls_run_cmp);
+
+    rel = p - moof;
+    fb = NULL;
+
+    for (i = 0; i < runs.nelts; i++) {
+
+        if (run[i].pos < 0 || run[i].last > mp4->end) {
+            ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                          "\"%s\" mp4 sample data are out of the file",
+                          mp4->file.name.data);
+            return NGX_ERROR;
+        }
+
+        ngx_mp4_set_32value(run[i].data_offset, rel);
+        rel += run[i].last - run[i].pos;
+
+        if (run[i].pos == run[i].last) {
+            continue;
+        }
+
+        if (fb && fb->file_last == run[i].pos) {
+            fb->file_last = run[i].last;
+            continue;
+        }
+
+        fb = ngx_calloc_buf(r->pool);
+        if (fb == NULL) {
+            return NGX_ERROR;
+        }
+
+        fb->file = &mp4->file;
+        fb->in_file = 1;
+        fb->file_pos = run[i].pos;
+        fb->file_last = run[i].last;
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = fb;
+        *ll = cl;
+        ll = &cl->next;
+    }
+
+    *ll = NULL;
+
+    if (fb == NULL) {
+        fb = b;
+    }
+
+    fb->last_buf = 1;
+    fb->last_in_chain = 1;
+
+    mp4->content_length = rel;
+
+    return NGX_OK;
+}
+
+
+static int ngx_libc_cdecl
+ngx_http_mp4_hls_run_cmp(const void *one, const void *two)
+{
+    ngx_http_mp4_hls_run_t  *first, *second;
+
+    first = (ngx_http_mp4_hls_run_t *) one;
+    second = (ngx_http_mp4_hls_run_t *) two;
+
+    if (first->pos < second->pos) {
+        return -1;
+    }
+
+    return first->pos > second->pos;
+}
+
+
+static ngx_int_t
+ngx_http_mp4_hls_check_trak(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_trak_t *trak)
+{
+    if (trak->timescale == 0
+        || trak->out[NGX_HTTP_MP4_TKHD_ATOM].buf == NULL
+        || trak->out[NGX_HTTP_MP4_STSD_ATOM].buf == NULL
+        || trak->out[NGX_HTTP_MP4_STTS_DATA].buf == NULL
+        || trak->out[NGX_HTTP_MP4_STSC_DATA].buf == NULL
+        || trak->out[NGX_HTTP_MP4_STSZ_ATOM].buf == NULL
+        || (trak->out[NGX_HTTP_MP4_STCO_DATA].buf == NULL
+            && trak->out[NGX_HTTP_MP4_CO64_DATA].buf == NULL))
+    {
+        ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                      "incomplete mp4 trak atom in \"%s\"",
+                      mp4->file.name.data);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_mp4_hls_stts_init(ngx_http_mp4_trak_t *trak,
+    ngx_http_mp4_hls_stts_t *stts)
+{
+    stts->entry = trak->stts_data_buf.pos;
+    stts->end = trak->stts_data_buf.last;
+    stts->sample = 0;
+    stts->time = 0;
+}
+
+
+/* the stts cursor moves forward only */
+
+static uint64_t
+ngx_http_mp4_hls_sample_time(ngx_http_mp4_hls_stts_t *stts, uint32_t sample)
+{
+    uint32_t               count, duration;
+    ngx_mp4_stts_entry_t  *entry;
+
+    while (stts->entry < stts->end) {
+        entry = (ngx_mp4_stts_entry_t *) stts->entry;
+
+        count = ngx_mp4_get_32value(entry->count);
+        duration = ngx_mp4_get_32value(entry->duration);
+
+        if (sample - stts->sample < count) {
+            return stts->time + (uint64_t) (sample - stts->sample) * duration;
+        }
+
+        stts->sample += count;
+        stts->time += (uint64_t) count * duration;
+        stts->entry += sizeof(ngx_mp4_stts_entry_t);
+    }
+
+    return stts->time;
+}
+
+
+static uint32_t
+ngx_http_mp4_hls_time_sample(ngx_http_mp4_hls_stts_t *stts, uint64_t time)
+{
+    uint32_t               count, duration;
+    uint64_t               n;
+    ngx_mp4_stts_entry_t  *entry;
+
+    /* the first sample starting not earlier than the time */
+
+    while (stts->entry < stts->end) {
+
+        if (time <= stts->time) {
+            return stts->sample;
+        }
+
+        entry = (ngx_mp4_stts_entry_t *) stts->entry;
+
+        count = ngx_mp4_get_32value(entry->count);
+        duration = ngx_mp4_get_32value(entry->duration);
+
+        if (duration) {
+            n = (time - stts->time + duration - 1) / duration;
+
+            if (n < count) {
+                return stts->sample + (uint32_t) n;
+            }
+        }
+
+        stts->sample += count;
+        stts->time += (uint64_t) count * duration;
+        stts->entry += sizeof(ngx_mp4_stts_entry_t);
+    }
+
+    return stts->sample;
+}
+
+
+static ngx_int_t
+ngx_http_mp4_hls_seek(ngx_http_mp4_file_t *mp4, ngx_http_mp4_hls_track_t *t,
+    uint32_t sample)
+{
+    uint32_t               n, count, duration, chunk, next, samples, rest;
+    uint64_t               first;
+    ngx_http_mp4_trak_t   *trak;
+    ngx_mp4_stts_entry_t  *stts;
+    ngx_mp4_ctts_entry_t  *ctts;
+    ngx_mp4_stsc_entry_t  *stsc;
+
+    trak = t->trak;
+
+    t->sample = sample;
+    t->time = 0;
+
+    /* whole table entries are skipped */
+
+    t->stts = trak->stts_data_buf.pos;
+    t->stts_end = trak->stts_data_buf.last;
+    t->stts_left = 0;
+
+    for (n = 0; t->stts < t->stts_end; n += count) {
+        stts = (ngx_mp4_stts_entry_t *) t->stts;
+
+        count = ngx_mp4_get_32value(stts->count);
+        duration = ngx_mp4_get_32value(stts->duration);
+
+        if (sample - n < count) {
+            t->time += (uint64_t) (sample - n) * duration;
+            t->stts_left = count - (sample - n);
+            break;
+        }
+
+        t->time += (uint64_t) count * duration;
+        t->stts += sizeof(ngx_mp4_stts_entry_t);
+    }
+
+    t->ctts = NULL;
+    t->ctts_end = NULL;
+    t->ctts_left = 0;
+
+    if (trak->out[NGX_HTTP_MP4_CTTS_DATA].buf) {
+        t->ctts = trak->ctts_data_buf.pos;
+        t->ctts_end = trak->ctts_data_buf.last;
+
+        for (n = 0; t->ctts < t->ctts_end; n += count) {
+            ctts = (ngx_mp4_ctts_entry_t *) t->ctts;
+
+            count = ngx_mp4_get_32value(ctts->count);
+
+            if (sample - n < count) {
+                t->ctts_left = count - (sample - n);
+                break;
+            }
+
+            t->ctts += sizeof(ngx_mp4_ctts_entry_t);
+        }
+    }
+
+    t->stsc = trak->stsc_data_buf.pos;
+    t->stsc_end = trak->stsc_data_buf.last;
+
+    for (first = 0; /* void */ ; first += (uint64_t) (next - chunk) * samples) {
+
+        if (t->stsc >= t->stsc_end) {
+            goto corrupted;
+        }
+
+        stsc = (ngx_mp4_stsc_entry_t *) t->stsc;
+
+        chunk = ngx_mp4_get_32value(stsc->chunk);
+        samples = ngx_mp4_get_32value(stsc->samples);
+
+        if (t->stsc + sizeof(ngx_mp4_stsc_entry_t) < t->stsc_end) {
+            next = ngx_mp4_get_32value(stsc[1].chunk);
+
+        } else {
+            next = trak->chunks + 1;
+        }
+
+        if (chunk == 0 || next < chunk) {
+            goto corrupted;
+        }
+
+        if (sample - first < (uint64_t) (next - chunk) * samples) {
+            n = (uint32_t) (sample - first);
+            rest = n % samples;
+
+            t->chunk = chunk - 1 + n / samples;
+            t->next_chunk = next - 1;
+            t->chunk_left = samples - rest;
+            break;
+        }
+
+        t->stsc += sizeof(ngx_mp4_stsc_entry_t);
+    }
+
+    if (t->chunk >= trak->chunks) {
+        goto corrupted;
+    }
+
+    t->offset = ngx_http_mp4_hls_chunk_offset(trak, t->chunk);
+
+    for (n = sample - rest; n < sample; n++) {
+        t->offset += ngx_http_mp4_hls_sample_size(t, n);
+    }
+
+    t->stss = NULL;
+    t->stss_end = NULL;
+
+    if (trak->out[NGX_HTTP_MP4_STSS_DATA].buf) {
+        t->stss = trak->stss_data_buf.pos
+                  + ngx_http_mp4_hls_stss_search(trak, sample)
+                    * sizeof(uint32_t);
+        t->stss_end = trak->stss_data_buf.last;
+    }
+
+    return NGX_OK;
+
+corrupted:
+
+    ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                  "\"%s\" mp4 stsc atom does not match sample %uD",
+                  mp4->file.name.data, sample);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_mp4_hls_next(ngx_http_mp4_file_t *mp4, ngx_http_mp4_hls_track_t *t)
+{
+    ngx_http_mp4_trak_t   *trak;
+    ngx_mp4_stsc_entry_t  *stsc;
+
+    trak = t->trak;
+
+    t->offset += ngx_http_mp4_hls_sample_size(t, t->sample);
+    t->sample++;
+
+    if (t->stts < t->stts_end) {
+        t->time += ngx_mp4_get_32value(
+                       ((ngx_mp4_stts_entry_t *) t->stts)->duration);
+
+        if (--t->stts_left == 0) {
+            do {
+                t->stts += sizeof(ngx_mp4_stts_entry_t);
+
+                if (t->stts >= t->stts_end) {
+                    break;
+                }
+
+                t->stts_left = ngx_mp4_get_32value(
+                                   ((ngx_mp4_stts_entry_t *) t->stts)->count);
+
+            } while (t->stts_left == 0);
+        }
+    }
+
+    if (t->ctts < t->ctts_end && --t->ctts_left == 0) {
+        do {
+            t->ctts += sizeof(ngx_mp4_ctts_entry_t);
+
+            if (t->ctts >= t->ctts_end) {
+                break;
+            }
+
+            t->ctts_left = ngx_mp4_get_32value(
+                               ((ngx_mp4_ctts_entry_t *) t->ctts)->count);
+
+        } while (t->ctts_left == 0);
+    }
+
+    if (t->stss < t->stss_end && ngx_mp4_get_32value(t->stss) <= t->sample) {
+        t->stss += sizeof(uint32_t);
+    }
+
+    if (--t->chunk_left) {
+        return NGX_OK;
+    }
+
+    t->chunk++;
+
+    while (t->chunk >= t->next_chunk) {
+        t->stsc += sizeof(ngx_mp4_stsc_entry_t);
+
+        if (t->stsc >= t->stsc_end) {
+            goto corrupted;
+        }
+
+        stsc = (ngx_mp4_stsc_entry_t *) t->stsc;
+
+        if (t->stsc + sizeof(ngx_mp4_stsc_entry_t) < t->stsc_end) {
+            t->next_chunk = ngx_mp4_get_32value(stsc[1].chunk) - 1;
+
+        } else {
+            t->next_chunk = trak->chunks;
+        }
+    }
+
+    t->chunk_left = ngx_mp4_get_32value(
+                        ((ngx_mp4_stsc_entry_t *) t->stsc)->samples);
+
+    if (t->chunk_left == 0 || t->chunk >= trak->chunks) {
+        goto corrupted;
+    }
+
+    t->offset = ngx_http_mp4_hls_chunk_offset(trak, t->chunk);
+
+    return NGX_OK;
+
+corrupted:
+
+    ngx_log_error(NGX_LOG_ERR, mp4->file.log, 0,
+                  "\"%s\" mp4 stsc atom does not match sample %uD",
+                  mp4->file.name.data, t->sample);
+
+    return NGX_ERROR;
+}
+
+
+static uint32_t
+ngx_http_mp4_hls_sample_size(ngx_http_mp4_hls_track_t *t, uint32_t sample)
+{
+    if (t->sample_size) {
+        return t->sample_size;
+    }
+
+    return ngx_mp4_get_32value(t->trak->stsz_data_buf.pos
+                               + sample * sizeof(uint32_t));
+}
+
+
+static uint32_t
+ngx_http_mp4_hls_sync_sample(ngx_http_mp4_trak_t *trak, uint32_t sample,
+    uint32_t *prev)
+{
+    u_char      *entries;
+    ngx_uint_t   i, n;
+
+    /* the first sync sample not less than the sample and the previous one */
+
+    if (trak->out[NGX_HTTP_MP4_STSS_DATA].buf == NULL) {
+        if (prev) {
+            *prev = sample ? sample - 1 : NGX_HTTP_MP4_NO_SAMPLE;
+        }
+
+        return sample;
+    }
+
+    entries = trak->stss_data_buf.pos;
+    n = (trak->stss_data_buf.last - entries) / sizeof(uint32_t);
+
+    i = ngx_http_mp4_hls_stss_search(trak, sample);
+
+    if (prev) {
+        *prev = i ? ngx_mp4_get_32value(entries + (i - 1) * sizeof(uint32_t))
+                    - 1
+                  : NGX_HTTP_MP4_NO_SAMPLE;
+    }
+
+    if (i == n) {
+        return NGX_HTTP_MP4_NO_SAMPLE;
+    }
+
+    return ngx_mp4_get_32value(entries + i * sizeof(uint32_t)) - 1;
+}
+
+
+static ngx_uint_t
+ngx_http_mp4_hls_stss_search(ngx_http_mp4_trak_t *trak, uint32_t sample)
+{
+    u_char      *entries;
+    ngx_uint_t   left, right, middle;
+
+    /* stss entries are 1-based sample numbers in ascending order */
+
+    entries = trak->stss_data_buf.pos;
+
+    left = 0;
+    right = (trak->stss_data_buf.last - entries) / sizeof(uint32_t);
+
+    while (left < right) {
+        middle = left + (right - left) / 2;
+
+        if (ngx_mp4_get_32value(entries + middle * sizeof(uint32_t))
+            < (uint64_t) sample + 1)
+        {
+            left = middle + 1;
+
+        } else {
+            right = middle;
+        }
+    }
+
+    return left;
+}
+
+
+static off_t
+ngx_http_mp4_hls_chunk_offset(ngx_http_mp4_trak_t *trak, uint32_t chunk)
+{
+    if (trak->out[NGX_HTTP_MP4_CO64_DATA].buf) {
+        return (off_t) ngx_mp4_get_64value(trak->co64_data_buf.pos
+                                           + chunk * sizeof(uint64_t));
+    }
+
+    return (off_t) ngx_mp4_get_32value(trak->stco_data_buf.pos
+                                       + chunk * sizeof(uint32_t));
+}
+
+
+static uint32_t
+ngx_http_mp4_hls_track_id(ngx_http_mp4_trak_t *trak)
+{
+    ngx_mp4_tkhd_atom_t    *tkhd_atom;
+    ngx_mp4_tkhd64_atom_t  *tkhd64_atom;
+
+    tkhd_atom = (ngx_mp4_tkhd_atom_t *) trak->tkhd_atom_buf.pos;
+
+    if (tkhd_atom->version[0] == 0) {
+        return ngx_mp4_get_32value(tkhd_atom->track_id);
+    }
+
+    tkhd64_atom = (ngx_mp4_tkhd64_atom_t *) trak->tkhd_atom_buf.pos;
+
+    return ngx_mp4_get_32value(tkhd64_atom->track_id);
+}
+
+
+static ngx_int_t
+ngx_http_mp4_cache_get(ngx_http_mp4_file_t *mp4)
+{
+    ngx_int_t             rc;
+    ngx_http_mp4_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
+
+    rc = ngx_http_shm_cache_get(conf->cache, mp4->md5,
+                                ngx_http_mp4_cache_copy, mp4);
+
+    if (rc == NGX_DECLINED) {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                       "mp4 cache miss");
+
+        return NGX_DECLINED;
+    }
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                   "mp4 cache hit: %uz", mp4->buffer_size);
+
+    rc = ngx_http_mp4_read_moov_atom(mp4, mp4->buffer_size);
+
+    if (rc == NGX_DECLINED) {
+        return NGX_DONE;
+    }
+
+    return rc;
+}
+
+
+/*
+ * the whole moov atom is copied as its atoms are updated in place for
+ * the request; the zone is not locked while an entry larger than a page
+ * is copied
+ */
+
+static ngx_int_t
+ngx_http_mp4_cache_copy(void *data, u_char *p, size_t len)
+{
+    ngx_http_mp4_file_t  *mp4 = data;
+
+    u_char                      *ftyp, *moov;
+    ngx_uint_t                   i;
+    ngx_buf_t                   *atom, *buf;
+    ngx_http_mp4_cache_trak_t   *ct;
+    ngx_http_mp4_cache_entry_t  *ce;
+
+    ce = (ngx_http_mp4_cache_entry_t *) p;
+
+    if (ce->moov_first && mp4->start == 0 && !mp4->hls) {
+        return NGX_DONE;
+    }
+
+    ftyp = NULL;
+
+    if (ce->ftyp_size) {
+        ftyp = ngx_pnalloc(mp4->request->pool, ce->ftyp_size);
+        if (ftyp == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(ftyp, ce->data, ce->ftyp_size);
+    }
+
+    moov = ngx_pnalloc(mp4->request->pool, ce->moov_size);
+    if (moov == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(moov, ce->data + ce->ftyp_size, ce->moov_size);
+
+    mp4->hints = ngx_palloc(mp4->request->pool,
+                            ce->traks * sizeof(ngx_http_mp4_hint_t));
+    if (mp4->hints == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = ngx_align_ptr(ce->data + ce->ftyp_size + ce->moov_size,
+                      sizeof(uint64_t));
+
+    for (i = 0; i < ce->traks; i++) {
+        ct = (ngx_http_mp4_cache_trak_t *) p;
+        ngx_http_mp4_cache_hint(mp4, ct, &mp4->hints[i]);
+        p += ngx_http_mp4_cache_trak_size(ct, NULL);
+    }
+
+    mp4->nhints = ce->traks;
+
+    if (ftyp) {
+        atom = &mp4->ftyp_atom_buf;
+        atom->temporary = 1;
+        atom->pos = ftyp;
+        atom->last = ftyp + ce->ftyp_size;
+
+        mp4->ftyp_atom.buf = atom;
+        mp4->ftyp_size = ce->ftyp_size;
+        mp4->content_length = ce->ftyp_size;
+    }
+
+    buf = &mp4->mdat_data_buf;
+    buf->file = &mp4->file;
+    buf->in_file = 1;
+    buf->last_buf = 1;
+    buf->last_in_chain = 1;
+    buf->file_pos = ce->mdat_offset;
+    buf->file_last = ce->mdat_end;
+
+    mp4->mdat_atom.buf = &mp4->mdat_atom_buf;
+    mp4->mdat_atom.next = &mp4->mdat_data;
+    mp4->mdat_data.buf = buf;
+
+    mp4->buffer = moov;
+    mp4->buffer_start = moov;
+    mp4->buffer_pos = moov;
+    mp4->buffer_end = moov + ce->moov_size;
+    mp4->buffer_size = ce->moov_size;
+    mp4->offset = ce->moov_offset;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_mp4_cache_hint(ngx_http_mp4_file_t *mp4,
+    ngx_http_mp4_cache_trak_t *ct, ngx_http_mp4_hint_t *hint)
+{
+    uint32_t                   *samples, start_sample;
+    uint64_t                    start_time;
+    ngx_uint_t                  n, lo, hi;
+    ngx_http_mp4_cache_stts_t  *stts;
+
+    ngx_memzero(hint, sizeof(ngx_http_mp4_hint_t));
+
+    if (ct->stts_entries == 0) {
+        return;
+    }
+
+    stts = (ngx_http_mp4_cache_stts_t *) &ct[1];
+    start_time = (uint64_t) mp4->start * ct->timescale / 1000;
+
+    /* the last stts entry starting not later than the start time */
+
+    lo = 0;
+    hi = ct->stts_entries;
+
+    while (hi - lo > 1) {
+        n = lo + (hi - lo) / 2;
+
+        if (stts[n].time <= start_time) {
+            lo = n;
+
+        } else {
+            hi = n;
+        }
+    }
+
+    if (start_time >= stts[lo + 1].time) {
+        /* the start time is out of the trak, let stts update report it */
+        return;
+    }
+
+    hint->stts_entry = lo;
+    hint->stts_time = stts[lo].time;
+    hint->stts_samples = stts[lo].sample;
+
+    start_sample = stts[lo].sample
+                   + (uint32_t) ((start_time - stts[lo].time)
+                                 / stts[lo].duration);
+
+    samples = (uint32_t *) &stts[ct->stts_entries + 1];
+
+    if (ct->ctts_entries) {
+        n = ngx_http_mp4_cache_search(samples, ct->ctts_entries,
+                                      start_sample);
+        hint->ctts_entry = n;
+        hint->ctts_samples = samples[n];
+    }
+
+    samples += ct->ctts_entries;
+
+    if (ct->stsc_entries && start_sample) {
+        n = ngx_http_mp4_cache_search(samples, ct->stsc_entries,
+                                      start_sample - 1);
+        hint->stsc_entry = n;
+        hint->stsc_samples = samples[n];
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                   "mp4 cache hint start_sample:%uD, stts:%ui, ctts:%ui, "
+                   "stsc:%ui", start_sample, hint->stts_entry,
+                   hint->ctts_entry, hint->stsc_entry);
+}
+
+
+static ngx_uint_t
+ngx_http_mp4_cache_search(uint32_t *samples, ngx_uint_t n, uint32_t sample)
+{
+    ngx_uint_t  lo, hi, m;
+
+    /* the last entry preceded by not more than the given samples */
+
+    lo = 0;
+    hi = n;
+
+    while (hi - lo > 1) {
+        m = lo + (hi - lo) / 2;
+
+        if (samples[m] <= sample) {
+            lo = m;
+
+        } else {
+            hi = m;
+        }
+    }
+
+    return lo;
+}
+
+
+static size_t
+ngx_http_mp4_cache_trak_size(ngx_http_mp4_cache_trak_t *ct,
+    ngx_http_mp4_trak_t *trak)
+{
+    if (trak) {
+        ct->timescale = trak->timescale;
+
+        ct->stts_entries = trak->out[NGX_HTTP_MP4_STTS_DATA].buf
+                           ? trak->time_to_sample_entries : 0;
+        ct->ctts_entries = trak->out[NGX_HTTP_MP4_CTTS_DATA].buf
+                           ? trak->composition_offset_entries : 0;
+        ct->stsc_entries = trak->out[NGX_HTTP_MP4_STSC_DATA].buf
+                           ? trak->sample_to_chunk_entries : 0;
+    }
+
+    return ngx_align(sizeof(ngx_http_mp4_cache_trak_t)
+                     + (ct->stts_entries + 1)
+                       * sizeof(ngx_http_mp4_cache_stts_t)
+                     + (ct->ctts_entries + ct->stsc_entries)
+                       * sizeof(uint32_t),
+                     sizeof(uint64_t));
+}
+
+
+static void
+ngx_http_mp4_cache_put(ngx_http_mp4_file_t *mp4)
+{
+    size_t                      len;
+    ngx_int_t                   rc;
+    ngx_uint_t                  i;
+    ngx_http_mp4_trak_t        *trak;
+    ngx_http_mp4_conf_t        *conf;
+    ngx_http_mp4_cache_trak_t   index;
+
+    conf = ngx_http_get_module_loc_conf(mp4->request, ngx_http_mp4_module);
+
+    trak = mp4->trak.elts;
+
+    len = offsetof(ngx_http_mp4_cache_entry_t, data)
+          + ngx_align(mp4->ftyp_size + mp4->cache_moov_size, sizeof(uint64_t));
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+        len += ngx_http_mp4_cache_trak_size(&index, &trak[i]);
+    }
+
+    rc = ngx_http_shm_cache_put(conf->cache, mp4->md5, len,
+                                ngx_http_mp4_cache_fill, mp4);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, mp4->file.log, 0,
+                   "mp4 cache %s: %uz", rc == NGX_OK ? "store" : "skip", len);
+
+    ngx_pfree(mp4->request->pool, mp4->cache_moov);
+    mp4->cache_moov = NULL;
+}
+
+
+static void
+ngx_http_mp4_cache_fill(void *data, u_char *p)
+{
+    ngx_http_mp4_file_t  *mp4 = data;
+
+    size_t                       size;
+    uint32_t                    *samples, count, duration, chunk, sample;
+    uint64_t                     time;
+    ngx_uint_t                   i, j;
+    ngx_buf_t                   *buf;
+    ngx_http_mp4_trak_t         *trak;
+    ngx_mp4_stts_entry_t        *stts_entry;
+    ngx_mp4_ctts_entry_t        *ctts_entry;
+    ngx_mp4_stsc_entry_t        *stsc_entry;
+    ngx_http_mp4_cache_trak_t   *ct;
+    ngx_http_mp4_cache_stts_t   *stts;
+    ngx_http_mp4_cache_entry_t  *ce;
+
+    trak = mp4->trak.elts;
+
+    ce = (ngx_http_mp4_cache_entry_t *) p;
+
+    ce->moov_offset = mp4->cache_moov_offset;
+    ce->mdat_offset = mp4->mdat_data_buf.file_pos;
+    ce->mdat_end = mp4->mdat_data_buf.file_last;
+    ce->ftyp_size = mp4->ftyp_size;
+    ce->moov_size = mp4->cache_moov_size;
+    ce->traks = mp4->trak.nelts;
+    ce->moov_first = mp4->cache_moov_first;
+
+    p = ce->data;
+
+    if (mp4->ftyp_size) {
+        p = ngx_cpymem(p, mp4->ftyp_atom_buf.pos, mp4->ftyp_size);
+    }
+
+    p = ngx_cpymem(p, mp4->cache_moov, mp4->cache_moov_size);
+
+    p = ngx_align_ptr(p, sizeof(uint64_t));
+
+    for (i = 0; i < mp4->trak.nelts; i++) {
+
+        ct = (ngx_http_mp4_cache_trak_t *) p;
+        size = ngx_http_mp4_cache_trak_size(ct, &trak[i]);
+
+        stts = (ngx_http_mp4_cache_stts_t *) &ct[1];
+        time = 0;
+        sample = 0;
+
+        if (ct->stts_entries) {
+            buf = trak[i].out[NGX_HTTP_MP4_STTS_DATA].buf;
+            stts_entry = (ngx_mp4_stts_entry_t *) buf->pos;
+
+            for (j = 0; j < ct->stts_entries; j++) {
+                count = ngx_mp4_get_32value(stts_entry[j].count);
+                duration = ngx_mp4_get_32value(stts_entry[j].duration);
+
+                stts[j].time = time;
+                stts[j].sample = sample;
+                stts[j].duration = duration;
+
+                time += (uint64_t) count * duration;
+                sample += count;
+            }
+        }
+
+        stts[ct->stts_entries].time = time;
+        stts[ct->stts_entries].sample = sample;
+        stts[ct->stts_entries].duration = 0;
+
+        samples = (uint32_t *) &stts[ct->stts_entries + 1];
+        sample = 0;
+
+        if (ct->ctts_entries) {
+            buf = trak[i].out[NGX_HTTP_MP4_CTTS_DATA].buf;
+            ctts_entry = (ngx_mp4_ctts_entry_t *) buf->pos;
+
+            for (j = 0; j < ct->ctts_entries; j++) {
+                samples[j] = sample;
+                sample += ngx_mp4_get_32value(ctts_entry[j].count);
+            }
+        }
+
+        samples += ct->ctts_entries;
+        sample = 0;
+
+        if (ct->stsc_entries) {
+            buf = trak[i].out[NGX_HTTP_MP4_STSC_DATA].buf;
+            stsc_entry = (ngx_mp4_stsc_entry_t *) buf->pos;
+
+            samples[0] = 0;
+
+            for (j = 1; j < ct->stsc_entries; j++) {
+                chunk = ngx_mp4_get_32value(stsc_entry[j - 1].chunk);
+                count = ngx_mp4_get_32value(stsc_entry[j - 1].samples);
+
+                sample += (ngx_mp4_get_32value(stsc_entry[j].chunk) - chunk)
+                          * count;
+                samples[j] = sample;
+            }
+        }
+
+        p += size;
+    }
+}
+
+
+static char *
+ngx_http_mp4(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_mp4_handler;
+
+    return NGX_CONF_OK;
+}
+
+
+static void *
+ngx_http_mp4_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_mp4_conf_t  *conf;
+
+    conf = ngx_palloc(cf->pool, sizeof(ngx_http_mp4_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    conf->buffer_size = NGX_CONF_UNSET_SIZE;
+    conf->max_buffer_size = NGX_CONF_UNSET_SIZE;
+    conf->cache = NGX_CONF_UNSET_PTR;
+    conf->hls = NGX_CONF_UNSET;
+    conf->hls_fragment = NGX_CONF_UNSET_MSEC;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_mp4_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_mp4_conf_t *prev = parent;
+    ngx_http_mp4_conf_t *conf = child;
+
+    ngx_conf_merge_size_value(conf->buffer_size, prev->buffer_size, 512 * 1024);
     ngx_conf_merge_size_value(conf->max_buffer_size, prev->max_buffer_size,
                               10 * 1024 * 1024);
 
+    ngx_conf_merge_ptr_value(conf->cache, prev->cache, NULL);
+
+    ngx_conf_merge_value(conf->hls, prev->hls, 0);
+    ngx_conf_merge_msec_value(conf->hls_fragment, prev->hls_fragment, 5000);
+
     return NGX_CONF_OK;
 }
@@ -52,15 +52,31 @@ typedef struct {
 } ngx_http_range_t;
 
 
+typedef struct {
+    off_t        start;
+    ngx_buf_t   *buf;
+} ngx_http_range_part_t;
+
+
 typedef struct {
     off_t        offset;
     ngx_str_t    boundary_header;
     ngx_array_t  ranges;
+    ngx_array_t  parts;         /* ngx_http_range_part_t */
+
+    ngx_uint_t   index;
+
+    unsigned     ordered:1;
+    unsigned     done:1;
 } ngx_http_range_filter_ctx_t;
 
 
 static ngx_int_t ngx_http_range_parse(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx, ngx_uint_t ranges);
+static ngx_int_t ngx_http_range_coalesce(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx);
+static int ngx_libc_cdecl ngx_http_range_cmp(const void *one,
+    const void *two);
 static ngx_int_t ngx_http_range_singlepart_header(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx);
 static ngx_int_t ngx_http_range_multipart_header(ngx_http_request_t *r,
@@ -72,6 +88,17 @@ static ngx_int_t ngx_http_range_singlepart_body(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in);
 static ngx_int_t ngx_http_range_multipart_body(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in);
+static ngx_int_t ngx_http_range_multipart_stream(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in);
+static ngx_int_t ngx_http_range_multipart_save(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in);
+static ngx_chain_t *ngx_http_range_boundary(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_http_range_t *range);
+static ngx_chain_t *ngx_http_range_last_boundary(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx);
+static ngx_chain_t *ngx_http_range_data(ngx_http_request_t *r,
+    ngx_buf_t *buf, off_t start, off_t end);
+static void ngx_http_range_skip(ngx_buf_t *buf);
 
 static ngx_int_t ngx_http_range_header_filter_init(ngx_conf_t *cf);
 static ngx_int_t ngx_http_range_body_filter_init(ngx_conf_t *cf);
@@ -243,12 +270,11 @@ ngx_http_range_parse(ngx_http_request_t *r, ngx_http_range_filter_ctx_t *ctx,
     ngx_uint_t ranges)
 {
     u_char            *p;
-    off_t              start, end, size, content_length;
+    off_t              start, end, content_length;
     ngx_uint_t         suffix;
     ngx_http_range_t  *range;
 
     p = r->headers_in.range->value.data + 6;
-    size = 0;
     content_length = r->headers_out.content_length_n;
 
     for ( ;; ) {
@@ -300,7 +326,10 @@ ngx_http_range_parse(ngx_http_request_t *r, ngx_http_range_filter_ctx_t *ctx,
         }
 
         if (suffix) {
-            start = content_length - end;
+
+            /* a suffix longer than the body selects the whole body */
+
+            start = (end < content_length) ? content_length - end : 0;
             end = content_length - 1;
         }
 
@@ -322,8 +351,6 @@ ngx_http_range_parse(ngx_http_request_t *r, ngx_http_range_filter_ctx_t *ctx,
             range->start = start;
             range->end = end;
 
-            size += end - start;
-
             if (ranges-- == 0) {
                 return NGX_DECLINED;
             }
@@ -338,14 +365,113 @@ ngx_http_range_parse(ngx_http_request_t *r, ngx_http_range_filter_ctx_t *ctx,
         return NGX_HTTP_RANGE_NOT_SATISFIABLE;
     }
 
-    if (size > content_length) {
-        return NGX_DECLINED;
+    if (ctx->ranges.nelts == 1) {
+        return NGX_OK;
+    }
+
+    return ngx_http_range_coalesce(r, ctx);
+}
+
+
+static ngx_int_t
+ngx_http_range_coalesce(ngx_http_request_t *r, ngx_http_range_filter_ctx_t *ctx)
+{
+    ngx_uint_t          i, j, n, *group;
+    ngx_http_range_t   *range, *merged, **sorted;
+
+    /*
+     * the overlapping and adjacent ranges are merged into one part,
+     * the parts are sent in the order the first of their ranges
+     * appeared in the request
+     */
+
+    range = ctx->ranges.elts;
+    n = ctx->ranges.nelts;
+
+    sorted = ngx_palloc(r->pool, n * sizeof(ngx_http_range_t *));
+    if (sorted == NULL) {
+        return NGX_ERROR;
+    }
+
+    merged = ngx_palloc(r->pool, n * sizeof(ngx_http_range_t));
+    if (merged == NULL) {
+        return NGX_ERROR;
+    }
+
+    group = ngx_palloc(r->pool, n * sizeof(ngx_uint_t));
+    if (group == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+        sorted[i] = &range[i];
+    }
+
+    ngx_qsort(sorted, n, sizeof(ngx_http_range_t *), ngx_http_range_cmp);
+
+    j = 0;
+
+    for (i = 0; i < n; i++) {
+
+        if (j && sorted[i]->start <= merged[j - 1].end) {
+            merged[j - 1].end = ngx_max(merged[j - 1].end, sorted[i]->end);
+
+        } else {
+            merged[j].start = sorted[i]->start;
+            merged[j].end = sorted[i]->end;
+            j++;
+        }
+
+        group[sorted[i] - range] = j - 1;
+    }
+
+    for (i = 0, j = 0; i < n; i++) {
+
+        if (merged[group[i]].start == -1) {
+            continue;
+        }
+
+        range[j].start = merged[group[i]].start;
+        range[j].end = merged[group[i]].end;
+        j++;
+
+        merged[group[i]].start = -1;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http range coalesced %ui of %ui", j, n);
+
+    ctx->ranges.nelts = j;
+
+    ctx->ordered = 1;
+
+    for (i = 1; i < j; i++) {
+        if (range[i].start < range[i - 1].end) {
+            ctx->ordered = 0;
+            break;
+        }
     }
 
     return NGX_OK;
 }
 
 
+static int ngx_libc_cdecl
+ngx_http_range_cmp(const void *one, const void *two)
+{
+    ngx_http_range_t  *first, *second;
+
+    first = *(ngx_http_range_t **) one;
+    second = *(ngx_http_range_t **) two;
+
+    if (first->start == second->start) {
+        return 0;
+    }
+
+    return (first->start < second->start) ? -1 : 1;
+}
+
+
 static ngx_int_t
 ngx_http_range_singlepart_header(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx)
@@ -399,6 +525,15 @@ ngx_http_range_multipart_header(ngx_http_request_t *r,
     ngx_http_range_t   *range;
     ngx_atomic_uint_t   boundary;
 
+    if (!ctx->ordered) {
+        if (ngx_array_init(&ctx->parts, r->pool, 4,
+                           sizeof(ngx_http_range_part_t))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
     len = sizeof(CRLF "--") - 1 + NGX_ATOMIC_T_LEN
           + sizeof(CRLF "Content-Type: ") - 1
           + r->headers_out.content_type.len
@@ -563,18 +698,6 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         return ngx_http_range_singlepart_body(r, ctx, in);
     }
 
-    /*
-     * multipart ranges are supported only if whole body is in a single buffer
-     */
-
-    if (ngx_buf_special(in->buf)) {
-        return ngx_http_next_body_filter(r, in);
-    }
-
-    if (ngx_http_range_test_overlapped(r, ctx, in) != NGX_OK) {
-        return NGX_ERROR;
-    }
-
     return ngx_http_range_multipart_body(r, ctx, in);
 }
 
@@ -589,7 +712,7 @@ ngx_http_range_test_overlapped(ngx_http_request_t *r,
     ngx_http_range_t  *range;
 
     if (ctx->offset) {
-        goto overlapped;
+        return NGX_DECLINED;
     }
 
     buf = in->buf;
@@ -601,21 +724,12 @@ ngx_http_range_test_overlapped(ngx_http_request_t *r,
         range = ctx->ranges.elts;
         for (i = 0; i < ctx->ranges.nelts; i++) {
             if (start > range[i].start || last < range[i].end) {
-                 goto overlapped;
+                return NGX_DECLINED;
             }
         }
     }
 
-    ctx->offset = ngx_buf_size(buf);
-
     return NGX_OK;
-
-overlapped:
-
-    ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
-                  "range in overlapped buffers");
-
-    return NGX_ERROR;
 }
 
 
@@ -709,102 +823,412 @@ static ngx_int_t
 ngx_http_range_multipart_body(ngx_http_request_t *r,
     ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in)
 {
-    ngx_buf_t         *b, *buf;
+    ngx_buf_t         *buf;
     ngx_uint_t         i;
-    ngx_chain_t       *out, *hcl, *rcl, *dcl, **ll;
+    ngx_chain_t       *out, *cl, *hcl, **ll;
     ngx_http_range_t  *range;
 
+    if (ctx->done) {
+        for (cl = in; cl; cl = cl->next) {
+            ngx_http_range_skip(cl->buf);
+        }
+
+        return NGX_OK;
+    }
+
+    if (ctx->ordered) {
+        return ngx_http_range_multipart_stream(r, ctx, in);
+    }
+
+    if (ngx_buf_special(in->buf)) {
+        return ngx_http_range_multipart_save(r, ctx, in);
+    }
+
+    if (ngx_http_range_test_overlapped(r, ctx, in) != NGX_OK) {
+        return ngx_http_range_multipart_save(r, ctx, in);
+    }
+
+    /* the whole body is in a single buffer, the ranges may go in any order */
+
+    ctx->offset = ngx_buf_size(in->buf);
+    ctx->done = 1;
+
+    for (cl = in->next; cl; cl = cl->next) {
+        ngx_http_range_skip(cl->buf);
+    }
+
     ll = &out;
     buf = in->buf;
     range = ctx->ranges.elts;
 
     for (i = 0; i < ctx->ranges.nelts; i++) {
 
-        /*
-         * The boundary header of the range:
-         * CRLF
-         * "--0123456789" CRLF
-         * "Content-Type: image/jpeg" CRLF
-         * "Content-Range: bytes "
-         */
-
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
+        hcl = ngx_http_range_boundary(r, ctx, &range[i]);
+        if (hcl == NULL) {
             return NGX_ERROR;
         }
 
-        b->memory = 1;
-        b->pos = ctx->boundary_header.data;
-        b->last = ctx->boundary_header.data + ctx->boundary_header.len;
+        *ll = hcl;
+
+        /* the range data */
 
-        hcl = ngx_alloc_chain_link(r->pool);
-        if (hcl == NULL) {
+        cl = ngx_http_range_data(r, buf, range[i].start, range[i].end);
+        if (cl == NULL) {
             return NGX_ERROR;
         }
 
-        hcl->buf = b;
+        hcl->next->next = cl;
+        ll = &cl->next;
+    }
 
+    *ll = ngx_http_range_last_boundary(r, ctx);
+    if (*ll == NULL) {
+        return NGX_ERROR;
+    }
 
-        /* "SSSS-EEEE/TTTT" CRLF CRLF */
+    return ngx_http_next_body_filter(r, out);
+}
 
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
-            return NGX_ERROR;
+
+static ngx_int_t
+ngx_http_range_multipart_stream(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in)
+{
+    off_t              start, last;
+    ngx_buf_t         *buf, *b;
+    ngx_uint_t         last_buf;
+    ngx_chain_t       *out, *cl, *next, *hcl, *dcl, **ll;
+    ngx_http_range_t  *range, *ranges;
+
+    /*
+     * the ranges go in the order of the body, so each buffer is cut
+     * into the parts as it passes, the last part of a buffer is the buffer
+     * itself, so it is not reused until all its parts are sent
+     */
+
+    out = NULL;
+    ll = &out;
+    ranges = ctx->ranges.elts;
+
+    for (cl = in; cl; cl = next) {
+
+        next = cl->next;
+        buf = cl->buf;
+        last_buf = buf->last_buf;
+
+        start = ctx->offset;
+        last = ctx->offset + ngx_buf_size(buf);
+
+        ctx->offset = last;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http range multipart buf: %O-%O", start, last);
+
+        if (ctx->done) {
+            ngx_http_range_skip(buf);
+            continue;
         }
 
-        b->temporary = 1;
-        b->pos = range[i].content_range.data;
-        b->last = range[i].content_range.data + range[i].content_range.len;
+        if (ngx_buf_special(buf)) {
 
-        rcl = ngx_alloc_chain_link(r->pool);
-        if (rcl == NULL) {
-            return NGX_ERROR;
+            if (!last_buf) {
+                *ll = cl;
+                ll = &cl->next;
+                continue;
+            }
+
+            /* the body is shorter than expected */
+
+            goto done;
         }
 
-        rcl->buf = b;
+        dcl = NULL;
 
+        while (ctx->index < ctx->ranges.nelts) {
 
-        /* the range data */
+            range = &ranges[ctx->index];
 
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
-            return NGX_ERROR;
+            if (range->start >= last) {
+                break;
+            }
+
+            if (range->start >= start) {
+                hcl = ngx_http_range_boundary(r, ctx, range);
+                if (hcl == NULL) {
+                    return NGX_ERROR;
+                }
+
+                *ll = hcl;
+                ll = &hcl->next->next;
+            }
+
+            dcl = ngx_http_range_data(r, buf,
+                                      ngx_max(range->start, start) - start,
+                                      ngx_min(range->end, last) - start);
+            if (dcl == NULL) {
+                return NGX_ERROR;
+            }
+
+            *ll = dcl;
+            ll = &dcl->next;
+
+            if (range->end > last) {
+                break;
+            }
+
+            ctx->index++;
         }
 
-        b->in_file = buf->in_file;
-        b->temporary = buf->temporary;
-        b->memory = buf->memory;
-        b->mmap = buf->mmap;
-        b->file = buf->file;
+        if (dcl) {
+            b = dcl->buf;
+
+            buf->pos = b->pos;
+            buf->last = b->last;
+            buf->file_pos = b->file_pos;
+            buf->file_last = b->file_last;
+            buf->last_buf = 0;
+            buf->last_in_chain = 0;
+
+            dcl->buf = buf;
 
-        if (buf->in_file) {
-            b->file_pos = buf->file_pos + range[i].start;
-            b->file_last = buf->file_pos + range[i].end;
+        } else {
+            ngx_http_range_skip(buf);
         }
 
-        if (ngx_buf_in_memory(buf)) {
-            b->pos = buf->pos + (size_t) range[i].start;
-            b->last = buf->pos + (size_t) range[i].end;
+        if (ctx->index < ctx->ranges.nelts && !last_buf) {
+            continue;
         }
 
-        dcl = ngx_alloc_chain_link(r->pool);
-        if (dcl == NULL) {
+    done:
+
+        *ll = ngx_http_range_last_boundary(r, ctx);
+        if (*ll == NULL) {
             return NGX_ERROR;
         }
 
-        dcl->buf = b;
+        ll = &(*ll)->next;
+
+        ctx->done = 1;
+    }
+
+    *ll = NULL;
+
+    if (out == NULL) {
+        return NGX_OK;
+    }
+
+    return ngx_http_next_body_filter(r, out);
+}
+
+
+static ngx_int_t
+ngx_http_range_multipart_save(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in)
+{
+    off_t                   start, last, from, to;
+    size_t                  size;
+    ngx_buf_t              *buf, *b;
+    ngx_uint_t              i, j, overlap, done;
+    ngx_chain_t            *out, *cl, *hcl, **ll;
+    ngx_http_range_t       *range;
+    ngx_http_range_part_t  *part;
+
+    /*
+     * the ranges go out of the order of the body and the body is in
+     * several buffers: the parts of the buffers with the ranges are kept,
+     * the file parts are referenced, the memory parts are copied
+     */
+
+    range = ctx->ranges.elts;
+    done = 0;
+
+    for (cl = in; cl; cl = cl->next) {
+
+        buf = cl->buf;
+
+        if (buf->last_buf) {
+            done = 1;
+        }
+
+        start = ctx->offset;
+        last = ctx->offset + ngx_buf_size(buf);
+
+        ctx->offset = last;
+
+        if (ngx_buf_special(buf)) {
+            continue;
+        }
+
+        overlap = 0;
+
+        for (i = 0; i < ctx->ranges.nelts; i++) {
+            if (range[i].start < last && range[i].end > start) {
+                overlap = 1;
+                break;
+            }
+        }
+
+        if (overlap) {
+            part = ngx_array_push(&ctx->parts);
+            if (part == NULL) {
+                return NGX_ERROR;
+            }
+
+            part->start = start;
+
+            if (ngx_buf_in_memory(buf)) {
+                size = buf->last - buf->pos;
+
+                b = ngx_create_temp_buf(r->pool, size);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+
+                b->last = ngx_cpymem(b->pos, buf->pos, size);
+
+            } else {
+                b = ngx_calloc_buf(r->pool);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+
+                b->in_file = 1;
+                b->file = buf->file;
+                b->file_pos = buf->file_pos;
+                b->file_last = buf->file_last;
+            }
+
+            part->buf = b;
+        }
+
+        ngx_http_range_skip(buf);
+    }
+
+    if (!done) {
+        for (i = 0; i < ctx->ranges.nelts; i++) {
+            if (range[i].end > ctx->offset) {
+                return NGX_OK;
+            }
+        }
+    }
+
+    ctx->done = 1;
+
+    ll = &out;
+    part = ctx->parts.elts;
+
+    for (i = 0; i < ctx->ranges.nelts; i++) {
+
+        hcl = ngx_http_range_boundary(r, ctx, &range[i]);
+        if (hcl == NULL) {
+            return NGX_ERROR;
+        }
 
         *ll = hcl;
-        hcl->next = rcl;
-        rcl->next = dcl;
-        ll = &dcl->next;
+        ll = &hcl->next->next;
+
+        for (j = 0; j < ctx->parts.nelts; j++) {
+
+            b = part[j].buf;
+
+            start = part[j].start;
+            last = start + ngx_buf_size(b);
+
+            if (range[i].start >= last || range[i].end <= start) {
+                continue;
+            }
+
+            from = ngx_max(range[i].start, start) - start;
+            to = ngx_min(range[i].end, last) - start;
+
+            cl = ngx_http_range_data(r, b, from, to);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            *ll = cl;
+            ll = &cl->next;
+        }
+    }
+
+    *ll = ngx_http_range_last_boundary(r, ctx);
+    if (*ll == NULL) {
+        return NGX_ERROR;
+    }
+
+    return ngx_http_next_body_filter(r, out);
+}
+
+
+static ngx_chain_t *
+ngx_http_range_boundary(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_http_range_t *range)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *hcl, *rcl;
+
+    /*
+     * The boundary header of the range:
+     * CRLF
+     * "--0123456789" CRLF
+     * "Content-Type: image/jpeg" CRLF
+     * "Content-Range: bytes "
+     */
+
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->memory = 1;
+    b->pos = ctx->boundary_header.data;
+    b->last = ctx->boundary_header.data + ctx->boundary_header.len;
+
+    hcl = ngx_alloc_chain_link(r->pool);
+    if (hcl == NULL) {
+        return NULL;
+    }
+
+    hcl->buf = b;
+
+
+    /* "SSSS-EEEE/TTTT" CRLF CRLF */
+
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->temporary = 1;
+    b->pos = range->content_range.data;
+    b->last = range->content_range.data + range->content_range.len;
+
+    rcl = ngx_alloc_chain_link(r->pool);
+    if (rcl == NULL) {
+        return NULL;
     }
 
+    rcl->buf = b;
+
+    hcl->next = rcl;
+    rcl->next = NULL;
+
+    return hcl;
+}
+
+
+static ngx_chain_t *
+ngx_http_range_last_boundary(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *hcl;
+
     /* the last boundary CRLF "--0123456789--" CRLF  */
 
     b = ngx_calloc_buf(r->pool);
     if (b == NULL) {
-        return NGX_ERROR;
+        return NULL;
     }
 
     b->temporary = 1;
@@ -813,7 +1237,7 @@ ngx_http_range_multipart_body(ngx_http_request_t *r,
     b->pos = ngx_pnalloc(r->pool, sizeof(CRLF "--") - 1 + NGX_ATOMIC_T_LEN
                                   + sizeof("--" CRLF) - 1);
     if (b->pos == NULL) {
-        return NGX_ERROR;
+        return NULL;
     }
 
     b->last = ngx_cpymem(b->pos, ctx->boundary_header.data,
@@ -823,15 +1247,67 @@ ngx_http_range_multipart_body(ngx_http_request_t *r,
 
     hcl = ngx_alloc_chain_link(r->pool);
     if (hcl == NULL) {
-        return NGX_ERROR;
+        return NULL;
     }
 
     hcl->buf = b;
     hcl->next = NULL;
 
-    *ll = hcl;
+    return hcl;
+}
 
-    return ngx_http_next_body_filter(r, out);
+
+static ngx_chain_t *
+ngx_http_range_data(ngx_http_request_t *r, ngx_buf_t *buf, off_t start,
+    off_t end)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *dcl;
+
+    /* the range data, the offsets are from the buffer start */
+
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->in_file = buf->in_file;
+    b->temporary = buf->temporary;
+    b->memory = buf->memory;
+    b->mmap = buf->mmap;
+    b->file = buf->file;
+
+    if (buf->in_file) {
+        b->file_pos = buf->file_pos + start;
+        b->file_last = buf->file_pos + end;
+    }
+
+    if (ngx_buf_in_memory(buf)) {
+        b->pos = buf->pos + (size_t) start;
+        b->last = buf->pos + (size_t) end;
+    }
+
+    dcl = ngx_alloc_chain_link(r->pool);
+    if (dcl == NULL) {
+        return NULL;
+    }
+
+    dcl->buf = b;
+    dcl->next = NULL;
+
+    return dcl;
+}
+
+
+static void
+ngx_http_range_skip(ngx_buf_t *buf)
+{
+    if (buf->in_file) {
+        buf->file_pos = buf->file_last;
+    }
+
+    buf->pos = buf->last;
+    buf->sync = 1;
 }
 
 
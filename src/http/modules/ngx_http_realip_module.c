@@ -446,6 +446,15 @@ ngx_http_realip_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         conf->header = prev->header;
     }
 
+    if (conf->from == NULL
+#if (NGX_HAVE_UNIX_DOMAIN)
+        && !conf->unixsock
+#endif
+       )
+    {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_PREACCESS_PHASE);
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -258,6 +258,7 @@ ngx_http_rewrite_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_uint_value(conf->stack_size, prev->stack_size, 10);
 
     if (conf->codes == NULL) {
+        ngx_http_core_phase_idle(cf, NGX_HTTP_REWRITE_PHASE);
         return NGX_CONF_OK;
     }
 
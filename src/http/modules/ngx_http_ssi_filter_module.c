@@ -18,19 +18,67 @@
 
 
 typedef struct {
-    ngx_flag_t    enable;
-    ngx_flag_t    silent_errors;
-    ngx_flag_t    ignore_recycled_buffers;
+    ngx_rbtree_t              rbtree;
+    ngx_rbtree_node_t         sentinel;
+    ngx_queue_t               queue;
 
-    ngx_hash_t    types;
+    ngx_uint_t                current;
+    ngx_uint_t                max;
+} ngx_http_ssi_cache_t;
 
-    size_t        min_file_chunk;
-    size_t        value_len;
 
-    ngx_array_t  *types_keys;
+typedef struct {
+    ngx_flag_t              enable;
+    ngx_flag_t              silent_errors;
+    ngx_flag_t              ignore_recycled_buffers;
+    ngx_flag_t              eager_includes;
+
+    ngx_hash_t              types;
+
+    size_t                  min_file_chunk;
+    size_t                  value_len;
+
+    ngx_http_ssi_cache_t   *cache;
+
+    ngx_array_t            *types_keys;
 } ngx_http_ssi_loc_conf_t;
 
 
+/* a command parsed from a cached template, the offsets are in the file */
+
+typedef struct {
+    off_t                     start;
+    off_t                     end;
+
+    ngx_uint_t                key;
+    ngx_str_t                 command;
+
+    ngx_uint_t                nparams;
+    ngx_table_elt_t          *params;
+
+    ngx_uint_t                error;   /* unsigned  error:1 */
+} ngx_http_ssi_tag_t;
+
+
+typedef struct {
+    ngx_str_node_t            sn;
+    ngx_queue_t               queue;
+
+    ngx_file_uniq_t           uniq;
+    time_t                    mtime;
+    off_t                     size;
+    size_t                    value_len;
+
+    ngx_array_t               tags;      /* ngx_http_ssi_tag_t */
+
+    ngx_pool_t               *pool;
+    ngx_http_ssi_cache_t     *cache;
+    ngx_uint_t                count;
+
+    unsigned                  cached:1;
+} ngx_http_ssi_template_t;
+
+
 typedef struct {
     ngx_str_t     name;
     ngx_uint_t    key;
@@ -75,6 +123,19 @@ static void ngx_http_ssi_buffered(ngx_http_request_t *r,
     ngx_http_ssi_ctx_t *ctx);
 static ngx_int_t ngx_http_ssi_parse(ngx_http_request_t *r,
     ngx_http_ssi_ctx_t *ctx);
+static ngx_int_t ngx_http_ssi_replay(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx);
+static ngx_int_t ngx_http_ssi_template_lookup(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx, ngx_http_ssi_loc_conf_t *slcf);
+static ngx_int_t ngx_http_ssi_template_record(ngx_http_ssi_ctx_t *ctx,
+    ngx_int_t rc);
+static void ngx_http_ssi_template_add(ngx_http_ssi_ctx_t *ctx);
+static void ngx_http_ssi_template_remove(ngx_http_ssi_cache_t *cache,
+    ngx_http_ssi_template_t *t);
+static void ngx_http_ssi_template_cleanup(void *data);
+static ngx_uint_t ngx_http_ssi_eager(ngx_http_ssi_command_t *cmd,
+    ngx_str_t **params);
+static ngx_http_request_t *ngx_http_ssi_waited(ngx_http_ssi_ctx_t *ctx);
 static ngx_str_t *ngx_http_ssi_get_variable(ngx_http_request_t *r,
     ngx_str_t *name, ngx_uint_t key);
 static ngx_int_t ngx_http_ssi_evaluate_string(ngx_http_request_t *r,
@@ -108,6 +169,9 @@ static ngx_int_t ngx_http_ssi_endblock(ngx_http_request_t *r,
 static ngx_int_t ngx_http_ssi_date_gmt_local_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t gmt);
 
+static char *ngx_http_ssi_template_cache(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
 static ngx_int_t ngx_http_ssi_preconfiguration(ngx_conf_t *cf);
 static void *ngx_http_ssi_create_main_conf(ngx_conf_t *cf);
 static char *ngx_http_ssi_init_main_conf(ngx_conf_t *cf, void *conf);
@@ -162,6 +226,20 @@ static ngx_command_t  ngx_http_ssi_filter_commands[] = {
       offsetof(ngx_http_ssi_loc_conf_t, types_keys),
       &ngx_http_html_default_types[0] },
 
+    { ngx_string("ssi_template_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_ssi_template_cache,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_ssi_loc_conf_t, cache),
+      NULL },
+
+    { ngx_string("ssi_eager_includes"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_ssi_loc_conf_t, eager_includes),
+      NULL },
+
       ngx_null_command
 };
 
@@ -355,6 +433,12 @@ ngx_http_ssi_header_filter(ngx_http_request_t *r)
     ngx_str_set(&ctx->errmsg,
                 "[an error occurred while processing the directive]");
 
+    if (slcf->cache) {
+        if (ngx_http_ssi_template_lookup(r, ctx, slcf) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
     r->filter_need_in_memory = 1;
 
     if (r == r->main) {
@@ -373,7 +457,7 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     size_t                     len;
     ngx_int_t                  rc;
     ngx_buf_t                 *b;
-    ngx_uint_t                 i, index;
+    ngx_uint_t                 i, index, eager;
     ngx_chain_t               *cl, **ll;
     ngx_table_elt_t           *param;
     ngx_http_ssi_ctx_t        *ctx, *mctx;
@@ -406,7 +490,14 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http ssi filter \"%V?%V\"", &r->uri, &r->args);
 
-    if (ctx->wait) {
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
+
+    /*
+     * with eager includes the parsing goes on while the waited
+     * subrequests run, up to the first command that has to wait for them
+     */
+
+    if (ctx->wait && (ctx->pending || !slcf->eager_includes)) {
 
         if (r != r->connection->data) {
             ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -421,9 +512,10 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                            "http ssi filter wait \"%V?%V\" done",
                            &ctx->wait->uri, &ctx->wait->args);
 
-            ctx->wait = NULL;
+            ctx->wait = ngx_http_ssi_waited(ctx);
+        }
 
-        } else {
+        if (ctx->wait) {
             ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "http ssi filter wait \"%V?%V\"",
                            &ctx->wait->uri, &ctx->wait->args);
@@ -432,8 +524,6 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         }
     }
 
-    slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
-
     while (ctx->in || ctx->buf) {
 
         if (ctx->buf == NULL) {
@@ -449,12 +539,27 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
         b = NULL;
 
-        while (ctx->pos < ctx->buf->last) {
+        while (ctx->pos < ctx->buf->last || ctx->pending) {
+
+            if (ctx->pending) {
+
+                /* the command has been parsed before the wait */
+
+                ctx->pending = 0;
+                rc = NGX_OK;
+
+                goto pending;
+            }
 
             ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "saved: %d state: %d", ctx->saved, ctx->state);
 
-            rc = ngx_http_ssi_parse(r, ctx);
+            if (ctx->parsed) {
+                rc = ngx_http_ssi_replay(r, ctx);
+
+            } else {
+                rc = ngx_http_ssi_parse(r, ctx);
+            }
 
             ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "parse: %d, looked: %d %p-%p",
@@ -464,6 +569,12 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 return rc;
             }
 
+            if (ctx->record && rc != NGX_AGAIN) {
+                if (ngx_http_ssi_template_record(ctx, rc) != NGX_OK) {
+                    return NGX_ERROR;
+                }
+            }
+
             if (ctx->copy_start != ctx->copy_end) {
 
                 if (ctx->output) {
@@ -605,6 +716,7 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 continue;
             }
 
+        pending:
 
             b = NULL;
 
@@ -781,6 +893,29 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                     }
                 }
 
+                eager = slcf->eager_includes && ngx_http_ssi_eager(cmd, params);
+
+                if (ctx->wait && !eager) {
+
+                    ctx->wait = ngx_http_ssi_waited(ctx);
+
+                    if (ctx->wait) {
+                        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log,
+                                       0, "ssi pending: \"%V\"",
+                                       &ctx->command);
+
+                        ctx->pending = 1;
+
+                        if (ctx->out && ngx_http_ssi_output(r, ctx) == NGX_ERROR)
+                        {
+                            return NGX_ERROR;
+                        }
+
+                        ngx_http_ssi_buffered(r, ctx);
+                        return NGX_AGAIN;
+                    }
+                }
+
                 if (cmd->flush && ctx->out) {
 
                     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -793,7 +928,7 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
                 rc = cmd->handler(r, ctx, params);
 
-                if (rc == NGX_OK) {
+                if (rc == NGX_OK || (rc == NGX_AGAIN && eager)) {
                     continue;
                 }
 
@@ -880,6 +1015,12 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             }
         }
 
+        ctx->offset += ctx->buf->last - ctx->buf->pos;
+
+        if (ctx->record && (ctx->buf->last_buf || ctx->buf->last_in_chain)) {
+            ngx_http_ssi_template_add(ctx);
+        }
+
         ctx->buf = NULL;
 
         ctx->saved = ctx->looked;
@@ -1096,6 +1237,7 @@ ngx_http_ssi_parse(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
                 if (p - ctx->pos < 4) {
                     ctx->saved = 0;
                 }
+                ctx->tag_start = ctx->offset + (p - ctx->buf->pos) - 4;
                 looked = 0;
                 state = ssi_precommand_state;
                 break;
@@ -1523,6 +1665,354 @@ ngx_http_ssi_parse(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
 }
 
 
+static ngx_int_t
+ngx_http_ssi_replay(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
+{
+    off_t                     start, last;
+    ngx_uint_t                i;
+    ngx_table_elt_t          *param;
+    ngx_http_ssi_tag_t       *tag;
+    ngx_http_ssi_template_t  *t;
+
+    /* the commands are taken from the cached template instead of parsing */
+
+    t = ctx->parsed;
+
+    start = ctx->offset + (ctx->pos - ctx->buf->pos);
+    last = ctx->offset + (ctx->buf->last - ctx->buf->pos);
+
+    ctx->copy_start = ctx->pos;
+
+    tag = t->tags.elts;
+    tag += ctx->tag;
+
+    if (ctx->tag == t->tags.nelts || tag->start >= last) {
+        ctx->copy_end = ctx->buf->last;
+        ctx->pos = ctx->buf->last;
+
+        return NGX_AGAIN;
+    }
+
+    ctx->copy_end = (tag->start > start) ? ctx->pos + (tag->start - start)
+                                         : ctx->pos;
+
+    if (tag->end > last) {
+        ctx->pos = ctx->buf->last;
+
+        return NGX_AGAIN;
+    }
+
+    ctx->pos = ctx->buf->pos + (tag->end - ctx->offset);
+    ctx->tag++;
+
+    if (tag->error) {
+        return NGX_HTTP_SSI_ERROR;
+    }
+
+    ctx->command = tag->command;
+    ctx->key = tag->key;
+
+    ctx->params.nelts = 0;
+
+    for (i = 0; i < tag->nparams; i++) {
+        param = ngx_array_push(&ctx->params);
+        if (param == NULL) {
+            return NGX_ERROR;
+        }
+
+        /* the commands may change the values in place */
+
+        param->key = tag->params[i].key;
+        param->value.len = tag->params[i].value.len;
+
+        param->value.data = ngx_pstrdup(r->pool, &tag->params[i].value);
+        if (param->value.data == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_ssi_template_lookup(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
+    ngx_http_ssi_loc_conf_t *slcf)
+{
+    u_char                    *last;
+    size_t                     root;
+    uint32_t                   hash;
+    ngx_str_t                  path;
+    ngx_pool_t                *pool;
+    ngx_pool_cleanup_t        *cln;
+    ngx_open_file_info_t       of;
+    ngx_http_ssi_cache_t      *cache;
+    ngx_http_ssi_template_t   *t;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    /*
+     * only the static files are cached, the identity of a file is
+     * taken from the open file cache and must match the response;
+     * the filters that change a body, such as sub and charset, clear
+     * the content length in main requests only, so subrequests are
+     * never matched against a cached template
+     */
+
+    if (clcf->open_file_cache == NULL
+        || r != r->main
+        || r->upstream
+        || r->headers_out.status != NGX_HTTP_OK
+        || r->headers_out.last_modified_time == -1
+        || r->headers_out.content_length_n <= 0)
+    {
+        return NGX_OK;
+    }
+
+    last = ngx_http_map_uri_to_path(r, &path, &root, 0);
+    if (last == NULL) {
+        return NGX_ERROR;
+    }
+
+    path.len = last - path.data;
+
+    ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+
+    of.read_ahead = clcf->read_ahead;
+    of.directio = clcf->directio;
+    of.valid = clcf->open_file_cache_valid;
+    of.min_uses = clcf->open_file_cache_min_uses;
+    of.errors = clcf->open_file_cache_errors;
+    of.events = clcf->open_file_cache_events;
+
+    if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
+        != NGX_OK)
+    {
+        return NGX_OK;
+    }
+
+    if (!of.is_file
+        || of.mtime != r->headers_out.last_modified_time
+        || of.size != r->headers_out.content_length_n)
+    {
+        return NGX_OK;
+    }
+
+    cache = slcf->cache;
+
+    hash = ngx_crc32_long(path.data, path.len);
+
+    t = (ngx_http_ssi_template_t *)
+            ngx_str_rbtree_lookup(&cache->rbtree, &path, hash);
+
+    if (t) {
+        if (t->uniq == of.uniq
+            && t->mtime == of.mtime
+            && t->size == of.size
+            && t->value_len == slcf->value_len)
+        {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "ssi template cached: \"%V\"", &path);
+
+            ngx_queue_remove(&t->queue);
+            ngx_queue_insert_head(&cache->queue, &t->queue);
+
+            ctx->parsed = t;
+
+            goto found;
+        }
+
+        ngx_http_ssi_template_remove(cache, t);
+    }
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_cycle->log);
+    if (pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    t = ngx_pcalloc(pool, sizeof(ngx_http_ssi_template_t));
+    if (t == NULL) {
+        goto failed;
+    }
+
+    t->sn.str.data = ngx_pstrdup(pool, &path);
+    if (t->sn.str.data == NULL) {
+        goto failed;
+    }
+
+    if (ngx_array_init(&t->tags, pool, 16, sizeof(ngx_http_ssi_tag_t))
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    t->sn.node.key = hash;
+    t->sn.str.len = path.len;
+    t->uniq = of.uniq;
+    t->mtime = of.mtime;
+    t->size = of.size;
+    t->value_len = slcf->value_len;
+    t->pool = pool;
+    t->cache = cache;
+
+    ctx->record = t;
+
+found:
+
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        ctx->parsed = NULL;
+        ctx->record = NULL;
+
+        if (!t->cached) {
+            ngx_destroy_pool(t->pool);
+        }
+
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_ssi_template_cleanup;
+    cln->data = t;
+
+    t->count++;
+
+    return NGX_OK;
+
+failed:
+
+    ngx_destroy_pool(pool);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_ssi_template_record(ngx_http_ssi_ctx_t *ctx, ngx_int_t rc)
+{
+    ngx_uint_t                i;
+    ngx_table_elt_t          *param;
+    ngx_http_ssi_tag_t       *tag;
+    ngx_http_ssi_template_t  *t;
+
+    t = ctx->record;
+
+    tag = ngx_array_push(&t->tags);
+    if (tag == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(tag, sizeof(ngx_http_ssi_tag_t));
+
+    tag->start = ctx->tag_start;
+    tag->end = ctx->offset + (ctx->pos - ctx->buf->pos);
+
+    if (rc == NGX_HTTP_SSI_ERROR) {
+        tag->error = 1;
+        return NGX_OK;
+    }
+
+    tag->key = ctx->key;
+
+    tag->command.len = ctx->command.len;
+    tag->command.data = ngx_pstrdup(t->pool, &ctx->command);
+    if (tag->command.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    tag->nparams = ctx->params.nelts;
+
+    if (tag->nparams == 0) {
+        return NGX_OK;
+    }
+
+    tag->params = ngx_palloc(t->pool, tag->nparams * sizeof(ngx_table_elt_t));
+    if (tag->params == NULL) {
+        return NGX_ERROR;
+    }
+
+    param = ctx->params.elts;
+
+    for (i = 0; i < tag->nparams; i++) {
+        tag->params[i].key.len = param[i].key.len;
+        tag->params[i].key.data = ngx_pstrdup(t->pool, &param[i].key);
+        if (tag->params[i].key.data == NULL) {
+            return NGX_ERROR;
+        }
+
+        tag->params[i].value.len = param[i].value.len;
+        tag->params[i].value.data = ngx_pstrdup(t->pool, &param[i].value);
+        if (tag->params[i].value.data == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_ssi_template_add(ngx_http_ssi_ctx_t *ctx)
+{
+    ngx_queue_t              *q;
+    ngx_http_ssi_cache_t     *cache;
+    ngx_http_ssi_template_t  *t;
+
+    t = ctx->record;
+    ctx->record = NULL;
+
+    if (ctx->offset != t->size) {
+        return;
+    }
+
+    cache = t->cache;
+
+    /* the same file may have been recorded by a concurrent request */
+
+    if (ngx_str_rbtree_lookup(&cache->rbtree, &t->sn.str, t->sn.node.key)) {
+        return;
+    }
+
+    if (cache->current == cache->max) {
+        q = ngx_queue_last(&cache->queue);
+        ngx_http_ssi_template_remove(cache,
+                          ngx_queue_data(q, ngx_http_ssi_template_t, queue));
+    }
+
+    ngx_rbtree_insert(&cache->rbtree, &t->sn.node);
+    ngx_queue_insert_head(&cache->queue, &t->queue);
+
+    cache->current++;
+    t->cached = 1;
+}
+
+
+static void
+ngx_http_ssi_template_remove(ngx_http_ssi_cache_t *cache,
+    ngx_http_ssi_template_t *t)
+{
+    ngx_queue_remove(&t->queue);
+    ngx_rbtree_delete(&cache->rbtree, &t->sn.node);
+
+    cache->current--;
+    t->cached = 0;
+
+    if (t->count == 0) {
+        ngx_destroy_pool(t->pool);
+    }
+}
+
+
+static void
+ngx_http_ssi_template_cleanup(void *data)
+{
+    ngx_http_ssi_template_t  *t = data;
+
+    if (--t->count == 0 && !t->cached) {
+        ngx_destroy_pool(t->pool);
+    }
+}
+
 static ngx_str_t *
 ngx_http_ssi_get_variable(ngx_http_request_t *r, ngx_str_t *name,
     ngx_uint_t key)
@@ -1966,7 +2456,7 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     ngx_buf_t                   *b;
     ngx_uint_t                   flags, i;
     ngx_chain_t                 *cl, *tl, **ll, *out;
-    ngx_http_request_t          *sr;
+    ngx_http_request_t          *sr, **waited;
     ngx_http_ssi_var_t          *var;
     ngx_http_ssi_ctx_t          *mctx;
     ngx_http_ssi_block_t        *bl;
@@ -2175,12 +2665,33 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
         ctx->wait = sr;
 
         return NGX_AGAIN;
+    }
 
-    } else {
-        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                      "only one subrequest may be waited at the same time");
+    if (set == NULL) {
+
+        /* an eager include while the others are still waited */
+
+        if (ctx->waited == NULL) {
+            ctx->waited = ngx_array_create(r->pool, 4,
+                                           sizeof(ngx_http_request_t *));
+            if (ctx->waited == NULL) {
+                return NGX_ERROR;
+            }
+        }
+
+        waited = ngx_array_push(ctx->waited);
+        if (waited == NULL) {
+            return NGX_ERROR;
+        }
+
+        *waited = sr;
+
+        return NGX_AGAIN;
     }
 
+    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                  "only one subrequest may be waited at the same time");
+
     return NGX_OK;
 }
 
@@ -2227,6 +2738,64 @@ ngx_http_ssi_set_variable(ngx_http_request_t *r, void *data, ngx_int_t rc)
 }
 
 
+static ngx_uint_t
+ngx_http_ssi_eager(ngx_http_ssi_command_t *cmd, ngx_str_t **params)
+{
+    ngx_str_t  *uri;
+
+    /*
+     * an include may be issued ahead of the waited subrequests
+     * if neither its uri nor the following commands depend on them
+     */
+
+    if (cmd->handler != ngx_http_ssi_include
+        || params[NGX_HTTP_SSI_INCLUDE_SET])
+    {
+        return 0;
+    }
+
+    uri = params[NGX_HTTP_SSI_INCLUDE_VIRTUAL];
+
+    if (uri == NULL) {
+        uri = params[NGX_HTTP_SSI_INCLUDE_FILE];
+
+        if (uri == NULL) {
+            return 0;
+        }
+    }
+
+    return ngx_strlchr(uri->data, uri->data + uri->len, '$') == NULL;
+}
+
+
+static ngx_http_request_t *
+ngx_http_ssi_waited(ngx_http_ssi_ctx_t *ctx)
+{
+    ngx_uint_t           i;
+    ngx_http_request_t  **sr;
+
+    if (ctx->wait && !ctx->wait->done) {
+        return ctx->wait;
+    }
+
+    if (ctx->waited == NULL) {
+        return NULL;
+    }
+
+    sr = ctx->waited->elts;
+
+    for (i = 0; i < ctx->waited->nelts; i++) {
+        if (!sr[i]->done) {
+            return sr[i];
+        }
+    }
+
+    ctx->waited->nelts = 0;
+
+    return NULL;
+}
+
+
 static ngx_int_t
 ngx_http_ssi_echo(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     ngx_str_t **params)
@@ -2759,6 +3328,59 @@ ngx_http_ssi_date_gmt_local_variable(ngx_http_request_t *r,
 }
 
 
+static char *
+ngx_http_ssi_template_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_ssi_loc_conf_t *slcf = conf;
+
+    ngx_int_t              max;
+    ngx_str_t             *value;
+    ngx_http_ssi_cache_t  *cache;
+
+    if (slcf->cache != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        slcf->cache = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[1].data, "max=", 4) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid \"ssi_template_cache\" parameter \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    max = ngx_atoi(value[1].data + 4, value[1].len - 4);
+    if (max == NGX_ERROR || max == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid \"ssi_template_cache\" parameter \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    cache = ngx_pcalloc(cf->pool, sizeof(ngx_http_ssi_cache_t));
+    if (cache == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_rbtree_init(&cache->rbtree, &cache->sentinel,
+                    ngx_str_rbtree_insert_value);
+
+    ngx_queue_init(&cache->queue);
+
+    cache->max = max;
+
+    slcf->cache = cache;
+
+    return NGX_CONF_OK;
+}
+
+
 static ngx_int_t
 ngx_http_ssi_preconfiguration(ngx_conf_t *cf)
 {
@@ -2866,10 +3488,13 @@ ngx_http_ssi_create_loc_conf(ngx_conf_t *cf)
     slcf->enable = NGX_CONF_UNSET;
     slcf->silent_errors = NGX_CONF_UNSET;
     slcf->ignore_recycled_buffers = NGX_CONF_UNSET;
+    slcf->eager_includes = NGX_CONF_UNSET;
 
     slcf->min_file_chunk = NGX_CONF_UNSET_SIZE;
     slcf->value_len = NGX_CONF_UNSET_SIZE;
 
+    slcf->cache = NGX_CONF_UNSET_PTR;
+
     return slcf;
 }
 
@@ -2884,10 +3509,13 @@ ngx_http_ssi_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_value(conf->silent_errors, prev->silent_errors, 0);
     ngx_conf_merge_value(conf->ignore_recycled_buffers,
                          prev->ignore_recycled_buffers, 0);
+    ngx_conf_merge_value(conf->eager_includes, prev->eager_includes, 0);
 
     ngx_conf_merge_size_value(conf->min_file_chunk, prev->min_file_chunk, 1024);
     ngx_conf_merge_size_value(conf->value_len, prev->value_len, 256);
 
+    ngx_conf_merge_ptr_value(conf->cache, prev->cache, NULL);
+
     if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
                              &prev->types_keys, &prev->types,
                              ngx_http_html_default_types)
@@ -76,11 +76,19 @@ typedef struct {
     unsigned                  block:1;
     unsigned                  output:1;
     unsigned                  output_chosen:1;
+    unsigned                  pending:1;
 
     ngx_http_request_t       *wait;
+    ngx_array_t              *waited;
     void                     *value_buf;
     ngx_str_t                 timefmt;
     ngx_str_t                 errmsg;
+
+    off_t                     offset;
+    off_t                     tag_start;
+    ngx_uint_t                tag;
+    void                     *parsed;
+    void                     *record;
 } ngx_http_ssi_ctx_t;
 
 
@@ -60,11 +60,14 @@ ngx_module_t  ngx_http_stub_status_module = {
 
 static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
 {
-    size_t             size;
-    ngx_int_t          rc;
-    ngx_buf_t         *b;
-    ngx_chain_t        out;
-    ngx_atomic_int_t   ap, hn, ac, rq, rd, wr;
+    size_t                      size;
+    ngx_int_t                   rc;
+    ngx_uint_t                  i, n, nstats;
+    ngx_buf_t                  *b;
+    ngx_chain_t                 out;
+    ngx_atomic_int_t            ap, hn, ac, rq, rd, wr, wm, rl, cm;
+    ngx_event_stat_t           *st, *stats;
+    ngx_http_core_main_conf_t  *cmcf;
 
     if (r->method != NGX_HTTP_GET && r->method != NGX_HTTP_HEAD) {
         return NGX_HTTP_NOT_ALLOWED;
@@ -93,6 +96,47 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
            + 6 + 3 * NGX_ATOMIC_T_LEN
            + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN;
 
+    /*
+     * the memory of the waiting connections is shown if
+     * "keepalive_release_timeout" is set, the memory of the reading
+     * and writing connections is not accounted
+     */
+
+    cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
+
+    if (cmcf->keepalive_release) {
+        size += sizeof("Waiting: memory  released  cached  \n")
+                + 3 * NGX_ATOMIC_T_LEN;
+    }
+
+    /* the loop statistics are shown if "loop_stats" is enabled */
+
+    stats = NULL;
+    nstats = 0;
+
+    if (ngx_event_stat) {
+        if (ngx_event_stats) {
+            stats = ngx_event_stats;
+            nstats = NGX_MAX_PROCESSES;
+
+        } else {
+            stats = ngx_event_stat;
+            nstats = 1;
+        }
+
+        for (i = 0; i < nstats; i++) {
+            if (stats[i].pid == 0) {
+                continue;
+            }
+
+            size += sizeof("Worker : loops  max  events    max  "
+                           "usec    max  slow \n")
+                    + 12 * NGX_ATOMIC_T_LEN
+                    + sizeof("Latency: \n")
+                    + NGX_EVENT_STAT_BUCKETS * (NGX_ATOMIC_T_LEN + 1);
+        }
+    }
+
     b = ngx_create_temp_buf(r->pool, size);
     if (b == NULL) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
@@ -118,6 +162,46 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     b->last = ngx_sprintf(b->last, "Reading: %uA Writing: %uA Waiting: %uA \n",
                           rd, wr, ac - (rd + wr));
 
+    if (cmcf->keepalive_release) {
+        wm = *ngx_stat_waiting_mem;
+        rl = *ngx_stat_released;
+        cm = *ngx_stat_cached_mem;
+
+        b->last = ngx_sprintf(b->last,
+                              "Waiting: memory %uA released %uA cached %uA \n",
+                              wm, rl, cm);
+    }
+
+    for (i = 0; i < nstats; i++) {
+        st = &stats[i];
+
+        if (st->pid == 0) {
+            continue;
+        }
+
+        b->last = ngx_sprintf(b->last, "Worker %uA: loops %uA max %uA "
+                              "events %uA %uA %uA max %uA "
+                              "usec %uA %uA %uA max %uA "
+                              "slow %uA\n",
+                              st->pid, st->loops, st->max_loop,
+                              st->events[NGX_EVENT_STAT_IO],
+                              st->events[NGX_EVENT_STAT_POSTED],
+                              st->events[NGX_EVENT_STAT_TIMERS],
+                              st->max_events,
+                              st->usec[NGX_EVENT_STAT_IO],
+                              st->usec[NGX_EVENT_STAT_POSTED],
+                              st->usec[NGX_EVENT_STAT_TIMERS],
+                              st->max_handler, st->slow);
+
+        b->last = ngx_cpymem(b->last, "Latency:", sizeof("Latency:") - 1);
+
+        for (n = 0; n < NGX_EVENT_STAT_BUCKETS; n++) {
+            b->last = ngx_sprintf(b->last, " %uA", st->latency[n]);
+        }
+
+        *b->last++ = '\n';
+    }
+
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.content_length_n = b->last - b->pos;
 
@@ -10,9 +10,43 @@
 #include <ngx_http.h>
 
 
+#define NGX_HTTP_SUB_MATCH  0x80000000
+
+
 typedef struct {
-    ngx_str_t                  match;
+    ngx_http_complex_value_t   match;
     ngx_http_complex_value_t   value;
+} ngx_http_sub_pair_t;
+
+
+/*
+ * the search strings are compiled into an Aho-Corasick automaton:
+ * the goto and failure functions are folded into one transition table
+ * indexed by the state and by the case insensitive class of a byte,
+ * the bytes that do not occur in the strings share the class 0
+ */
+
+typedef struct {
+    u_char                     classes[256];
+    ngx_uint_t                 nclasses;
+
+    uint32_t                   root[256];
+    uint32_t                  *next;
+
+    u_short                   *match;     /* string number + 1 */
+    u_short                   *fail;
+    u_short                   *depth;
+
+    size_t                    *len;
+    size_t                     max_len;
+    ngx_uint_t                 nmatches;
+} ngx_http_sub_tables_t;
+
+
+typedef struct {
+    ngx_array_t               *pairs;     /* ngx_http_sub_pair_t */
+    ngx_http_sub_tables_t     *tables;
+    ngx_uint_t                 dynamic;   /* unsigned  dynamic:1 */
 
     ngx_hash_t                 types;
 
@@ -22,14 +56,9 @@ typedef struct {
 } ngx_http_sub_loc_conf_t;
 
 
-typedef enum {
-    sub_start_state = 0,
-    sub_match_state,
-} ngx_http_sub_state_e;
-
-
 typedef struct {
-    ngx_str_t                  match;
+    ngx_http_sub_tables_t     *tables;
+
     ngx_str_t                  saved;
     ngx_str_t                  looked;
 
@@ -41,22 +70,32 @@ typedef struct {
     u_char                    *copy_start;
     u_char                    *copy_end;
 
+    size_t                     saved_out;
+    size_t                     keep;
+
     ngx_chain_t               *in;
     ngx_chain_t               *out;
     ngx_chain_t              **last_out;
     ngx_chain_t               *busy;
     ngx_chain_t               *free;
 
-    ngx_str_t                  sub;
+    ngx_str_t                 *sub;
+    u_char                    *replaced;
+    ngx_uint_t                 nreplaced;
 
+    ngx_uint_t                 index;
     ngx_uint_t                 state;
 } ngx_http_sub_ctx_t;
 
 
+static ngx_chain_t *ngx_http_sub_get_buf(ngx_http_request_t *r,
+    ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_output(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_parse(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
+static ngx_http_sub_tables_t *ngx_http_sub_init_tables(ngx_pool_t *pool,
+    ngx_str_t *match, ngx_uint_t n);
 
 static char * ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -131,36 +170,86 @@ static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
 static ngx_int_t
 ngx_http_sub_header_filter(ngx_http_request_t *r)
 {
+    ngx_str_t                 *match;
+    ngx_uint_t                 i, n;
     ngx_http_sub_ctx_t        *ctx;
+    ngx_http_sub_pair_t       *pairs;
+    ngx_http_sub_tables_t     *tables;
     ngx_http_sub_loc_conf_t  *slcf;
 
     slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
 
-    if (slcf->match.len == 0
+    if (slcf->pairs == NULL
         || r->headers_out.content_length_n == 0
         || ngx_http_test_content_type(r, &slcf->types) == NULL)
     {
         return ngx_http_next_header_filter(r);
     }
 
+    pairs = slcf->pairs->elts;
+    n = slcf->pairs->nelts;
+
+    tables = slcf->tables;
+
+    if (tables == NULL) {
+
+        /* the search strings have variables */
+
+        match = ngx_palloc(r->pool, n * sizeof(ngx_str_t));
+        if (match == NULL) {
+            return NGX_ERROR;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (ngx_http_complex_value(r, &pairs[i].match, &match[i])
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+
+        tables = ngx_http_sub_init_tables(r->pool, match, n);
+        if (tables == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "sub_filter search strings are too long");
+            return ngx_http_next_header_filter(r);
+        }
+
+        if (tables->nmatches == 0) {
+            return ngx_http_next_header_filter(r);
+        }
+    }
+
     ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_sub_ctx_t));
     if (ctx == NULL) {
         return NGX_ERROR;
     }
 
-    ctx->saved.data = ngx_pnalloc(r->pool, slcf->match.len);
+    ctx->saved.data = ngx_pnalloc(r->pool, tables->max_len);
     if (ctx->saved.data == NULL) {
         return NGX_ERROR;
     }
 
-    ctx->looked.data = ngx_pnalloc(r->pool, slcf->match.len);
+    ctx->looked.data = ngx_pnalloc(r->pool, tables->max_len);
     if (ctx->looked.data == NULL) {
         return NGX_ERROR;
     }
 
+    ctx->sub = ngx_pcalloc(r->pool, n * sizeof(ngx_str_t));
+    if (ctx->sub == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (slcf->once) {
+        ctx->replaced = ngx_pcalloc(r->pool, n);
+        if (ctx->replaced == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
     ngx_http_set_ctx(r, ctx, ngx_http_sub_filter_module);
 
-    ctx->match = slcf->match;
+    ctx->tables = tables;
     ctx->last_out = &ctx->out;
 
     r->filter_need_in_memory = 1;
@@ -177,10 +266,14 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
 static ngx_int_t
 ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
+    u_char                    *p;
+    size_t                     len;
     ngx_int_t                  rc;
     ngx_buf_t                 *b;
+    ngx_str_t                 *sub;
     ngx_chain_t               *cl;
     ngx_http_sub_ctx_t        *ctx;
+    ngx_http_sub_pair_t       *pairs;
     ngx_http_sub_loc_conf_t   *slcf;
 
     ctx = ngx_http_get_module_ctx(r, ngx_http_sub_filter_module);
@@ -227,89 +320,59 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             ctx->pos = ctx->buf->pos;
         }
 
-        if (ctx->state == sub_start_state) {
-            ctx->copy_start = ctx->pos;
-            ctx->copy_end = ctx->pos;
-        }
-
         b = NULL;
 
         while (ctx->pos < ctx->buf->last) {
 
             ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                           "saved: \"%V\" state: %d", &ctx->saved, ctx->state);
+                           "saved: \"%V\" state: %ui", &ctx->saved, ctx->state);
 
             rc = ngx_http_sub_parse(r, ctx);
 
             ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                           "parse: %d, looked: \"%V\" %p-%p",
-                           rc, &ctx->looked, ctx->copy_start, ctx->copy_end);
+                           "parse: %i, saved out: %uz %p-%p",
+                           rc, ctx->saved_out, ctx->copy_start, ctx->copy_end);
 
             if (rc == NGX_ERROR) {
                 return rc;
             }
 
-            if (ctx->copy_start != ctx->copy_end) {
-
-                ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                               "saved: \"%V\"", &ctx->saved);
-
-                if (ctx->saved.len) {
-
-                    if (ctx->free) {
-                        cl = ctx->free;
-                        ctx->free = ctx->free->next;
-                        b = cl->buf;
-                        ngx_memzero(b, sizeof(ngx_buf_t));
-
-                    } else {
-                        b = ngx_calloc_buf(r->pool);
-                        if (b == NULL) {
-                            return NGX_ERROR;
-                        }
+            /*
+             * the bytes held back from the previous buffers
+             * that turned out not to be a part of a match
+             */
 
-                        cl = ngx_alloc_chain_link(r->pool);
-                        if (cl == NULL) {
-                            return NGX_ERROR;
-                        }
+            if (ctx->saved_out) {
 
-                        cl->buf = b;
-                    }
-
-                    b->pos = ngx_pnalloc(r->pool, ctx->saved.len);
-                    if (b->pos == NULL) {
-                        return NGX_ERROR;
-                    }
-
-                    ngx_memcpy(b->pos, ctx->saved.data, ctx->saved.len);
-                    b->last = b->pos + ctx->saved.len;
-                    b->memory = 1;
+                cl = ngx_http_sub_get_buf(r, ctx);
+                if (cl == NULL) {
+                    return NGX_ERROR;
+                }
 
-                    *ctx->last_out = cl;
-                    ctx->last_out = &cl->next;
+                b = cl->buf;
 
-                    ctx->saved.len = 0;
+                b->pos = ngx_pnalloc(r->pool, ctx->saved_out);
+                if (b->pos == NULL) {
+                    return NGX_ERROR;
                 }
 
-                if (ctx->free) {
-                    cl = ctx->free;
-                    ctx->free = ctx->free->next;
-                    b = cl->buf;
+                ngx_memcpy(b->pos, ctx->saved.data, ctx->saved_out);
+                b->last = b->pos + ctx->saved_out;
+                b->memory = 1;
 
-                } else {
-                    b = ngx_alloc_buf(r->pool);
-                    if (b == NULL) {
-                        return NGX_ERROR;
-                    }
+                *ctx->last_out = cl;
+                ctx->last_out = &cl->next;
+            }
 
-                    cl = ngx_alloc_chain_link(r->pool);
-                    if (cl == NULL) {
-                        return NGX_ERROR;
-                    }
+            if (ctx->copy_start != ctx->copy_end) {
 
-                    cl->buf = b;
+                cl = ngx_http_sub_get_buf(r, ctx);
+                if (cl == NULL) {
+                    return NGX_ERROR;
                 }
 
+                b = cl->buf;
+
                 ngx_memcpy(b, ctx->buf, sizeof(ngx_buf_t));
 
                 b->pos = ctx->copy_start;
@@ -323,27 +386,34 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                     b->file_pos += b->pos - ctx->buf->pos;
                 }
 
-                cl->next = NULL;
                 *ctx->last_out = cl;
                 ctx->last_out = &cl->next;
             }
 
-            if (ctx->state == sub_start_state) {
-                ctx->copy_start = ctx->pos;
-                ctx->copy_end = ctx->pos;
+            if (rc == NGX_AGAIN) {
 
-            } else {
-                ctx->copy_start = NULL;
-                ctx->copy_end = NULL;
-            }
+                /* hold back the tail that may start a match */
+
+                len = ctx->keep - (ctx->buf->last - ctx->copy_end);
+
+                ngx_memcpy(ctx->looked.data, ctx->saved.data + ctx->saved_out,
+                           len);
+                ngx_memcpy(ctx->looked.data + len, ctx->copy_end,
+                           ctx->buf->last - ctx->copy_end);
+
+                p = ctx->saved.data;
+                ctx->saved.data = ctx->looked.data;
+                ctx->saved.len = ctx->keep;
+                ctx->looked.data = p;
 
-            if (rc == NGX_AGAIN) {
                 continue;
             }
 
 
             /* rc == NGX_OK */
 
+            ctx->saved.len = 0;
+
             b = ngx_calloc_buf(r->pool);
             if (b == NULL) {
                 return NGX_ERROR;
@@ -356,19 +426,23 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
             slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
 
-            if (ctx->sub.data == NULL) {
+            sub = &ctx->sub[ctx->index];
+
+            if (sub->data == NULL) {
 
-                if (ngx_http_complex_value(r, &slcf->value, &ctx->sub)
+                pairs = slcf->pairs->elts;
+
+                if (ngx_http_complex_value(r, &pairs[ctx->index].value, sub)
                     != NGX_OK)
                 {
                     return NGX_ERROR;
                 }
             }
 
-            if (ctx->sub.len) {
+            if (sub->len) {
                 b->memory = 1;
-                b->pos = ctx->sub.data;
-                b->last = ctx->sub.data + ctx->sub.len;
+                b->pos = sub->data;
+                b->last = sub->data + sub->len;
 
             } else {
                 b->sync = 1;
@@ -379,50 +453,62 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             *ctx->last_out = cl;
             ctx->last_out = &cl->next;
 
-            ctx->once = slcf->once;
+            if (ctx->replaced) {
+                ctx->replaced[ctx->index] = 1;
+
+                if (++ctx->nreplaced == ctx->tables->nmatches) {
+                    ctx->once = 1;
+                }
+            }
 
             continue;
         }
 
+        if ((ctx->buf->last_buf || ctx->buf->last_in_chain)
+            && ctx->saved.len)
+        {
+
+            /* the held back tail did not end up in a match */
+
+            cl = ngx_http_sub_get_buf(r, ctx);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            b = cl->buf;
+
+            b->pos = ctx->saved.data;
+            b->last = ctx->saved.data + ctx->saved.len;
+            b->memory = 1;
+
+            *ctx->last_out = cl;
+            ctx->last_out = &cl->next;
+
+            ctx->saved.len = 0;
+        }
+
         if (ctx->buf->last_buf || ngx_buf_in_memory(ctx->buf)) {
             if (b == NULL) {
-                if (ctx->free) {
-                    cl = ctx->free;
-                    ctx->free = ctx->free->next;
-                    b = cl->buf;
-                    ngx_memzero(b, sizeof(ngx_buf_t));
-
-                } else {
-                    b = ngx_calloc_buf(r->pool);
-                    if (b == NULL) {
-                        return NGX_ERROR;
-                    }
-
-                    cl = ngx_alloc_chain_link(r->pool);
-                    if (cl == NULL) {
-                        return NGX_ERROR;
-                    }
-
-                    cl->buf = b;
+                cl = ngx_http_sub_get_buf(r, ctx);
+                if (cl == NULL) {
+                    return NGX_ERROR;
                 }
 
+                b = cl->buf;
                 b->sync = 1;
 
-                cl->next = NULL;
                 *ctx->last_out = cl;
                 ctx->last_out = &cl->next;
             }
 
             b->last_buf = ctx->buf->last_buf;
+            b->flush = ctx->buf->flush;
             b->shadow = ctx->buf;
 
             b->recycled = ctx->buf->recycled;
         }
 
         ctx->buf = NULL;
-
-        ctx->saved.len = ctx->looked.len;
-        ngx_memcpy(ctx->saved.data, ctx->looked.data, ctx->looked.len);
     }
 
     if (ctx->out == NULL && ctx->busy == NULL) {
@@ -433,6 +519,37 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 }
 
 
+static ngx_chain_t *
+ngx_http_sub_get_buf(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    if (ctx->free) {
+        cl = ctx->free;
+        ctx->free = ctx->free->next;
+        ngx_memzero(cl->buf, sizeof(ngx_buf_t));
+
+    } else {
+        b = ngx_calloc_buf(r->pool);
+        if (b == NULL) {
+            return NULL;
+        }
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NULL;
+        }
+
+        cl->buf = b;
+    }
+
+    cl->next = NULL;
+
+    return cl;
+}
+
+
 static ngx_int_t
 ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 {
@@ -505,117 +622,295 @@ ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 static ngx_int_t
 ngx_http_sub_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 {
-    u_char                *p, *last, *copy_end, ch, match;
-    size_t                 looked;
-    ngx_http_sub_state_e   state;
+    u_char                 *p, *start, *last, *classes;
+    size_t                  len, n;
+    uint32_t               *next, *root, t;
+    u_short                *match, *fail;
+    ngx_uint_t              state, s, i;
+    ngx_http_sub_tables_t  *tables;
+
+    start = ctx->pos;
+    last = ctx->buf->last;
+
+    ctx->copy_start = start;
 
     if (ctx->once) {
-        ctx->copy_start = ctx->pos;
-        ctx->copy_end = ctx->buf->last;
-        ctx->pos = ctx->buf->last;
-        ctx->looked.len = 0;
+        ctx->saved_out = ctx->saved.len;
+        ctx->copy_end = last;
+        ctx->pos = last;
+        ctx->keep = 0;
 
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0, "once");
 
         return NGX_AGAIN;
     }
 
-    state = ctx->state;
-    looked = ctx->looked.len;
-    last = ctx->buf->last;
-    copy_end = ctx->copy_end;
+    /*
+     * the pending bytes are ctx->saved followed by start..p,
+     * the bytes before the last depth[state] of them can not
+     * be a part of a match any more
+     */
 
-    for (p = ctx->pos; p < last; p++) {
+    tables = ctx->tables;
 
-        ch = *p;
-        ch = ngx_tolower(ch);
+    classes = tables->classes;
+    root = tables->root;
+    next = tables->next;
+    match = tables->match;
 
-        if (state == sub_start_state) {
+    state = ctx->state;
 
-            /* the tight loop */
+    for (p = start; p < last; p++) {
 
-            match = ctx->match.data[0];
+        if (state == 0) {
 
-            for ( ;; ) {
-                if (ch == match) {
-                    copy_end = p;
-                    ctx->looked.data[0] = *p;
-                    looked = 1;
-                    state = sub_match_state;
+            /* the tight loop */
 
-                    goto match_started;
+            while (root[*p] == 0) {
+                if (++p == last) {
+                    goto done;
                 }
+            }
+        }
 
-                if (++p == last) {
+        t = next[state + classes[*p]];
+        state = t & ~NGX_HTTP_SUB_MATCH;
+
+        if (!(t & NGX_HTTP_SUB_MATCH)) {
+            continue;
+        }
+
+        s = state / tables->nclasses;
+        i = match[s] - 1;
+
+        if (ctx->replaced && ctx->replaced[i]) {
+
+            /* look for a shorter string that is not replaced yet */
+
+            fail = tables->fail;
+
+            for (s = fail[s]; match[s]; s = fail[s]) {
+                i = match[s] - 1;
+
+                if (!ctx->replaced[i]) {
                     break;
                 }
+            }
 
-                ch = *p;
-                ch = ngx_tolower(ch);
+            if (match[s] == 0) {
+                continue;
             }
+        }
+
+        len = tables->len[i];
+        n = ++p - start;
+
+        if (len <= n) {
+            ctx->saved_out = ctx->saved.len;
+            ctx->copy_end = p - len;
+
+        } else {
+            ctx->saved_out = ctx->saved.len - (len - n);
+            ctx->copy_end = start;
+        }
+
+        ctx->index = i;
+        ctx->state = 0;
+        ctx->pos = p;
+
+        return NGX_OK;
+    }
+
+done:
+
+    len = tables->depth[state / tables->nclasses];
+    n = last - start;
+
+    if (len <= n) {
+        ctx->saved_out = ctx->saved.len;
+        ctx->copy_end = last - len;
+
+    } else {
+        ctx->saved_out = ctx->saved.len - (len - n);
+        ctx->copy_end = start;
+    }
+
+    ctx->keep = len;
+    ctx->state = state;
+    ctx->pos = last;
+
+    return NGX_AGAIN;
+}
+
+
+static ngx_http_sub_tables_t *
+ngx_http_sub_init_tables(ngx_pool_t *pool, ngx_str_t *match, ngx_uint_t n)
+{
+    u_char                 *p, *last;
+    size_t                  size;
+    uint32_t               *next;
+    u_short                *fail, *queue, *out;
+    ngx_uint_t              i, c, s, t, f, nclasses, nstates, head, tail;
+    ngx_http_sub_tables_t  *tables;
+
+    tables = ngx_pcalloc(pool, sizeof(ngx_http_sub_tables_t));
+    if (tables == NULL) {
+        return NULL;
+    }
+
+    tables->len = ngx_palloc(pool, n * sizeof(size_t));
+    if (tables->len == NULL) {
+        return NULL;
+    }
+
+    nclasses = 1;
+    size = 1;
+
+    for (i = 0; i < n; i++) {
+
+        tables->len[i] = match[i].len;
+
+        if (match[i].len > tables->max_len) {
+            tables->max_len = match[i].len;
+        }
+
+        size += match[i].len;
 
-            ctx->state = state;
-            ctx->pos = p;
-            ctx->looked.len = looked;
-            ctx->copy_end = p;
+        last = match[i].data + match[i].len;
 
-            if (ctx->copy_start == NULL) {
-                ctx->copy_start = ctx->buf->pos;
+        for (p = match[i].data; p < last; p++) {
+            c = ngx_tolower(*p);
+
+            if (tables->classes[c] == 0) {
+                tables->classes[c] = (u_char) nclasses;
+                tables->classes[ngx_toupper(c)] = (u_char) nclasses;
+                nclasses++;
             }
+        }
+    }
 
-            return NGX_AGAIN;
+    if (size > 0xffff || n > 0xfffe) {
+        return NULL;
+    }
 
-        match_started:
+    next = ngx_pcalloc(pool, size * nclasses * sizeof(uint32_t));
+    if (next == NULL) {
+        return NULL;
+    }
 
+    out = ngx_pcalloc(pool, size * sizeof(u_short));
+    if (out == NULL) {
+        return NULL;
+    }
+
+    fail = ngx_pcalloc(pool, size * sizeof(u_short));
+    if (fail == NULL) {
+        return NULL;
+    }
+
+    tables->depth = ngx_pcalloc(pool, size * sizeof(u_short));
+    if (tables->depth == NULL) {
+        return NULL;
+    }
+
+    queue = ngx_palloc(pool, size * sizeof(u_short));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    /* the goto function, the state 0 is the root */
+
+    nstates = 1;
+
+    for (i = 0; i < n; i++) {
+
+        if (match[i].len == 0) {
             continue;
         }
 
-        /* state == sub_match_state */
+        s = 0;
+        last = match[i].data + match[i].len;
 
-        if (ch == ctx->match.data[looked]) {
-            ctx->looked.data[looked] = *p;
-            looked++;
+        for (p = match[i].data; p < last; p++) {
+            c = s * nclasses + tables->classes[*p];
 
-            if (looked == ctx->match.len) {
-                if ((size_t) (p - ctx->pos) < looked) {
-                    ctx->saved.len = 0;
-                }
+            if (next[c] == 0) {
+                next[c] = nstates;
+                tables->depth[nstates] = (u_short) (tables->depth[s] + 1);
+                nstates++;
+            }
 
-                ctx->state = sub_start_state;
-                ctx->pos = p + 1;
-                ctx->looked.len = 0;
-                ctx->copy_end = copy_end;
+            s = next[c];
+        }
 
-                if (ctx->copy_start == NULL && copy_end) {
-                    ctx->copy_start = ctx->buf->pos;
-                }
+        if (out[s] == 0) {
+            out[s] = (u_short) (i + 1);
+            tables->nmatches++;
+        }
+    }
 
-                return NGX_OK;
-            }
+    /*
+     * the failure function in breadth-first order: the transitions
+     * missing from the trie are replaced by the ones of the failure state,
+     * and a state without its own string reports the longest string
+     * ending at the failure state
+     */
 
-        } else if (ch == ctx->match.data[0]) {
-            copy_end = p;
-            ctx->looked.data[0] = *p;
-            looked = 1;
+    head = 0;
+    tail = 0;
 
-        } else {
-            copy_end = p;
-            looked = 0;
-            state = sub_start_state;
+    for (c = 0; c < nclasses; c++) {
+        t = next[c];
+
+        if (t) {
+            fail[t] = 0;
+            queue[tail++] = (u_short) t;
         }
     }
 
-    ctx->state = state;
-    ctx->pos = p;
-    ctx->looked.len = looked;
+    while (head < tail) {
+        s = queue[head++];
 
-    ctx->copy_end = (state == sub_start_state) ? p : copy_end;
+        if (out[s] == 0) {
+            out[s] = out[fail[s]];
+        }
+
+        for (c = 0; c < nclasses; c++) {
+            t = next[s * nclasses + c];
+            f = next[fail[s] * nclasses + c];
 
-    if (ctx->copy_start == NULL && ctx->copy_end) {
-        ctx->copy_start = ctx->buf->pos;
+            if (t) {
+                fail[t] = (u_short) f;
+                queue[tail++] = (u_short) t;
+
+            } else {
+                next[s * nclasses + c] = f;
+            }
+        }
     }
 
-    return NGX_AGAIN;
+    ngx_pfree(pool, queue);
+
+    /*
+     * the transitions are stored as the offsets of the target rows
+     * flagged if the target state reports a match
+     */
+
+    for (i = 0; i < nstates * nclasses; i++) {
+        t = next[i];
+        next[i] = t * nclasses | (out[t] ? NGX_HTTP_SUB_MATCH : 0);
+    }
+
+    for (c = 0; c < 256; c++) {
+        tables->root[c] = next[tables->classes[c]];
+    }
+
+    tables->nclasses = nclasses;
+    tables->next = next;
+    tables->match = out;
+    tables->fail = fail;
+
+    return tables;
 }
 
 
@@ -625,23 +920,43 @@ ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_sub_loc_conf_t *slcf = conf;
 
     ngx_str_t                         *value;
+    ngx_http_sub_pair_t               *pair;
     ngx_http_compile_complex_value_t   ccv;
 
-    if (slcf->match.len) {
-        return "is duplicate";
+    value = cf->args->elts;
+
+    if (slcf->pairs == NULL) {
+        slcf->pairs = ngx_array_create(cf->pool, 1,
+                                       sizeof(ngx_http_sub_pair_t));
+        if (slcf->pairs == NULL) {
+            return NGX_CONF_ERROR;
+        }
     }
 
-    value = cf->args->elts;
+    pair = ngx_array_push(slcf->pairs);
+    if (pair == NULL) {
+        return NGX_CONF_ERROR;
+    }
 
-    ngx_strlow(value[1].data, value[1].data, value[1].len);
+    ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
 
-    slcf->match = value[1];
+    ccv.cf = cf;
+    ccv.value = &value[1];
+    ccv.complex_value = &pair->match;
+
+    if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (pair->match.lengths) {
+        slcf->dynamic = 1;
+    }
 
     ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
 
     ccv.cf = cf;
     ccv.value = &value[2];
-    ccv.complex_value = &slcf->value;
+    ccv.complex_value = &pair->value;
 
     if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
         return NGX_CONF_ERROR;
@@ -664,10 +979,9 @@ ngx_http_sub_create_conf(ngx_conf_t *cf)
     /*
      * set by ngx_pcalloc():
      *
-     *     conf->match = { 0, NULL };
-     *     conf->sub = { 0, NULL };
-     *     conf->sub_lengths = NULL;
-     *     conf->sub_values = NULL;
+     *     conf->pairs = NULL;
+     *     conf->tables = NULL;
+     *     conf->dynamic = 0;
      *     conf->types = { NULL };
      *     conf->types_keys = NULL;
      */
@@ -684,11 +998,39 @@ ngx_http_sub_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_http_sub_loc_conf_t *prev = parent;
     ngx_http_sub_loc_conf_t *conf = child;
 
+    ngx_str_t            *match;
+    ngx_uint_t            i;
+    ngx_http_sub_pair_t  *pairs;
+
     ngx_conf_merge_value(conf->once, prev->once, 1);
-    ngx_conf_merge_str_value(conf->match, prev->match, "");
 
-    if (conf->value.value.len == 0) {
-        conf->value = prev->value;
+    if (conf->pairs == NULL) {
+        conf->pairs = prev->pairs;
+        conf->tables = prev->tables;
+        conf->dynamic = prev->dynamic;
+    }
+
+    if (conf->pairs && conf->tables == NULL && !conf->dynamic) {
+
+        match = ngx_palloc(cf->temp_pool,
+                           conf->pairs->nelts * sizeof(ngx_str_t));
+        if (match == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        pairs = conf->pairs->elts;
+
+        for (i = 0; i < conf->pairs->nelts; i++) {
+            match[i] = pairs[i].match.value;
+        }
+
+        conf->tables = ngx_http_sub_init_tables(cf->pool, match,
+                                                conf->pairs->nelts);
+        if (conf->tables == NULL) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "sub_filter search strings are too long");
+            return NGX_CONF_ERROR;
+        }
     }
 
     if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
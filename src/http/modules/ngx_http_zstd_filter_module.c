@@ -0,0 +1,692 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include <zstd.h>
+
+
+/* ZSTD_WINDOWLOG_ABSOLUTEMIN is not in the stable API */
+
+#define NGX_HTTP_ZSTD_MIN_WLOG   10
+
+
+typedef struct {
+    ngx_flag_t               enable;
+
+    ngx_int_t                level;
+    size_t                   wlog;
+} ngx_http_zstd_conf_t;
+
+
+typedef struct {
+    ngx_chain_t             *in;
+    ngx_chain_t             *free;
+    ngx_chain_t             *busy;
+    ngx_chain_t             *out;
+    ngx_chain_t            **last_out;
+
+    ngx_buf_t               *in_buf;
+    ngx_buf_t               *out_buf;
+    ngx_int_t                bufs;
+
+    ZSTD_CCtx               *cctx;
+    ZSTD_EndDirective        op;
+
+    ZSTD_inBuffer            input;
+    ZSTD_outBuffer           output;
+
+    int                      wlog;
+
+    unsigned                 redo:1;
+    unsigned                 done:1;
+    unsigned                 nomem:1;
+
+    ngx_http_request_t      *request;
+} ngx_http_zstd_ctx_t;
+
+
+static ngx_int_t ngx_http_zstd_filter_start(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_add_data(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_get_buf(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_compress(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_out(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static void ngx_http_zstd_filter_cleanup(void *data);
+
+static ngx_int_t ngx_http_zstd_filter_init(ngx_conf_t *cf);
+static void *ngx_http_zstd_create_conf(ngx_conf_t *cf);
+static char *ngx_http_zstd_merge_conf(ngx_conf_t *cf,
+    void *parent, void *child);
+static char *ngx_http_zstd_window(ngx_conf_t *cf, void *post, void *data);
+
+
+/* the levels above 19 need much more memory and are not for the fly */
+
+static ngx_conf_num_bounds_t  ngx_http_zstd_comp_level_bounds = {
+    ngx_conf_check_num_bounds, 1, 19
+};
+
+static ngx_conf_post_handler_pt  ngx_http_zstd_window_p =
+    ngx_http_zstd_window;
+
+
+static ngx_command_t  ngx_http_zstd_filter_commands[] = {
+
+    { ngx_string("zstd"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_HTTP_LIF_CONF
+                        |NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, enable),
+      NULL },
+
+    { ngx_string("zstd_comp_level"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, level),
+      &ngx_http_zstd_comp_level_bounds },
+
+    { ngx_string("zstd_window"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, wlog),
+      &ngx_http_zstd_window_p },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_zstd_filter_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_zstd_filter_init,             /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    ngx_http_zstd_create_conf,             /* create location configuration */
+    ngx_http_zstd_merge_conf               /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_zstd_filter_module = {
+    NGX_MODULE_V1,
+    &ngx_http_zstd_filter_module_ctx,      /* module context */
+    ngx_http_zstd_filter_commands,         /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
+static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
+
+
+static ngx_int_t
+ngx_http_zstd_header_filter(ngx_http_request_t *r)
+{
+    int                        wlog;
+    ngx_table_elt_t           *h;
+    ngx_http_zstd_ctx_t       *ctx;
+    ngx_http_zstd_conf_t      *conf;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_zstd_filter_module);
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    /* the buffers, types and minimum length are those of gzip */
+
+    if (!conf->enable
+        || (r->headers_out.status != NGX_HTTP_OK
+            && r->headers_out.status != NGX_HTTP_FORBIDDEN
+            && r->headers_out.status != NGX_HTTP_NOT_FOUND)
+        || (r->headers_out.content_encoding
+            && r->headers_out.content_encoding->value.len)
+        || (r->headers_out.content_length_n != -1
+            && r->headers_out.content_length_n < clcf->gzip_min_length)
+        || ngx_http_test_content_type(r, &clcf->gzip_types) == NULL
+        || r->header_only)
+    {
+        return ngx_http_next_header_filter(r);
+    }
+
+    r->gzip_vary = 1;
+
+#if (NGX_HTTP_DEGRADATION)
+
+    if (clcf->gzip_disable_degradation && ngx_http_degraded(r)) {
+        return ngx_http_next_header_filter(r);
+    }
+
+#endif
+
+    if (!r->gzip_tested) {
+        (void) ngx_http_gzip_ok(r);
+    }
+
+    if (!r->zstd_ok) {
+        return ngx_http_next_header_filter(r);
+    }
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_zstd_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_http_set_ctx(r, ctx, ngx_http_zstd_filter_module);
+
+    ctx->request = r;
+
+    wlog = conf->wlog;
+
+    if (r->headers_out.content_length_n > 0) {
+
+        /* there is no need in a window larger than the response */
+
+        while (wlog > NGX_HTTP_ZSTD_MIN_WLOG
+               && r->headers_out.content_length_n < (1 << (wlog - 1)))
+        {
+            wlog--;
+        }
+    }
+
+    ctx->wlog = wlog;
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    h->hash = 1;
+    ngx_str_set(&h->key, "Content-Encoding");
+    ngx_str_set(&h->value, "zstd");
+    r->headers_out.content_encoding = h;
+
+    r->main_filter_need_in_memory = 1;
+
+    ngx_http_clear_content_length(r);
+    ngx_http_clear_accept_ranges(r);
+
+    return ngx_http_next_header_filter(r);
+}
+
+
+static ngx_int_t
+ngx_http_zstd_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    ngx_int_t             rc;
+    ngx_chain_t          *cl;
+    ngx_http_zstd_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_zstd_filter_module);
+
+    if (ctx == NULL || ctx->done) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http zstd filter");
+
+    if (ctx->cctx == NULL) {
+        if (ngx_http_zstd_filter_start(r, ctx) != NGX_OK) {
+            goto failed;
+        }
+    }
+
+    if (in) {
+        if (ngx_chain_add_copy(r->pool, &ctx->in, in) != NGX_OK) {
+            goto failed;
+        }
+    }
+
+    if (ctx->nomem) {
+
+        /* flush busy buffers */
+
+        if (ngx_http_next_body_filter(r, NULL) == NGX_ERROR) {
+            goto failed;
+        }
+
+        cl = NULL;
+
+        ngx_chain_update_chains(&ctx->free, &ctx->busy, &cl,
+                                (ngx_buf_tag_t) &ngx_http_zstd_filter_module);
+        ctx->nomem = 0;
+    }
+
+    for ( ;; ) {
+
+        /* cycle while we can write to a client */
+
+        for ( ;; ) {
+
+            /* cycle while there is data to feed the encoder and ... */
+
+            rc = ngx_http_zstd_filter_add_data(r, ctx);
+
+            if (rc == NGX_DECLINED) {
+                break;
+            }
+
+            if (rc == NGX_AGAIN) {
+                continue;
+            }
+
+
+            /* ... there are buffers to write the encoder output */
+
+            rc = ngx_http_zstd_filter_get_buf(r, ctx);
+
+            if (rc == NGX_DECLINED) {
+                break;
+            }
+
+            if (rc == NGX_ERROR) {
+                goto failed;
+            }
+
+
+            rc = ngx_http_zstd_filter_compress(r, ctx);
+
+            if (rc == NGX_OK) {
+                break;
+            }
+
+            if (rc == NGX_ERROR) {
+                goto failed;
+            }
+
+            /* rc == NGX_AGAIN */
+        }
+
+        if (ctx->out == NULL) {
+            return ctx->busy ? NGX_AGAIN : NGX_OK;
+        }
+
+        rc = ngx_http_next_body_filter(r, ctx->out);
+
+        if (rc == NGX_ERROR) {
+            goto failed;
+        }
+
+        ngx_chain_update_chains(&ctx->free, &ctx->busy, &ctx->out,
+                                (ngx_buf_tag_t) &ngx_http_zstd_filter_module);
+        ctx->last_out = &ctx->out;
+
+        ctx->nomem = 0;
+
+        if (ctx->done) {
+            return rc;
+        }
+    }
+
+    /* unreachable */
+
+failed:
+
+    ctx->done = 1;
+
+    if (ctx->cctx) {
+        ZSTD_freeCCtx(ctx->cctx);
+        ctx->cctx = NULL;
+    }
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_start(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    size_t                 rc;
+    ngx_pool_cleanup_t    *cln;
+    ngx_http_zstd_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_zstd_filter_module);
+
+    /*
+     * the context is allocated by the library as the custom allocator
+     * API is experimental, so it is freed by the pool cleanup as well
+     * if the request is finalized before the response is compressed
+     */
+
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->cctx = ZSTD_createCCtx();
+    if (ctx->cctx == NULL) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "ZSTD_createCCtx() failed");
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_zstd_filter_cleanup;
+    cln->data = ctx;
+
+    rc = ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel,
+                                (int) conf->level);
+
+    if (!ZSTD_isError(rc)) {
+        rc = ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_windowLog, ctx->wlog);
+    }
+
+    if (ZSTD_isError(rc)) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "ZSTD_CCtx_setParameter() failed: %s",
+                      ZSTD_getErrorName(rc));
+        return NGX_ERROR;
+    }
+
+    ctx->last_out = &ctx->out;
+    ctx->op = ZSTD_e_continue;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_add_data(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    if (ctx->input.pos < ctx->input.size
+        || ctx->op != ZSTD_e_continue
+        || ctx->redo)
+    {
+        return NGX_OK;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd in: %p", ctx->in);
+
+    if (ctx->in == NULL) {
+        return NGX_DECLINED;
+    }
+
+    ctx->in_buf = ctx->in->buf;
+    ctx->in = ctx->in->next;
+
+    ctx->input.src = ctx->in_buf->pos;
+    ctx->input.size = ctx->in_buf->last - ctx->in_buf->pos;
+    ctx->input.pos = 0;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd in_buf:%p ni:%p ai:%uz",
+                   ctx->in_buf, ctx->input.src, ctx->input.size);
+
+    if (ctx->in_buf->last_buf) {
+        ctx->op = ZSTD_e_end;
+
+    } else if (ctx->in_buf->flush) {
+        ctx->op = ZSTD_e_flush;
+    }
+
+    if (ctx->input.size == 0 && ctx->op == ZSTD_e_continue) {
+        return NGX_AGAIN;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_get_buf(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (ctx->output.pos < ctx->output.size) {
+        return NGX_OK;
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (ctx->free) {
+        ctx->out_buf = ctx->free->buf;
+        ctx->free = ctx->free->next;
+
+    } else if (ctx->bufs < clcf->gzip_bufs.num) {
+
+        ctx->out_buf = ngx_create_temp_buf(r->pool, clcf->gzip_bufs.size);
+        if (ctx->out_buf == NULL) {
+            return NGX_ERROR;
+        }
+
+        ctx->out_buf->tag = (ngx_buf_tag_t) &ngx_http_zstd_filter_module;
+        ctx->out_buf->recycled = 1;
+        ctx->bufs++;
+
+    } else {
+        ctx->nomem = 1;
+        return NGX_DECLINED;
+    }
+
+    ctx->output.dst = ctx->out_buf->pos;
+    ctx->output.size = clcf->gzip_bufs.size;
+    ctx->output.pos = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_compress(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    size_t  rc;
+
+    ngx_log_debug5(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                 "zstd in: ni:%p no:%p ai:%uz ao:%uz op:%d",
+                 (u_char *) ctx->input.src + ctx->input.pos,
+                 (u_char *) ctx->output.dst + ctx->output.pos,
+                 ctx->input.size - ctx->input.pos,
+                 ctx->output.size - ctx->output.pos, ctx->op);
+
+    rc = ZSTD_compressStream2(ctx->cctx, &ctx->output, &ctx->input, ctx->op);
+
+    if (ZSTD_isError(rc)) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "ZSTD_compressStream2() failed: %s",
+                      ZSTD_getErrorName(rc));
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug5(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd out: ni:%p no:%p ai:%uz ao:%uz rc:%uz",
+                   (u_char *) ctx->input.src + ctx->input.pos,
+                   (u_char *) ctx->output.dst + ctx->output.pos,
+                   ctx->input.size - ctx->input.pos,
+                   ctx->output.size - ctx->output.pos, rc);
+
+    if (ctx->input.src) {
+        ctx->in_buf->pos = (u_char *) ctx->input.src + ctx->input.pos;
+
+        if (ctx->input.pos == ctx->input.size) {
+            ctx->input.src = NULL;
+            ctx->input.size = 0;
+            ctx->input.pos = 0;
+        }
+    }
+
+    ctx->out_buf->last = (u_char *) ctx->output.dst + ctx->output.pos;
+
+    if (ctx->output.pos == ctx->output.size) {
+
+        /* the encoder wants to output some more data */
+
+        if (ngx_http_zstd_filter_out(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        ctx->redo = 1;
+
+        return NGX_AGAIN;
+    }
+
+    ctx->redo = 0;
+
+    if (ctx->input.pos < ctx->input.size) {
+        return NGX_AGAIN;
+    }
+
+    if (ctx->op == ZSTD_e_continue || rc != 0) {
+
+        /* the more input is needed, or the frame is not flushed yet */
+
+        return NGX_AGAIN;
+    }
+
+    ctx->output.size = ctx->output.pos;
+
+    if (ctx->op == ZSTD_e_flush) {
+
+        ctx->out_buf->flush = 1;
+        ctx->op = ZSTD_e_continue;
+
+        if (ngx_http_zstd_filter_out(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_OK;
+    }
+
+    /* ZSTD_e_end */
+
+    ZSTD_freeCCtx(ctx->cctx);
+    ctx->cctx = NULL;
+
+    ctx->out_buf->last_buf = 1;
+
+    if (ngx_http_zstd_filter_out(r, ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ctx->done = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_out(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    ngx_chain_t  *cl;
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = ctx->out_buf;
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_zstd_filter_cleanup(void *data)
+{
+    ngx_http_zstd_ctx_t  *ctx = data;
+
+    if (ctx->cctx) {
+        ZSTD_freeCCtx(ctx->cctx);
+        ctx->cctx = NULL;
+    }
+}
+
+
+static void *
+ngx_http_zstd_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_zstd_conf_t  *conf;
+
+    conf = ngx_palloc(cf->pool, sizeof(ngx_http_zstd_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    conf->enable = NGX_CONF_UNSET;
+
+    conf->level = NGX_CONF_UNSET;
+    conf->wlog = NGX_CONF_UNSET_SIZE;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_zstd_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_zstd_conf_t *prev = parent;
+    ngx_http_zstd_conf_t *conf = child;
+
+    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+
+    ngx_conf_merge_value(conf->level, prev->level, 3);
+    ngx_conf_merge_size_value(conf->wlog, prev->wlog, 21);
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_init(ngx_conf_t *cf)
+{
+    ngx_http_next_header_filter = ngx_http_top_header_filter;
+    ngx_http_top_header_filter = ngx_http_zstd_header_filter;
+
+    ngx_http_next_body_filter = ngx_http_top_body_filter;
+    ngx_http_top_body_filter = ngx_http_zstd_body_filter;
+
+    return NGX_OK;
+}
+
+
+/* the browsers do not accept the windows larger than 8m */
+
+static char *
+ngx_http_zstd_window(ngx_conf_t *cf, void *post, void *data)
+{
+    size_t *np = data;
+
+    size_t  wlog, wsize;
+
+    wlog = 23;
+
+    for (wsize = 8 * 1024 * 1024; wsize >= 1024; wsize >>= 1) {
+
+        if (wsize == *np) {
+            *np = wlog;
+
+            return NGX_CONF_OK;
+        }
+
+        wlog--;
+    }
+
+    return "must be 1k, 2k, 4k, 8k, 16k, 32k, 64k, 128k, 256k, 512k, "
+           "1m, 2m, 4m, or 8m";
+}
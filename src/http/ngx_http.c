@@ -17,6 +17,10 @@ static ngx_int_t ngx_http_init_headers_in_hash(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf);
 static ngx_int_t ngx_http_init_phase_handlers(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf);
+static ngx_int_t ngx_http_init_phase_engines(ngx_conf_t *cf,
+    ngx_http_core_main_conf_t *cmcf, ngx_uint_t *start);
+static ngx_uint_t ngx_http_phase_idle(ngx_http_core_main_conf_t *cmcf,
+    ngx_http_core_loc_conf_t *clcf, ngx_uint_t phase);
 
 static ngx_int_t ngx_http_add_addresses(ngx_conf_t *cf,
     ngx_http_core_srv_conf_t *cscf, ngx_http_conf_port_t *port,
@@ -65,6 +69,8 @@ static ngx_int_t ngx_http_add_addrs(ngx_conf_t *cf, ngx_http_port_t *hport,
 static ngx_int_t ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
     ngx_http_conf_addr_t *addr);
 #endif
+static ngx_int_t ngx_http_add_server_names_cache(ngx_conf_t *cf,
+    ngx_http_virtual_names_t *vn);
 
 ngx_uint_t   ngx_http_max_module;   //!< ngx_modules中 属于NGX_HTTP_MODULE模块 的个数 
 
@@ -287,7 +293,7 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         ngx_command_t *cmd, void *conf/* &(((void **) cycle->conf_ctx)[ngx_http_module->index])*/)  //!< 解析 http {} 块  里的配置指令
 {
     char                        *rv;
-    ngx_uint_t                   mi, m, s;
+    ngx_uint_t                   mi, m, s, start;
     ngx_conf_t                   pcf;
     ngx_http_module_t           *module;
     ngx_http_conf_ctx_t         *ctx;
@@ -408,9 +414,14 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         
         //如果存在preconfiguratio则调用初始化,真正初始化模块之前需要调用preconfiguration来进行一些操作。
         if (module->preconfiguration) {
+            start = ngx_conf_profile_start();
+
             if (module->preconfiguration(cf) != NGX_OK) {
                 return NGX_CONF_ERROR;
             }
+
+            ngx_conf_profile_add(cf->cycle, ngx_module_names[m],
+                                 "preconfiguration", start);
         }
     }
 
@@ -429,12 +440,16 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
      *
      * server{} 解析命令为ngx_http_core_server
      */
+    start = ngx_conf_profile_start();
+
     rv = ngx_conf_parse(cf, NULL);
 
     if (rv != NGX_CONF_OK) {
         goto failed;
     }
 
+    ngx_conf_profile_add(cf->cycle, "http", "parse", start);
+
     /**
      * init http{} main_conf's, merge the server{}s' srv_conf's and its location{}s' loc_conf's
      */
@@ -451,6 +466,8 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         module = ngx_modules[m]->ctx;
         mi = ngx_modules[m]->ctx_index;
 
+        start = ngx_conf_profile_start();
+
         /* init http{} main_conf's */
 
         //如果有init_main_conf,则首先初始化main conf
@@ -466,8 +483,12 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         if (rv != NGX_CONF_OK) {
             goto failed;
         }
+
+        ngx_conf_profile_add(cf->cycle, ngx_module_names[m], "merge", start);
     }
 
+    start = ngx_conf_profile_start();
+
     /* create location trees */
     //当merge完毕之后，然后就是初始化location tree，创建handler phase，调用postconfiguration，以及变量的初始化
     for (s = 0; s < cmcf->servers.nelts; s++) {
@@ -540,6 +561,8 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         }
     }   //!< for {}, 依次迭代每个server{}配置块, 依次初始化每个server{}块对应的 static location tree(三叉location匹配树), 即 srv_conf[0]  loc_conf[0]->static_locations
 
+    ngx_conf_profile_add(cf->cycle, "http", "location trees", start);
+
     //初始化handler phase array数组 
     if (ngx_http_init_phases(cf, cmcf) != NGX_OK) {
         return NGX_CONF_ERROR;
@@ -560,17 +583,26 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
         
         //调用回调
         if (module->postconfiguration) {
+            start = ngx_conf_profile_start();
+
             if (module->postconfiguration(cf) != NGX_OK) {
                 return NGX_CONF_ERROR;
             }
+
+            ngx_conf_profile_add(cf->cycle, ngx_module_names[m],
+                                 "postconfiguration", start);
         }
     }
     
     //开始初始化变量 - before 这个函数前, ngx_http_core_preconfiguration->ngx_http_variables_add_core_vars 根据ngx_http_core_variables[] 初始化 内置动态变量
+    start = ngx_conf_profile_start();
+
     if (ngx_http_variables_init_vars(cf) != NGX_OK) {
         return NGX_CONF_ERROR;
     }
 
+    ngx_conf_profile_add(cf->cycle, "http", "variables", start);
+
     /*
      * http{}'s cf->ctx was needed while the configuration merging
      * and in postconfiguration process
@@ -597,10 +629,14 @@ static char *ngx_http_block(ngx_conf_t *cf/* cf->ctx 为ngx_init_cycle创建的
      *      在 Nginx 处理请求过程中，在函数 ngx_http_find_virtual_server 中，根据请求包头 的 “Host” 字段内容，
      *      使用 ngx_hash_find_combined 函数对虚拟主机名哈希表中进行 查找匹配，寻找合适的虚拟主机
      */
+    start = ngx_conf_profile_start();
+
     if (ngx_http_optimize_servers(cf, cmcf, cmcf->ports) != NGX_OK) {   
         return NGX_CONF_ERROR;
     }
 
+    ngx_conf_profile_add(cf->cycle, "http", "server names", start);
+
     return NGX_CONF_OK;
 
 failed:
@@ -705,6 +741,13 @@ ngx_http_init_headers_in_hash(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
         return NGX_ERROR;
     }
 
+    if (ngx_hash_dispatch_init(&cmcf->headers_in_dispatch, cf->pool,
+                               headers_in.elts, headers_in.nelts)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
     return NGX_OK;
 }
 
@@ -723,6 +766,7 @@ static ngx_int_t ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main
     ngx_int_t                   j;
     ngx_uint_t                  i, n;
     ngx_uint_t                  find_config_index, use_rewrite, use_access;
+    ngx_uint_t                  start[NGX_HTTP_LOG_PHASE + 1];
     ngx_http_handler_pt        *h;
     ngx_http_phase_handler_t   *ph;
     ngx_http_phase_handler_pt   checker;
@@ -795,7 +839,8 @@ static ngx_int_t ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main
 	 * ph是一个数组(cmcf->phase_engine.handlers), 他包含了所有阶段中的方法
 	 */  
     for (i = 0; i < NGX_HTTP_LOG_PHASE; i++) {
-        h = cmcf->phases[i].handlers.elts;  //!< 每个ngx_http_phases下 不同子阶段的 回调函数 指针数组首地址
+        h = cmcf->phases[i].handlers.elts;
+        start[i] = ph - cmcf->phase_engine.handlers;  //!< 每个ngx_http_phases下 不同子阶段的 回调函数 指针数组首地址
 
         switch (i) {
         case NGX_HTTP_SERVER_REWRITE_PHASE:
@@ -920,10 +965,122 @@ static ngx_int_t ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main
         }
     }   //!< for (i = 0; i < NGX_HTTP_LOG_PHASE; i++) {
 
+    start[NGX_HTTP_LOG_PHASE] = ph - cmcf->phase_engine.handlers;
+
+    return ngx_http_init_phase_engines(cf, cmcf, start);
+}
+
+
+static ngx_int_t
+ngx_http_init_phase_engines(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
+    ngx_uint_t *start)
+{
+    u_char                      idle[NGX_HTTP_LOG_PHASE];
+    ngx_uint_t                  i, k, n, p, mask;
+    ngx_http_phase_handler_t   *ph, *engines[16];
+    ngx_http_core_loc_conf_t   *clcf, **clcfp;
+
+    /*
+     * the locations, where all handlers of a phase have reported
+     * that they have no work, get a copy of the engine with the same
+     * layout, but with the phase entries marked to be skipped and
+     * with all "next" indices moved past the skipped entries
+     */
+
+    n = start[NGX_HTTP_LOG_PHASE];
+
+    ngx_memzero(engines, sizeof(engines));
+    engines[0] = cmcf->phase_engine.handlers;
+
+    clcfp = cmcf->phase_locations.elts;
+
+    for (i = 0; i < cmcf->phase_locations.nelts; i++) {
+        clcf = clcfp[i];
+
+        mask = 0;
+
+        if (ngx_http_phase_idle(cmcf, clcf, NGX_HTTP_REWRITE_PHASE)) {
+            mask |= 0x01;
+        }
+
+        if (ngx_http_phase_idle(cmcf, clcf, NGX_HTTP_PREACCESS_PHASE)) {
+            mask |= 0x02;
+        }
+
+        if (ngx_http_phase_idle(cmcf, clcf, NGX_HTTP_ACCESS_PHASE)) {
+            mask |= 0x04;
+        }
+
+        if (cmcf->try_files && clcf->try_files == NULL) {
+            mask |= 0x08;
+        }
+
+        if (engines[mask]) {
+            clcf->phase_handlers = engines[mask];
+            continue;
+        }
+
+        ngx_memzero(idle, sizeof(idle));
+
+        idle[NGX_HTTP_REWRITE_PHASE] = mask & 0x01;
+        idle[NGX_HTTP_POST_REWRITE_PHASE] = mask & 0x01;
+        idle[NGX_HTTP_PREACCESS_PHASE] = mask & 0x02;
+        idle[NGX_HTTP_ACCESS_PHASE] = mask & 0x04;
+        idle[NGX_HTTP_POST_ACCESS_PHASE] = mask & 0x04;
+        idle[NGX_HTTP_TRY_FILES_PHASE] = mask & 0x08;
+
+        ph = ngx_palloc(cf->pool,
+                        n * sizeof(ngx_http_phase_handler_t) + sizeof(void *));
+        if (ph == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(ph, engines[0],
+                   n * sizeof(ngx_http_phase_handler_t) + sizeof(void *));
+
+        for (p = 0; p < NGX_HTTP_LOG_PHASE; p++) {
+
+            if (!idle[p]) {
+                continue;
+            }
+
+            for (k = start[p]; k < start[p + 1]; k++) {
+                ph[k].checker = ngx_http_core_skip_phase;
+                ph[k].next = start[p + 1];
+            }
+        }
+
+        for (k = 0; k < n; k++) {
+            while (ph[k].next < n
+                   && ph[ph[k].next].checker == ngx_http_core_skip_phase)
+            {
+                ph[k].next = ph[ph[k].next].next;
+            }
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, cf->log, 0,
+                       "http phase engine without idle phases: %02Xi", mask);
+
+        engines[mask] = ph;
+        clcf->phase_handlers = ph;
+    }
+
     return NGX_OK;
 }
 
 
+static ngx_uint_t
+ngx_http_phase_idle(ngx_http_core_main_conf_t *cmcf,
+    ngx_http_core_loc_conf_t *clcf, ngx_uint_t phase)
+{
+    ngx_uint_t  nelts;
+
+    nelts = cmcf->phases[phase].handlers.nelts;
+
+    return nelts && clcf->phase_idle[phase] == nelts;
+}
+
+
 static char *
 ngx_http_merge_servers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
     ngx_http_module_t *module, ngx_uint_t ctx_index)
@@ -1043,6 +1200,7 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf/*各个sr
     ngx_http_core_loc_conf_t   **clcfp;
 #if (NGX_PCRE)
     ngx_uint_t                   r;
+    ngx_http_regex_literal_t    *rl;
     ngx_queue_t                 *regex;
 #endif
 
@@ -1165,6 +1323,15 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf/*各个sr
 
         pclcf->regex_locations = clcfp;
 
+        /* the literals are kept apart to be tested without the loc confs */
+
+        rl = ngx_palloc(cf->pool, r * sizeof(ngx_http_regex_literal_t));
+        if (rl == NULL) {
+            return NGX_ERROR;
+        }
+
+        pclcf->regex_literals = rl;
+
         for (q = regex;
              q != ngx_queue_sentinel(locations);
              q = ngx_queue_next(q))
@@ -1172,6 +1339,7 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf/*各个sr
             lq = (ngx_http_location_queue_t *) q;
 
             *(clcfp++) = lq->exact;
+            *(rl++) = lq->exact->regex_literal;
         }
 
         *clcfp = NULL;
@@ -2532,6 +2700,10 @@ ngx_http_add_addrs(ngx_conf_t *cf, ngx_http_port_t *hport,
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
 #endif
+
+        if (ngx_http_add_server_names_cache(cf, vn) != NGX_OK) {
+            return NGX_ERROR;
+        }
     }
 
     return NGX_OK;
@@ -2593,6 +2765,10 @@ ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
 #endif
+
+        if (ngx_http_add_server_names_cache(cf, vn) != NGX_OK) {
+            return NGX_ERROR;
+        }
     }
 
     return NGX_OK;
@@ -2601,6 +2777,72 @@ ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
 #endif
 
 
+/*
+ * the cache is allocated only if there are wildcard or regex names,
+ * the exact names hash is cheaper to search than the cache
+ */
+
+static ngx_int_t
+ngx_http_add_server_names_cache(ngx_conf_t *cf, ngx_http_virtual_names_t *vn)
+{
+    ngx_uint_t                     i, n;
+    ngx_http_server_name_node_t   *node;
+    ngx_http_core_main_conf_t     *cmcf;
+    ngx_http_server_name_cache_t  *cache;
+
+    vn->cache = NULL;
+
+    cmcf = ngx_http_cycle_get_module_main_conf(cf->cycle, ngx_http_core_module);
+
+    n = cmcf->server_names_cache_size;
+
+    if (n == 0) {
+        return NGX_OK;
+    }
+
+    if ((vn->names.wc_head == NULL
+         || vn->names.wc_head->hash.buckets == NULL)
+        && (vn->names.wc_tail == NULL
+            || vn->names.wc_tail->hash.buckets == NULL)
+#if (NGX_PCRE)
+        && vn->nregex == 0
+#endif
+        )
+    {
+        return NGX_OK;
+    }
+
+    cache = ngx_palloc(cf->pool, sizeof(ngx_http_server_name_cache_t));
+    if (cache == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->buckets = ngx_pcalloc(cf->pool,
+                                 n * sizeof(ngx_http_server_name_node_t *));
+    if (cache->buckets == NULL) {
+        return NGX_ERROR;
+    }
+
+    node = ngx_palloc(cf->pool, n * sizeof(ngx_http_server_name_node_t));
+    if (node == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->nbuckets = n;
+
+    ngx_queue_init(&cache->lru);
+    ngx_queue_init(&cache->free);
+
+    for (i = 0; i < n; i++) {
+        ngx_queue_insert_tail(&cache->free, &node[i].queue);
+    }
+
+    vn->cache = cache;
+
+    return NGX_OK;
+}
+
+
 char *
 ngx_http_types_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
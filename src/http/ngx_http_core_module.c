@@ -71,7 +71,8 @@ static char *ngx_http_core_internal(ngx_conf_t *cf, ngx_command_t *cmd,
 static char *ngx_http_core_resolver(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 #if (NGX_HTTP_GZIP)
-static ngx_int_t ngx_http_gzip_accept_encoding(ngx_str_t *ae);
+static ngx_uint_t ngx_http_accept_encoding(ngx_str_t *ae, char *coding,
+    size_t len);
 static ngx_uint_t ngx_http_gzip_quantity(u_char *p, u_char *last);
 static char *ngx_http_gzip_disable(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -218,6 +219,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_main_conf_t, server_names_hash_bucket_size),
       NULL },
 
+    { ngx_string("server_names_cache_size"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, server_names_cache_size),
+      NULL },
+
 
     /* ------------------------------------------------ srv_conf --------------------------------------------------------------- */
     { ngx_string("server"),
@@ -510,6 +518,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("keepalive_release_timeout"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, keepalive_release_timeout),
+      NULL },
+
     { ngx_string("keepalive_requests"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_num_slot,
@@ -766,6 +781,27 @@ static ngx_command_t  ngx_http_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("gzip_buffers"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      ngx_conf_set_bufs_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, gzip_bufs),
+      NULL },
+
+    { ngx_string("gzip_types"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_types_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, gzip_types_keys),
+      &ngx_http_html_default_types[0] },
+
+    { ngx_string("gzip_min_length"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, gzip_min_length),
+      NULL },
+
 #endif
 
       ngx_null_command
@@ -830,7 +866,8 @@ ngx_http_handler(ngx_http_request_t *r)
             break;
         }
 
-        r->lingering_close = (r->headers_in.content_length_n > 0);
+        r->lingering_close = (r->headers_in.content_length_n > 0
+                              || r->headers_in.chunked);
         r->phase_handler = 0;
 
     } else {
@@ -843,6 +880,8 @@ ngx_http_handler(ngx_http_request_t *r)
     r->gzip_tested = 0;
     r->gzip_ok = 0;
     r->gzip_vary = 0;
+    r->brotli_ok = 0;
+    r->zstd_ok = 0;
 #endif
 
     r->write_event_handler = ngx_http_core_run_phases;
@@ -855,17 +894,26 @@ ngx_http_handler(ngx_http_request_t *r)
  */
 void ngx_http_core_run_phases(ngx_http_request_t *r)
 {
-    ngx_int_t                   rc;
-    ngx_http_phase_handler_t   *ph;
-    ngx_http_core_main_conf_t  *cmcf;
+    ngx_int_t                  rc;
+    ngx_http_phase_handler_t  *ph;
+    ngx_http_core_loc_conf_t  *clcf;
 
-    cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
+    for ( ;; ) {
 
-    ph = cmcf->phase_engine.handlers;
+        /*
+         * the location may change between the handlers, its engine
+         * has the same layout as the main one with the idle phases skipped
+         */
+
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
-    while (ph[r->phase_handler].checker) {
+        ph = &clcf->phase_handlers[r->phase_handler];
 
-        rc = ph[r->phase_handler].checker(r, &ph[r->phase_handler]);
+        if (ph->checker == NULL) {
+            return;
+        }
+
+        rc = ph->checker(r, ph);
 
         if (rc == NGX_OK) {
             return;
@@ -1420,6 +1468,35 @@ ngx_http_core_content_phase(ngx_http_request_t *r,
 }
 
 
+ngx_int_t
+ngx_http_core_skip_phase(ngx_http_request_t *r, ngx_http_phase_handler_t *ph)
+{
+    /*
+     * the checker of the phases that have no work in the location,
+     * it is reached only if the previous handler has declined
+     */
+
+    r->phase_handler = ph->next;
+    return NGX_AGAIN;
+}
+
+
+void
+ngx_http_core_phase_idle(ngx_conf_t *cf, ngx_uint_t phase)
+{
+    ngx_http_core_loc_conf_t  *clcf;
+
+    /*
+     * a module calls it from its merge_loc_conf() if its handler
+     * of the phase would just decline in the location being merged
+     */
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+
+    clcf->phase_idle[phase]++;
+}
+
+
 void
 ngx_http_update_location_config(ngx_http_request_t *r)
 {
@@ -1520,8 +1597,10 @@ ngx_http_core_find_location(ngx_http_request_t *r)
     ngx_int_t                  rc;
     ngx_http_core_loc_conf_t  *pclcf;
 #if (NGX_PCRE)
+    uint64_t                   mask;
     ngx_int_t                  n;
     ngx_uint_t                 noregex;
+    ngx_http_regex_literal_t  *rl;
     ngx_http_core_loc_conf_t  *clcf, **clcfp;
 
     noregex = 0;
@@ -1558,7 +1637,14 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 #if (NGX_PCRE)
     if (noregex == 0/*ƥ ^~ xxx, clcf->noregeΪ1*/ && pclcf->regex_locations) {
 
-        for (clcfp = pclcf->regex_locations; *clcfp; clcfp++) {
+        rl = pclcf->regex_literals;
+        mask = ngx_http_regex_literal_mask(r->uri.data, r->uri.len);
+
+        for (clcfp = pclcf->regex_locations; *clcfp; clcfp++, rl++) {
+
+            if (!ngx_http_regex_literal_test(rl, &r->uri, mask)) {
+                continue;
+            }
 
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "test location: ~ \"%V\"", &(*clcfp)->name);
@@ -2111,7 +2197,7 @@ ngx_int_t
 ngx_http_gzip_ok(ngx_http_request_t *r)
 {
     time_t                     date, expires;
-    ngx_uint_t                 p;
+    ngx_uint_t                 p, gzip, br, zstd;
     ngx_array_t               *cc;
     ngx_table_elt_t           *e, *d, *ae;
     ngx_http_core_loc_conf_t  *clcf;
@@ -2127,7 +2213,7 @@ ngx_http_gzip_ok(ngx_http_request_t *r)
         return NGX_DECLINED;
     }
 
-    if (ae->value.len < sizeof("gzip") - 1) {
+    if (ae->value.len < sizeof("br") - 1) {
         return NGX_DECLINED;
     }
 
@@ -2140,9 +2226,28 @@ ngx_http_gzip_ok(ngx_http_request_t *r)
      *   Opera:   "gzip, deflate"
      */
 
-    if (ngx_memcmp(ae->value.data, "gzip,", 5) != 0
-        && ngx_http_gzip_accept_encoding(&ae->value) != NGX_OK)
+    if (ae->value.len >= sizeof("gzip,") - 1
+        && ngx_memcmp(ae->value.data, "gzip,", 5) == 0)
     {
+        gzip = 1000;
+
+    } else {
+        gzip = ngx_http_accept_encoding(&ae->value, "gzip", 4);
+    }
+
+#if (NGX_HTTP_BROTLI)
+    br = ngx_http_accept_encoding(&ae->value, "br", 2);
+#else
+    br = 0;
+#endif
+
+#if (NGX_HTTP_ZSTD)
+    zstd = ngx_http_accept_encoding(&ae->value, "zstd", 4);
+#else
+    zstd = 0;
+#endif
+
+    if (gzip == 0 && br == 0 && zstd == 0) {
         return NGX_DECLINED;
     }
 
@@ -2262,6 +2367,18 @@ ok:
 
 #endif
 
+    /*
+     * the coding rated highest by the client is preferred, brotli, zstd
+     * and gzip go in this order if the client rates them equally
+     */
+
+    r->brotli_ok = (br && br >= zstd && br >= gzip);
+    r->zstd_ok = (zstd && zstd > br && zstd >= gzip);
+
+    if (gzip == 0) {
+        return NGX_DECLINED;
+    }
+
     r->gzip_ok = 1;
 
     return NGX_OK;
@@ -2269,14 +2386,14 @@ ok:
 
 
 /*
- * gzip is enabled for the following quantities:
- *     "gzip; q=0.001" ... "gzip; q=1.000"
- * gzip is disabled for the following quantities:
+ * returns the quantity of the coding in thousandths:
+ *     "gzip" and "gzip; q=1" give 1000, "gzip; q=0.5" gives 500
+ * the coding is disabled for the following quantities:
  *     "gzip; q=0" ... "gzip; q=0.000", and for any invalid cases
  */
 
-static ngx_int_t
-ngx_http_gzip_accept_encoding(ngx_str_t *ae)
+static ngx_uint_t
+ngx_http_accept_encoding(ngx_str_t *ae, char *coding, size_t len)
 {
     u_char  *p, *start, *last;
 
@@ -2284,34 +2401,37 @@ ngx_http_gzip_accept_encoding(ngx_str_t *ae)
     last = start + ae->len;
 
     for ( ;; ) {
-        p = ngx_strcasestrn(start, "gzip", 4 - 1);
+        p = ngx_strcasestrn(start, coding, len - 1);
         if (p == NULL) {
-            return NGX_DECLINED;
+            return 0;
         }
 
-        if (p == start || (*(p - 1) == ',' || *(p - 1) == ' ')) {
+        if ((p == start || (*(p - 1) == ',' || *(p - 1) == ' '))
+            && (p + len == last
+                || p[len] == ',' || p[len] == ';' || p[len] == ' '))
+        {
             break;
         }
 
-        start = p + 4;
+        start = p + len;
     }
 
-    p += 4;
+    p += len;
 
     while (p < last) {
         switch(*p++) {
         case ',':
-            return NGX_OK;
+            return 1000;
         case ';':
             goto quantity;
         case ' ':
             continue;
         default:
-            return NGX_DECLINED;
+            return 0;
         }
     }
 
-    return NGX_OK;
+    return 1000;
 
 quantity:
 
@@ -2323,27 +2443,23 @@ quantity:
         case ' ':
             continue;
         default:
-            return NGX_DECLINED;
+            return 0;
         }
     }
 
-    return NGX_OK;
+    return 1000;
 
 equal:
 
     if (p + 2 > last || *p++ != '=') {
-        return NGX_DECLINED;
-    }
-
-    if (ngx_http_gzip_quantity(p, last) == 0) {
-        return NGX_DECLINED;
+        return 0;
     }
 
-    return NGX_OK;
+    return ngx_http_gzip_quantity(p, last);
 }
 
 
-ngx_uint_t
+static ngx_uint_t
 ngx_http_gzip_quantity(u_char *p, u_char *last)
 {
     u_char      c;
@@ -2355,7 +2471,7 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
         return 0;
     }
 
-    q = (c - '0') * 100;
+    q = (c - '0') * 1000;
 
     if (p == last) {
         return q;
@@ -2380,8 +2496,8 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
             break;
         }
 
-        if (c >= '0' && c <= '9') {
-            q += c - '0';
+        if (c >= '0' && c <= '9' && n < 3) {
+            q += (c - '0') * (n == 0 ? 100 : (n == 1 ? 10 : 1));
             n++;
             continue;
         }
@@ -2389,7 +2505,7 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
         return 0;
     }
 
-    if (q > 100 || n > 3) {
+    if (q > 1000) {
         return 0;
     }
 
@@ -3072,7 +3188,9 @@ static ngx_int_t ngx_http_core_regex_location(ngx_conf_t *cf, ngx_http_core_loc_
 
     clcf->name = *regex;
 
-    return NGX_OK;
+    clcf->regex_literal.caseless = (rc.options & NGX_REGEX_CASELESS) ? 1 : 0;
+
+    return ngx_http_regex_literal(cf, regex, &clcf->regex_literal);
 
 #else
 
@@ -3085,6 +3203,306 @@ static ngx_int_t ngx_http_core_regex_location(ngx_conf_t *cf, ngx_http_core_loc_
 }
 
 
+#if (NGX_PCRE)
+
+/*
+ * looks for the longest literal run every match of the pattern contains;
+ * the scan is conservative: groups and classes are skipped, a quantifier
+ * ends a run, and an alternation, an inline option or an escape that is
+ * not a class or a punctuation character leave the regex without a literal
+ */
+
+ngx_int_t
+ngx_http_regex_literal(ngx_conf_t *cf, ngx_str_t *regex,
+    ngx_http_regex_literal_t *rl)
+{
+    u_char      *p, *last, *run, *best, *q, ch;
+    size_t       len, best_len;
+    ngx_uint_t   depth, literal, anchored, best_anchored;
+
+    rl->len = 0;
+
+    run = ngx_pnalloc(cf->pool, regex->len);
+    best = ngx_pnalloc(cf->pool, regex->len);
+    if (run == NULL || best == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = regex->data;
+    last = p + regex->len;
+
+    anchored = (p < last && *p == '^');
+
+    if (anchored) {
+        p++;
+    }
+
+    len = 0;
+    best_len = 0;
+    best_anchored = 0;
+    depth = 0;
+    literal = 0;
+
+    while (p < last) {
+
+        ch = *p;
+
+        switch (ch) {
+
+        case '\\':
+            if (p + 1 == last) {
+                return NGX_OK;
+            }
+
+            ch = p[1];
+            p += 2;
+
+            if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')
+                || (ch >= '0' && ch <= '9'))
+            {
+                if (ngx_strchr("dDwWsShHvVRXbBAzZG", ch) == NULL) {
+                    return NGX_OK;
+                }
+
+                goto not_literal;
+            }
+
+            break;
+
+        case '|':
+            if (depth == 0) {
+                return NGX_OK;
+            }
+
+            p++;
+            goto not_literal;
+
+        case '(':
+            p++;
+
+            if (p < last && *p == '?') {
+                if (p + 1 == last) {
+                    return NGX_OK;
+                }
+
+                switch (p[1]) {
+                case ':':
+                case '=':
+                case '!':
+                case '<':
+                case '\'':
+                case 'P':
+                    break;
+                default:
+                    /* inline options */
+                    return NGX_OK;
+                }
+            }
+
+            depth++;
+            goto not_literal;
+
+        case ')':
+            if (depth == 0) {
+                return NGX_OK;
+            }
+
+            depth--;
+            p++;
+            goto not_literal;
+
+        case '[':
+            p++;
+
+            if (p < last && *p == '^') {
+                p++;
+            }
+
+            if (p < last && *p == ']') {
+                p++;
+            }
+
+            while (p < last && *p != ']') {
+
+                if (*p == '\\') {
+                    p++;
+
+                } else if (*p == '[' && p + 1 < last && p[1] == ':') {
+                    q = ngx_strlstrn(p + 2, last, (u_char *) ":]", 1);
+                    if (q == NULL) {
+                        return NGX_OK;
+                    }
+
+                    p = q + 1;
+                }
+
+                p++;
+            }
+
+            if (p >= last) {
+                return NGX_OK;
+            }
+
+            p++;
+            goto not_literal;
+
+        case '*':
+        case '?':
+            if (literal && depth == 0) {
+                /* the last character is optional */
+                len--;
+            }
+
+            p++;
+            goto not_literal;
+
+        case '+':
+            p++;
+            goto not_literal;
+
+        case '{':
+            for (q = p + 1; q < last && *q >= '0' && *q <= '9'; q++) {
+                /* void */
+            }
+
+            if (q == p + 1 || q == last || (*q != '}' && *q != ',')) {
+
+                /* not a quantifier, the brace is a literal character */
+
+                ch = '{';
+                p++;
+                break;
+            }
+
+            if (literal && depth == 0 && p[1] == '0') {
+                len--;
+            }
+
+            q = ngx_strlchr(q, last, '}');
+            if (q == NULL) {
+                return NGX_OK;
+            }
+
+            p = q + 1;
+            goto not_literal;
+
+        case '.':
+        case '^':
+        case '$':
+            p++;
+            goto not_literal;
+
+        default:
+            p++;
+            break;
+        }
+
+        /* a literal character */
+
+        if (depth == 0) {
+            run[len++] = rl->caseless ? ngx_tolower(ch) : ch;
+            literal = 1;
+        }
+
+        continue;
+
+    not_literal:
+
+        /* the end of a run */
+
+        if (len > best_len) {
+            q = best;
+            best = run;
+            run = q;
+            best_len = len;
+            best_anchored = anchored;
+        }
+
+        len = 0;
+        literal = 0;
+        anchored = 0;
+    }
+
+    if (len > best_len) {
+        best = run;
+        best_len = len;
+        best_anchored = anchored;
+    }
+
+    if (best_len == 0) {
+        return NGX_OK;
+    }
+
+    rl->data = best;
+    rl->len = best_len;
+    rl->anchored = best_anchored;
+    rl->mask = ngx_http_regex_literal_mask(best, best_len);
+
+    return NGX_OK;
+}
+
+
+ngx_uint_t
+ngx_http_regex_literal_test(ngx_http_regex_literal_t *rl, ngx_str_t *s,
+    uint64_t mask)
+{
+    if (rl->len == 0) {
+        return 1;
+    }
+
+    if ((rl->mask & ~mask) || s->len < rl->len) {
+        return 0;
+    }
+
+    if (rl->anchored) {
+        if (rl->caseless) {
+            return ngx_strncasecmp(s->data, rl->data, rl->len) == 0;
+        }
+
+        return ngx_memcmp(s->data, rl->data, rl->len) == 0;
+    }
+
+    if (rl->caseless) {
+        return ngx_strlcasestrn(s->data, s->data + s->len,
+                                rl->data, rl->len - 1)
+               != NULL;
+    }
+
+    return ngx_strlstrn(s->data, s->data + s->len, rl->data, rl->len - 1)
+           != NULL;
+}
+
+
+/* the character pairs are taken case-insensitively */
+
+uint64_t
+ngx_http_regex_literal_mask(u_char *p, size_t len)
+{
+    u_char      *last;
+    uint64_t     mask;
+    ngx_uint_t   c, prev;
+
+    mask = 0;
+
+    if (len < 2) {
+        return mask;
+    }
+
+    last = p + len;
+    prev = ngx_tolower(*p);
+
+    for (p++; p < last; p++) {
+        c = ngx_tolower(*p);
+        mask |= (uint64_t) 1 << ((prev * 5 + c) & 0x3f);
+        prev = c;
+    }
+
+    return mask;
+}
+
+#endif
+
+
 static char *
 ngx_http_core_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -3209,8 +3627,16 @@ ngx_http_core_create_main_conf(ngx_conf_t *cf)
         return NULL;
     }
 
+    if (ngx_array_init(&cmcf->phase_locations, cf->pool, 16,
+                       sizeof(ngx_http_core_loc_conf_t *))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
     cmcf->server_names_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->server_names_hash_bucket_size = NGX_CONF_UNSET_UINT;
+    cmcf->server_names_cache_size = NGX_CONF_UNSET_UINT;
 
     cmcf->variables_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->variables_hash_bucket_size = NGX_CONF_UNSET_UINT;
@@ -3235,6 +3661,10 @@ ngx_http_core_init_main_conf(ngx_conf_t *cf, void *conf)
     cmcf->server_names_hash_bucket_size =
             ngx_align(cmcf->server_names_hash_bucket_size, ngx_cacheline_size);
 
+    if (cmcf->server_names_cache_size == NGX_CONF_UNSET_UINT) {
+        cmcf->server_names_cache_size = 0;
+    }
+
 
     if (cmcf->variables_hash_max_size == NGX_CONF_UNSET_UINT) {
         cmcf->variables_hash_max_size = 512;
@@ -3390,6 +3820,9 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
      *     clcf->auto_redirect = 0;
      *     clcf->alias = 0;
      *     clcf->gzip_proxied = 0;
+     *     clcf->gzip_bufs.num = 0;
+     *     clcf->gzip_types = { NULL };
+     *     clcf->gzip_types_keys = NULL;
      *     clcf->keepalive_disable = 0;
      */
 
@@ -3418,6 +3851,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
     clcf->limit_rate = NGX_CONF_UNSET_SIZE;
     clcf->limit_rate_after = NGX_CONF_UNSET_SIZE;
     clcf->keepalive_timeout = NGX_CONF_UNSET_MSEC;
+    clcf->keepalive_release_timeout = NGX_CONF_UNSET_MSEC;
     clcf->keepalive_header = NGX_CONF_UNSET;
     clcf->keepalive_requests = NGX_CONF_UNSET_UINT;
     clcf->lingering_close = NGX_CONF_UNSET_UINT;
@@ -3446,6 +3880,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
 #if (NGX_HTTP_GZIP)
     clcf->gzip_vary = NGX_CONF_UNSET;
     clcf->gzip_http_version = NGX_CONF_UNSET_UINT;
+    clcf->gzip_min_length = NGX_CONF_UNSET;
 #if (NGX_PCRE)
     clcf->gzip_disable = NGX_CONF_UNSET_PTR;
 #endif
@@ -3477,9 +3912,11 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_http_core_loc_conf_t *prev = parent;
     ngx_http_core_loc_conf_t *conf = child;
 
-    ngx_uint_t        i;
-    ngx_hash_key_t   *type;
-    ngx_hash_init_t   types_hash;
+    ngx_uint_t                  i;
+    ngx_hash_key_t             *type;
+    ngx_hash_init_t             types_hash;
+    ngx_http_core_main_conf_t  *cmcf;
+    ngx_http_core_loc_conf_t  **clcfp;
 
     if (conf->root.data == NULL) {
 
@@ -3638,6 +4075,8 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               0);
     ngx_conf_merge_msec_value(conf->keepalive_timeout,
                               prev->keepalive_timeout, 75000);
+    ngx_conf_merge_msec_value(conf->keepalive_release_timeout,
+                              prev->keepalive_release_timeout, 0);
     ngx_conf_merge_sec_value(conf->keepalive_header,
                               prev->keepalive_header, 0);
     ngx_conf_merge_uint_value(conf->keepalive_requests,
@@ -3714,6 +4153,18 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_bitmask_value(conf->gzip_proxied, prev->gzip_proxied,
                               (NGX_CONF_BITMASK_SET|NGX_HTTP_GZIP_PROXIED_OFF));
 
+    ngx_conf_merge_bufs_value(conf->gzip_bufs, prev->gzip_bufs,
+                              (128 * 1024) / ngx_pagesize, ngx_pagesize);
+    ngx_conf_merge_value(conf->gzip_min_length, prev->gzip_min_length, 20);
+
+    if (ngx_http_merge_types(cf, &conf->gzip_types_keys, &conf->gzip_types,
+                             &prev->gzip_types_keys, &prev->gzip_types,
+                             ngx_http_html_default_types)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
 #if (NGX_PCRE)
     ngx_conf_merge_ptr_value(conf->gzip_disable, prev->gzip_disable, NULL);
 #endif
@@ -3734,6 +4185,19 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 #endif
 #endif
 
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    if (conf->keepalive_release_timeout) {
+        cmcf->keepalive_release = 1;
+    }
+
+    clcfp = ngx_array_push(&cmcf->phase_locations);
+    if (clcfp == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    *clcfp = conf;
+
     return NGX_CONF_OK;
 }
 
@@ -4067,6 +4531,13 @@ ngx_http_core_server_name(ngx_conf_t *cf/*ngx_http_core_server(srv_conf) 
 
             sn->name = value[i];
             cscf->captures = (rc.captures > 0);
+
+            sn->literal.caseless = (rc.options & NGX_REGEX_CASELESS) ? 1 : 0;
+
+            if (ngx_http_regex_literal(cf, &value[i], &sn->literal) != NGX_OK)
+            {
+                return NGX_CONF_ERROR;
+            }
         }
 #else
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
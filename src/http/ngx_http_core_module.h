@@ -205,7 +205,11 @@ typedef struct {
      */
     ngx_http_phase_engine_t    phase_engine;
 
+    /* the merged locations to get the engines with the idle phases skipped */
+    ngx_array_t                phase_locations; /* ngx_http_core_loc_conf_t * */
+
     ngx_hash_t                 headers_in_hash; //!< http request header各个头部对应的 handler回调, 以hash方式存储以加快索引速度
+    ngx_hash_dispatch_t        headers_in_dispatch;
 
     /**
      * 被索引的nginx变量 ，比如通过rewrite模块的set指令设置的变量，会在这个hash 中分配空间
@@ -222,6 +226,7 @@ typedef struct {
 
     ngx_uint_t                 server_names_hash_max_size;      //!< server names的hash表的允许的最大bucket数量，默认值是512
     ngx_uint_t                 server_names_hash_bucket_size;   //!< server names的hash表中每个桶允许占用的最大空间，默认值是ngx_cacheline_size
+    ngx_uint_t                 server_names_cache_size;
 
     ngx_uint_t                 variables_hash_max_size;         //!< variables的hash表的允许的最大bucket数量，默认值是512
     ngx_uint_t                 variables_hash_bucket_size;      //!< variables的hash表中每个桶允许占用的最大空间，默认值是64
@@ -239,6 +244,8 @@ typedef struct {
     ngx_array_t               *ports;
 
     ngx_uint_t                 try_files;       /* unsigned  try_files:1 */
+    ngx_uint_t                 keepalive_release;
+                                         /* unsigned  keepalive_release:1 */
 
     /**
      * 所有的phase的数组，其中每个元素是该phase上注册的handler的数组
@@ -407,12 +414,32 @@ typedef struct {
     ngx_array_t                servers;  /* array of ngx_http_core_srv_conf_t */
 } ngx_http_conf_addr_t;
 
+
+#if (NGX_PCRE)
+
+/*
+ * a literal that every match of a regex location or server name contains,
+ * a string without it does not need the regex to be run;
+ * the mask has a bit for each pair of the literal characters
+ */
+
+typedef struct {
+    uint64_t                   mask;
+    u_char                    *data;
+    size_t                     len;
+    unsigned                   anchored:1;
+    unsigned                   caseless:1;
+} ngx_http_regex_literal_t;
+
+#endif
+
 /**
  * server_name 虚拟主机 描述符
  */
 struct ngx_http_server_name_s {
 #if (NGX_PCRE)
     ngx_http_regex_t          *regex;
+    ngx_http_regex_literal_t   literal;
 #endif
     ngx_http_core_srv_conf_t  *server;      //!< value: virtual name server conf
     ngx_str_t                  name;        //!< key:   http Host
@@ -445,6 +472,7 @@ struct ngx_http_core_loc_conf_s {
 
 #if (NGX_PCRE)
     ngx_http_regex_t  *regex;   //!< 根据location输入的正则表达式, ngx_http_core_location -> ngx_http_core_regex_location用PCRE编译出的 正则结果描述符
+    ngx_http_regex_literal_t  regex_literal;
 #endif
 
     /**
@@ -467,7 +495,8 @@ struct ngx_http_core_loc_conf_s {
 
     ngx_http_location_tree_node_t   *static_locations;  //!< 字符匹配树        由 ngx_http_init_static_location_trees 初始化
 #if (NGX_PCRE)
-    ngx_http_core_loc_conf_t       **regex_locations;   //!< 正则查询location  由 ngx_http_init_locations时初始化
+    ngx_http_core_loc_conf_t       **regex_locations;
+    ngx_http_regex_literal_t        *regex_literals;   //!< 正则查询location  由 ngx_http_init_locations时初始化
 #endif
 
     /* pointer to the modules' loc_conf */
@@ -481,6 +510,12 @@ struct ngx_http_core_loc_conf_s {
 
     ngx_http_handler_pt  handler;
 
+    /* the phase engine without the phases that have no work in the location */
+    ngx_http_phase_handler_t  *phase_handlers;
+
+    /* the number of the handlers of each phase that have no work */
+    u_char        phase_idle[NGX_HTTP_LOG_PHASE];
+
     /* location name length for inclusive location with inherited alias */
     size_t        alias;
     ngx_str_t     root;                         /* root, alias */
@@ -508,6 +543,7 @@ struct ngx_http_core_loc_conf_s {
     ngx_msec_t    client_body_timeout;          /* client_body_timeout */
     ngx_msec_t    send_timeout;                 /* send_timeout */
     ngx_msec_t    keepalive_timeout;            /* keepalive_timeout */
+    ngx_msec_t    keepalive_release_timeout;    /* keepalive_release_timeout */
     ngx_msec_t    lingering_time;               /* lingering_time */
     ngx_msec_t    lingering_timeout;            /* lingering_timeout */
     ngx_msec_t    resolver_timeout;             /* resolver_timeout */
@@ -550,6 +586,13 @@ struct ngx_http_core_loc_conf_s {
     ngx_uint_t    gzip_http_version;            /* gzip_http_version */
     ngx_uint_t    gzip_proxied;                 /* gzip_proxied */
 
+    /* shared by the gzip, brotli and zstd filters */
+
+    ngx_bufs_t    gzip_bufs;                    /* gzip_buffers */
+    ssize_t       gzip_min_length;              /* gzip_min_length */
+    ngx_hash_t    gzip_types;
+    ngx_array_t  *gzip_types_keys;              /* gzip_types */
+
 #if (NGX_PCRE)
     ngx_array_t  *gzip_disable;                 /* gzip_disable */
 #endif
@@ -674,6 +717,9 @@ ngx_int_t ngx_http_core_try_files_phase(ngx_http_request_t *r,
     ngx_http_phase_handler_t *ph);
 ngx_int_t ngx_http_core_content_phase(ngx_http_request_t *r,
     ngx_http_phase_handler_t *ph);
+ngx_int_t ngx_http_core_skip_phase(ngx_http_request_t *r,
+    ngx_http_phase_handler_t *ph);
+void ngx_http_core_phase_idle(ngx_conf_t *cf, ngx_uint_t phase);
 
 
 void *ngx_http_test_content_type(ngx_http_request_t *r, ngx_hash_t *types_hash);
@@ -687,6 +733,13 @@ ngx_int_t ngx_http_auth_basic_user(ngx_http_request_t *r);
 #if (NGX_HTTP_GZIP)
 ngx_int_t ngx_http_gzip_ok(ngx_http_request_t *r);
 #endif
+#if (NGX_PCRE)
+ngx_int_t ngx_http_regex_literal(ngx_conf_t *cf, ngx_str_t *regex,
+    ngx_http_regex_literal_t *rl);
+ngx_uint_t ngx_http_regex_literal_test(ngx_http_regex_literal_t *rl,
+    ngx_str_t *s, uint64_t mask);
+uint64_t ngx_http_regex_literal_mask(u_char *p, size_t len);
+#endif
 
 
 ngx_int_t ngx_http_subrequest(ngx_http_request_t *r,
@@ -432,6 +432,10 @@ ngx_http_header_filter(ngx_http_request_t *r)
                + sizeof(CRLF) - 1;
     }
 
+    if (r->headers_out.header_block) {
+        len += r->headers_out.header_block->text.len;
+    }
+
     b = ngx_create_temp_buf(r->pool, len);
     if (b == NULL) {
         return NGX_ERROR;
@@ -595,6 +599,11 @@ ngx_http_header_filter(ngx_http_request_t *r)
         *b->last++ = CR; *b->last++ = LF;
     }
 
+    if (r->headers_out.header_block) {
+        b->last = ngx_copy(b->last, r->headers_out.header_block->text.data,
+                           r->headers_out.header_block->text.len);
+    }
+
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
                    "%*s", (size_t) (b->last - b->pos), b->pos);
 
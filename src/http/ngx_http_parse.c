@@ -9,6 +9,10 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#if (NGX_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
 
 static uint32_t  usual[] = {
     0xffffdbfe, /* 1111 1111 1111 1111  1101 1011 1111 1110 */
@@ -100,6 +104,150 @@ static uint32_t  usual[] = {
 
 /* gcc, icc, msvc and others compile these switches as an jump table */
 
+#if (NGX_HAVE_X86_SIMD)
+
+/*
+ * The vectorized scanners are used for the long runs of the URI arguments,
+ * the header values and the header names.  They return either the first
+ * byte that the state machine has to look at, or the start of the tail
+ * shorter than a vector, and the state machine goes on from there.
+ */
+
+static u_char  ngx_http_uri_set[] = { ' ', CR, LF, '#', '\0' };
+static u_char  ngx_http_value_set[] = { CR, LF, '\0', CR, CR };
+
+
+__attribute__((target("sse2")))
+static u_char *
+ngx_http_parse_scan_sse2(u_char *p, u_char *last, u_char *set)
+{
+    int      mask;
+    __m128i  v, s0, s1, s2, s3, s4, eq;
+
+    s0 = _mm_set1_epi8((char) set[0]);
+    s1 = _mm_set1_epi8((char) set[1]);
+    s2 = _mm_set1_epi8((char) set[2]);
+    s3 = _mm_set1_epi8((char) set[3]);
+    s4 = _mm_set1_epi8((char) set[4]);
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        eq = _mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, s2));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, s3));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, s4));
+
+        mask = _mm_movemask_epi8(eq);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+
+    return p;
+}
+
+
+__attribute__((target("avx2")))
+static u_char *
+ngx_http_parse_scan_avx2(u_char *p, u_char *last, u_char *set)
+{
+    int      mask;
+    __m256i  v, s0, s1, s2, s3, s4, eq;
+
+    s0 = _mm256_set1_epi8((char) set[0]);
+    s1 = _mm256_set1_epi8((char) set[1]);
+    s2 = _mm256_set1_epi8((char) set[2]);
+    s3 = _mm256_set1_epi8((char) set[3]);
+    s4 = _mm256_set1_epi8((char) set[4]);
+
+    mask = 0;
+
+    while (last - p >= 32) {
+        v = _mm256_loadu_si256((__m256i *) p);
+
+        eq = _mm256_or_si256(_mm256_cmpeq_epi8(v, s0),
+                             _mm256_cmpeq_epi8(v, s1));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, s2));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, s3));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, s4));
+
+        mask = _mm256_movemask_epi8(eq);
+
+        if (mask) {
+            break;
+        }
+
+        p += 32;
+    }
+
+    /*
+     * the upper halves of the registers are cleared to avoid the penalty
+     * of the transition to the legacy SSE code of the caller
+     */
+
+    _mm256_zeroupper();
+
+    if (mask) {
+        return p + __builtin_ctz(mask);
+    }
+
+    return ngx_http_parse_scan_sse2(p, last, set);
+}
+
+
+/* returns the first byte that is not a letter, a digit, "-" or "_" */
+
+__attribute__((target("sse4.2")))
+static u_char *
+ngx_http_parse_name_sse42(u_char *p, u_char *last,
+    ngx_uint_t allow_underscores)
+{
+    int             n, len;
+    __m128i         v, ranges;
+    static u_char   token[16] = "azAZ09--__";
+
+    ranges = _mm_loadu_si128((__m128i *) token);
+    len = allow_underscores ? 10 : 8;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        n = _mm_cmpestri(ranges, len, v, 16,
+                         _SIDD_UBYTE_OPS|_SIDD_CMP_RANGES
+                         |_SIDD_NEGATIVE_POLARITY|_SIDD_LEAST_SIGNIFICANT);
+
+        if (n != 16) {
+            return p + n;
+        }
+
+        p += 16;
+    }
+
+    return p;
+}
+
+
+static ngx_inline u_char *
+ngx_http_parse_scan(u_char *p, u_char *last, u_char *set)
+{
+    if (ngx_cpu_features & NGX_CPU_AVX2) {
+        return ngx_http_parse_scan_avx2(p, last, set);
+    }
+
+    if (ngx_cpu_features & NGX_CPU_SSE2) {
+        return ngx_http_parse_scan_sse2(p, last, set);
+    }
+
+    return p;
+}
+
+#endif
+
+
 ngx_int_t
 ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
 {
@@ -556,6 +704,9 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         case sw_uri:
 
             if (usual[ch >> 5] & (1 << (ch & 0x1f))) {
+#if (NGX_HAVE_X86_SIMD)
+                p = ngx_http_parse_scan(p + 1, b->last, ngx_http_uri_set) - 1;
+#endif
                 break;
             }
 
@@ -757,6 +908,9 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
 {
     u_char      c, ch, *p;
     ngx_uint_t  hash, i;
+#if (NGX_HAVE_X86_SIMD)
+    u_char     *q;
+#endif
     enum {
         sw_start = 0,
         sw_name,
@@ -833,6 +987,35 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
                 hash = ngx_hash(hash, c);
                 r->lowcase_header[i++] = c;
                 i &= (NGX_HTTP_LC_HEADER_LEN - 1);
+
+#if (NGX_HAVE_X86_SIMD)
+
+                if (!(ngx_cpu_features & NGX_CPU_SSE42)) {
+                    break;
+                }
+
+                q = ngx_http_parse_name_sse42(p + 1, b->last,
+                                              allow_underscores);
+
+                if (i + (q - p - 1) > NGX_HTTP_LC_HEADER_LEN) {
+                    break;
+                }
+
+                while (++p < q) {
+                    c = lowcase[*p];
+
+                    if (c == '\0') {
+                        c = '_';
+                    }
+
+                    hash = ngx_hash(hash, c);
+                    r->lowcase_header[i++] = c;
+                }
+
+                i &= (NGX_HTTP_LC_HEADER_LEN - 1);
+                p--;
+#endif
+
                 break;
             }
 
@@ -926,7 +1109,27 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
                 r->header_end = p;
                 goto done;
             case '\0':
+                r->header_end = p;
                 return NGX_HTTP_PARSE_INVALID_HEADER;
+#if (NGX_HAVE_X86_SIMD)
+            default:
+                p = ngx_http_parse_scan(p + 1, b->last, ngx_http_value_set) - 1;
+
+                /* the trailing spaces are skipped by sw_space_after_value */
+
+                if (*p == ' ') {
+                    for (r->header_end = p;
+                         r->header_end[-1] == ' ';
+                         r->header_end--)
+                    {
+                        /* void */
+                    }
+
+                    state = sw_space_after_value;
+                }
+
+                break;
+#endif
             }
             break;
 
@@ -941,6 +1144,7 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
             case LF:
                 goto done;
             case '\0':
+                r->header_end = p;
                 return NGX_HTTP_PARSE_INVALID_HEADER;
             default:
                 state = sw_value;
@@ -1732,3 +1936,274 @@ ngx_http_split_args(ngx_http_request_t *r, ngx_str_t *uri, ngx_str_t *args)
         args->len = 0;
     }
 }
+
+
+ngx_int_t
+ngx_http_parse_chunked(ngx_http_request_t *r, ngx_buf_t *b,
+    ngx_http_chunked_t *ctx)
+{
+    u_char     *pos, ch, c;
+    ngx_int_t   rc;
+    enum {
+        sw_chunk_start = 0,
+        sw_chunk_size,
+        sw_chunk_extension,
+        sw_chunk_extension_almost_done,
+        sw_chunk_data,
+        sw_after_data,
+        sw_after_data_almost_done,
+        sw_last_chunk_extension,
+        sw_last_chunk_extension_almost_done,
+        sw_trailer,
+        sw_trailer_almost_done,
+        sw_trailer_header,
+        sw_trailer_header_almost_done
+    } state;
+
+    state = ctx->state;
+
+    if (state == sw_chunk_data && ctx->size == 0) {
+        state = sw_after_data;
+    }
+
+    rc = NGX_AGAIN;
+
+    for (pos = b->pos; pos < b->last; pos++) {
+
+        ch = *pos;
+
+        switch (state) {
+
+        case sw_chunk_start:
+            if (ch >= '0' && ch <= '9') {
+                state = sw_chunk_size;
+                ctx->size = ch - '0';
+                break;
+            }
+
+            c = (u_char) (ch | 0x20);
+
+            if (c >= 'a' && c <= 'f') {
+                state = sw_chunk_size;
+                ctx->size = c - 'a' + 10;
+                break;
+            }
+
+            goto invalid;
+
+        case sw_chunk_size:
+            if (ch >= '0' && ch <= '9') {
+                if (ctx->size > NGX_MAX_OFF_T_VALUE / 16) {
+                    goto invalid;
+                }
+
+                ctx->size = ctx->size * 16 + (ch - '0');
+                break;
+            }
+
+            c = (u_char) (ch | 0x20);
+
+            if (c >= 'a' && c <= 'f') {
+                if (ctx->size > NGX_MAX_OFF_T_VALUE / 16) {
+                    goto invalid;
+                }
+
+                ctx->size = ctx->size * 16 + (c - 'a' + 10);
+                break;
+            }
+
+            if (ctx->size == 0) {
+
+                switch (ch) {
+                case CR:
+                    state = sw_last_chunk_extension_almost_done;
+                    break;
+                case LF:
+                    state = sw_trailer;
+                    break;
+                case ';':
+                case ' ':
+                case '\t':
+                    state = sw_last_chunk_extension;
+                    break;
+                default:
+                    goto invalid;
+                }
+
+                break;
+            }
+
+            switch (ch) {
+            case CR:
+                state = sw_chunk_extension_almost_done;
+                break;
+            case LF:
+                state = sw_chunk_data;
+                break;
+            case ';':
+            case ' ':
+            case '\t':
+                state = sw_chunk_extension;
+                break;
+            default:
+                goto invalid;
+            }
+
+            break;
+
+        case sw_chunk_extension:
+            switch (ch) {
+            case CR:
+                state = sw_chunk_extension_almost_done;
+                break;
+            case LF:
+                state = sw_chunk_data;
+            }
+            break;
+
+        case sw_chunk_extension_almost_done:
+            if (ch == LF) {
+                state = sw_chunk_data;
+                break;
+            }
+            goto invalid;
+
+        case sw_chunk_data:
+            rc = NGX_OK;
+            goto data;
+
+        case sw_after_data:
+            switch (ch) {
+            case CR:
+                state = sw_after_data_almost_done;
+                break;
+            case LF:
+                state = sw_chunk_start;
+                break;
+            default:
+                goto invalid;
+            }
+            break;
+
+        case sw_after_data_almost_done:
+            if (ch == LF) {
+                state = sw_chunk_start;
+                break;
+            }
+            goto invalid;
+
+        case sw_last_chunk_extension:
+            switch (ch) {
+            case CR:
+                state = sw_last_chunk_extension_almost_done;
+                break;
+            case LF:
+                state = sw_trailer;
+            }
+            break;
+
+        case sw_last_chunk_extension_almost_done:
+            if (ch == LF) {
+                state = sw_trailer;
+                break;
+            }
+            goto invalid;
+
+        case sw_trailer:
+            switch (ch) {
+            case CR:
+                state = sw_trailer_almost_done;
+                break;
+            case LF:
+                goto done;
+            default:
+                state = sw_trailer_header;
+            }
+            break;
+
+        case sw_trailer_almost_done:
+            if (ch == LF) {
+                goto done;
+            }
+            goto invalid;
+
+        case sw_trailer_header:
+            switch (ch) {
+            case CR:
+                state = sw_trailer_header_almost_done;
+                break;
+            case LF:
+                state = sw_trailer;
+            }
+            break;
+
+        case sw_trailer_header_almost_done:
+            if (ch == LF) {
+                state = sw_trailer;
+                break;
+            }
+            goto invalid;
+
+        }
+    }
+
+data:
+
+    ctx->state = state;
+    b->pos = pos;
+
+    if (ctx->size > NGX_MAX_OFF_T_VALUE - 5) {
+        goto invalid;
+    }
+
+    /* the least number of bytes left, so a body is never read past its end */
+
+    switch (state) {
+
+    case sw_chunk_start:
+        ctx->length = 3 /* "0" LF LF */;
+        break;
+    case sw_chunk_size:
+        ctx->length = 1 /* LF */
+                      + (ctx->size ? ctx->size + 4 /* LF "0" LF LF */
+                                   : 1 /* LF */);
+        break;
+    case sw_chunk_extension:
+    case sw_chunk_extension_almost_done:
+        ctx->length = 1 /* LF */ + ctx->size + 4 /* LF "0" LF LF */;
+        break;
+    case sw_chunk_data:
+        ctx->length = ctx->size + 4 /* LF "0" LF LF */;
+        break;
+    case sw_after_data:
+    case sw_after_data_almost_done:
+        ctx->length = 4 /* LF "0" LF LF */;
+        break;
+    case sw_last_chunk_extension:
+    case sw_last_chunk_extension_almost_done:
+        ctx->length = 2 /* LF LF */;
+        break;
+    case sw_trailer:
+    case sw_trailer_almost_done:
+        ctx->length = 1 /* LF */;
+        break;
+    case sw_trailer_header:
+    case sw_trailer_header_almost_done:
+        ctx->length = 2 /* LF LF */;
+        break;
+
+    }
+
+    return rc;
+
+done:
+
+    ctx->state = 0;
+    b->pos = pos + 1;
+
+    return NGX_DONE;
+
+invalid:
+
+    return NGX_ERROR;
+}
@@ -36,6 +36,12 @@ static ssize_t ngx_http_validate_host(ngx_http_request_t *r, u_char **host,
     size_t len, ngx_uint_t alloc);
 static ngx_int_t ngx_http_find_virtual_server(ngx_http_request_t *r,
     u_char *host, size_t len);
+static ngx_http_server_name_node_t *ngx_http_server_names_cache_lookup(
+    ngx_http_server_name_cache_t *cache, ngx_uint_t key, u_char *host,
+    size_t len);
+static void ngx_http_server_names_cache_insert(
+    ngx_http_server_name_cache_t *cache, ngx_uint_t key, u_char *host,
+    size_t len, ngx_http_core_srv_conf_t *cscf);
 
 static void ngx_http_request_handler(ngx_event_t *ev);
 static void ngx_http_terminate_request(ngx_http_request_t *r, ngx_int_t rc);
@@ -47,6 +53,14 @@ static void ngx_http_request_finalizer(ngx_http_request_t *r);
 
 static void ngx_http_set_keepalive(ngx_http_request_t *r);
 static void ngx_http_keepalive_handler(ngx_event_t *ev);
+static void ngx_http_keepalive_release(ngx_connection_t *c);
+static void ngx_http_released_handler(ngx_event_t *rev);
+static ngx_int_t ngx_http_keepalive_restore(ngx_connection_t *c);
+static ngx_pool_t *ngx_http_get_connection_pool(size_t size);
+static void ngx_http_free_connection_pool(ngx_pool_t *pool);
+#if (NGX_STAT_STUB)
+static ngx_atomic_int_t ngx_http_keepalive_mem(ngx_connection_t *c);
+#endif
 static void ngx_http_set_lingering_close(ngx_http_request_t *r);
 static void ngx_http_lingering_close_handler(ngx_event_t *ev);
 static ngx_int_t ngx_http_post_action(ngx_http_request_t *r);
@@ -78,6 +92,10 @@ static char *ngx_http_client_errors[] = {
 };
 
 
+static ngx_pool_t  *ngx_http_free_pools;
+static ngx_uint_t   ngx_http_nfree_pools;
+
+
 ngx_http_header_t  ngx_http_headers_in[] = {
     { ngx_string("Host"), offsetof(ngx_http_headers_in_t, host),
                  ngx_http_process_host },
@@ -1135,8 +1153,8 @@ ngx_http_process_request_headers(ngx_event_t *rev)
             /** headers_in_hash,  ngx_http_headers_in !!!!!!!!!!!!!!!!!!!!!!!!!
              * ngx_http_headers_in ƥhttpӦͷ
              */
-            hh = ngx_hash_find(&cmcf->headers_in_hash, h->hash,
-                               h->lowcase_key, h->key.len);
+            hh = ngx_hash_dispatch_find(&cmcf->headers_in_dispatch,
+                                        h->lowcase_key, h->key.len);
 
             /** httpͷص,  ngx_http_headers_in !!!!!!!!!!!!!!!!!!!!!!!!!
              * http request headerͷӦ handlerص
@@ -1298,7 +1316,22 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
 
     hc = r->http_connection;
 
-    if (hc->nfree) {
+    if (request_line
+        && old - r->header_in->start >= r->header_in->end - old)
+    {
+        /*
+         * the request line of a pipelined request was cut by the buffer
+         * end while the preceding requests are already done, so the line
+         * is moved to the start of the same buffer
+         */
+
+        b = r->header_in;
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http pipelined request line move: %d",
+                       r->header_in->pos - old);
+
+    } else if (hc->nfree) {
         b = hc->free[--hc->nfree];
 
         ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -1329,7 +1362,9 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
         return NGX_DECLINED;
     }
 
-    hc->busy[hc->nbusy++] = b;
+    if (b != r->header_in) {
+        hc->busy[hc->nbusy++] = b;
+    }
 
     if (r->state == 0) {
         /*
@@ -1352,10 +1387,10 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
 
     new = b->start;
 
-    ngx_memcpy(new, old, r->header_in->pos - old);
+    ngx_memmove(new, old, r->header_in->pos - old);
 
     b->pos = new + (r->header_in->pos - old);
-    b->last = new + (r->header_in->pos - old);
+    b->last = b->pos;
 
     if (request_line) {
         r->request_start = new;
@@ -1696,7 +1731,32 @@ ngx_http_process_request_header(ngx_http_request_t *r)
         }
     }
 
-    if (r->method & NGX_HTTP_PUT && r->headers_in.content_length_n == -1) {
+    if (r->headers_in.transfer_encoding) {
+        if (r->headers_in.transfer_encoding->value.len == 7
+            && ngx_strncasecmp(r->headers_in.transfer_encoding->value.data,
+                               (u_char *) "chunked", 7) == 0)
+        {
+            r->headers_in.content_length = NULL;
+            r->headers_in.content_length_n = -1;
+            r->headers_in.chunked = 1;
+
+        } else if (r->headers_in.transfer_encoding->value.len != 8
+                   || ngx_strncasecmp(
+                                 r->headers_in.transfer_encoding->value.data,
+                                 (u_char *) "identity", 8) != 0)
+        {
+            ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                          "client sent unknown \"Transfer-Encoding\": \"%V\"",
+                          &r->headers_in.transfer_encoding->value);
+            ngx_http_finalize_request(r, NGX_HTTP_NOT_IMPLEMENTED);
+            return NGX_ERROR;
+        }
+    }
+
+    if (r->method & NGX_HTTP_PUT
+        && r->headers_in.content_length_n == -1
+        && !r->headers_in.chunked)
+    {
         ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
                   "client sent %V method without \"Content-Length\" header",
                   &r->method_name);
@@ -1711,16 +1771,6 @@ ngx_http_process_request_header(ngx_http_request_t *r)
         return NGX_ERROR;
     }
 
-    if (r->headers_in.transfer_encoding
-        && ngx_strcasestrn(r->headers_in.transfer_encoding->value.data,
-                           "chunked", 7 - 1))
-    {
-        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
-                      "client sent \"Transfer-Encoding: chunked\" header");
-        ngx_http_finalize_request(r, NGX_HTTP_LENGTH_REQUIRED);
-        return NGX_ERROR;
-    }
-
     if (r->headers_in.connection_type == NGX_HTTP_CONNECTION_KEEP_ALIVE) {
         if (r->headers_in.keep_alive) {
             r->headers_in.keep_alive_n =
@@ -1873,10 +1923,15 @@ ngx_http_validate_host(ngx_http_request_t *r, u_char **host, size_t len,
 static ngx_int_t
 ngx_http_find_virtual_server(ngx_http_request_t *r, u_char *host/*http request host*/, size_t len/*host*/)
 {
-    ngx_http_core_loc_conf_t  *clcf;
-    ngx_http_core_srv_conf_t  *cscf;
+    ngx_uint_t                    key;
+    ngx_http_core_loc_conf_t     *clcf;
+    ngx_http_core_srv_conf_t     *cscf;
+    ngx_http_virtual_names_t     *vn;
+    ngx_http_server_name_node_t  *node;
+
+    vn = r->virtual_names;
 
-    if (r->virtual_names == NULL) {
+    if (vn == NULL) {
         return NGX_DECLINED;
     }
 
@@ -1893,16 +1948,59 @@ ngx_http_find_virtual_server(ngx_http_request_t *r, u_char *host/*http request h
      *      3). ׺ͨ  -   server_name www.baidu.*     ---> ϣ, www.baidu
      *      4). ʽ  -   Ҫϣ
      */
-    cscf = ngx_hash_find_combined(&r->virtual_names->names,
-                                  ngx_hash_key(host, len), host, len);
+    key = ngx_hash_key(host, len);
+
+    if (vn->cache == NULL) {
+        cscf = ngx_hash_find_combined(&vn->names, key, host, len);
+
+        if (cscf) {
+            goto found;
+        }
+
+    } else {
+
+        if (vn->names.hash.buckets) {
+            cscf = ngx_hash_find(&vn->names.hash, key, host, len);
+
+            if (cscf) {
+                goto found;
+            }
+        }
+
+        node = ngx_http_server_names_cache_lookup(vn->cache, key, host, len);
+
+        if (node) {
+            if (node->server == NULL) {
+                return NGX_OK;
+            }
 
-    if (cscf) {
-        goto found;
+            cscf = node->server;
+            goto found;
+        }
+
+        cscf = NULL;
+
+        if (len && vn->names.wc_head && vn->names.wc_head->hash.buckets) {
+            cscf = ngx_hash_find_wc_head(vn->names.wc_head, host, len);
+        }
+
+        if (cscf == NULL
+            && len && vn->names.wc_tail && vn->names.wc_tail->hash.buckets)
+        {
+            cscf = ngx_hash_find_wc_tail(vn->names.wc_tail, host, len);
+        }
+
+        if (cscf) {
+            ngx_http_server_names_cache_insert(vn->cache, key, host, len,
+                                               cscf);
+            goto found;
+        }
     }
 
 #if (NGX_PCRE)  /*ʽƥ*/
 
-    if (len && r->virtual_names->nregex) {
+    if (len && vn->nregex) {
+        uint64_t                 mask;
         ngx_int_t                n;
         ngx_uint_t               i;
         ngx_str_t                name;
@@ -1911,14 +2009,28 @@ ngx_http_find_virtual_server(ngx_http_request_t *r, u_char *host/*http request h
         name.len = len;
         name.data = host;
 
-        sn = r->virtual_names->regex;
+        mask = ngx_http_regex_literal_mask(host, len);
+
+        sn = vn->regex;
 
-        for (i = 0; i < r->virtual_names->nregex; i++) {
+        for (i = 0; i < vn->nregex; i++) {
+
+            if (!ngx_http_regex_literal_test(&sn[i].literal, &name, mask)) {
+                continue;
+            }
 
             n = ngx_http_regex_exec(r, sn[i].regex, &name);
 
             if (n == NGX_OK) {
                 cscf = sn[i].server;
+
+                /* a match with captures has to set them every time */
+
+                if (vn->cache && sn[i].regex->ncaptures == 0) {
+                    ngx_http_server_names_cache_insert(vn->cache, key,
+                                                       host, len, cscf);
+                }
+
                 goto found;
             }
 
@@ -1932,6 +2044,10 @@ ngx_http_find_virtual_server(ngx_http_request_t *r, u_char *host/*http request h
 
 #endif
 
+    if (vn->cache) {
+        ngx_http_server_names_cache_insert(vn->cache, key, host, len, NULL);
+    }
+
     return NGX_OK;
 
 found:
@@ -1950,6 +2066,76 @@ found:
 }
 
 
+static ngx_http_server_name_node_t *
+ngx_http_server_names_cache_lookup(ngx_http_server_name_cache_t *cache,
+    ngx_uint_t key, u_char *host, size_t len)
+{
+    ngx_http_server_name_node_t  *node;
+
+    for (node = cache->buckets[key % cache->nbuckets]; node; node = node->next)
+    {
+        if (node->key == key
+            && node->len == len
+            && ngx_memcmp(node->name, host, len) == 0)
+        {
+            ngx_queue_remove(&node->queue);
+            ngx_queue_insert_head(&cache->lru, &node->queue);
+
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_http_server_names_cache_insert(ngx_http_server_name_cache_t *cache,
+    ngx_uint_t key, u_char *host, size_t len, ngx_http_core_srv_conf_t *cscf)
+{
+    ngx_queue_t                   *q;
+    ngx_http_server_name_node_t   *node, **np;
+
+    if (len == 0 || len > NGX_HTTP_SERVER_NAME_CACHE_LEN) {
+        return;
+    }
+
+    if (ngx_queue_empty(&cache->free)) {
+
+        /* evict the least recently used name */
+
+        q = ngx_queue_last(&cache->lru);
+        node = ngx_queue_data(q, ngx_http_server_name_node_t, queue);
+
+        for (np = &cache->buckets[node->key % cache->nbuckets];
+             *np != node;
+             np = &(*np)->next)
+        {
+            /* void */
+        }
+
+        *np = node->next;
+
+    } else {
+        q = ngx_queue_head(&cache->free);
+        node = ngx_queue_data(q, ngx_http_server_name_node_t, queue);
+    }
+
+    ngx_queue_remove(q);
+
+    node->key = key;
+    node->server = cscf;
+    node->len = (u_short) len;
+    ngx_memcpy(node->name, host, len);
+
+    np = &cache->buckets[key % cache->nbuckets];
+    node->next = *np;
+    *np = node;
+
+    ngx_queue_insert_head(&cache->lru, q);
+}
+
+
 static void
 ngx_http_request_handler(ngx_event_t *ev)
 {
@@ -2311,6 +2497,14 @@ ngx_http_finalize_connection(ngx_http_request_t *r)
         return;
     }
 
+    if (r->request_body && r->request_body->rest) {
+
+        /* the rest of the request body was not read */
+
+        r->keepalive = 0;
+        r->lingering_close = 1;
+    }
+
     if (!ngx_terminate
          && !ngx_exiting
          && r->keepalive
@@ -2630,13 +2824,6 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 
     c->data = hc;
 
-    ngx_add_timer(rev, clcf->keepalive_timeout);
-
-    if (ngx_handle_read_event(rev, 0) != NGX_OK) {
-        ngx_http_close_connection(c);
-        return;
-    }
-
     wev = c->write;
     wev->handler = ngx_http_empty_handler;
 
@@ -2651,11 +2838,47 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
         hc->pipeline = 1;
         c->log->action = "reading client pipelined request line";
 
+        /*
+         * the request is already in the buffer and is started while
+         * the posted events of this iteration are processed, so neither
+         * the keepalive timer nor the read event are touched here:
+         * ngx_http_read_request_header() sets client_header_timeout and
+         * the read event if the request turns out to be incomplete
+         */
+
         rev->handler = ngx_http_init_request;
         ngx_post_event(rev, &ngx_posted_events);
         return;
     }
 
+    hc->keepalive_rest = 0;
+
+    if (clcf->keepalive_release_timeout
+        && clcf->keepalive_release_timeout < clcf->keepalive_timeout
+#if (NGX_HTTP_SSL)
+        && c->ssl == NULL
+#endif
+       )
+    {
+        /*
+         * the connection memory is released on the first timer,
+         * and the connection is closed on the second one
+         */
+
+        hc->keepalive_rest = clcf->keepalive_timeout
+                             - clcf->keepalive_release_timeout;
+
+        ngx_add_timer(rev, clcf->keepalive_release_timeout);
+
+    } else {
+        ngx_add_timer(rev, clcf->keepalive_timeout);
+    }
+
+    if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+        ngx_http_close_connection(c);
+        return;
+    }
+
     hc->pipeline = 0;
 
     /*
@@ -2775,6 +2998,10 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
     c->idle = 1;
     ngx_reusable_connection(c, 1);
 
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_waiting_mem, ngx_http_keepalive_mem(c));
+#endif
+
     if (rev->ready) {
         ngx_post_event(rev, &ngx_posted_events);
     }
@@ -2785,14 +3012,32 @@ static void
 ngx_http_keepalive_handler(ngx_event_t *rev)
 {
     size_t             size;
-    ssize_t            n;
-    ngx_buf_t         *b;
-    ngx_connection_t  *c;
+    ssize_t                 n;
+    ngx_buf_t              *b;
+    ngx_connection_t       *c;
+    ngx_http_connection_t  *hc;
 
     c = rev->data;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http keepalive handler");
 
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_waiting_mem,
+                                -ngx_http_keepalive_mem(c));
+#endif
+
+    hc = c->data;
+
+    if (rev->timedout && !c->close && hc->keepalive_rest) {
+        rev->timedout = 0;
+        ngx_add_timer(rev, hc->keepalive_rest);
+
+        hc->keepalive_rest = 0;
+
+        ngx_http_keepalive_release(c);
+        return;
+    }
+
     if (rev->timedout || c->close) {
         ngx_http_close_connection(c);
         return;
@@ -2854,8 +3099,14 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
     if (n == NGX_AGAIN) {
         if (ngx_handle_read_event(rev, 0) != NGX_OK) {
             ngx_http_close_connection(c);
+            return;
         }
 
+#if (NGX_STAT_STUB)
+        (void) ngx_atomic_fetch_add(ngx_stat_waiting_mem,
+                                    ngx_http_keepalive_mem(c));
+#endif
+
         return;
     }
 
@@ -2889,6 +3140,293 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
 }
 
 
+static void
+ngx_http_keepalive_release(ngx_connection_t *c)
+{
+    ngx_pool_t  *pool;
+
+    pool = c->pool;
+
+    if (pool->cleanup
+#if (NGX_HAVE_UNIX_DOMAIN)
+        || c->sockaddr->sa_family == AF_UNIX
+#endif
+#if (NGX_DEBUG)
+        || (c->log->log_level & NGX_LOG_DEBUG_CONNECTION)
+#endif
+       )
+    {
+#if (NGX_STAT_STUB)
+        (void) ngx_atomic_fetch_add(ngx_stat_waiting_mem,
+                                    ngx_http_keepalive_mem(c));
+#endif
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http keepalive release: %d", c->fd);
+
+    /*
+     * everything the connection has got in its pool is rebuilt
+     * by ngx_http_keepalive_restore() if the client sends a request,
+     * and the log was in the pool too
+     */
+
+    c->log = ngx_cycle->log;
+    c->read->log = c->log;
+    c->write->log = c->log;
+
+    c->pool = NULL;
+    c->data = NULL;
+    c->buffer = NULL;
+    c->sockaddr = NULL;
+    ngx_str_null(&c->addr_text);
+    c->local_sockaddr = c->listening->sockaddr;
+
+    ngx_http_free_connection_pool(pool);
+
+    c->read->handler = ngx_http_released_handler;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_released, 1);
+#endif
+}
+
+
+static void
+ngx_http_released_handler(ngx_event_t *rev)
+{
+    u_char             buf[1];
+    ssize_t            n;
+    ngx_err_t          err;
+    ngx_connection_t  *c;
+
+    c = rev->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http released handler");
+
+    if (rev->timedout || c->close) {
+#if (NGX_STAT_STUB)
+        (void) ngx_atomic_fetch_add(ngx_stat_released, -1);
+#endif
+        ngx_http_close_connection(c);
+        return;
+    }
+
+    /* nothing is read until there is a buffer to read the request in */
+
+    n = recv(c->fd, buf, 1, MSG_PEEK);
+
+    err = (n == -1) ? ngx_socket_errno : 0;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, err,
+                   "http released recv(): %d", n);
+
+    if (err == NGX_EAGAIN) {
+        rev->ready = 0;
+
+        if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+#if (NGX_STAT_STUB)
+            (void) ngx_atomic_fetch_add(ngx_stat_released, -1);
+#endif
+            ngx_http_close_connection(c);
+        }
+
+        return;
+    }
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_released, -1);
+#endif
+
+    if (n == -1 || ngx_http_keepalive_restore(c) != NGX_OK) {
+        ngx_http_close_connection(c);
+        return;
+    }
+
+    if (n == 0) {
+        c->log->handler = NULL;
+        ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                      "client %V closed keepalive connection", &c->addr_text);
+        ngx_http_close_connection(c);
+        return;
+    }
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_reading, 1);
+#endif
+
+    c->log->action = "reading client request line";
+
+    c->idle = 0;
+    ngx_reusable_connection(c, 0);
+
+    /* ngx_http_init_request() allocates the header buffer and hc */
+
+    ngx_http_init_request(rev);
+}
+
+
+static ngx_int_t
+ngx_http_keepalive_restore(ngx_connection_t *c)
+{
+    u_char               sa[NGX_SOCKADDRLEN];
+    socklen_t            len;
+    ngx_log_t           *log;
+    ngx_listening_t     *ls;
+    ngx_http_log_ctx_t  *ctx;
+
+    len = NGX_SOCKADDRLEN;
+
+    if (getpeername(c->fd, (struct sockaddr *) sa, &len) == -1) {
+        ngx_connection_error(c, ngx_socket_errno, "getpeername() failed");
+        return NGX_ERROR;
+    }
+
+    ls = c->listening;
+
+    c->pool = ngx_http_get_connection_pool(ls->pool_size);
+    if (c->pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    c->sockaddr = ngx_palloc(c->pool, len);
+    if (c->sockaddr == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(c->sockaddr, sa, len);
+    c->socklen = len;
+
+    log = ngx_palloc(c->pool, sizeof(ngx_log_t));
+    if (log == NULL) {
+        return NGX_ERROR;
+    }
+
+    *log = ls->log;
+
+    if (ls->addr_ntop) {
+        c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
+        if (c->addr_text.data == NULL) {
+            return NGX_ERROR;
+        }
+
+        c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->addr_text.data,
+                                         ls->addr_text_max_len, 0);
+        if (c->addr_text.len == 0) {
+            return NGX_ERROR;
+        }
+    }
+
+    ctx = ngx_palloc(c->pool, sizeof(ngx_http_log_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->connection = c;
+    ctx->request = NULL;
+    ctx->current_request = NULL;
+
+    log->connection = c->number;
+    log->handler = ngx_http_log_error;
+    log->data = ctx;
+    log->action = "keepalive";
+
+    c->log = log;
+    c->pool->log = log;
+    c->read->log = log;
+    c->write->log = log;
+
+    c->log_error = NGX_ERROR_INFO;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http keepalive restore: %d", c->fd);
+
+    return NGX_OK;
+}
+
+
+static ngx_pool_t *
+ngx_http_get_connection_pool(size_t size)
+{
+    ngx_pool_t  *pool;
+
+    pool = ngx_http_free_pools;
+
+    if (pool == NULL || (size_t) (pool->d.end - (u_char *) pool) != size) {
+        return ngx_create_pool(size, ngx_cycle->log);
+    }
+
+    ngx_http_free_pools = pool->d.next;
+    ngx_http_nfree_pools--;
+
+    pool->d.next = NULL;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_cached_mem, -(ngx_atomic_int_t) size);
+#endif
+
+    return pool;
+}
+
+
+static void
+ngx_http_free_connection_pool(ngx_pool_t *pool)
+{
+    ngx_pool_t  *p, *n;
+
+    if (pool->cleanup || ngx_http_nfree_pools == NGX_HTTP_FREE_POOLS) {
+        ngx_destroy_pool(pool);
+        return;
+    }
+
+    ngx_reset_pool(pool);
+
+    /* only the first block is kept for reuse */
+
+    for (p = pool->d.next; p; p = n) {
+        n = p->d.next;
+        ngx_free(p);
+    }
+
+    pool->d.failed = 0;
+    pool->current = pool;
+    pool->chain = NULL;
+    pool->log = ngx_cycle->log;
+
+    pool->d.next = ngx_http_free_pools;
+    ngx_http_free_pools = pool;
+    ngx_http_nfree_pools++;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_cached_mem,
+                                pool->d.end - (u_char *) pool);
+#endif
+}
+
+
+#if (NGX_STAT_STUB)
+
+static ngx_atomic_int_t
+ngx_http_keepalive_mem(ngx_connection_t *c)
+{
+    ngx_pool_t        *p;
+    ngx_atomic_int_t   size;
+
+    /* the pool blocks, the large allocations are freed on keepalive */
+
+    size = 0;
+
+    for (p = c->pool; p; p = p->d.next) {
+        size += p->d.end - (u_char *) p;
+    }
+
+    return size;
+}
+
+#endif
+
+
 static void
 ngx_http_set_lingering_close(ngx_http_request_t *r)
 {
@@ -3226,7 +3764,11 @@ ngx_http_close_connection(ngx_connection_t *c)
 
     ngx_close_connection(c);
 
-    ngx_destroy_pool(pool);
+    /* the released keepalive connection has no pool */
+
+    if (pool) {
+        ngx_destroy_pool(pool);
+    }
 }
 
 
@@ -19,6 +19,9 @@
 #define NGX_HTTP_DISCARD_BUFFER_SIZE       4096
 #define NGX_HTTP_LINGERING_BUFFER_SIZE     4096
 
+/* the released keepalive connection pools kept for reuse by a worker */
+#define NGX_HTTP_FREE_POOLS                64
+
 
 #define NGX_HTTP_VERSION_9                 9
 #define NGX_HTTP_VERSION_10                1000
@@ -229,9 +232,21 @@ typedef struct {
     unsigned                          chrome:1;
     unsigned                          safari:1;
     unsigned                          konqueror:1;
+    unsigned                          chunked:1;
 } ngx_http_headers_in_t;
 
 
+/*
+ * the "add_header" values without variables serialized once per location,
+ * the table elements are kept for the $sent_http_* variables
+ */
+
+typedef struct {
+    ngx_str_t                         text;
+    ngx_list_part_t                   part;
+} ngx_http_header_block_t;
+
+
 //ngx_http_headers_out_t 代表输出的响应头(reponse headers)
 typedef struct {
     //待发送的HTTP头部链表。
@@ -266,6 +281,8 @@ typedef struct {
 
     ngx_array_t                       cache_control;
 
+    ngx_http_header_block_t          *header_block;
+
     //这里指定过content_length_n后，不用再到ngx_table_elt_t中设置了
     off_t                             content_length_n;
     time_t                            date_time;
@@ -309,6 +326,12 @@ typedef struct {
 
     // HTTP包体接收完毕后执行的回调方法，也就是ngx_http_read_client_request_body 方法传递的第二个参数
     ngx_http_client_body_handler_pt   post_handler;
+
+    /* the chunked body: the decoder state and the decoded data size */
+    ngx_http_chunked_t               *chunked;
+    off_t                             received;
+    ngx_chain_t                      *last;
+    ngx_chain_t                      *free;
 } ngx_http_request_body_t;
 
 
@@ -322,17 +345,50 @@ typedef struct {
     ngx_int_t                         nfree;
 
     ngx_uint_t                        pipeline;    /* unsigned  pipeline:1; */
+
+    /* the rest of keepalive_timeout after the memory is released */
+    ngx_msec_t                        keepalive_rest;
 } ngx_http_connection_t;
 
 
 typedef struct ngx_http_server_name_s  ngx_http_server_name_t;
 
 
+#define NGX_HTTP_SERVER_NAME_CACHE_LEN  110
+
+typedef struct ngx_http_server_name_node_s  ngx_http_server_name_node_t;
+
+struct ngx_http_server_name_node_s {
+    ngx_queue_t                       queue;
+    ngx_http_server_name_node_t      *next;
+    ngx_uint_t                        key;
+    void                             *server;
+    u_short                           len;
+    u_char                            name[NGX_HTTP_SERVER_NAME_CACHE_LEN];
+};
+
+
+/*
+ * a per worker cache of the host names that were looked up beyond
+ * the exact names hash; the server is NULL if the default server was used
+ */
+
+typedef struct {
+    ngx_http_server_name_node_t     **buckets;
+    ngx_uint_t                        nbuckets;
+
+    ngx_queue_t                       lru;
+    ngx_queue_t                       free;
+} ngx_http_server_name_cache_t;
+
+
 typedef struct {
      ngx_hash_combined_t              names;
 
      ngx_uint_t                       nregex;
      ngx_http_server_name_t          *regex;
+
+     ngx_http_server_name_cache_t    *cache;
 } ngx_http_virtual_names_t;
 
 
@@ -584,6 +640,7 @@ struct ngx_http_request_s {
     unsigned                          request_body_in_clean_file:1;
     unsigned                          request_body_file_group_access:1;
     unsigned                          request_body_file_log_level:3;
+    unsigned                          request_body_no_buffering:1;
 
     unsigned                          subrequest_in_memory:1;
     unsigned                          waited:1;
@@ -596,6 +653,8 @@ struct ngx_http_request_s {
     unsigned                          gzip_tested:1;
     unsigned                          gzip_ok:1;
     unsigned                          gzip_vary:1;
+    unsigned                          brotli_ok:1;
+    unsigned                          zstd_ok:1;
 #endif
 
     unsigned                          proxy:1;
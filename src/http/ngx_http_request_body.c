@@ -12,9 +12,19 @@
 
 static void ngx_http_read_client_request_body_handler(ngx_http_request_t *r);
 static ngx_int_t ngx_http_do_read_client_request_body(ngx_http_request_t *r);
+static ngx_int_t ngx_http_read_chunked_request_body(ngx_http_request_t *r);
+static ngx_int_t ngx_http_do_read_chunked_request_body(ngx_http_request_t *r);
+static ngx_int_t ngx_http_chunked_request_body_done(ngx_http_request_t *r);
+static ngx_int_t ngx_http_read_unbuffered_chunked_request_body(
+    ngx_http_request_t *r);
+static ngx_int_t ngx_http_request_body_chunked(ngx_http_request_t *r,
+    ngx_buf_t *b);
+static void ngx_http_request_body_free(ngx_http_request_body_t *rb);
 static ngx_int_t ngx_http_write_request_body(ngx_http_request_t *r,
     ngx_chain_t *body);
 static ngx_int_t ngx_http_read_discarded_request_body(ngx_http_request_t *r);
+static ngx_int_t ngx_http_discard_chunked_request_body(ngx_http_request_t *r,
+    ngx_buf_t *b);
 static ngx_int_t ngx_http_test_expect(ngx_http_request_t *r);
 
 
@@ -55,11 +65,16 @@ ngx_http_read_client_request_body(ngx_http_request_t *r,
 
     r->request_body = rb;
 
-    if (r->headers_in.content_length_n < 0) {
+    if (r->headers_in.content_length_n < 0 && !r->headers_in.chunked) {
         post_handler(r);
         return NGX_OK;
     }
 
+    if (r->headers_in.chunked) {
+        rb->post_handler = post_handler;
+        return ngx_http_read_chunked_request_body(r);
+    }
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (r->headers_in.content_length_n == 0) {
@@ -98,6 +113,66 @@ ngx_http_read_client_request_body(ngx_http_request_t *r,
         return NGX_OK;
     }
 
+    if (r->request_body_no_buffering) {
+
+        /*
+         * the body is passed on while it is being read: the pre-read part
+         * is placed in rb->bufs and the rest is read into rb->buf part by
+         * part by ngx_http_read_unbuffered_request_body()
+         */
+
+        rb->rest = r->headers_in.content_length_n;
+
+        preread = r->header_in->last - r->header_in->pos;
+
+        if (preread) {
+
+            if ((off_t) preread > rb->rest) {
+                preread = (size_t) rb->rest;
+            }
+
+            b = ngx_calloc_buf(r->pool);
+            if (b == NULL) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            b->temporary = 1;
+            b->start = r->header_in->pos;
+            b->pos = r->header_in->pos;
+            b->last = r->header_in->pos + preread;
+            b->end = b->last;
+
+            rb->bufs = ngx_alloc_chain_link(r->pool);
+            if (rb->bufs == NULL) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            rb->bufs->buf = b;
+            rb->bufs->next = NULL;
+
+            r->header_in->pos += preread;
+            r->request_length += preread;
+            rb->rest -= preread;
+        }
+
+        if (rb->rest) {
+            size = clcf->client_body_buffer_size;
+
+            if ((off_t) size > rb->rest) {
+                size = (ssize_t) rb->rest;
+            }
+
+            rb->buf = ngx_create_temp_buf(r->pool, size);
+            if (rb->buf == NULL) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
+
+        post_handler(r);
+
+        return NGX_OK;
+    }
+
     rb->post_handler = post_handler;
 
     /*
@@ -271,6 +346,10 @@ ngx_http_do_read_client_request_body(ngx_http_request_t *r)
     c = r->connection;
     rb = r->request_body;
 
+    if (rb->chunked) {
+        return ngx_http_do_read_chunked_request_body(r);
+    }
+
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
                    "http read client request body");
 
@@ -387,6 +466,554 @@ ngx_http_do_read_client_request_body(ngx_http_request_t *r)
 }
 
 
+/*
+ * reads the next part of the body into rb->buf in the unbuffered mode,
+ * the caller must have sent the previous part already;
+ * on NGX_OK rb->bufs holds the part, its last_buf is set for the last part
+ */
+
+ngx_int_t
+ngx_http_read_unbuffered_request_body(ngx_http_request_t *r)
+{
+    size_t                     size;
+    ssize_t                    n;
+    ngx_buf_t                 *b;
+    ngx_chain_t               *cl;
+    ngx_connection_t          *c;
+    ngx_http_request_body_t   *rb;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    c = r->connection;
+    rb = r->request_body;
+
+    if (c->read->timedout) {
+        c->timedout = 1;
+        return NGX_HTTP_REQUEST_TIME_OUT;
+    }
+
+    if (rb->rest == 0) {
+        return NGX_OK;
+    }
+
+    if (rb->chunked) {
+        return ngx_http_read_unbuffered_chunked_request_body(r);
+    }
+
+    b = rb->buf;
+
+    if (rb->bufs == NULL || rb->bufs->buf != b) {
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        cl->buf = b;
+        cl->next = NULL;
+
+        rb->bufs = cl;
+    }
+
+    b->pos = b->start;
+    b->last = b->start;
+
+    size = b->end - b->start;
+
+    if ((off_t) size > rb->rest) {
+        size = (size_t) rb->rest;
+    }
+
+    n = c->recv(c, b->last, size);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http client request body unbuffered recv %z", n);
+
+    if (n == NGX_AGAIN) {
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+        ngx_add_timer(c->read, clcf->client_body_timeout);
+
+        if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+    if (n == 0) {
+        ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                      "client closed prematurely connection");
+    }
+
+    if (n == 0 || n == NGX_ERROR) {
+        c->error = 1;
+        return NGX_HTTP_BAD_REQUEST;
+    }
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    b->last += n;
+    rb->rest -= n;
+    r->request_length += n;
+
+    b->last_buf = (rb->rest == 0);
+
+    return NGX_OK;
+}
+
+
+/*
+ * a chunked body is decoded in place: rb->bufs links the chunk data
+ * in r->header_in and rb->buf, when rb->buf is full the data are written
+ * to the temporary file and the buffer is reused
+ */
+
+static ngx_int_t
+ngx_http_read_chunked_request_body(ngx_http_request_t *r)
+{
+    u_char                    *pos;
+    ngx_int_t                  rc;
+    ngx_http_request_body_t   *rb;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    rb = r->request_body;
+
+    rb->chunked = ngx_pcalloc(r->pool, sizeof(ngx_http_chunked_t));
+    if (rb->chunked == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    /* the body size is not known until the last chunk */
+
+    rb->rest = 1;
+
+    pos = r->header_in->pos;
+
+    rc = ngx_http_request_body_chunked(r, r->header_in);
+
+    r->request_length += r->header_in->pos - pos;
+
+    if (rc == NGX_DONE) {
+        return ngx_http_chunked_request_body_done(r);
+    }
+
+    if (rc != NGX_AGAIN) {
+        return rc;
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    rb->buf = ngx_create_temp_buf(r->pool, clcf->client_body_buffer_size);
+    if (rb->buf == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (r->request_body_no_buffering) {
+        rb->post_handler(r);
+        return NGX_OK;
+    }
+
+    r->read_event_handler = ngx_http_read_client_request_body_handler;
+
+    return ngx_http_do_read_chunked_request_body(r);
+}
+
+
+static ngx_int_t
+ngx_http_do_read_chunked_request_body(ngx_http_request_t *r)
+{
+    size_t                     size;
+    ssize_t                    n;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *b;
+    ngx_connection_t          *c;
+    ngx_http_request_body_t   *rb;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    c = r->connection;
+    rb = r->request_body;
+    b = rb->buf;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http read client chunked body");
+
+    for ( ;; ) {
+
+        if (b->last == b->end) {
+
+            /* the buffer is full, the data decoded so far go to the file */
+
+            if (rb->bufs) {
+                if (ngx_http_write_request_body(r, rb->bufs) != NGX_OK) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                ngx_http_request_body_free(rb);
+            }
+
+            b->pos = b->start;
+            b->last = b->start;
+        }
+
+        /* do not read past the body end into a pipelined request */
+
+        size = b->end - b->last;
+
+        if ((off_t) size > rb->chunked->length) {
+            size = (size_t) rb->chunked->length;
+        }
+
+        n = c->recv(c, b->last, size);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http client chunked body recv %z", n);
+
+        if (n == NGX_AGAIN) {
+            clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+            ngx_add_timer(c->read, clcf->client_body_timeout);
+
+            if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            return NGX_AGAIN;
+        }
+
+        if (n == 0) {
+            ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                          "client closed prematurely connection");
+        }
+
+        if (n == 0 || n == NGX_ERROR) {
+            c->error = 1;
+            return NGX_HTTP_BAD_REQUEST;
+        }
+
+        b->last += n;
+        r->request_length += n;
+
+        rc = ngx_http_request_body_chunked(r, b);
+
+        if (rc == NGX_DONE) {
+            break;
+        }
+
+        if (rc != NGX_AGAIN) {
+            return rc;
+        }
+    }
+
+    if (c->read->timer_set) {
+        ngx_del_timer(c->read);
+    }
+
+    return ngx_http_chunked_request_body_done(r);
+}
+
+
+static ngx_int_t
+ngx_http_chunked_request_body_done(ngx_http_request_t *r)
+{
+    ngx_buf_t                *b;
+    ngx_chain_t              *cl;
+    ngx_http_request_body_t  *rb;
+
+    rb = r->request_body;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http client chunked body size %O", rb->received);
+
+    rb->rest = 0;
+
+    r->headers_in.content_length_n = rb->received;
+
+    if (rb->temp_file || r->request_body_in_file_only) {
+
+        if (rb->bufs == NULL && rb->temp_file == NULL) {
+
+            /* an empty buf creates the temporary file for an empty body */
+
+            rb->bufs = ngx_chain_get_free_buf(r->pool, &rb->free);
+            if (rb->bufs == NULL) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            ngx_memzero(rb->bufs->buf, sizeof(ngx_buf_t));
+            rb->last = rb->bufs;
+        }
+
+        if (rb->bufs) {
+            if (ngx_http_write_request_body(r, rb->bufs) != NGX_OK) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            ngx_http_request_body_free(rb);
+        }
+
+        b = ngx_calloc_buf(r->pool);
+        if (b == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        b->in_file = 1;
+        b->file_pos = 0;
+        b->file_last = rb->temp_file->file.offset;
+        b->file = &rb->temp_file->file;
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        cl->buf = b;
+        cl->next = NULL;
+
+        rb->bufs = cl;
+        rb->last = cl;
+
+    } else if (r->request_body_in_single_buf && rb->bufs && rb->bufs->next) {
+
+        b = ngx_create_temp_buf(r->pool, (size_t) rb->received);
+        if (b == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        for (cl = rb->bufs; cl; cl = cl->next) {
+            b->last = ngx_cpymem(b->last, cl->buf->pos,
+                                 cl->buf->last - cl->buf->pos);
+        }
+
+        rb->bufs->buf = b;
+        rb->bufs->next = NULL;
+        rb->last = rb->bufs;
+    }
+
+    r->read_event_handler = ngx_http_block_reading;
+
+    rb->post_handler(r);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_read_unbuffered_chunked_request_body(ngx_http_request_t *r)
+{
+    size_t                     size;
+    ssize_t                    n;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *b;
+    ngx_chain_t               *cl;
+    ngx_connection_t          *c;
+    ngx_http_request_body_t   *rb;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    c = r->connection;
+    rb = r->request_body;
+    b = rb->buf;
+
+    if (rb->bufs && rb->bufs->buf->end != b->end) {
+
+        /* the pre-read part is linked to the upstream request, keep it */
+
+        rb->bufs = NULL;
+        rb->last = NULL;
+    }
+
+    ngx_http_request_body_free(rb);
+
+    for ( ;; ) {
+        b->pos = b->start;
+        b->last = b->start;
+
+        size = b->end - b->start;
+
+        if ((off_t) size > rb->chunked->length) {
+            size = (size_t) rb->chunked->length;
+        }
+
+        n = c->recv(c, b->last, size);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http client chunked body unbuffered recv %z", n);
+
+        if (n == NGX_AGAIN) {
+            clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+            ngx_add_timer(c->read, clcf->client_body_timeout);
+
+            if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+
+            return NGX_AGAIN;
+        }
+
+        if (n == 0) {
+            ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                          "client closed prematurely connection");
+        }
+
+        if (n == 0 || n == NGX_ERROR) {
+            c->error = 1;
+            return NGX_HTTP_BAD_REQUEST;
+        }
+
+        if (c->read->timer_set) {
+            ngx_del_timer(c->read);
+        }
+
+        b->last += n;
+        r->request_length += n;
+
+        rc = ngx_http_request_body_chunked(r, b);
+
+        if (rc == NGX_DONE) {
+            break;
+        }
+
+        if (rc != NGX_AGAIN) {
+            return rc;
+        }
+
+        /* a read of the chunk framing only is followed by the next one */
+
+        if (rb->bufs) {
+            return NGX_OK;
+        }
+    }
+
+    rb->rest = 0;
+
+    r->headers_in.content_length_n = rb->received;
+
+    if (rb->bufs == NULL) {
+        cl = ngx_chain_get_free_buf(r->pool, &rb->free);
+        if (cl == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        ngx_memzero(cl->buf, sizeof(ngx_buf_t));
+
+        rb->bufs = cl;
+        rb->last = cl;
+    }
+
+    rb->last->buf->last_buf = 1;
+
+    return NGX_OK;
+}
+
+
+/*
+ * decodes the chunks in b and links their data to rb->bufs,
+ * returns NGX_DONE after the last chunk and NGX_AGAIN if more is needed
+ */
+
+static ngx_int_t
+ngx_http_request_body_chunked(ngx_http_request_t *r, ngx_buf_t *b)
+{
+    size_t                     size;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *buf;
+    ngx_chain_t               *cl;
+    ngx_http_request_body_t   *rb;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    rb = r->request_body;
+
+    for ( ;; ) {
+
+        rc = ngx_http_parse_chunked(r, b, rb->chunked);
+
+        if (rc == NGX_OK) {
+
+            /* a part of the chunk data is at b->pos */
+
+            size = b->last - b->pos;
+
+            if ((off_t) size > rb->chunked->size) {
+                size = (size_t) rb->chunked->size;
+            }
+
+            rb->received += size;
+
+            clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+            if (clcf->client_max_body_size
+                && clcf->client_max_body_size < rb->received)
+            {
+                ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                              "client intended to send too large chunked "
+                              "body: %O bytes", rb->received);
+
+                return NGX_HTTP_REQUEST_ENTITY_TOO_LARGE;
+            }
+
+            if (size <= 128 && rb->last && rb->last->buf->end == b->end) {
+
+                /* a small chunk is moved next to the previous one */
+
+                buf = rb->last->buf;
+                buf->last = ngx_movemem(buf->last, b->pos, size);
+
+            } else {
+                cl = ngx_chain_get_free_buf(r->pool, &rb->free);
+                if (cl == NULL) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                buf = cl->buf;
+                ngx_memzero(buf, sizeof(ngx_buf_t));
+
+                buf->temporary = 1;
+                buf->start = b->pos;
+                buf->pos = b->pos;
+                buf->last = b->pos + size;
+                buf->end = b->end;
+
+                if (rb->last) {
+                    rb->last->next = cl;
+
+                } else {
+                    rb->bufs = cl;
+                }
+
+                rb->last = cl;
+            }
+
+            b->pos += size;
+            rb->chunked->size -= size;
+
+            continue;
+        }
+
+        if (rc == NGX_DONE || rc == NGX_AGAIN) {
+            return rc;
+        }
+
+        /* rc == NGX_ERROR */
+
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "client sent invalid chunked body");
+
+        return NGX_HTTP_BAD_REQUEST;
+    }
+}
+
+
+static void
+ngx_http_request_body_free(ngx_http_request_body_t *rb)
+{
+    if (rb->bufs) {
+        rb->last->next = rb->free;
+        rb->free = rb->bufs;
+
+        rb->bufs = NULL;
+        rb->last = NULL;
+    }
+}
+
+
 static ngx_int_t
 ngx_http_write_request_body(ngx_http_request_t *r, ngx_chain_t *body)
 {
@@ -439,6 +1066,7 @@ ngx_int_t
 ngx_http_discard_request_body(ngx_http_request_t *r)
 {
     ssize_t       size;
+    ngx_int_t     rc;
     ngx_event_t  *rev;
 
     if (r != r->main || r->discard_body) {
@@ -457,13 +1085,22 @@ ngx_http_discard_request_body(ngx_http_request_t *r)
         ngx_del_timer(rev);
     }
 
-    if (r->headers_in.content_length_n <= 0 || r->request_body) {
+    if ((r->headers_in.content_length_n <= 0 && !r->headers_in.chunked)
+        || r->request_body)
+    {
         return NGX_OK;
     }
 
     size = r->header_in->last - r->header_in->pos;
 
-    if (size) {
+    if (r->headers_in.chunked) {
+        rc = ngx_http_discard_chunked_request_body(r, r->header_in);
+
+        if (rc != NGX_AGAIN) {
+            return rc;
+        }
+
+    } else if (size) {
         if (r->headers_in.content_length_n > size) {
             r->header_in->pos += size;
             r->headers_in.content_length_n -= size;
@@ -561,15 +1198,26 @@ ngx_http_discarded_request_body_handler(ngx_http_request_t *r)
 static ngx_int_t
 ngx_http_read_discarded_request_body(ngx_http_request_t *r)
 {
-    size_t   size;
-    ssize_t  n;
-    u_char   buffer[NGX_HTTP_DISCARD_BUFFER_SIZE];
+    off_t      rest;
+    size_t     size;
+    ssize_t    n;
+    ngx_int_t  rc;
+    ngx_buf_t  b;
+    u_char     buffer[NGX_HTTP_DISCARD_BUFFER_SIZE];
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http read discarded body");
 
     for ( ;; ) {
-        if (r->headers_in.content_length_n == 0) {
+        if (r->headers_in.chunked) {
+            rest = r->request_body->rest ? r->request_body->chunked->length
+                                         : 0;
+
+        } else {
+            rest = r->headers_in.content_length_n;
+        }
+
+        if (rest == 0) {
             r->read_event_handler = ngx_http_block_reading;
             return NGX_OK;
         }
@@ -578,9 +1226,9 @@ ngx_http_read_discarded_request_body(ngx_http_request_t *r)
             return NGX_AGAIN;
         }
 
-        size = (r->headers_in.content_length_n > NGX_HTTP_DISCARD_BUFFER_SIZE) ?
+        size = (rest > NGX_HTTP_DISCARD_BUFFER_SIZE) ?
                    NGX_HTTP_DISCARD_BUFFER_SIZE:
-                   (size_t) r->headers_in.content_length_n;
+                   (size_t) rest;
 
         n = r->connection->recv(r->connection, buffer, size);
 
@@ -597,11 +1245,91 @@ ngx_http_read_discarded_request_body(ngx_http_request_t *r)
             return NGX_OK;
         }
 
+        if (r->headers_in.chunked) {
+            ngx_memzero(&b, sizeof(ngx_buf_t));
+
+            b.pos = buffer;
+            b.last = buffer + n;
+
+            rc = ngx_http_discard_chunked_request_body(r, &b);
+
+            if (rc != NGX_OK && rc != NGX_AGAIN) {
+                r->connection->error = 1;
+                return NGX_OK;
+            }
+
+            continue;
+        }
+
         r->headers_in.content_length_n -= n;
     }
 }
 
 
+static ngx_int_t
+ngx_http_discard_chunked_request_body(ngx_http_request_t *r, ngx_buf_t *b)
+{
+    size_t                    size;
+    ngx_int_t                 rc;
+    ngx_http_request_body_t  *rb;
+
+    rb = r->request_body;
+
+    if (rb == NULL) {
+        rb = ngx_pcalloc(r->pool, sizeof(ngx_http_request_body_t));
+        if (rb == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        rb->chunked = ngx_pcalloc(r->pool, sizeof(ngx_http_chunked_t));
+        if (rb->chunked == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        rb->rest = 1;
+
+        r->request_body = rb;
+    }
+
+    for ( ;; ) {
+
+        rc = ngx_http_parse_chunked(r, b, rb->chunked);
+
+        if (rc == NGX_OK) {
+
+            /* skip the chunk data */
+
+            size = b->last - b->pos;
+
+            if ((off_t) size > rb->chunked->size) {
+                size = (size_t) rb->chunked->size;
+            }
+
+            b->pos += size;
+            rb->chunked->size -= size;
+
+            continue;
+        }
+
+        if (rc == NGX_DONE) {
+            rb->rest = 0;
+            return NGX_OK;
+        }
+
+        if (rc == NGX_AGAIN) {
+            return NGX_AGAIN;
+        }
+
+        /* rc == NGX_ERROR */
+
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "client sent invalid chunked body");
+
+        return NGX_HTTP_BAD_REQUEST;
+    }
+}
+
+
 static ngx_int_t
 ngx_http_test_expect(ngx_http_request_t *r)
 {
@@ -0,0 +1,416 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+static ngx_http_shm_cache_node_t *ngx_http_shm_cache_lookup(
+    ngx_http_shm_cache_t *cache, u_char *md5);
+static void ngx_http_shm_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+static ngx_int_t ngx_http_shm_cache_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+
+
+/*
+ * returns NGX_DECLINED if the entry is not found, otherwise the entry
+ * is moved to the head of the LRU queue and the result of the get handler
+ * is returned; the zone is not locked while a large entry is copied,
+ * a worker that exits meanwhile leaves the entry held until the restart
+ */
+
+ngx_int_t
+ngx_http_shm_cache_get(ngx_shm_zone_t *shm_zone, u_char *md5,
+    ngx_http_shm_cache_get_pt get, void *data)
+{
+    ngx_int_t                   rc;
+    ngx_http_shm_cache_t       *cache;
+    ngx_http_shm_cache_node_t  *cn;
+
+    cache = shm_zone->data;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cn = ngx_http_shm_cache_lookup(cache, md5);
+
+    if (cn == NULL || cn->len <= ngx_pagesize) {
+        rc = cn ? get(data, cn->data, cn->len) : NGX_DECLINED;
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        return rc;
+    }
+
+    cn->count++;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    rc = get(data, cn->data, cn->len);
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cn->count--;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    return rc;
+}
+
+
+/*
+ * allocates an entry of len bytes evicting the least recently used ones
+ * and lets the put handler fill it in; returns NGX_DECLINED if the entry
+ * is already cached, is too large, or does not fit after the entries
+ * of twice its size have been evicted: the freed memory may be scattered
+ * over pages that are still partly used, and evicting the whole cache
+ * for one entry is worse than not caching it
+ */
+
+ngx_int_t
+ngx_http_shm_cache_put(ngx_shm_zone_t *shm_zone, u_char *md5, size_t len,
+    ngx_http_shm_cache_put_pt put, void *data)
+{
+    size_t                      n, freed;
+    ngx_int_t                   rc;
+    ngx_queue_t                *q;
+    ngx_rbtree_node_t          *node;
+    ngx_http_shm_cache_t       *cache;
+    ngx_http_shm_cache_node_t  *cn;
+
+    cache = shm_zone->data;
+
+    n = offsetof(ngx_rbtree_node_t, color)
+        + offsetof(ngx_http_shm_cache_node_t, data)
+        + len;
+
+    /* an entry should not evict everything else */
+
+    if (n > shm_zone->shm.size / 2) {
+        return NGX_DECLINED;
+    }
+
+    rc = NGX_DECLINED;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    if (ngx_http_shm_cache_lookup(cache, md5)) {
+        goto done;
+    }
+
+    freed = 0;
+
+    for ( ;; ) {
+        node = ngx_slab_alloc_locked(cache->shpool, n);
+        if (node) {
+            break;
+        }
+
+        /* the entries being copied are skipped */
+
+        for (q = ngx_queue_last(&cache->sh->queue);
+             q != ngx_queue_sentinel(&cache->sh->queue);
+             q = ngx_queue_prev(q))
+        {
+            cn = ngx_queue_data(q, ngx_http_shm_cache_node_t, queue);
+
+            if (cn->count == 0) {
+                break;
+            }
+        }
+
+        if (freed >= 2 * n || q == ngx_queue_sentinel(&cache->sh->queue)) {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                           "shm cache: no room for %uz bytes", n);
+            goto done;
+        }
+
+        ngx_queue_remove(q);
+
+        node = (ngx_rbtree_node_t *)
+                   ((u_char *) cn - offsetof(ngx_rbtree_node_t, color));
+
+        ngx_rbtree_delete(&cache->sh->rbtree, node);
+
+        freed += offsetof(ngx_rbtree_node_t, color)
+                 + offsetof(ngx_http_shm_cache_node_t, data)
+                 + cn->len;
+
+        ngx_slab_free_locked(cache->shpool, node);
+    }
+
+    cn = (ngx_http_shm_cache_node_t *) &node->color;
+
+    ngx_memcpy((u_char *) &node->key, md5, sizeof(ngx_rbtree_key_t));
+    ngx_memcpy(cn->md5, md5, 16);
+
+    cn->count = 0;
+    cn->len = len;
+
+    put(data, cn->data);
+
+    ngx_rbtree_insert(&cache->sh->rbtree, node);
+
+    ngx_queue_insert_head(&cache->sh->queue, &cn->queue);
+
+    rc = NGX_OK;
+
+done:
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    return rc;
+}
+
+
+static ngx_http_shm_cache_node_t *
+ngx_http_shm_cache_lookup(ngx_http_shm_cache_t *cache, u_char *md5)
+{
+    ngx_int_t                   rc;
+    ngx_rbtree_key_t            key;
+    ngx_rbtree_node_t          *node, *sentinel;
+    ngx_http_shm_cache_node_t  *cn;
+
+    ngx_memcpy((u_char *) &key, md5, sizeof(ngx_rbtree_key_t));
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (key < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (key > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* key == node->key */
+
+        cn = (ngx_http_shm_cache_node_t *) &node->color;
+
+        rc = ngx_memcmp(md5, cn->md5, 16);
+
+        if (rc == 0) {
+            ngx_queue_remove(&cn->queue);
+            ngx_queue_insert_head(&cache->sh->queue, &cn->queue);
+
+            return cn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_http_shm_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t          **p;
+    ngx_http_shm_cache_node_t   *cn, *cnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            cn = (ngx_http_shm_cache_node_t *) &node->color;
+            cnt = (ngx_http_shm_cache_node_t *) &temp->color;
+
+            p = (ngx_memcmp(cn->md5, cnt->md5, 16) < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static ngx_int_t
+ngx_http_shm_cache_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_shm_cache_t  *ocache = data;
+
+    size_t                 len;
+    ngx_http_shm_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache) {
+        cache->sh = ocache->sh;
+        cache->shpool = ocache->shpool;
+
+        return NGX_OK;
+    }
+
+    cache->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    /*
+     * a full cache is the normal state, the failed allocations are
+     * followed by the evictions and should not be logged at "crit" level
+     */
+
+    cache->shpool->log_nomem = 0;
+
+    if (shm_zone->shm.exists) {
+        cache->sh = cache->shpool->data;
+
+        return NGX_OK;
+    }
+
+    cache->sh = ngx_slab_alloc(cache->shpool, sizeof(ngx_http_shm_cache_sh_t));
+    if (cache->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->shpool->data = cache->sh;
+
+    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
+                    ngx_http_shm_cache_rbtree_insert_value);
+
+    ngx_queue_init(&cache->sh->queue);
+
+    len = sizeof(" in  \"\"") + cache->name.len + shm_zone->shm.name.len;
+
+    cache->shpool->log_ctx = ngx_slab_alloc(cache->shpool, len);
+    if (cache->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->shpool->log_ctx, " in %V \"%V\"%Z",
+                &cache->name, &shm_zone->shm.name);
+
+    return NGX_OK;
+}
+
+
+/*
+ * the zone directive, "name:size"; the module the zone belongs to
+ * is passed in cmd->post
+ */
+
+char *
+ngx_http_shm_cache_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    u_char                *p;
+    ssize_t                size;
+    ngx_str_t             *value, name, s;
+    ngx_shm_zone_t        *shm_zone;
+    ngx_http_shm_cache_t  *cache;
+
+    value = cf->args->elts;
+
+    name = value[1];
+
+    p = (u_char *) ngx_strchr(name.data, ':');
+
+    if (p == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone size \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    name.len = p - name.data;
+
+    s.data = p + 1;
+    s.len = value[1].data + value[1].len - s.data;
+
+    size = ngx_parse_size(&s);
+
+    if (size == NGX_ERROR || size < (ssize_t) (8 * ngx_pagesize)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone size \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    cache = ngx_pcalloc(cf->pool, sizeof(ngx_http_shm_cache_t));
+    if (cache == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    cache->name = cmd->name;
+
+    shm_zone = ngx_shared_memory_add(cf, &name, size, cmd->post);
+    if (shm_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (shm_zone->data) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "duplicate zone \"%V\"", &name);
+        return NGX_CONF_ERROR;
+    }
+
+    shm_zone->init = ngx_http_shm_cache_init_zone;
+    shm_zone->data = cache;
+
+    return NGX_CONF_OK;
+}
+
+
+/*
+ * the cache directive, "name" or "off"; the ngx_shm_zone_t pointer is
+ * at cmd->offset, the module the zone belongs to is passed in cmd->post
+ */
+
+char *
+ngx_http_shm_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    char  *p = conf;
+
+    ngx_str_t        *value;
+    ngx_shm_zone_t  **zone;
+
+    zone = (ngx_shm_zone_t **) (p + cmd->offset);
+
+    if (*zone != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        *zone = NULL;
+        return NGX_CONF_OK;
+    }
+
+    /*
+     * the zone may be declared later, a zone that is never declared
+     * is rejected by ngx_init_cycle() as having zero size
+     */
+
+    *zone = ngx_shared_memory_add(cf, &value[1], 0, cmd->post);
+    if (*zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
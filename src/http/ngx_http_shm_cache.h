@@ -0,0 +1,70 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HTTP_SHM_CACHE_H_INCLUDED_
+#define _NGX_HTTP_SHM_CACHE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * a shared memory cache of module specific entries keyed by MD5, the
+ * least recently used entries are evicted when the zone is full
+ */
+
+typedef struct {
+    u_char                       color;
+    u_char                       dummy;
+    ngx_queue_t                  queue;
+    u_char                       md5[16];
+    ngx_uint_t                   count;
+    size_t                       len;
+    u_char                       data[1];
+} ngx_http_shm_cache_node_t;
+
+
+typedef struct {
+    ngx_rbtree_t                 rbtree;
+    ngx_rbtree_node_t            sentinel;
+    ngx_queue_t                  queue;
+} ngx_http_shm_cache_sh_t;
+
+
+typedef struct {
+    ngx_http_shm_cache_sh_t     *sh;
+    ngx_slab_pool_t             *shpool;
+    ngx_str_t                    name;
+} ngx_http_shm_cache_t;
+
+
+/*
+ * the put handler and the get handler of the entries up to a page are
+ * called with the zone locked; larger entries are held by a counter while
+ * the get handler copies them without the lock, so the handler may only
+ * read the entry
+ */
+
+typedef ngx_int_t (*ngx_http_shm_cache_get_pt)(void *data, u_char *p,
+    size_t len);
+typedef void (*ngx_http_shm_cache_put_pt)(void *data, u_char *p);
+
+
+ngx_int_t ngx_http_shm_cache_get(ngx_shm_zone_t *shm_zone, u_char *md5,
+    ngx_http_shm_cache_get_pt get, void *data);
+ngx_int_t ngx_http_shm_cache_put(ngx_shm_zone_t *shm_zone, u_char *md5,
+    size_t len, ngx_http_shm_cache_put_pt put, void *data);
+
+char *ngx_http_shm_cache_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+char *ngx_http_shm_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+#endif /* _NGX_HTTP_SHM_CACHE_H_INCLUDED_ */
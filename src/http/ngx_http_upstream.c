@@ -31,6 +31,11 @@ static ngx_int_t ngx_http_upstream_reinit(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
 static void ngx_http_upstream_send_request(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_send_request_body(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static void ngx_http_upstream_read_request_handler(ngx_http_request_t *r);
+static void ngx_http_upstream_request_body_done(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
 static void ngx_http_upstream_send_request_handler(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
 static void ngx_http_upstream_process_header(ngx_http_request_t *r,
@@ -487,6 +492,10 @@ ngx_http_upstream_init_request(ngx_http_request_t *r)
 
     if (r->request_body) {
         u->request_bufs = r->request_body->bufs;
+
+        if (r->request_body_no_buffering && r->request_body->rest) {
+            u->request_body_streaming = 1;
+        }
     }
 
     if (u->create_request(r) != NGX_OK) {
@@ -502,8 +511,11 @@ ngx_http_upstream_init_request(ngx_http_request_t *r)
     u->output.pool = r->pool;
     u->output.bufs.num = 1;
     u->output.bufs.size = clcf->client_body_buffer_size;
-    u->output.output_filter = ngx_chain_writer;
-    u->output.filter_ctx = &u->writer;
+
+    if (u->output.output_filter == NULL) {
+        u->output.output_filter = ngx_chain_writer;
+        u->output.filter_ctx = &u->writer;
+    }
 
     u->writer.pool = r->pool;
 
@@ -1387,15 +1399,31 @@ ngx_http_upstream_send_request(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
     u->request_sent = 1;
 
+    if (rc == NGX_OK && u->request_body_streaming) {
+        rc = ngx_http_upstream_send_request_body(r, u);
+    }
+
     if (rc == NGX_ERROR) {
         ngx_http_upstream_next(r, u, NGX_HTTP_UPSTREAM_FT_ERROR);
         return;
     }
 
+    if (rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+        ngx_http_upstream_finalize_request(r, u, rc);
+        return;
+    }
+
     if (c->write->timer_set) {
         ngx_del_timer(c->write);
     }
 
+    if (rc == NGX_DONE) {
+
+        /* the upstream waits for the next part of the request body */
+
+        return;
+    }
+
     if (rc == NGX_AGAIN) {
         ngx_add_timer(c->write, u->conf->send_timeout);
 
@@ -1451,6 +1479,90 @@ ngx_http_upstream_send_request(ngx_http_request_t *r, ngx_http_upstream_t *u)
 }
 
 
+static ngx_int_t
+ngx_http_upstream_send_request_body(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_int_t  rc;
+
+    /* the request can not be repeated from now on */
+
+    u->request_body_streamed = 1;
+
+    for ( ;; ) {
+        rc = ngx_http_read_unbuffered_request_body(r);
+
+        if (rc == NGX_AGAIN) {
+            r->read_event_handler = ngx_http_upstream_read_request_handler;
+            return NGX_DONE;
+        }
+
+        if (rc != NGX_OK) {
+            return rc;
+        }
+
+        if (r->request_body->rest == 0) {
+            ngx_http_upstream_request_body_done(r, u);
+        }
+
+        rc = ngx_output_chain(&u->output, r->request_body->bufs);
+
+        if (rc != NGX_OK || !u->request_body_streaming) {
+            return rc;
+        }
+    }
+}
+
+
+static void
+ngx_http_upstream_read_request_handler(ngx_http_request_t *r)
+{
+    ngx_connection_t     *c;
+    ngx_http_upstream_t  *u;
+
+    c = r->connection;
+    u = r->upstream;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream read request handler");
+
+    if (u->writer.out) {
+
+        /* the previous part of the body is not sent yet */
+
+        if ((ngx_event_flags & NGX_USE_LEVEL_EVENT) && c->read->active) {
+            if (ngx_del_event(c->read, NGX_READ_EVENT, 0) != NGX_OK) {
+                ngx_http_upstream_finalize_request(r, u,
+                                               NGX_HTTP_INTERNAL_SERVER_ERROR);
+            }
+        }
+
+        return;
+    }
+
+    ngx_http_upstream_send_request(r, u);
+}
+
+
+static void
+ngx_http_upstream_request_body_done(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    u->request_body_streaming = 0;
+
+    if (r->connection->read->timer_set) {
+        ngx_del_timer(r->connection->read);
+    }
+
+    if (!u->store && !r->post_action && !u->conf->ignore_client_abort) {
+        r->read_event_handler = ngx_http_upstream_rd_check_broken_connection;
+
+    } else {
+        r->read_event_handler = ngx_http_block_reading;
+    }
+}
+
+
 static void
 ngx_http_upstream_send_request_handler(ngx_http_request_t *r,
     ngx_http_upstream_t *u)
@@ -1613,6 +1725,19 @@ ngx_http_upstream_process_header(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
     /* rc == NGX_OK */
 
+    if (u->request_body_streaming) {
+
+        /*
+         * the upstream has responded before the whole request body was
+         * passed to it, the rest of the body is not read
+         */
+
+        ngx_http_upstream_request_body_done(r, u);
+
+        u->write_event_handler = ngx_http_upstream_dummy_handler;
+        r->keepalive = 0;
+    }
+
     if (u->headers_in.status_n > NGX_HTTP_SPECIAL_RESPONSE) {
 
         if (r->subrequest_in_memory) {
@@ -1868,8 +1993,8 @@ ngx_http_upstream_process_headers(ngx_http_request_t *r, ngx_http_upstream_t *u)
                 i = 0;
             }
 
-            hh = ngx_hash_find(&umcf->headers_in_hash, h[i].hash,
-                               h[i].lowcase_key, h[i].key.len);
+            hh = ngx_hash_dispatch_find(&umcf->headers_in_dispatch,
+                                        h[i].lowcase_key, h[i].key.len);
 
             if (hh && hh->redirect) {
                 if (hh->copy_handler(r, &h[i], hh->conf) != NGX_OK) {
@@ -1921,8 +2046,8 @@ ngx_http_upstream_process_headers(ngx_http_request_t *r, ngx_http_upstream_t *u)
             continue;
         }
 
-        hh = ngx_hash_find(&umcf->headers_in_hash, h[i].hash,
-                           h[i].lowcase_key, h[i].key.len);
+        hh = ngx_hash_dispatch_find(&umcf->headers_in_dispatch,
+                                    h[i].lowcase_key, h[i].key.len);
 
         if (hh) {
             if (hh->copy_handler(r, &h[i], hh->conf) != NGX_OK) {
@@ -1952,6 +2077,10 @@ ngx_http_upstream_process_headers(ngx_http_request_t *r, ngx_http_upstream_t *u)
     r->headers_out.status = u->headers_in.status_n;
     r->headers_out.status_line = u->headers_in.status_line;
 
+    if (u->conf->force_ranges) {
+        r->allow_ranges = 1;
+    }
+
     u->headers_in.content_length_n = r->headers_out.content_length_n;
 
     if (r->headers_out.content_length_n != -1) {
@@ -2857,7 +2986,10 @@ ngx_http_upstream_next(ngx_http_request_t *r, ngx_http_upstream_t *u,
     if (status) {
         u->state->status = status;
 
-        if (u->peer.tries == 0 || !(u->conf->next_upstream & ft_type)) {
+        if (u->peer.tries == 0
+            || !(u->conf->next_upstream & ft_type)
+            || u->request_body_streamed)
+        {
 
 #if (NGX_HTTP_CACHE)
 
@@ -4627,5 +4759,12 @@ ngx_http_upstream_init_main_conf(ngx_conf_t *cf, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    if (ngx_hash_dispatch_init(&umcf->headers_in_dispatch, cf->pool,
+                               headers_in.elts, headers_in.nelts)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
     return NGX_CONF_OK;
 }
@@ -65,6 +65,7 @@ typedef struct {
 
 typedef struct {
     ngx_hash_t                       headers_in_hash;
+    ngx_hash_dispatch_t              headers_in_dispatch;
     ngx_array_t                      upstreams;
                                              /* ngx_http_upstream_srv_conf_t */
 } ngx_http_upstream_main_conf_t;
@@ -174,8 +175,10 @@ typedef struct {
     ngx_flag_t                       buffering;
     ngx_flag_t                       pass_request_headers;
     ngx_flag_t                       pass_request_body;
+    ngx_flag_t                       request_buffering;
 
     ngx_flag_t                       ignore_client_abort;
+    ngx_flag_t                       force_ranges;
     ngx_flag_t                       intercept_errors;
     ngx_flag_t                       cyclic_temp_file;
 
@@ -361,6 +364,8 @@ struct ngx_http_upstream_s {
 
     unsigned                         request_sent:1;
     unsigned                         header_sent:1;
+    unsigned                         request_body_streaming:1;
+    unsigned                         request_body_streamed:1;
 };
 
 
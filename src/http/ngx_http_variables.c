@@ -23,6 +23,8 @@ static ngx_int_t ngx_http_variable_header(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_variable_headers(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_variable_content_length(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
 
 static ngx_int_t ngx_http_variable_unknown_header_in(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
@@ -134,8 +136,8 @@ static ngx_http_variable_t  ngx_http_core_variables[] = {
     { ngx_string("http_cookie"), NULL, ngx_http_variable_headers,
       offsetof(ngx_http_request_t, headers_in.cookies), 0, 0 },
 
-    { ngx_string("content_length"), NULL, ngx_http_variable_header,
-      offsetof(ngx_http_request_t, headers_in.content_length), 0, 0 },
+    { ngx_string("content_length"), NULL, ngx_http_variable_content_length,
+      0, 0, 0 },
 
     { ngx_string("content_type"), NULL, ngx_http_variable_header,
       offsetof(ngx_http_request_t, headers_in.content_type), 0, 0 },
@@ -637,6 +639,46 @@ ngx_http_variable_header(ngx_http_request_t *r, ngx_http_variable_value_t *v,
 }
 
 
+static ngx_int_t
+ngx_http_variable_content_length(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char  *p;
+
+    if (r->headers_in.content_length) {
+        v->len = r->headers_in.content_length->value.len;
+        v->data = r->headers_in.content_length->value.data;
+
+    } else if (r->headers_in.chunked && r->headers_in.content_length_n >= 0) {
+
+        /* the decoded size of a chunked body that has been read */
+
+        p = ngx_pnalloc(r->pool, NGX_OFF_T_LEN);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        v->len = ngx_sprintf(p, "%O", r->headers_in.content_length_n) - p;
+        v->data = p;
+
+    } else {
+        v->not_found = 1;
+
+        /* a chunked body size becomes known once the body is read */
+
+        v->no_cacheable = r->headers_in.chunked;
+
+        return NGX_OK;
+    }
+
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_variable_headers(ngx_http_request_t *r, ngx_http_variable_value_t *v,
     uintptr_t data)
@@ -724,9 +766,24 @@ static ngx_int_t
 ngx_http_variable_unknown_header_out(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
 {
-    return ngx_http_variable_unknown_header(v, (ngx_str_t *) data,
-                                            &r->headers_out.headers.part,
-                                            sizeof("sent_http_") - 1);
+    ngx_str_t  *var;
+
+    var = (ngx_str_t *) data;
+
+    if (ngx_http_variable_unknown_header(v, var, &r->headers_out.headers.part,
+                                         sizeof("sent_http_") - 1)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (v->not_found && r->headers_out.header_block) {
+        return ngx_http_variable_unknown_header(v, var,
+                                         &r->headers_out.header_block->part,
+                                         sizeof("sent_http_") - 1);
+    }
+
+    return NGX_OK;
 }
 
 
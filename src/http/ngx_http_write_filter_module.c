@@ -285,8 +285,14 @@ ngx_http_write_filter(ngx_http_request_t *r, ngx_chain_t *in)
         && c->write->ready
         && c->sent - sent >= limit - (off_t) (2 * ngx_pagesize))
     {
+        /*
+         * let the other connections run before the next chunk is sent,
+         * the event stays delayed until it is processed, so nothing is
+         * sent out of turn
+         */
+
         c->write->delayed = 1;
-        ngx_add_timer(c->write, 1);
+        ngx_post_event(c->write, &ngx_posted_bulk_events);
     }
 
     for (cl = r->out; cl && cl != chain; /* void */) {